@@ -0,0 +1,90 @@
+// This file is part of MultiReplace.
+//
+// MultiReplace is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// DocLineCursor.h
+// Line numbers and line bounds for a run of document positions, read
+// straight from the document bytes (SCI_GETCHARACTERPOINTER).
+//
+// Asking Scintilla with SCI_LINEFROMPOSITION per hit is a binary search
+// behind a window message; a file with half a million hits paid that
+// once while collecting and once more while formatting the dock rows.
+// Hits come out of a forward search in position order, so the cursor
+// walks the buffer forward instead and looks at each byte between the
+// first and the last hit once. Line ends follow Scintilla's default:
+// CR, LF and CRLF each end a line.
+//
+// Positions may also go backwards (each criterion of a grouped list
+// starts from the top again); the cursor then walks back, which costs
+// the distance travelled.
+//
+// The bytes must not change while the cursor is in use.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+class DocLineCursor
+{
+public:
+    using Pos = std::int64_t;
+
+    DocLineCursor(const char* text, Pos length)
+        : _text(text), _len(text ? length : 0)
+    {
+        _lineEnd = scanLineEnd(0);
+    }
+
+    // Move to the line that contains pos. An EOL belongs to the line it
+    // ends; positions past the end clamp to the last line.
+    void seek(Pos pos)
+    {
+        while (pos >= nextLineStart() && _lineEnd < _len) {
+            _lineStart = nextLineStart();
+            _lineEnd = scanLineEnd(_lineStart);
+            ++_line;
+        }
+        while (pos < _lineStart && _line > 0) {
+            // Step over the previous line's EOL (CRLF counts once)
+            Pos end = _lineStart - 1;
+            if (_text[end] == '\n' && end > 0 && _text[end - 1] == '\r') --end;
+            Pos start = end;
+            while (start > 0 && _text[start - 1] != '\n' && _text[start - 1] != '\r') --start;
+            _lineStart = start;
+            _lineEnd = end;
+            --_line;
+        }
+    }
+
+    int line() const { return _line; }
+    Pos lineStart() const { return _lineStart; }
+    Pos lineEnd() const { return _lineEnd; }  // before the EOL
+
+    const char* lineText() const { return _text + _lineStart; }
+    std::size_t lineLength() const { return static_cast<std::size_t>(_lineEnd - _lineStart); }
+
+private:
+    Pos scanLineEnd(Pos from) const
+    {
+        Pos p = from;
+        while (p < _len && _text[p] != '\n' && _text[p] != '\r') ++p;
+        return p;
+    }
+
+    Pos nextLineStart() const
+    {
+        if (_lineEnd >= _len) return _len + 1;
+        return (_text[_lineEnd] == '\r' && _lineEnd + 1 < _len && _text[_lineEnd + 1] == '\n')
+            ? _lineEnd + 2 : _lineEnd + 1;
+    }
+
+    const char* _text = nullptr;
+    Pos _len = 0;
+    int _line = 0;
+    Pos _lineStart = 0;
+    Pos _lineEnd = 0;
+};
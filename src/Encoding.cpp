@@ -279,6 +279,33 @@ namespace Encoding {
         return wstringToBytes(utf8ToWString(u8), cp);
     }
 
+    // ---------- reusable transcoder ----------
+
+    bool Utf8Transcoder::toCodepage(const char* u8, size_t len, UINT cp, std::string& out) {
+        out.clear();
+        if (!u8 || len == 0) return true;
+        // Valid UTF-8 into a UTF-8 document is a plain copy. Invalid input
+        // takes the round trip below even then, so ill-formed bytes come
+        // out as U+FFFD instead of landing in the document.
+        if (cp == CP_UTF8 && isValidUtf8(u8, len)) {
+            out.assign(u8, len);
+            return true;
+        }
+
+        // resize() only grows the allocation; after the first few matches
+        // both buffers are large enough and the calls below just write.
+        int wlen = MultiByteToWideChar(CP_UTF8, 0, u8, static_cast<int>(len), nullptr, 0);
+        if (wlen <= 0) return false;
+        _wide.resize(static_cast<size_t>(wlen));
+        MultiByteToWideChar(CP_UTF8, 0, u8, static_cast<int>(len), _wide.data(), wlen);
+
+        int mlen = WideCharToMultiByte(cp, 0, _wide.data(), wlen, nullptr, 0, nullptr, nullptr);
+        if (mlen <= 0) return false;
+        out.resize(static_cast<size_t>(mlen));
+        WideCharToMultiByte(cp, 0, _wide.data(), wlen, out.data(), mlen, nullptr, nullptr);
+        return true;
+    }
+
     // ---------- buffer conversions + BOM ----------
 
     static inline void appendBOM(Kind kind, std::string& out) {
@@ -72,6 +72,26 @@ namespace Encoding {
     std::wstring utf8ToWString(const std::string& u8);
     std::string  utf8ToBytes(const std::string& u8, UINT cp);
 
+    // ---------- Reusable UTF-8 -> codepage transcoder ----------
+    // For per-match conversions (engine output into the document). Holds a
+    // wide scratch buffer that keeps its capacity between calls, so a
+    // Replace-All over a non-UTF-8 document allocates once, not per match.
+    // Valid UTF-8 into CP_UTF8 is a plain copy; invalid UTF-8 is decoded
+    // with U+FFFD for each ill-formed sequence, whatever the target.
+    // Same permissive flags as utf8ToBytes().
+    class Utf8Transcoder {
+    public:
+        // Replaces `out` with `u8` converted to `cp`. Returns false (out
+        // cleared) if the input can't be converted at all.
+        bool toCodepage(const char* u8, size_t len, UINT cp, std::string& out);
+        bool toCodepage(const std::string& u8, UINT cp, std::string& out) {
+            return toCodepage(u8.data(), u8.size(), cp, out);
+        }
+
+    private:
+        std::wstring _wide;
+    };
+
     // ---------- Buffer conversions with BOM handling ----------
     bool convertBufferToUtf8(const char* data, size_t len, const EncodingInfo& src, std::string& outUtf8);
     bool convertUtf8ToOriginal(const std::string& u8, const EncodingInfo& dst, std::string& outBytes);
@@ -5129,7 +5129,7 @@ void MultiReplace::jumpToNextMatchInEditor(size_t listIndex) {
     //    Filtered on findText + searchFlags to show only hits for THIS list entry.
     struct MatchRange {
         Sci_Position start; Sci_Position length; int docLine;
-        size_t hitIdx; std::string filePathUtf8; bool isCurrentDoc;
+        size_t hitIdx; size_t matchIdx; bool isCurrentDoc;
     };
     std::vector<MatchRange> ranges;
 
@@ -5153,10 +5153,10 @@ void MultiReplace::jumpToNextMatchInEditor(size_t listIndex) {
 
     // Determine block scope from dock cursor (independent of which file it points to)
     size_t blockFirst = 0;
-    size_t blockLast = allHits.size();
+    size_t blockLast = allHits.rowCount();
 
     auto cursorInfo = dock.getCurrentCursorHitInfo();
-    if (cursorInfo.valid && cursorInfo.hitIndex < allHits.size()) {
+    if (cursorInfo.valid && cursorInfo.hitIndex < allHits.rowCount()) {
         auto br = dock.getBlockRangeForHit(cursorInfo.hitIndex);
         if (br.valid) {
             blockFirst = br.first;
@@ -5164,32 +5164,36 @@ void MultiReplace::jumpToNextMatchInEditor(size_t listIndex) {
         }
     }
 
+    // Current-document test once per interned path instead of once per hit
+    std::vector<char> fileIsCurDoc(allHits.fileCount(), 0);
+    for (std::uint32_t id = 0; id < allHits.fileCount(); ++id)
+        fileIsCurDoc[id] = pathsEqualUtf8(allHits.filePath(id), curPathUtf8) ? 1 : 0;
+
     // Collect matching hits across all files within the block
-    for (size_t i = blockFirst; i < blockLast && i < allHits.size(); ++i)
+    for (size_t i = blockFirst; i < blockLast && i < allHits.rowCount(); ++i)
     {
-        const auto& hit = allHits[i];
-        const bool isCurDoc = pathsEqualUtf8(hit.fullPathUtf8, curPathUtf8);
+        const bool isCurDoc = fileIsCurDoc[allHits.rowFileId(i)] != 0;
+        const int rowDocLine = allHits.rowDocLine(i);
 
-        for (size_t j = 0; j < hit.allFindTexts.size(); ++j)
+        for (size_t m = allHits.matchBegin(i), e = allHits.matchEnd(i); m < e; ++m)
         {
-            if (hit.allFindTexts[j] != item.findText)
+            if ((allHits.matchSearchFlags(m) & identityMask) != itemFlags)
                 continue;
-            int subFlags = (j < hit.allSearchFlags.size()) ? hit.allSearchFlags[j] : hit.searchFlags;
-            if ((subFlags & identityMask) != itemFlags)
+            if (allHits.matchFindText(m) != item.findText)
                 continue;
-            if (j < hit.allPositions.size()) {
-                Sci_Position mPos = hit.allPositions[j];
-                Sci_Position mLen = (j < hit.allLengths.size()) ? hit.allLengths[j] : hit.length;
-                int line = (hit.docLine >= 0) ? hit.docLine
-                    : (isCurDoc ? static_cast<int>(send(SCI_LINEFROMPOSITION, mPos, 0)) : -1);
-                ranges.push_back({ mPos, mLen, line, i, hit.fullPathUtf8, isCurDoc });
-            }
+            const Sci_Position mPos = static_cast<Sci_Position>(allHits.matchPos(m));
+            const Sci_Position mLen = static_cast<Sci_Position>(allHits.matchLength(m));
+            int line = (rowDocLine >= 0) ? rowDocLine
+                : (isCurDoc ? static_cast<int>(send(SCI_LINEFROMPOSITION, mPos, 0)) : -1);
+            ranges.push_back({ mPos, mLen, line, i, m, isCurDoc });
         }
     }
 
     // Sort by hit index (preserves cross-file order from ResultDock block)
     std::sort(ranges.begin(), ranges.end(),
-        [](const MatchRange& a, const MatchRange& b) { return a.hitIdx < b.hitIdx; });
+        [](const MatchRange& a, const MatchRange& b) {
+            return a.hitIdx != b.hitIdx ? a.hitIdx < b.hitIdx : a.matchIdx < b.matchIdx;
+        });
 
     if (ranges.empty()) {
         showStatusMessage(LM.get(L"status_no_results_linked"), MessageStatus::Error);
@@ -5204,7 +5208,7 @@ void MultiReplace::jumpToNextMatchInEditor(size_t listIndex) {
     bool wrapped = false;
     Sci_Position editorPos = static_cast<Sci_Position>(send(SCI_GETCURRENTPOS, 0, 0));
 
-    if (cursorInfo.valid && cursorInfo.hitIndex < allHits.size()) {
+    if (cursorInfo.valid && cursorInfo.hitIndex < allHits.rowCount()) {
         // Dock-anchored: start from the dock cursor position in block order.
         const size_t anchorHitIdx = cursorInfo.hitIndex;
 
@@ -5258,8 +5262,8 @@ void MultiReplace::jumpToNextMatchInEditor(size_t listIndex) {
 
     if (crossFile) {
         // Cross-file: open/switch to target file and navigate to hit
-        if (hitIdx < allHits.size()) {
-            const auto& targetHit = allHits[hitIdx];
+        if (hitIdx < allHits.rowCount()) {
+            const ResultDock::Hit targetHit = dock.hitAt(hitIdx, ranges[foundIdx].matchIdx);
             std::wstring wPath = Encoding::utf8ToWString(targetHit.fullPathUtf8);
             std::wstring openedPath;
             if (!ResultDock::EnsureFileOpenOrOfferCreate(wPath, openedPath)) {
@@ -5274,26 +5278,25 @@ void MultiReplace::jumpToNextMatchInEditor(size_t listIndex) {
         displayResultCentered(ranges[foundIdx].start, ranges[foundIdx].start + ranges[foundIdx].length, true);
     }
 
-    // 6. Sync ResultDock to the matching hit
-    if (hitIdx < allHits.size() && allHits[hitIdx].displayLineStart >= 0) {
-        dock.scrollToHitAndHighlight(allHits[hitIdx].displayLineStart);
+    // 6. Sync ResultDock to the matching hit (rendering it first if it is still deferred)
+    if (hitIdx < allHits.rowCount() && allHits.rowDisplayStart(hitIdx) >= 0) {
+        dock.ensureRowRendered(hitIdx);
+        dock.scrollToHitAndHighlight(allHits.rowDisplayStart(hitIdx));
     }
     else if (!allHits.empty()) {
         // Fallback: find hit by line
         int jumpLine = ranges[foundIdx].docLine;
-        for (size_t i = 0; i < allHits.size(); ++i) {
-            const auto& hit = allHits[i];
-            if (hit.docLine == jumpLine && hit.displayLineStart >= 0) {
-                bool textMatch = (hit.findTextW == item.findText);
-                if (!textMatch) {
-                    for (const auto& ft : hit.allFindTexts) {
-                        if (ft == item.findText) { textMatch = true; break; }
-                    }
-                }
-                if (textMatch) {
-                    dock.scrollToHitAndHighlight(hit.displayLineStart);
-                    break;
-                }
+        for (size_t i = 0; i < allHits.rowCount(); ++i) {
+            if (allHits.rowDocLine(i) != jumpLine || allHits.rowDisplayStart(i) < 0)
+                continue;
+            bool textMatch = false;
+            for (size_t m = allHits.matchBegin(i), e = allHits.matchEnd(i); m < e; ++m) {
+                if (allHits.matchFindText(m) == item.findText) { textMatch = true; break; }
+            }
+            if (textMatch) {
+                dock.ensureRowRendered(i);
+                dock.scrollToHitAndHighlight(allHits.rowDisplayStart(i));
+                break;
             }
         }
     }
@@ -7589,9 +7592,11 @@ bool MultiReplace::handleReplaceAllButton(bool showCompletionMessage, const std:
 
         {
             // Suppress modification notifications during bulk replace to avoid
-            // per-edit re-lexing and folding overhead.
+            // per-edit re-lexing and folding overhead. The result dock is told
+            // about each replacement directly instead.
             const LRESULT savedEventMask = send(SCI_GETMODEVENTMASK, 0, 0);
             send(SCI_SETMODEVENTMASK, 0, 0);
+            ResultDock::instance().beginReplaceAllTracking();
 
             ScopedUndoAction undo(*this);
             for (size_t i = 0; i < replaceListData.size(); ++i)
@@ -7636,6 +7641,7 @@ bool MultiReplace::handleReplaceAllButton(bool showCompletionMessage, const std:
                 }
             }
 
+            ResultDock::instance().endReplaceAllTracking();
             send(SCI_SETMODEVENTMASK, savedEventMask, 0);
             _delimiterPositionsStale = true;
         }
@@ -7658,11 +7664,13 @@ bool MultiReplace::handleReplaceAllButton(bool showCompletionMessage, const std:
         {
             const LRESULT savedEventMask = send(SCI_GETMODEVENTMASK, 0, 0);
             send(SCI_SETMODEVENTMASK, 0, 0);
+            ResultDock::instance().beginReplaceAllTracking();
 
             ScopedUndoAction undo(*this);
             int findCount = 0;
             replaceSuccess = replaceAll(itemData, findCount, totalReplaceCount);
 
+            ResultDock::instance().endReplaceAllTracking();
             send(SCI_SETMODEVENTMASK, savedEventMask, 0);
             _delimiterPositionsStale = true;
         }
@@ -7694,6 +7702,7 @@ bool MultiReplace::handleReplaceAllButton(bool showCompletionMessage, const std:
         std::wstring msg = LM.get(L"status_occurrences_replaced",
             { std::to_wstring(totalReplaceCount) });
         std::wstring noticeBody;
+        MessageStatus status = MessageStatus::Success;
 
         if (auto* engine = getActiveEngine()) {
             std::wstring summary = engine->endRunSummary();
@@ -7702,8 +7711,11 @@ bool MultiReplace::handleReplaceAllButton(bool showCompletionMessage, const std:
                 msg += summary;
             }
             noticeBody = engine->endRunSkipAllNoticeText();
+            // Matches left unchanged by a budget are an error, not a note
+            if (engine->budgetSkipCount() != 0)
+                status = MessageStatus::Error;
         }
-        showStatusMessage(msg, MessageStatus::Success);
+        showStatusMessage(msg, status);
 
         if (!noticeBody.empty()) {
             const std::wstring noticeTitle = LM.get(
@@ -7947,6 +7959,7 @@ bool MultiReplace::replaceOne(const ReplaceItemData& itemData, const SelectionIn
                 if (itemData.regex) {
                     fillCapturesForEngine(vars, documentCodepage);
                 }
+                vars.ruleIndex = (itemIndex == SIZE_MAX) ? -1 : static_cast<int>(itemIndex);
 
                 _currentRuleIndex = itemIndex;
                 _currentMatchPos = searchResult.pos;
@@ -7962,9 +7975,8 @@ bool MultiReplace::replaceOne(const ReplaceItemData& itemData, const SelectionIn
                 engineOutputIsRegexSafe = res.outputIsRegexSafe;
 
                 // Convert engine result (UTF-8) to the document codepage.
-                finalReplaceText = convertAndExtendW(
-                    Encoding::utf8ToWString(res.output),
-                    itemData.extended, documentCodepage);
+                engineOutputToDocument(res.output, itemData.extended,
+                    documentCodepage, finalReplaceText);
             }
             else {
                 // Case without variables: convert once using the safe helper.
@@ -8077,6 +8089,10 @@ bool MultiReplace::replaceAll(const ReplaceItemData& itemData, int& findCount, i
     int prevLineIdx = -1;
     int lineFindCount = 0;
 
+    // Final text per hit, in the document's native encoding. Declared
+    // outside the loop so the transcoder path reuses its allocation.
+    std::string finalReplaceText;
+
     // --- Main replacement loop ---
     while (searchResult.pos >= 0)
     {
@@ -8090,7 +8106,6 @@ bool MultiReplace::replaceAll(const ReplaceItemData& itemData, int& findCount, i
         Sci_Position nextPos; // declared before both branches use it
 
         {
-            std::string finalReplaceText; // Will hold the final text in the document's native encoding.
             bool engineOutputIsRegexSafe = false;
 
             // --- Formula engine expansion ---
@@ -8108,6 +8123,7 @@ bool MultiReplace::replaceAll(const ReplaceItemData& itemData, int& findCount, i
                     if (itemData.regex) {
                         fillCapturesForEngine(vars, documentCodepage);
                     }
+                    vars.ruleIndex = (itemIndex == SIZE_MAX) ? -1 : static_cast<int>(itemIndex);
 
                     _currentRuleIndex = itemIndex;
                     _currentMatchPos = searchResult.pos;
@@ -8123,9 +8139,8 @@ bool MultiReplace::replaceAll(const ReplaceItemData& itemData, int& findCount, i
                     engineOutputIsRegexSafe = res.outputIsRegexSafe;
 
                     if (!skipReplace) {
-                        finalReplaceText = convertAndExtendW(
-                            Encoding::utf8ToWString(res.output),
-                            itemData.extended, documentCodepage);
+                        engineOutputToDocument(res.output, itemData.extended,
+                            documentCodepage, finalReplaceText);
                     }
                 }
             }
@@ -8170,11 +8185,14 @@ Sci_Position MultiReplace::performReplace(const std::string& replaceTextUtf8, Sc
 {
     send(SCI_SETTARGETRANGE, pos, pos + length);
 
-    return pos + send(
+    const Sci_Position replacedLen = send(
         SCI_REPLACETARGET,
         replaceTextUtf8.size(),
         reinterpret_cast<sptr_t>(replaceTextUtf8.c_str())
     );
+
+    ResultDock::instance().trackReplacement(pos, length, replacedLen);
+    return pos + replacedLen;
 }
 
 Sci_Position MultiReplace::performRegexReplace(const std::string& replaceTextUtf8, Sci_Position pos, Sci_Position length)
@@ -8187,6 +8205,7 @@ Sci_Position MultiReplace::performRegexReplace(const std::string& replaceTextUtf
         reinterpret_cast<sptr_t>(replaceTextUtf8.c_str())
     );
 
+    ResultDock::instance().trackReplacement(pos, length, static_cast<Sci_Position>(replacedLen));
     return pos + static_cast<Sci_Position>(replacedLen);
 }
 
@@ -8249,6 +8268,7 @@ bool MultiReplace::preProcessListForReplace(bool highlight) {
                         vars.FPATH = cachedFilePath;
                     }
                     vars.FNAME = cachedFileName;
+                    vars.ruleIndex = static_cast<int>(i);
 
                     MultiReplaceEngine::FormulaResult res = engine->execute(
                         localReplaceTextUtf8, vars, replaceListData[i].regex, -1);
@@ -8490,6 +8510,31 @@ bool MultiReplace::isLuaSafeModeEnabled() const
     return _luaSafeModeEnabled;
 }
 
+MultiReplaceEngine::FormulaLimits MultiReplace::formulaLimits() const
+{
+    MultiReplaceEngine::FormulaLimits limits;
+    limits.luaInstructionsPerMatch = static_cast<std::uint64_t>(_luaInstructionLimit);
+    limits.loopIterationsPerMatch = static_cast<std::uint64_t>(_loopIterationLimit);
+    limits.secondsPerRun = static_cast<std::uint32_t>(_runTimeLimitSeconds);
+    return limits;
+}
+
+MultiReplaceEngine::LuaGcSettings MultiReplace::luaGcSettings() const
+{
+    return _luaGcSettings;
+}
+
+void MultiReplace::readLuaGcSettings()
+{
+    using Mode = MultiReplaceEngine::LuaGcSettings::Mode;
+    const std::wstring mode = CFG.readString(L"Lua", L"GCMode", L"Incremental");
+    _luaGcSettings.mode = (mode == L"Generational") ? Mode::Generational : Mode::Incremental;
+    // 0 keeps Lua's own value; see LuaGcSettings.
+    _luaGcSettings.pause = std::clamp(CFG.readInt(L"Lua", L"GCPause", 150), 0, 1000);
+    _luaGcSettings.stepMul = std::clamp(CFG.readInt(L"Lua", L"GCStepMul", 400), 0, 1000);
+    _luaGcSettings.reportStats = CFG.readBool(L"Lua", L"MemoryStats", false);
+}
+
 bool MultiReplace::isDebugModeEnabled() const
 {
     // The user-facing toggle stays active across runs; _debugSkipForRun
@@ -9052,23 +9097,17 @@ std::wstring MultiReplace::sanitizeSearchPattern(const std::wstring& raw) {
     return escaped;
 }
 
-void MultiReplace::trimHitToFirstLine(
-    const std::function<LRESULT(UINT, WPARAM, LPARAM)>& sciSend,
-    ResultDock::Hit& h)
+void MultiReplace::trimHitToFirstLine(const DocLineCursor& lines, ResultDock::Hit& h)
 {
     // Only regex matches can span line boundaries.
     // Normal, Extended, and WholeWord searches always stay within a single line,
-    // so trimming is unnecessary and we can skip 3 Scintilla calls per hit.
+    // so trimming is unnecessary.
     if (!(h.searchFlags & SCFIND_REGEXP))
         return;
 
-    // Quick check: if hit doesn't extend beyond line end, no trimming needed.
-    // This avoids further work for regex matches that stay within one line.
-    const int lineZero = (h.docLine >= 0)
-        ? h.docLine
-        : static_cast<int>(sciSend(SCI_LINEFROMPOSITION, h.pos, 0));
-    const Sci_Position lineStart = sciSend(SCI_POSITIONFROMLINE, lineZero, 0);
-    const Sci_Position lineEnd = sciSend(SCI_GETLINEENDPOSITION, lineZero, 0);
+    // The cursor sits on the hit's line already (seeked by the caller)
+    const Sci_Position lineStart = static_cast<Sci_Position>(lines.lineStart());
+    const Sci_Position lineEnd = static_cast<Sci_Position>(lines.lineEnd());
 
     // If match fits entirely within the line content (before EOL), no trim needed
     if (h.pos >= lineStart && (h.pos + h.length) <= lineEnd)
@@ -9178,6 +9217,8 @@ void MultiReplace::handleFindAllButton()
 
             std::vector<ResultDock::Hit> rawHits;
             LRESULT pos = scanStart;
+            DocLineCursor lines(reinterpret_cast<const char*>(sciSend(SCI_GETCHARACTERPOINTER, 0, 0)),
+                sciSend(SCI_GETLENGTH, 0, 0));
             while (true) {
                 SearchResult r = performSearchForward(context, pos);
                 if (r.pos < 0) break;
@@ -9187,12 +9228,14 @@ void MultiReplace::handleFindAllButton()
                 h.fullPathUtf8 = utf8FilePath;
                 h.pos = (Sci_Position)r.pos;
                 h.length = (Sci_Position)r.length;
-                h.docLine = static_cast<int>(sciSend(SCI_LINEFROMPOSITION, r.pos, 0));
+                lines.seek(r.pos);
+                h.docLine = lines.line();
                 h.searchFlags = context.searchFlags;
-                this->trimHitToFirstLine(sciSend, h);
+                this->trimHitToFirstLine(lines, h);
                 if (h.length > 0) {
                     h.findTextW = item.findText;
                     h.colorIndex = slotIndex;
+                    h.listIndex = static_cast<int>(idx);
                     rawHits.push_back(std::move(h));
                 }
             }
@@ -9230,6 +9273,8 @@ void MultiReplace::handleFindAllButton()
 
         std::vector<ResultDock::Hit> rawHits;
         LRESULT pos = scanStart;
+        DocLineCursor lines(reinterpret_cast<const char*>(sciSend(SCI_GETCHARACTERPOINTER, 0, 0)),
+            sciSend(SCI_GETLENGTH, 0, 0));
         while (true) {
             SearchResult r = performSearchForward(context, pos);
             if (r.pos < 0) break;
@@ -9239,9 +9284,10 @@ void MultiReplace::handleFindAllButton()
             h.fullPathUtf8 = utf8FilePath;
             h.pos = r.pos;
             h.length = r.length;
-            h.docLine = static_cast<int>(sciSend(SCI_LINEFROMPOSITION, r.pos, 0));
+            lines.seek(r.pos);
+            h.docLine = lines.line();
             h.searchFlags = context.searchFlags;
-            this->trimHitToFirstLine(sciSend, h);
+            this->trimHitToFirstLine(lines, h);
             if (h.length > 0) {
                 h.findTextW = findW;
                 h.colorIndex = 0;
@@ -9372,6 +9418,8 @@ void MultiReplace::handleFindAllInDocsButton()
         auto collect = [&](size_t critIdx, const std::wstring& patt, SearchContext& ctx) {
             std::vector<ResultDock::Hit> raw;
             LRESULT pos = scanStart;
+            DocLineCursor lines(reinterpret_cast<const char*>(sciSend(SCI_GETCHARACTERPOINTER, 0, 0)),
+                sciSend(SCI_GETLENGTH, 0, 0));
             while (true) {
                 SearchResult r = performSearchForward(ctx, pos);
                 if (r.pos < 0) break;
@@ -9381,15 +9429,17 @@ void MultiReplace::handleFindAllInDocsButton()
                 h.fullPathUtf8 = u8Path;
                 h.pos = r.pos;
                 h.length = r.length;
-                h.docLine = static_cast<int>(sciSend(SCI_LINEFROMPOSITION, r.pos, 0));
+                lines.seek(r.pos);
+                h.docLine = lines.line();
                 h.searchFlags = ctx.searchFlags;
-                this->trimHitToFirstLine(sciSend, h);
+                this->trimHitToFirstLine(lines, h);
                 if (h.length > 0) {
                     h.findTextW = replaceListData[critIdx].findText;
                     if (useListEnabled) {
                         int slot = static_cast<int>(critIdx);
                         if (slot >= maxListSlots) slot = maxListSlots - 1;
                         h.colorIndex = slot;
+                        h.listIndex = static_cast<int>(critIdx);
                     }
                     else { h.colorIndex = 0; }
                     raw.push_back(std::move(h));
@@ -9705,6 +9755,8 @@ void MultiReplace::handleFindInFiles() {
         auto collect = [&](size_t critIdx, const std::wstring& pattW, SearchContext& ctx) {
             std::vector<ResultDock::Hit> raw;
             LRESULT pos = 0;
+            DocLineCursor lines(reinterpret_cast<const char*>(send(SCI_GETCHARACTERPOINTER, 0, 0)),
+                send(SCI_GETLENGTH, 0, 0));
             while (true) {
                 SearchResult r = performSearchForward(ctx, pos);
                 if (r.pos < 0) break;
@@ -9713,15 +9765,17 @@ void MultiReplace::handleFindInFiles() {
                 h.fullPathUtf8 = u8Path;
                 h.pos = r.pos;
                 h.length = r.length;
-                h.docLine = static_cast<int>(send(SCI_LINEFROMPOSITION, r.pos, 0));
+                lines.seek(r.pos);
+                h.docLine = lines.line();
                 h.searchFlags = ctx.searchFlags;
-                this->trimHitToFirstLine([this](UINT m, WPARAM w, LPARAM l)->LRESULT { return send(m, w, l); }, h);
+                this->trimHitToFirstLine(lines, h);
                 if (h.length > 0) {
                     h.findTextW = pattW;
                     if (useListEnabled) {
                         int slot = static_cast<int>(critIdx);
                         if (slot >= maxListSlots) slot = maxListSlots - 1;
                         h.colorIndex = slot;
+                        h.listIndex = static_cast<int>(critIdx);
                     }
                     else { h.colorIndex = 0; }
                     raw.push_back(std::move(h));
@@ -13939,6 +13993,26 @@ std::string MultiReplace::convertAndExtendW(const std::wstring& input, bool exte
     return convertAndExtendW(input, extended, cp);
 }
 
+// Engine output (always UTF-8) into document bytes for performReplace.
+// Extended mode has to decode escapes on the wide form, so it keeps the
+// convertAndExtendW route. Otherwise a UTF-8 document takes the engine
+// bytes as they are (moved, not copied) and any other codepage goes
+// through the panel's reusable transcoder. Invalid UTF-8 from a script
+// also takes the transcoder, which round-trips it through UTF-16 even for
+// a UTF-8 document and so substitutes U+FFFD as the wide route did.
+void MultiReplace::engineOutputToDocument(std::string& engineOutputUtf8, bool extended, UINT cp, std::string& out)
+{
+    if (extended) {
+        out = convertAndExtendW(Encoding::utf8ToWString(engineOutputUtf8), true, cp);
+        return;
+    }
+    if (cp == CP_UTF8 && Encoding::isValidUtf8(engineOutputUtf8.data(), engineOutputUtf8.size())) {
+        out = std::move(engineOutputUtf8);
+        return;
+    }
+    engineOutputTranscoder.toCodepage(engineOutputUtf8, cp, out);
+}
+
 void MultiReplace::addStringToComboBoxHistory(HWND hComboBox, const std::wstring& str, int maxItems)
 {
     if (str.length() == 0)
@@ -15644,6 +15718,10 @@ void MultiReplace::loadSettingsToPanelUI() {
 
     ResultDock::setWrapEnabled(CFG.readBool(optSec(L"DockWrap"), L"DockWrap", false));
     ResultDock::setPurgeEnabled(CFG.readBool(optSec(L"DockPurge"), L"DockPurge", false));
+    ResultDock::setMemoryLimitMB(CFG.readInt(optSec(L"DockMemoryLimitMB"), L"DockMemoryLimitMB", 1024));
+    ResultDock::setHistoryMaxSearches(CFG.readInt(optSec(L"DockHistoryMaxSearches"), L"DockHistoryMaxSearches", 100));
+    ResultDock::setHistoryMaxHits(CFG.readInt(optSec(L"DockHistoryMaxHits"), L"DockHistoryMaxHits", 0));
+    ResultDock::setHistoryMaxMB(CFG.readInt(optSec(L"DockHistoryMaxMB"), L"DockHistoryMaxMB", 0));
 
     highlightMatchEnabled = CFG.readBool(optSec(L"HighlightMatch"), L"HighlightMatch", true);
     flowTabsIntroDontShowEnabled = CFG.readBool(optSec(L"FlowTabsIntroDontShow"), L"FlowTabsIntroDontShow", false);
@@ -15673,9 +15751,13 @@ void MultiReplace::loadSettingsToPanelUI() {
 
     // Lua runtime options
     _luaSafeModeEnabled = CFG.readBool(L"Lua", L"SafeMode", false);
+    readLuaGcSettings();
 
     // Formula engine options (shared by all engines)
     _formulaErrorDialogEnabled = CFG.readBool(L"Engines", L"ShowErrorDialogs", true);
+    _luaInstructionLimit = std::max(0, CFG.readInt(L"Engines", L"LuaInstructionLimit", 0));
+    _loopIterationLimit = std::max(0, CFG.readInt(L"Engines", L"LoopIterationLimit", 0));
+    _runTimeLimitSeconds = std::max(0, CFG.readInt(L"Engines", L"RunTimeLimitSeconds", 0));
 
     // Loading and setting the scope
     int selection = CFG.readInt(L"Scope", L"Selection", 0);
@@ -18569,6 +18651,10 @@ const wchar_t* MultiReplace::optSec(const std::wstring& key)
         { L"ResultDockPerEntryColors", L"ResultDock" },
         { L"DockWrap",                 L"ResultDock" },
         { L"DockPurge",                L"ResultDock" },
+        { L"DockMemoryLimitMB",        L"ResultDock" },
+        { L"DockHistoryMaxSearches",   L"ResultDock" },
+        { L"DockHistoryMaxHits",       L"ResultDock" },
+        { L"DockHistoryMaxMB",         L"ResultDock" },
         { L"FlowTabsNumericAlign",     L"Csv" },
         { L"FlowTabsIntroDontShow",    L"Csv" },
         { L"DuplicateBookmarks",       L"Csv" },
@@ -18780,15 +18866,28 @@ void MultiReplace::syncUIToCache()
         MultiReplaceEngine::engineTypeToString(_defaultEngine));
     CFG.writeBool(optSec(L"DockWrap"), L"DockWrap", ResultDock::wrapEnabled());
     CFG.writeBool(optSec(L"DockPurge"), L"DockPurge", ResultDock::purgeEnabled());
+    CFG.writeInt(optSec(L"DockMemoryLimitMB"), L"DockMemoryLimitMB", ResultDock::memoryLimitMB());
+    CFG.writeInt(optSec(L"DockHistoryMaxSearches"), L"DockHistoryMaxSearches", ResultDock::historyMaxSearches());
+    CFG.writeInt(optSec(L"DockHistoryMaxHits"), L"DockHistoryMaxHits", ResultDock::historyMaxHits());
+    CFG.writeInt(optSec(L"DockHistoryMaxMB"), L"DockHistoryMaxMB", ResultDock::historyMaxMB());
 
     // Lua Options
     CFG.writeBool(L"Lua", L"SafeMode", _luaSafeModeEnabled);
+    CFG.writeString(L"Lua", L"GCMode",
+        _luaGcSettings.mode == MultiReplaceEngine::LuaGcSettings::Mode::Generational
+        ? L"Generational" : L"Incremental");
+    CFG.writeInt(L"Lua", L"GCPause", _luaGcSettings.pause);
+    CFG.writeInt(L"Lua", L"GCStepMul", _luaGcSettings.stepMul);
+    CFG.writeBool(L"Lua", L"MemoryStats", _luaGcSettings.reportStats);
 
     // Formula engine options (shared by all engines). The toggle is set
     // through the settings dialog rather than from the panel, but we mirror
     // it back to the cache here for symmetry with the other persisted
     // engine flags above.
     CFG.writeBool(L"Engines", L"ShowErrorDialogs", _formulaErrorDialogEnabled);
+    CFG.writeInt(L"Engines", L"LuaInstructionLimit", _luaInstructionLimit);
+    CFG.writeInt(L"Engines", L"LoopIterationLimit", _loopIterationLimit);
+    CFG.writeInt(L"Engines", L"RunTimeLimitSeconds", _runTimeLimitSeconds);
 
     // Scope - only HeaderLines is global (settings-dialog)
     CFG.writeInt(L"Scope", L"HeaderLines", static_cast<int>(CSVheaderLinesCount));
@@ -18850,7 +18949,11 @@ void MultiReplace::applyConfigSettingsOnly()
     flowTabsIntroDontShowEnabled = CFG.readBool(optSec(L"FlowTabsIntroDontShow"), L"FlowTabsIntroDontShow", false);
     flowTabsNumericAlignEnabled = CFG.readBool(optSec(L"FlowTabsNumericAlign"), L"FlowTabsNumericAlign", true);
     _luaSafeModeEnabled = CFG.readBool(L"Lua", L"SafeMode", false);
+    readLuaGcSettings();
     _formulaErrorDialogEnabled = CFG.readBool(L"Engines", L"ShowErrorDialogs", true);
+    _luaInstructionLimit = std::max(0, CFG.readInt(L"Engines", L"LuaInstructionLimit", 0));
+    _loopIterationLimit = std::max(0, CFG.readInt(L"Engines", L"LoopIterationLimit", 0));
+    _runTimeLimitSeconds = std::max(0, CFG.readInt(L"Engines", L"RunTimeLimitSeconds", 0));
     limitFileSizeEnabled = CFG.readBool(L"ReplaceInFiles", L"LimitFileSize", false);
     maxFileSizeMB = CFG.readInt(L"ReplaceInFiles", L"MaxFileSizeMB", 100);
     pickupSelection = CFG.readBool(optSec(L"PickupSelection"), L"PickupSelection", true);
@@ -20,6 +20,7 @@
 // Project headers
 #include "ColumnTabs.h"
 #include "ConfigManager.h"
+#include "DocLineCursor.h"
 #include "DPIManager.h"
 #include "DropTarget.h"
 #include "Encoding.h"
@@ -715,6 +716,13 @@ public:
     inline static bool isCaretPositionEnabled = false;
     inline static bool _formulaErrorDialogEnabled = true;
 
+    // INI [Engines] formula budgets (0 = unlimited), handed to the engine
+    // at the start of each run; see MultiReplaceEngine::FormulaLimits.
+    // Persisted, not shown in the config dialog.
+    inline static int  _luaInstructionLimit = 0;          // LuaInstructionLimit, per match
+    inline static int  _loopIterationLimit = 0;           // LoopIterationLimit, per match (ExprTk)
+    inline static int  _runTimeLimitSeconds = 0;          // RunTimeLimitSeconds, per run
+
     inline static std::vector<size_t> originalLineOrder{}; // Stores the order of lines before sorting
     inline static std::vector<size_t> _markedDuplicateLines{};  // Stores line indices of marked duplicates
     inline static size_t _duplicateGroupCount = 0;              // Number of unique duplicate groups
@@ -928,6 +936,7 @@ private:
     std::unordered_map<HWND, std::wstring> _rememberedComboText;
     std::vector<char> styleBuffer; // reusable Buffer for highlightColumnsInLine()
     std::vector<char> tagBuffer;  // reusable Buffer for SCI_GETTAG in fillCapturesForEngine()
+    Encoding::Utf8Transcoder engineOutputTranscoder; // reusable UTF-8 -> doc codepage for engine output
     size_t _currentRuleIndex = SIZE_MAX; // List index for showErrorMessage; SIZE_MAX = no engine call active
     Sci_Position _currentMatchPos = -1;  // Document position for showErrorMessage; -1 = unknown
     bool isColumnHighlighted = false;
@@ -1045,6 +1054,12 @@ private:
     inline static bool stayAfterReplaceEnabled = false;   // Status for keeping panel open after replace
     inline static bool groupResultsEnabled = false;       // Status for flat list view
     inline static bool _luaSafeModeEnabled = false;        // Safer Lua mode: disables system/file/debug libs; common libs stay enabled
+    // INI [Lua] GCMode / GCPause / GCStepMul / MemoryStats: collector setup
+    // handed to the Lua engine at the start of each run; see
+    // MultiReplaceEngine::LuaGcSettings. Persisted, not shown in the
+    // config dialog.
+    inline static MultiReplaceEngine::LuaGcSettings _luaGcSettings{
+        MultiReplaceEngine::LuaGcSettings::Mode::Incremental, 150, 400, false };
     inline static bool allFromCursorEnabled = false;      // Controls the starting point for Replace All, Find All and Mark when wrap is OFF.
     inline static bool keepListVisible = false;            // Library mode: list stays visible when toggled off, only dims
     // INI [Options] DimIntensity (0-100): dimming of the inactive list.
@@ -1297,6 +1312,9 @@ private:
     bool         isFormulaErrorDialogEnabled() const override;
     bool         isLuaSafeModeEnabled()    const override;
     bool         isDebugModeEnabled()      const override;
+    MultiReplaceEngine::FormulaLimits formulaLimits() const override;
+    MultiReplaceEngine::LuaGcSettings luaGcSettings() const override;
+    static void readLuaGcSettings();
     bool         readCurrentRowColumnByIndex(int colIndex1Based,
         std::string& out) const override;
     bool         readCurrentRowColumnByName(const std::string& headerName,
@@ -1336,7 +1354,7 @@ private:
 
 #pragma region Find All
     std::wstring sanitizeSearchPattern(const std::wstring& raw);
-    void trimHitToFirstLine(const std::function<LRESULT(UINT, WPARAM, LPARAM)>& sciSend, ResultDock::Hit& h);
+    void trimHitToFirstLine(const DocLineCursor& lines, ResultDock::Hit& h);
     void handleFindAllButton();
     void handleFindAllInDocsButton();
     void handleFindInFiles();
@@ -1445,6 +1463,7 @@ private:
 #pragma region Utilities
     std::string convertAndExtendW(const std::wstring& input, bool extended, UINT cp) const;
     std::string convertAndExtendW(const std::wstring& input, bool extended);
+    void engineOutputToDocument(std::string& engineOutputUtf8, bool extended, UINT cp, std::string& out);
     static void addStringToComboBoxHistory(HWND hComboBox, const std::wstring& str, int maxItems = 100);
     std::wstring getTextFromDialogItem(HWND hwnd, int itemID) const;
     void setTextInDialogItem(HWND hDlg, int itemID, const std::wstring& text);
@@ -23,6 +23,8 @@
 #include "StaticDialog/DockingDlgInterface.h"
 #include "ResultDock.h"
 #include "ColumnTabs.h"
+#include "DocLineCursor.h"
+#include "FileDialogUtil.h"
 #include "image_data.h"
 #include "LanguageManager.h"
 #include <algorithm>
@@ -32,6 +34,8 @@
 #include "Encoding.h"
 #include <unordered_set>
 #include <sstream>
+#include <filesystem>
+#include <fstream>
 #include <windowsx.h> 
 #include "NppStyleKit.h"
 
@@ -98,6 +102,7 @@ namespace {
 
     static PendingJumpState s_pending;
     static const UINT s_timerId = 1001;
+    static const UINT s_renderTimerId = 1002;   // deferred hit lines
 
     // Legacy function signature for compatibility with SwitchAndJump
     static void SetPendingJump(const std::wstring& path, Sci_Position pos, Sci_Position len)
@@ -110,6 +115,138 @@ namespace {
         // docLine = -1 means fallback-only mode (no re-search)
     }
 
+    // Does the match still start at its tracked position? Anchored search
+    // from pos to the end of its line; outLen receives the match length.
+    static bool matchStartsAt(HWND hEd, Sci_Position pos, const std::string& findBytes,
+        int searchFlags, Sci_Position& outLen)
+    {
+        if (findBytes.empty() || pos < 0 || pos > ::SendMessage(hEd, SCI_GETLENGTH, 0, 0))
+            return false;
+
+        const Sci_Position line = ::SendMessage(hEd, SCI_LINEFROMPOSITION, pos, 0);
+        const Sci_Position lineEnd = ::SendMessage(hEd, SCI_GETLINEENDPOSITION, line, 0);
+        ::SendMessage(hEd, SCI_SETSEARCHFLAGS, searchFlags, 0);
+        ::SendMessage(hEd, SCI_SETTARGETRANGE, pos, lineEnd);
+        const Sci_Position found = ::SendMessage(hEd, SCI_SEARCHINTARGET,
+            findBytes.size(), reinterpret_cast<LPARAM>(findBytes.c_str()));
+        if (found != pos)
+            return false;
+
+        outLen = ::SendMessage(hEd, SCI_GETTARGETEND, 0, 0) - found;
+        return true;
+    }
+
+    // Bytes of hit text shown behind "Line N: ". A row that is formatted
+    // later keeps up to twice as much of its document text: cleaning never
+    // lengthens the text, and the slack covers what it drops.
+    constexpr size_t kMaxHitTextUtf8 = 2048;
+    constexpr size_t kMaxKeptHitTextUtf8 = 2 * kMaxHitTextUtf8;
+
+    // Length of the text a row formatted later keeps, cut at a UTF-8
+    // sequence start.
+    size_t keptHitTextLen(const std::string& textU8)
+    {
+        if (textU8.size() <= kMaxKeptHitTextUtf8) return textU8.size();
+        size_t cut = kMaxKeptHitTextUtf8;
+        while (cut > 0 && (static_cast<unsigned char>(textU8[cut]) & 0xC0) == 0x80) --cut;
+        return cut;
+    }
+
+    // Display form of a hit's line text: SHY dropped, NBSP and control
+    // characters shown as one ASCII space, the rest verbatim, capped with
+    // an ellipsis. Cleaning clean text changes nothing. map (optional)
+    // receives the display offset of every input byte, plus the end.
+    void cleanHitText(std::string_view in, std::string& out, std::vector<size_t>* map)
+    {
+        auto isCtlCp = [](uint32_t cp)->bool {
+            if (cp == 0x0000) return true;
+            if ((cp <= 0x1Fu) && cp != 0x09 && cp != 0x0A && cp != 0x0D) return true;
+            if (cp == 0x007Fu) return true;
+            if (cp >= 0x80u && cp <= 0x9Fu) return true;
+            if (cp == 0x2028 || cp == 0x2029) return true;
+            return false;
+            };
+        auto isNbspCp = [](uint32_t cp)->bool { return cp == 0x00A0; };
+
+        out.clear();
+        out.reserve(in.size());
+        if (map) map->assign(in.size() + 1, 0);
+
+        size_t o = 0, d = 0;
+        while (o < in.size())
+        {
+            unsigned char c = (unsigned char)in[o];
+            size_t clen;
+            if ((c & 0x80) == 0x00) clen = 1;
+            else if ((c & 0xE0) == 0xC0 && o + 1 < in.size()) clen = 2;
+            else if ((c & 0xF0) == 0xE0 && o + 2 < in.size()) clen = 3;
+            else if ((c & 0xF8) == 0xF0 && o + 3 < in.size()) clen = 4;
+            else clen = 1;
+
+            uint32_t cp = 0;
+            if (clen == 1) cp = c;
+            else if (clen == 2) cp = ((c & 0x1Fu) << 6) | (uint32_t(in[o + 1]) & 0x3Fu);
+            else if (clen == 3) cp = ((c & 0x0Fu) << 12) |
+                ((uint32_t(in[o + 1]) & 0x3Fu) << 6) |
+                (uint32_t(in[o + 2]) & 0x3Fu);
+            else cp = ((c & 0x07u) << 18) |
+                ((uint32_t(in[o + 1]) & 0x3Fu) << 12) |
+                ((uint32_t(in[o + 2]) & 0x3Fu) << 6) |
+                (uint32_t(in[o + 3]) & 0x3Fu);
+
+            if (cp == 0x00AD) {
+                // SHY drop
+                if (map) for (size_t k = 0; k < clen; ++k) (*map)[o + k] = d;
+            }
+            else if (isNbspCp(cp) || isCtlCp(cp)) {
+                if (map) for (size_t k = 0; k < clen; ++k) (*map)[o + k] = d;
+                out.push_back(' ');
+                ++d; // one visible ASCII space per replaced codepoint
+            }
+            else {
+                if (map) for (size_t k = 0; k < clen; ++k) (*map)[o + k] = d + k;
+                out.append(in.data() + o, clen);
+                d += clen;
+            }
+
+            o += clen;
+        }
+        if (map) map->back() = d;
+
+        // cap display text to limit memory/rendering cost on very long lines
+        if (out.size() > kMaxHitTextUtf8) {
+            size_t cut = kMaxHitTextUtf8 - 3;
+            while (cut > 0 && (static_cast<unsigned char>(out[cut]) & 0xC0) == 0x80) --cut;
+            out.resize(cut);
+            out.append("...");
+        }
+    }
+
+    // Highlight span in the row of a match at [start, start + len) of the
+    // text cleanHitText mapped; zero length when the match lies behind the
+    // display cap. prefixLen is the length of the row's "Line N: ".
+    void hitDisplaySpan(const std::vector<size_t>& map, size_t displaySize, size_t prefixLen,
+        size_t start, size_t len, int& outStart, int& outLen)
+    {
+        auto mapToDisp = [&](size_t off) -> size_t {
+            if (off >= map.size()) return map.empty() ? 0 : map.back();
+            return map[off];
+            };
+        const size_t dispStart = mapToDisp(start);
+        const size_t dispEnd = mapToDisp(start + len);
+        size_t safeLen = (dispEnd > dispStart ? dispEnd - dispStart : 0);
+
+        outStart = 0;
+        outLen = 0;
+        if (dispStart < displaySize) {
+            if (dispStart + safeLen > displaySize) safeLen = displaySize - dispStart;
+            if (safeLen > 0) {
+                outStart = (int)(prefixLen + dispStart);
+                outLen = (int)safeLen;
+            }
+        }
+    }
+
     static constexpr uint32_t argb(BYTE a, COLORREF c)
     {
         return (uint32_t(a) << 24) |
@@ -162,21 +299,49 @@ void ResultDock::hide(const NppData& npp)
 
 bool ResultDock::hasHitsForFile(const std::string& fullPathUtf8) const
 {
-    for (const auto& hit : _hits) {
-        if (pathsEqualUtf8(hit.fullPathUtf8, fullPathUtf8))
+    // Compare against the interned paths, then look for a row of that file
+    for (std::uint32_t id = 0; id < _hits.fileCount(); ++id) {
+        if (pathsEqualUtf8(_hits.filePath(id), fullPathUtf8) && _hits.hasRowsForFile(id))
             return true;
     }
     return false;
 }
 
+ResultDock::Hit ResultDock::hitAt(size_t rowIndex, size_t matchIndex) const
+{
+    Hit h;
+    if (rowIndex >= _hits.rowCount()) return h;
+
+    const size_t mBegin = _hits.matchBegin(rowIndex);
+    const size_t mEnd = _hits.matchEnd(rowIndex);
+    const size_t m = (matchIndex >= mBegin && matchIndex < mEnd) ? matchIndex : mBegin;
+
+    h.fullPathUtf8 = _hits.rowFilePath(rowIndex);
+    h.docLine = _hits.rowDocLine(rowIndex);
+    if (m < mEnd) {
+        h.pos = static_cast<Sci_Position>(_hits.matchPos(m));
+        h.length = static_cast<Sci_Position>(_hits.matchLength(m));
+        h.searchFlags = _hits.matchSearchFlags(m);
+        h.findTextW = _hits.matchFindText(m);
+        h.colorIndex = _hits.matchColor(m);
+        h.listIndex = _hits.matchListIndex(m);
+    }
+    return h;
+}
+
 void ResultDock::clear()
 {
     // ----- Data structures -------------------------------------------------
     _hits.clear();
-    _lineStartToHitIndex.clear();
 
     _searchHeaderLines.clear();
     _slotToColor.clear();
+    _deferred.clear();
+    _deferredBytesInMemory = 0;
+    _spillFile.close();
+    _trackedPath.clear();
+    _trackedIds.clear();
+    _trackedFileCount = 0;
 
     if (!_hSci)
         return;
@@ -185,6 +350,7 @@ void ResultDock::clear()
     S(SCI_SETREADONLY, FALSE);
     S(SCI_CLEARALL);                                      // Text & styles
     S(SCI_SETREADONLY, TRUE);
+    S(SCI_MARKERDELETEALL, MARKER_PINNED);
 
     // remove all folding levels → BASE
     const int lineCount = static_cast<int>(S(SCI_GETLINECOUNT));
@@ -212,6 +378,7 @@ void ResultDock::clear()
     // ----- Rebuild Styles & Folding -----------------------------------
     rebuildFolding();
     applyStyling();
+    updateHistoryInfo(0);
 
     ::RedrawWindow(_hSci, nullptr, nullptr, RDW_INVALIDATE | RDW_ERASE | RDW_UPDATENOW | RDW_ALLCHILDREN);
 }
@@ -323,36 +490,10 @@ void ResultDock::applyStyling() const
             S(SCI_INDICSETOUTLINEALPHA, indicId, outlineAlpha);
             S(SCI_INDICSETUNDER, indicId, TRUE);
         }
-
-        // Apply Colors to hits
-        for (const auto& hit : _hits) {
-            if (hit.displayLineStart < 0) continue;
-
-            for (size_t i = 0; i < hit.matchStarts.size(); ++i) {
-                if (i >= hit.matchColors.size()) break;
-
-                // Retrieve the slot index we stored in matchColors
-                int slotIdx = hit.matchColors[i];
-
-                if (slotIdx >= 0 && slotIdx < MAX_ENTRY_COLORS) {
-                    const int indicId = INDIC_ENTRY_BG_BASE + slotIdx;
-                    S(SCI_SETINDICATORCURRENT, indicId);
-                    S(SCI_INDICATORFILLRANGE, hit.displayLineStart + hit.matchStarts[i], hit.matchLens[i]);
-                }
-            }
-        }
-    }
-    else {
-        // Standard Mode (Single Color)
-        // Red Match Color
-        S(SCI_SETINDICATORCURRENT, INDIC_MATCH_FORE);
-        for (const auto& hit : _hits) {
-            if (hit.displayLineStart < 0) continue;
-            for (size_t i = 0; i < hit.matchStarts.size(); ++i) {
-                S(SCI_INDICATORFILLRANGE, hit.displayLineStart + hit.matchStarts[i], hit.matchLens[i]);
-            }
-        }
     }
+
+    // 4) Apply colors to hits (per-entry backgrounds or the red match color)
+    fillMatchIndicators(_hits, 0, _hits.rowCount());
 }
 void ResultDock::onThemeChanged() {
     applyTheme();
@@ -428,6 +569,8 @@ void ResultDock::startSearchBlock(const std::wstring& header, bool groupView, bo
 
     _pendingText.clear();
     _pendingHits.clear();
+    applyMemoryLimit(_pendingHits);
+    _pendingBodyLines = 0;
     _groupViewPending = groupView;
     _blockOpen = true;
 
@@ -444,19 +587,17 @@ void ResultDock::appendFileBlock(FileMap& fm, const SciSendFn& sciSend)
 {
     if (!_blockOpen) return;
 
-    std::string  partText;
-    std::vector<Hit> partHits;
+    std::string    partText;
+    ResultHitStore partHits;
+    applyMemoryLimit(partHits);
 
     // build WITHOUT another search header
-    buildListText(fm, _groupViewPending, L"", sciSend, partText, partHits);
+    buildListText(fm, _groupViewPending, L"", sciSend, partText, partHits, _pendingBodyLines);
 
-    shiftHits(partHits, _pendingText.size());      // adjust offsets
+    // rows move behind the pending text, offsets adjusted on the way
+    _pendingHits.append(partHits, static_cast<int>(_pendingText.size()));
 
     _pendingText += partText;
-
-    _pendingHits.insert(_pendingHits.end(),
-        std::make_move_iterator(partHits.begin()),
-        std::make_move_iterator(partHits.end()));
 }
 
 // -----------------------------------------------------------
@@ -540,13 +681,12 @@ void ResultDock::closeSearchBlock(int totalHits, int totalFiles)
     }
 
     // Adjust hit offsets if the patched header changed length.
-    if (deltaBytes != 0) {
-        for (auto& h : _pendingHits)
-            h.displayLineStart += static_cast<int>(deltaBytes);
-    }
+    if (deltaBytes != 0)
+        _pendingHits.shiftDisplay(static_cast<int>(deltaBytes));
 
     // Prepend the whole block (with a blank separator line between searches)
     prependBlock(_pendingText, _pendingHits);
+    _pendingHits.clear();
 
     _blockOpen = false;
 
@@ -566,18 +706,19 @@ void ResultDock::insertFileBlockNow(FileMap& fm, const SciSendFn& sciSend)
     if (!_hSci) return;
 
     // Build per-file text & hits (no SearchHdr)
-    std::string  partText;
-    std::vector<Hit> partHits;
-    buildListText(fm, _groupViewPending, L"", sciSend, partText, partHits);
+    std::string    partText;
+    ResultHitStore partHits;
+    applyMemoryLimit(partHits);
+    int bodyLines = 0;
+    buildListText(fm, _groupViewPending, L"", sciSend, partText, partHits, bodyLines);
     if (partText.empty()) return;
 
-    // Count lines of the new block; check whether there was old content
+    // Check whether there was old content
     const bool hadOld = S(SCI_GETLENGTH) > 0;
-    int newBlockLines = 0;
-    for (char c : partText) if (c == '\n') ++newBlockLines;
 
-    // Prepend the block (will also style/fold this fragment and collapse previous block)
-    prependBlock(partText, partHits);
+    // Prepend the block (will also style/fold this fragment and collapse previous block).
+    // Deferred hit lines are not in the dock yet, so use the inserted line count.
+    const int newBlockLines = prependBlock(partText, partHits);
 
     // If there was a previous block, prependBlock() collapsed it by design.
     // For per-file incremental commits we prefer keeping it expanded → re-expand it.
@@ -609,7 +750,7 @@ void ResultDock::insertSearchHeader(const std::wstring& header)
     const bool hadOld = S(SCI_GETLENGTH) > 0;
     int hdrLines = 0; for (char c : hdr) if (c == '\n') ++hdrLines;
 
-    std::vector<Hit> none;
+    ResultHitStore none;
     prependBlock(hdr, none);
 
     // If there was existing content, the previous top block (a file block)
@@ -719,7 +860,7 @@ void ResultDock::create(const NppData& npp)
     _dockData.pszName = L"MultiReplace – Search results";
     _dockData.dlgID = IDD_MULTIREPLACE_RESULT_DOCK;
     _dockData.uMask = DWS_DF_CONT_BOTTOM | DWS_ICONTAB;
-    _dockData.pszAddInfo = L"";
+    _dockData.pszAddInfo = _historyInfo;
     _dockData.pszModuleName = NPP_PLUGIN_NAME;
     _dockData.iPrevCont = -1;
     _dockData.rcFloat = { 0, 0, 0, 0 };
@@ -808,6 +949,9 @@ void ResultDock::initFolding() const
     S(SCI_SETFOLDFLAGS, SC_FOLDFLAG_LINEAFTER_CONTRACTED);
 
     S(SCI_MARKERENABLEHIGHLIGHT, TRUE);
+
+    // 8) pinned searches: underline across the header line, no margin needed
+    S(SCI_MARKERDEFINE, MARKER_PINNED, SC_MARK_UNDERLINE);
 }
 
 void ResultDock::applyTheme()
@@ -871,6 +1015,7 @@ void ResultDock::applyTheme()
         S(SCI_MARKERSETFORE, id, marginBg);
         S(SCI_MARKERSETBACKSELECTED, id, theme.foldHighlight);
     }
+    S(SCI_MARKERSETBACK, MARKER_PINNED, theme.foldHighlight);
 
     // Caret line (always visible, even when dock loses focus after navigation)
     S(SCI_SETCARETLINEVISIBLEALWAYS, TRUE, 0);
@@ -929,82 +1074,110 @@ void ResultDock::applyTheme()
 
 // -------- Range styling / folding (partial updates) -------
 
-void ResultDock::applyStylingRange(Sci_Position pos0, Sci_Position len, const std::vector<Hit>& newHits) const
+void ResultDock::applyStylingRange(Sci_Position pos0, const std::string& dockTextU8, const ResultHitStore& hits,
+    size_t firstRow, size_t endRow) const
 {
-    if (!_hSci || len <= 0) return;
-
-    const Sci_Position endPos = pos0 + len;
-    const int firstLine = static_cast<int>(S(SCI_LINEFROMPOSITION, pos0));
-    const int lastLine = static_cast<int>(S(SCI_LINEFROMPOSITION, endPos));
-
-    // Base styling using indentation (no GETLINE)
-    Sci_Position lineStartPos = S(SCI_POSITIONFROMLINE, firstLine);
-    S(SCI_STARTSTYLING, lineStartPos, 0);
+    if (!_hSci || dockTextU8.empty()) return;
 
+    // Base styling from the text itself (indent = leading spaces, as in
+    // rebuildFoldingRange); consecutive lines of one style are one run.
     const int IND_SRCH = INDENT_SPACES[(int)LineLevel::SearchHdr];
     const int IND_FILE = INDENT_SPACES[(int)LineLevel::FileHdr];
     const int IND_CRIT = INDENT_SPACES[(int)LineLevel::CritHdr];
 
-    for (int line = firstLine; line <= lastLine; ++line) {
-        const Sci_Position ls = S(SCI_POSITIONFROMLINE, line);
-        const int          ll = static_cast<int>(S(SCI_LINELENGTH, line));
+    const size_t N = dockTextU8.size();
+    S(SCI_STARTSTYLING, pos0, 0);
+    int    runStyle = STYLE_DEFAULT;
+    size_t runLen = 0;
+    for (size_t pos = 0; pos < N;) {
+        int indent = 0;
+        while (pos + indent < N && dockTextU8[pos + indent] == ' ') ++indent;
+        const size_t eol = dockTextU8.find('\n', pos);
+        const size_t next = (eol == std::string::npos) ? N : eol + 1;
 
         int style = STYLE_DEFAULT;
-        if (ll > 0) {
-            const int indent = static_cast<int>(S(SCI_GETLINEINDENTATION, line));
-            if (indent == IND_SRCH) style = STYLE_HEADER;
-            else if (indent == IND_CRIT) style = STYLE_CRITHDR;
-            else if (indent == IND_FILE) style = STYLE_FILEPATH;
-        }
-        if (ll > 0) S(SCI_SETSTYLING, ll, style);
+        if (indent == IND_SRCH) style = STYLE_HEADER;
+        else if (indent == IND_CRIT) style = STYLE_CRITHDR;
+        else if (indent == IND_FILE) style = STYLE_FILEPATH;
 
-        // Keep EOL visuals aligned with default
-        const Sci_Position lineEnd = S(SCI_GETLINEENDPOSITION, line);
-        const int          eolLen = (int)(lineEnd - (ls + ll));
-        if (eolLen > 0) S(SCI_SETSTYLING, eolLen, STYLE_DEFAULT);
+        if (style != runStyle && runLen > 0) {
+            S(SCI_SETSTYLING, runLen, runStyle);
+            runLen = 0;
+        }
+        runStyle = style;
+        runLen += next - pos;
+        pos = next;
     }
+    if (runLen > 0) S(SCI_SETSTYLING, runLen, runStyle);
+
+    // Indicators only on the freshly added hits (rows [firstRow, endRow));
+    // rows still waiting behind a placeholder have no line yet. Hit lines
+    // of one file body are adjacent, so their backgrounds merge into one fill.
+    const size_t rowEnd = (std::min)(endRow, hits.rowCount());
+    IndicatorRuns lines;
+    IndicatorRuns numbers;
+    for (size_t r = firstRow; r < rowEnd; ++r) {
+        const int rowStart = hits.rowDisplayStart(r);
+        if (rowStart < 0 || hits.rowPending(r)) continue;
+
+        const size_t off = static_cast<size_t>(rowStart - pos0);
+        const size_t eol = (off < N) ? dockTextU8.find('\n', off) : std::string::npos;
+        const Sci_Position lineLen = (eol != std::string::npos)
+            ? static_cast<Sci_Position>(eol + 1 - off)
+            : S(SCI_LINELENGTH, S(SCI_LINEFROMPOSITION, rowStart));
+        lines.add(rowStart, lineLen);
+        numbers.add(rowStart + hits.rowNumberStart(r), hits.rowNumberLen(r));
+    }
+    fillIndicatorRuns(INDIC_LINE_BACKGROUND, lines);
+    fillIndicatorRuns(INDIC_LINENUMBER_FORE, numbers);
+
+    fillMatchIndicators(hits, firstRow, rowEnd);
+}
 
-    // Indicators only on the freshly added hits
-    S(SCI_SETINDICATORCURRENT, INDIC_LINE_BACKGROUND);
-    for (const auto& h : newHits) {
-        if (h.displayLineStart < 0) continue;
-        const int          line = static_cast<int>(S(SCI_LINEFROMPOSITION, h.displayLineStart));
-        const Sci_Position ls = S(SCI_POSITIONFROMLINE, line);
-        const Sci_Position ll = S(SCI_LINELENGTH, line);
-        if (ll > 0) S(SCI_INDICATORFILLRANGE, ls, ll);
+void ResultDock::IndicatorRuns::add(Sci_Position start, Sci_Position len)
+{
+    if (len <= 0) return;
+    if (!runs.empty() && start >= runs.back().first && start <= runs.back().second) {
+        runs.back().second = (std::max)(runs.back().second, start + len);
+        return;
     }
+    runs.emplace_back(start, start + len);
+}
 
-    S(SCI_SETINDICATORCURRENT, INDIC_LINENUMBER_FORE);
-    for (const auto& h : newHits)
-        if (h.displayLineStart >= 0)
-            S(SCI_INDICATORFILLRANGE, h.displayLineStart + h.numberStart, h.numberLen);
+void ResultDock::fillIndicatorRuns(int indicator, const IndicatorRuns& runs) const
+{
+    if (runs.runs.empty()) return;
+    S(SCI_SETINDICATORCURRENT, indicator);
+    for (const auto& [start, end] : runs.runs)
+        S(SCI_INDICATORFILLRANGE, start, end - start);
+}
 
-    // 3c/3d) Match Highlighting (Exclusive Logic for Partial Updates)
-    if (_perEntryColorsEnabled) {
-        // CASE A: Colorful Backgrounds -> Apply ONLY background indicators (Text remains standard/white)
-        for (const auto& h : newHits) {
-            if (h.displayLineStart < 0) continue;
-            for (size_t i = 0; i < h.matchStarts.size(); ++i) {
-                const int colorIdx = (i < h.matchColors.size())
-                    ? h.matchColors[i]
-                    : h.colorIndex;  // fallback
-
-                if (colorIdx >= 0 && colorIdx < MAX_ENTRY_COLORS) {
-                    S(SCI_SETINDICATORCURRENT, INDIC_ENTRY_BG_BASE + colorIdx);
-                    S(SCI_INDICATORFILLRANGE, h.displayLineStart + h.matchStarts[i], h.matchLens[i]);
-                }
-            }
+// Match highlighting (exclusive): per-entry backgrounds, one run list per
+// color slot, or the single match color.
+void ResultDock::fillMatchIndicators(const ResultHitStore& hits, size_t firstRow, size_t endRow) const
+{
+    const size_t rowEnd = (std::min)(endRow, hits.rowCount());
+    const bool perEntry = _perEntryColorsEnabled;
+
+    std::vector<IndicatorRuns> slots(perEntry ? MAX_ENTRY_COLORS : 1);
+    for (size_t r = firstRow; r < rowEnd; ++r) {
+        const int rowStart = hits.rowDisplayStart(r);
+        if (rowStart < 0 || hits.rowPending(r)) continue;
+        for (size_t m = hits.matchBegin(r), e = hits.matchEnd(r); m < e; ++m) {
+            const int dispLen = hits.matchDisplayLen(m);
+            if (dispLen <= 0) continue;
+            const int slot = perEntry ? hits.matchColor(m) : 0;
+            if (slot >= 0 && slot < static_cast<int>(slots.size()))
+                slots[slot].add(rowStart + hits.matchDisplayStart(m), dispLen);
         }
     }
+
+    if (perEntry) {
+        for (int i = 0; i < MAX_ENTRY_COLORS; ++i)
+            fillIndicatorRuns(INDIC_ENTRY_BG_BASE + i, slots[i]);
+    }
     else {
-        // CASE B: Standard Mode -> Apply ONLY text color indicator (e.g. Orange/Green)
-        S(SCI_SETINDICATORCURRENT, INDIC_MATCH_FORE);
-        for (const auto& h : newHits) {
-            if (h.displayLineStart < 0) continue;
-            for (size_t i = 0; i < h.matchStarts.size(); ++i) {
-                S(SCI_INDICATORFILLRANGE, h.displayLineStart + h.matchStarts[i], h.matchLens[i]);
-            }
-        }
+        fillIndicatorRuns(INDIC_MATCH_FORE, slots[0]);
     }
 }
 
@@ -1070,19 +1243,22 @@ void ResultDock::rebuildFoldingRange(int firstLine, int lastLine, const std::str
 
 // ---------------- Block building / insertion --------------
 
-void ResultDock::prependBlock(const std::string& dockTextU8, std::vector<Hit>& newHits)
+int ResultDock::prependBlock(const std::string& dockTextU8, ResultHitStore& newHits)
 {
     if (!_hSci || dockTextU8.empty())
-        return;
+        return 0;
+
+    // File bodies beyond the eager budget stay out of Scintilla; only their
+    // placeholder lines go in now (see renderDeferredChunk()).
+    std::string shortened;
+    std::vector<std::pair<int, int>> placeholders;  // (line in block, deferred id)
+    const std::string& shownU8 = deferBodyLines(dockTextU8, newHits, shortened, placeholders)
+        ? shortened : dockTextU8;
 
     const Sci_Position oldLen = (Sci_Position)S(SCI_GETLENGTH);
 
     const int sepBytes = (oldLen > 0 ? 2 : 0);
-    const int deltaBytes = (int)dockTextU8.size() + sepBytes;
-
-    // Shift existing hits
-    for (auto& h : _hits)
-        h.displayLineStart += deltaBytes;
+    const int deltaBytes = (int)shownU8.size() + sepBytes;
 
     ::SendMessage(_hSci, WM_SETREDRAW, FALSE, 0);
     S(SCI_SETREADONLY, FALSE);
@@ -1092,12 +1268,12 @@ void ResultDock::prependBlock(const std::string& dockTextU8, std::vector<Hit>& n
     S(SCI_SETEMPTYSELECTION, 0, 0);
 
     // Insert new block at start
-    S(SCI_INSERTTEXT, 0, (sptr_t)dockTextU8.c_str());
+    S(SCI_INSERTTEXT, 0, (sptr_t)shownU8.c_str());
 
     // Defensive: recompute length before inserting separator
     if (sepBytes) {
         const Sci_Position lenAfterBlock = (Sci_Position)S(SCI_GETLENGTH);
-        const Sci_Position sepPos = (Sci_Position)dockTextU8.size();
+        const Sci_Position sepPos = (Sci_Position)shownU8.size();
         if (sepPos <= lenAfterBlock) {
             S(SCI_INSERTTEXT, (uptr_t)sepPos, (sptr_t)"\r\n");
         }
@@ -1114,17 +1290,30 @@ void ResultDock::prependBlock(const std::string& dockTextU8, std::vector<Hit>& n
 
 
     const Sci_Position pos0 = 0;
-    const Sci_Position len = (Sci_Position)dockTextU8.size();
 
     int newBlockLines = 0;
-    for (char c : dockTextU8) if (c == '\n') ++newBlockLines;
+    for (char c : shownU8) if (c == '\n') ++newBlockLines;
     const int firstLine = 0;
     const int lastLine = (newBlockLines > 0 ? newBlockLines - 1 : 0);
 
-    rebuildFoldingRange(firstLine, lastLine, dockTextU8);
+    rebuildFoldingRange(firstLine, lastLine, shownU8);
+
+    // The separator takes over the fold level of the line it was inserted
+    // in front of (the old top header); it is a plain blank line.
+    if (sepBytes)
+        S(SCI_SETFOLDLEVEL, newBlockLines, SC_FOLDLEVELBASE);
+
+    // Inserted lines inherit a neighbour's line state; clear them, then tag
+    // the placeholders with their deferred id.
+    if (!_deferred.empty()) {
+        for (int l = 0; l <= newBlockLines; ++l)
+            S(SCI_SETLINESTATE, l, 0);
+        for (const auto& [line, id] : placeholders)
+            S(SCI_SETLINESTATE, line, id);
+    }
 
 
-    applyStylingRange(pos0, len, newHits);
+    applyStylingRange(pos0, shownU8, newHits);
 
 
     if (oldLen > 0) {
@@ -1134,16 +1323,18 @@ void ResultDock::prependBlock(const std::string& dockTextU8, std::vector<Hit>& n
             S(SCI_FOLDLINE, firstLineOfOldBlock, SC_FOLDACTION_CONTRACT);
     }
 
-    _hits.insert(_hits.begin(),
-        std::make_move_iterator(newHits.begin()),
-        std::make_move_iterator(newHits.end()));
+    // Older blocks move back through the block table; their rows stay put
+    applyMemoryLimit(_hits);
+    _hits.prependBlock(newHits, deltaBytes);
 
-    rebuildHitLineIndex();
+    // Make room for it: evict the oldest searches beyond the history caps
+    trimHistory();
 
     // Ensure view starts at top-left after new block is inserted
     S(SCI_SETFIRSTVISIBLELINE, 0, 0);
     S(SCI_SETXOFFSET, 0, 0);
 
+    return newBlockLines;
 }
 
 void ResultDock::collapseOldSearches()
@@ -1164,6 +1355,854 @@ void ResultDock::collapseOldSearches()
     }
 }
 
+// ---------------- Result history ---------------------------
+
+std::vector<int> ResultDock::collectSearchHeaders() const
+{
+    std::vector<int> headers;
+    if (!_hSci) return headers;
+
+    // Jump from header to header over each block's last child
+    const int searchHdrLevel = SC_FOLDLEVELBASE + static_cast<int>(LineLevel::SearchHdr);
+    const int lineCount = static_cast<int>(S(SCI_GETLINECOUNT));
+    for (int line = 0; line < lineCount;) {
+        const int level = static_cast<int>(S(SCI_GETFOLDLEVEL, line));
+        if (!(level & SC_FOLDLEVELHEADERFLAG)) {
+            ++line;
+            continue;
+        }
+        if ((level & SC_FOLDLEVELNUMBERMASK) == searchHdrLevel)
+            headers.push_back(line);
+        const int last = static_cast<int>(S(SCI_GETLASTCHILD, line, -1));
+        line = (std::max)(last, line) + 1;
+    }
+    return headers;
+}
+
+int ResultDock::searchHeaderAtLine(int line) const
+{
+    if (!_hSci || line < 0) return -1;
+
+    // Walk up the fold parents, as getBlockRangeAtLine() does
+    const int searchHdrLevel = SC_FOLDLEVELBASE + static_cast<int>(LineLevel::SearchHdr);
+    for (;;) {
+        const int level = static_cast<int>(S(SCI_GETFOLDLEVEL, line));
+        if ((level & SC_FOLDLEVELNUMBERMASK) <= searchHdrLevel)
+            return (level & SC_FOLDLEVELHEADERFLAG) ? line : -1;
+        const int parent = static_cast<int>(S(SCI_GETFOLDPARENT, line));
+        if (parent < 0 || parent == line) return -1;
+        line = parent;
+    }
+}
+
+bool ResultDock::isPinned(int headerLine) const
+{
+    return (S(SCI_MARKERGET, headerLine) & (1 << MARKER_PINNED)) != 0;
+}
+
+void ResultDock::togglePinAtLine(int line)
+{
+    const int header = searchHeaderAtLine(line);
+    if (header < 0) return;
+
+    if (isPinned(header))
+        S(SCI_MARKERDELETE, header, MARKER_PINNED);
+    else
+        S(SCI_MARKERADD, header, MARKER_PINNED);
+}
+
+void ResultDock::trimHistory()
+{
+    if (!_hSci) return;
+
+    const std::vector<int> headers = collectSearchHeaders();
+    size_t searches = headers.size();
+
+    const size_t maxSearches = static_cast<size_t>(_historyMaxSearches);
+    const size_t maxHits = static_cast<size_t>(_historyMaxHits);
+    const size_t maxBytes = static_cast<size_t>(_historyMaxMB) * 1024 * 1024;
+    auto overCap = [&]() {
+        return (maxSearches && searches > maxSearches)
+            || (maxHits && _hits.matchCount() > maxHits)
+            || (maxBytes && historyBytes() > maxBytes);
+        };
+
+    if (overCap()) {
+        ::SendMessage(_hSci, WM_SETREDRAW, FALSE, 0);
+
+        // Oldest first. A search runs from the blank separator above its
+        // header to the separator of the next older search that stays.
+        int olderKept = -1;
+        for (size_t i = headers.size(); i-- > 1 && overCap();) {
+            if (isPinned(headers[i])) {
+                olderKept = headers[i];
+                continue;
+            }
+            const int removed = evictLines(headers[i] - 1, olderKept >= 0 ? olderKept - 1 : -1);
+            if (olderKept >= 0) olderKept -= removed;
+            --searches;
+        }
+
+        ::SendMessage(_hSci, WM_SETREDRAW, TRUE, 0);
+    }
+
+    updateHistoryInfo(searches);
+}
+
+// Remove lines [firstLine, endLine) (endLine -1 = to the end) with their
+// hit rows, deferred lines and markers.
+int ResultDock::evictLines(int firstLine, int endLine)
+{
+    const int lineCount = static_cast<int>(S(SCI_GETLINECOUNT));
+    if (endLine < 0 || endLine > lineCount) endLine = lineCount;
+    if (firstLine < 0 || firstLine >= endLine) return 0;
+
+    const Sci_Position p0 = S(SCI_POSITIONFROMLINE, firstLine);
+    const Sci_Position p1 = (endLine < lineCount) ? S(SCI_POSITIONFROMLINE, endLine) : S(SCI_GETLENGTH);
+
+    // Deferred lines go with their placeholder; the line that moves up
+    // into firstLine keeps firstLine's line state, so carry its own over.
+    int nextState = 0;
+    if (!_deferred.empty()) {
+        for (int l = firstLine; l < endLine; ++l) {
+            const int id = static_cast<int>(S(SCI_GETLINESTATE, l));
+            auto deferred = (id != 0) ? _deferred.find(id) : _deferred.end();
+            if (deferred != _deferred.end()) {
+                releaseDeferred(deferred->second);
+                _deferred.erase(deferred);
+            }
+        }
+        if (endLine < lineCount)
+            nextState = static_cast<int>(S(SCI_GETLINESTATE, endLine));
+    }
+
+    // Markers of removed lines would be merged into firstLine
+    const int pinMask = 1 << MARKER_PINNED;
+    for (int l = static_cast<int>(S(SCI_MARKERNEXT, firstLine, pinMask)); l >= 0 && l < endLine;
+        l = static_cast<int>(S(SCI_MARKERNEXT, l + 1, pinMask)))
+        S(SCI_MARKERDELETE, l, MARKER_PINNED);
+
+    // Same for the header flag of the fold level
+    const int nextLevel = (endLine < lineCount)
+        ? static_cast<int>(S(SCI_GETFOLDLEVEL, endLine)) : SC_FOLDLEVELBASE;
+
+    _hits.eraseDisplayRange(static_cast<int>(p0), static_cast<int>(p1));
+
+    S(SCI_SETREADONLY, FALSE);
+    S(SCI_DELETERANGE, p0, p1 - p0);
+    S(SCI_SETREADONLY, TRUE);
+
+    if (!_deferred.empty())
+        S(SCI_SETLINESTATE, firstLine, nextState);
+    S(SCI_SETFOLDLEVEL, firstLine, nextLevel);
+
+    return lineCount - static_cast<int>(S(SCI_GETLINECOUNT));
+}
+
+// Dock text plus hit columns plus deferred lines, spilled parts included.
+size_t ResultDock::historyBytes() const
+{
+    return static_cast<size_t>(S(SCI_GETLENGTH))
+        + _hits.memoryBytes() + static_cast<size_t>(_hits.spilledBytes())
+        + _deferredBytesInMemory + static_cast<size_t>(_spillFile.bytesInUse());
+}
+
+// Shown after the dock title, e.g. "12 searches, 48210 hits, 35.2 MB".
+void ResultDock::updateHistoryInfo(size_t searches)
+{
+    std::wstring info;
+    if (searches > 0) {
+        const size_t tenths = (historyBytes() * 10 + 512 * 1024) / (1024 * 1024);
+        info = LM.get(L"dock_history_info", { std::to_wstring(searches), std::to_wstring(_hits.matchCount()),
+            std::to_wstring(tenths / 10) + L"." + std::to_wstring(tenths % 10) });
+    }
+    if (info == _historyInfo) return;
+
+    const size_t n = (std::min)(info.size(), std::size(_historyInfo) - 1);
+    std::copy_n(info.c_str(), n, _historyInfo);
+    _historyInfo[n] = L'\0';
+    if (_hSci)
+        ::SendMessage(nppData._nppHandle, NPPM_DMMUPDATEDISPINFO, 0, reinterpret_cast<LPARAM>(_hSci));
+}
+
+// ---------------- Deferred (lazy) hit lines ---------------
+
+bool ResultDock::deferBodyLines(const std::string& dockTextU8, ResultHitStore& rows,
+    std::string& outShownU8, std::vector<std::pair<int, int>>& outPlaceholders)
+{
+    // Small blocks go in as they are.
+    if (std::count(dockTextU8.begin(), dockTextU8.end(), '\n') <= kEagerBodyLines)
+        return false;
+
+    const size_t IND_FILE = static_cast<size_t>(INDENT_SPACES[(int)LineLevel::FileHdr]);
+    const size_t N = dockTextU8.size();
+    const size_t rowCount = rows.rowCount();
+
+    outShownU8.clear();
+    DeferredLines cur;
+    bool open = false;
+    int anchor = 0;       // placeholder position in the shown text
+    int shownLines = 0;
+    int bodyLines = 0;
+    size_t r = 0;
+
+    // Close the running deferral and emit its placeholder line
+    auto flush = [&]() {
+        if (!open) return;
+        const int id = _nextDeferredId++;
+        outPlaceholders.emplace_back(shownLines, id);
+        outShownU8 += placeholderLineU8(cur.matchesLeft);
+        ++shownLines;
+        cur.size = cur.textU8.size();
+        spillDeferred(cur);
+        _deferred.emplace(id, std::move(cur));
+        cur = DeferredLines{};
+        open = false;
+        };
+
+    for (size_t pos = 0; pos < N;) {
+        const size_t eol = dockTextU8.find('\n', pos);
+        const size_t next = (eol == std::string::npos) ? N : eol + 1;
+
+        size_t indent = 0;
+        while (pos + indent < next && dockTextU8[pos + indent] == ' ') ++indent;
+        const bool hasContent = (pos + indent < next)
+            && dockTextU8[pos + indent] != '\r' && dockTextU8[pos + indent] != '\n';
+
+        // Crit headers and hit lines form a file body; any header ends it,
+        // so every file header stays visible with its hit count.
+        const bool body = hasContent && indent > IND_FILE;
+        if (!body) flush();
+
+        // An unformatted row cannot be shown as it is
+        if (body && r < rowCount && rows.rowDisplayStart(r) < static_cast<int>(next) && rows.rowUnformatted(r))
+            bodyLines = (std::max)(bodyLines, kEagerBodyLines);
+
+        const bool defer = body && bodyLines >= kEagerBodyLines;
+        if (body) ++bodyLines;
+        if (defer && !open) {
+            open = true;
+            anchor = static_cast<int>(outShownU8.size());
+        }
+
+        // Rows starting on this line: real position, or pending at the placeholder
+        for (; r < rowCount && rows.rowDisplayStart(r) < static_cast<int>(next); ++r) {
+            const int inLine = rows.rowDisplayStart(r) - static_cast<int>(pos);
+            if (defer) {
+                cur.rowOffsets.push_back(static_cast<int>(cur.textU8.size()) + inLine);
+                cur.matchesLeft += rows.matchEnd(r) - rows.matchBegin(r);
+                rows.deferRow(r, anchor);
+            }
+            else {
+                rows.placeRow(r, static_cast<int>(outShownU8.size()) + inLine);
+            }
+        }
+
+        if (defer) {
+            cur.textU8.append(dockTextU8, pos, next - pos);
+        }
+        else {
+            outShownU8.append(dockTextU8, pos, next - pos);
+            ++shownLines;
+        }
+        pos = next;
+    }
+    flush();
+    return true;
+}
+
+std::string ResultDock::placeholderLineU8(size_t matchesLeft) const
+{
+    std::string line(PLACEHOLDER_INDENT, ' ');
+    line += Encoding::wstringToUtf8(LM.get(L"dock_more_hits", { std::to_wstring(matchesLeft) }));
+    line += "\r\n";
+    return line;
+}
+
+// Replace the placeholder on `placeholderLine` by the next chunk of its
+// deferred lines (plus a new placeholder while lines remain). Folding and
+// styling are applied to the inserted range only.
+bool ResultDock::renderDeferredChunk(int placeholderLine)
+{
+    if (!_hSci) return false;
+
+    const int id = static_cast<int>(S(SCI_GETLINESTATE, placeholderLine));
+    auto it = (id != 0) ? _deferred.find(id) : _deferred.end();
+    if (it == _deferred.end()) return false;
+    DeferredLines& d = it->second;
+
+    // Next chunk: whole lines of the unrendered remainder
+    std::string repl;
+    const int chunkLines = nextDeferredChunk(d, repl);
+    if (chunkLines == 0) return false;
+    const size_t end = d.consumed + repl.size();
+    const bool more = end < d.size;
+
+    const Sci_Position phStart = S(SCI_POSITIONFROMLINE, placeholderLine);
+    const Sci_Position phEnd = S(SCI_GETLINEENDPOSITION, placeholderLine);  // EOL stays
+
+    // The placeholder's rows are contiguous and all point at its start
+    const size_t firstRow = _hits.lowerBoundDisplay(static_cast<int>(phStart));
+    const size_t pendingRows = d.rowOffsets.size() - d.rowsConsumed;
+    if (pendingRows > 0 && (firstRow + pendingRows > _hits.rowCount() || !_hits.rowPending(firstRow)))
+        return false;
+
+    size_t chunkRows = 0;
+    size_t chunkMatches = 0;
+    while (chunkRows < pendingRows && d.rowOffsets[d.rowsConsumed + chunkRows] < static_cast<int>(end)) {
+        const size_t r = firstRow + chunkRows;
+        chunkMatches += _hits.matchEnd(r) - _hits.matchBegin(r);
+        ++chunkRows;
+    }
+    d.matchesLeft -= (std::min)(chunkMatches, d.matchesLeft);
+
+    // Format the chunk's rows; their starts move with the text in front
+    std::string shown;
+    shown.reserve(repl.size());
+    std::vector<int> rowStarts(chunkRows);
+    size_t from = 0;
+    for (size_t k = 0; k < chunkRows; ++k) {
+        const size_t at = static_cast<size_t>(d.rowOffsets[d.rowsConsumed + k]) - d.consumed;
+        size_t eol = repl.find('\n', at);
+        eol = (eol == std::string::npos) ? repl.size() : eol;
+        if (eol > at && repl[eol - 1] == '\r') --eol;
+        shown.append(repl, from, at - from);
+        rowStarts[k] = static_cast<int>(shown.size());
+        formatDeferredRow(firstRow + k, std::string_view(repl).substr(at, eol - at), shown);
+        from = eol;
+    }
+    shown.append(repl, from, std::string::npos);
+    repl.swap(shown);
+    const int chunkBytes = static_cast<int>(repl.size());
+
+    // Chunk text, then a new placeholder without its line break: the old
+    // placeholder's CRLF closes the replacement.
+    if (more) {
+        const std::string ph = placeholderLineU8(d.matchesLeft);
+        repl.append(ph, 0, ph.size() - 2);
+    }
+    else if (repl.size() >= 2 && repl.compare(repl.size() - 2, 2, "\r\n") == 0) {
+        repl.resize(repl.size() - 2);
+    }
+
+    ::SendMessage(_hSci, WM_SETREDRAW, FALSE, 0);
+    S(SCI_SETREADONLY, FALSE);
+    S(SCI_SETTARGETRANGE, phStart, phEnd);
+    S(SCI_REPLACETARGET, repl.size(), reinterpret_cast<sptr_t>(repl.c_str()));
+    S(SCI_SETREADONLY, TRUE);
+    ::SendMessage(_hSci, WM_SETREDRAW, TRUE, 0);
+
+    // Rows behind the placeholder move; the chunk's rows get their real
+    // positions, the remaining ones follow the new placeholder.
+    const int delta = static_cast<int>(repl.size()) - static_cast<int>(phEnd - phStart);
+    _hits.shiftDisplay(delta, static_cast<int>(phStart) + 1);
+    for (size_t k = 0; k < chunkRows; ++k)
+        _hits.placeRow(firstRow + k, static_cast<int>(phStart) + rowStarts[k]);
+    for (size_t k = chunkRows; k < pendingRows; ++k)
+        _hits.deferRow(firstRow + k, static_cast<int>(phStart) + chunkBytes);
+
+    // Inserted lines carry no state; the new placeholder keeps the id
+    for (int l = placeholderLine; l < placeholderLine + chunkLines; ++l)
+        S(SCI_SETLINESTATE, l, 0);
+    if (more)
+        S(SCI_SETLINESTATE, placeholderLine + chunkLines, id);
+
+    rebuildFoldingRange(placeholderLine, placeholderLine + chunkLines - (more ? 0 : 1), repl);
+    applyStylingRange(phStart, repl, _hits, firstRow, firstRow + chunkRows);
+
+    d.consumed = end;
+    d.rowsConsumed += chunkRows;
+    if (d.nextChunk < d.chunks.size()) {
+        _spillFile.release(d.chunks[d.nextChunk].first, d.chunks[d.nextChunk].second);
+        ++d.nextChunk;
+    }
+    if (!more) {
+        releaseDeferred(d);
+        _deferred.erase(it);
+    }
+    return true;
+}
+
+// Whole lines of text from `from`, at most kRenderChunkLines of them.
+size_t ResultDock::deferredChunkEnd(const std::string& text, size_t from, int& lines)
+{
+    size_t end = from;
+    lines = 0;
+    while (end < text.size() && lines < kRenderChunkLines) {
+        const size_t eol = text.find('\n', end);
+        end = (eol == std::string::npos) ? text.size() : eol + 1;
+        ++lines;
+    }
+    return end;
+}
+
+// The chunk renderDeferredChunk inserts next, read back from the spill
+// file if needed; returns its line count (0 when nothing is left).
+int ResultDock::nextDeferredChunk(DeferredLines& d, std::string& outU8)
+{
+    outU8.clear();
+    if (d.chunks.empty()) {
+        int lines = 0;
+        const size_t end = deferredChunkEnd(d.textU8, d.consumed, lines);
+        outU8.assign(d.textU8, d.consumed, end - d.consumed);
+        return lines;
+    }
+
+    if (d.nextChunk >= d.chunks.size()) return 0;
+    const auto [offset, bytes] = d.chunks[d.nextChunk];
+    outU8.resize(bytes);
+    if (!_spillFile.read(offset, outU8.data(), bytes)) {
+        outU8.clear();
+        return 0;
+    }
+    int lines = static_cast<int>(std::count(outU8.begin(), outU8.end(), '\n'));
+    if (!outU8.empty() && outU8.back() != '\n') ++lines;
+    return lines;
+}
+
+// Deferred lines stay in memory up to half the memory ceiling; beyond it
+// a new deferral goes to the spill file, one record per render chunk so
+// each visit of its placeholder reads exactly one record.
+void ResultDock::spillDeferred(DeferredLines& d)
+{
+    const size_t limit = static_cast<size_t>(_memoryLimitMB) * 1024 * 1024 / 2;
+    if (limit == 0 || _deferredBytesInMemory + d.textU8.size() <= limit) {
+        _deferredBytesInMemory += d.textU8.size();
+        return;
+    }
+
+    for (size_t pos = 0; pos < d.textU8.size();) {
+        int lines = 0;
+        const size_t end = deferredChunkEnd(d.textU8, pos, lines);
+        const uint64_t offset = _spillFile.write(d.textU8.data() + pos, end - pos);
+        if (offset == ResultSpillFile::kNoOffset) {
+            // No temp file: keep the lines in memory after all
+            for (const auto& [o, bytes] : d.chunks)
+                _spillFile.release(o, bytes);
+            d.chunks.clear();
+            _deferredBytesInMemory += d.textU8.size();
+            return;
+        }
+        d.chunks.emplace_back(offset, static_cast<uint32_t>(end - pos));
+        pos = end;
+    }
+    std::string().swap(d.textU8);
+}
+
+// Give up the memory and spill records of a deferral that goes away.
+void ResultDock::releaseDeferred(DeferredLines& d)
+{
+    for (size_t k = d.nextChunk; k < d.chunks.size(); ++k)
+        _spillFile.release(d.chunks[k].first, d.chunks[k].second);
+    d.chunks.clear();
+    d.nextChunk = 0;
+    _deferredBytesInMemory -= (std::min)(_deferredBytesInMemory, d.textU8.size());
+    std::string().swap(d.textU8);
+}
+
+void ResultDock::applyMemoryLimit(ResultHitStore& store)
+{
+    // The hit columns get half of the ceiling, deferred lines the rest
+    const size_t limit = static_cast<size_t>(_memoryLimitMB) * 1024 * 1024 / 2;
+    if (store.memoryLimit() != limit)
+        store.setMemoryLimit(limit);
+}
+
+int ResultDock::firstVisibleDeferredLine() const
+{
+    const int lineCount = static_cast<int>(S(SCI_GETLINECOUNT));
+    const int firstVisible = static_cast<int>(S(SCI_GETFIRSTVISIBLELINE));
+    const int onScreen = static_cast<int>(S(SCI_LINESONSCREEN)) + 1;
+
+    // Visible lines only: placeholders inside a collapsed fold are skipped
+    for (int v = firstVisible; v < firstVisible + onScreen; ++v) {
+        const int line = static_cast<int>(S(SCI_DOCLINEFROMVISIBLE, v));
+        if (line >= lineCount) break;
+        const int id = static_cast<int>(S(SCI_GETLINESTATE, line));
+        if (id != 0 && _deferred.count(id)) return line;
+    }
+    return -1;
+}
+
+// Called on every paint of the dock; the rendering itself runs from a
+// timer so the document is not modified while Scintilla paints.
+void ResultDock::scheduleDeferredRender()
+{
+    if (!_hSci || _deferred.empty() || _deferredRenderQueued) return;
+    if (firstVisibleDeferredLine() < 0) return;
+
+    _deferredRenderQueued = true;
+    ::SetTimer(_hSci, s_renderTimerId, 1, nullptr);
+}
+
+void ResultDock::renderVisibleDeferred()
+{
+    _deferredRenderQueued = false;
+    if (!_hSci) return;
+
+    // Each chunk pushes its placeholder down; stop once none is on screen
+    bool rendered = false;
+    for (int guard = 0; guard < 64; ++guard) {
+        const int line = firstVisibleDeferredLine();
+        if (line < 0 || !renderDeferredChunk(line)) break;
+        rendered = true;
+    }
+    if (!rendered) return;
+
+    ::RedrawWindow(_hSci, nullptr, nullptr, RDW_INVALIDATE);
+}
+
+void ResultDock::ensureRowRendered(size_t rowIndex)
+{
+    if (!_hSci || rowIndex >= _hits.rowCount() || !_hits.rowPending(rowIndex))
+        return;
+
+    while (_hits.rowPending(rowIndex)) {
+        const int line = static_cast<int>(S(SCI_LINEFROMPOSITION, _hits.rowDisplayStart(rowIndex)));
+        if (!renderDeferredChunk(line)) break;
+    }
+}
+
+void ResultDock::formatDeferredRow(size_t r, std::string_view line, std::string& out)
+{
+    const size_t prefixLen = (std::min)(
+        static_cast<size_t>(_hits.rowNumberStart(r) + _hits.rowNumberLen(r)) + 2, line.size());  // ": "
+    out.append(line.data(), prefixLen);
+
+    // Cleaning a formatted row's text again changes nothing
+    const bool convert = _hits.rowUnformatted(r);
+    std::string display;
+    std::vector<size_t> map;
+    cleanHitText(line.substr(prefixLen), display, convert ? &map : nullptr);
+    out += display;
+    if (!convert) return;
+
+    for (size_t m = _hits.matchBegin(r); m < _hits.matchEnd(r); ++m) {
+        int start = 0;
+        int len = 0;
+        hitDisplaySpan(map, display.size(), prefixLen,
+            static_cast<size_t>(_hits.matchDisplayStart(m)), static_cast<size_t>(_hits.matchDisplayLen(m)), start, len);
+        _hits.setMatchDisplay(m, start, len);
+    }
+    _hits.markRowFormatted(r);
+}
+
+// Hit lines still deferred behind the placeholder on `line`, for the copy
+// commands (they copy what the block holds, rendered or not).
+void ResultDock::appendDeferredHitLines(HWND hSci, int line, std::vector<std::wstring>& out)
+{
+    const ResultDock& dock = instance();
+    const int id = static_cast<int>(::SendMessage(hSci, SCI_GETLINESTATE, line, 0));
+    auto it = (id != 0) ? dock._deferred.find(id) : dock._deferred.end();
+    if (it == dock._deferred.end()) return;
+
+    const DeferredLines& d = it->second;
+    auto appendHitLines = [&out](const std::string& text, size_t from) {
+        for (size_t pos = from; pos < text.size();) {
+            const size_t eol = text.find('\n', pos);
+            const size_t next = (eol == std::string::npos) ? text.size() : eol + 1;
+            const std::string raw(text, pos, next - pos);
+            if (classify(raw) == LineKind::HitLine) {
+                // Shown the way it renders: the text behind ": " cleaned
+                const size_t colon = raw.find(": ");
+                size_t eol = raw.size();
+                while (eol > 0 && (raw[eol - 1] == '\r' || raw[eol - 1] == '\n')) --eol;
+                std::string line = raw;
+                if (colon != std::string::npos && colon + 2 <= eol) {
+                    std::string display;
+                    cleanHitText(std::string_view(raw).substr(colon + 2, eol - colon - 2), display, nullptr);
+                    line.replace(colon + 2, eol - colon - 2, display);
+                }
+                out.emplace_back(stripHitPrefix(Encoding::utf8ToWString(line)));
+            }
+            pos = next;
+        }
+        };
+
+    if (d.chunks.empty()) {
+        appendHitLines(d.textU8, d.consumed);
+        return;
+    }
+
+    // Spilled: one record at a time
+    std::string chunk;
+    for (size_t k = d.nextChunk; k < d.chunks.size(); ++k) {
+        chunk.resize(d.chunks[k].second);
+        if (!dock._spillFile.read(d.chunks[k].first, chunk.data(), chunk.size())) break;
+        appendHitLines(chunk, 0);
+    }
+}
+
+// ------------------------- Row lines ----------------------
+
+// Rows are visited in display order. A rendered row is read from the dock
+// text at its display start; a pending row from its placeholder's stored
+// lines (one spill record at a time), so nothing gets rendered first.
+// The line passed to fn is only valid during the call.
+bool ResultDock::forEachRowLine(size_t first, size_t end, const RowLineFn& fn)
+{
+    end = (std::min)(end, _hits.rowCount());
+    const char* dockText = _hSci ? reinterpret_cast<const char*>(S(SCI_GETCHARACTERPOINTER)) : nullptr;
+    const size_t dockLen = dockText ? static_cast<size_t>(S(SCI_GETLENGTH)) : 0;
+    auto lineAt = [](const char* text, size_t size, size_t start) {
+        size_t end = start;
+        while (end < size && text[end] != '\r' && text[end] != '\n') ++end;
+        return std::string_view(text + start, end - start);
+        };
+
+    // A pending row is passed in its rendered form
+    std::string rowLine;
+    auto pendingLine = [&](size_t row, std::string_view stored) {
+        rowLine.clear();
+        formatDeferredRow(row, stored, rowLine);
+        return std::string_view(rowLine);
+        };
+
+    std::string chunk;
+    size_t r = first;
+    while (r < end) {
+        const size_t start = static_cast<size_t>(_hits.rowDisplayStart(r));
+        if (start >= dockLen) return false;
+
+        if (!_hits.rowPending(r)) {
+            if (!fn(r, lineAt(dockText, dockLen, start))) return true;
+            ++r;
+            continue;
+        }
+
+        // Pending rows of one placeholder are contiguous and in text order;
+        // all of them point at the placeholder line.
+        const int phLine = static_cast<int>(S(SCI_LINEFROMPOSITION, start));
+        const int id = static_cast<int>(S(SCI_GETLINESTATE, phLine));
+        auto it = (id != 0) ? _deferred.find(id) : _deferred.end();
+        if (it == _deferred.end()) return false;
+        const DeferredLines& d = it->second;
+        const size_t k0 = d.rowsConsumed + (r - _hits.lowerBoundDisplay(static_cast<int>(start)));
+        if (k0 >= d.rowOffsets.size()) return false;
+
+        if (d.chunks.empty()) {
+            for (size_t k = k0; k < d.rowOffsets.size() && r < end; ++k, ++r)
+                if (!fn(r, pendingLine(r, lineAt(d.textU8.data(), d.textU8.size(), static_cast<size_t>(d.rowOffsets[k]))))) return true;
+            continue;
+        }
+
+        // Spilled: records follow each other from d.consumed on
+        size_t chunkBase = d.consumed;
+        size_t c = d.nextChunk;
+        chunk.clear();
+        for (size_t k = k0; k < d.rowOffsets.size() && r < end; ++k, ++r) {
+            const size_t offset = static_cast<size_t>(d.rowOffsets[k]);
+            while (offset >= chunkBase + chunk.size() && c < d.chunks.size()) {
+                chunkBase += chunk.size();
+                chunk.resize(d.chunks[c].second);
+                if (!_spillFile.read(d.chunks[c].first, chunk.data(), chunk.size())) chunk.clear();
+                ++c;
+            }
+            if (offset < chunkBase || offset >= chunkBase + chunk.size()) return false;
+            if (!fn(r, pendingLine(r, lineAt(chunk.data(), chunk.size(), offset - chunkBase)))) return true;
+        }
+    }
+    return true;
+}
+
+// ------------------------- Export -------------------------
+
+bool ResultDock::exportHits(const std::wstring& path, ResultExportWriter::Format format, size_t& outCount)
+{
+    outCount = 0;
+    std::ofstream file(std::filesystem::path(path), std::ios::binary | std::ios::trunc);
+    if (!file) return false;
+
+    ResultExportWriter writer(file, format);
+    writer.writeHeader();
+
+    const size_t rowCount = _hits.rowCount();
+    const size_t reportEvery = (std::max)(rowCount / 100, size_t{ 10000 });
+    const uint64_t readFailures = _hits.spillReadFailures();
+
+    // One record per match of row r; line is the row's dock line without EOL
+    auto exportRow = [&](size_t r, std::string_view line) {
+        const size_t textStart = static_cast<size_t>(_hits.rowNumberStart(r) + _hits.rowNumberLen(r)) + 2;  // ": "
+        const std::string_view text = (line.size() > textStart) ? line.substr(textStart) : std::string_view{};
+
+        ResultExportWriter::Record rec;
+        rec.file = _hits.rowFilePath(r);
+        rec.line = _hits.rowDocLine(r) + 1;
+        rec.lineText = text;
+        for (size_t m = _hits.matchBegin(r); m < _hits.matchEnd(r); ++m) {
+            rec.length = _hits.matchLength(m);
+            rec.rule = _hits.matchListIndex(m);
+
+            // Matches behind the display cap have no span in the line text
+            const int start = _hits.matchDisplayStart(m) - static_cast<int>(textStart);
+            const int len = _hits.matchDisplayLen(m);
+            rec.column = 0;
+            rec.matchText = {};
+            if (len > 0 && start >= 0 && static_cast<size_t>(start + len) <= text.size()) {
+                rec.column = 1;
+                for (int i = 0; i < start; ++i)
+                    if ((static_cast<unsigned char>(text[i]) & 0xC0) != 0x80) ++rec.column;
+                rec.matchText = text.substr(start, len);
+            }
+            writer.write(rec);
+        }
+
+        if ((r + 1) % reportEvery == 0 && _statusCallback)
+            _statusCallback(LM.get(L"status_export_progress", { std::to_wstring((r + 1) * 100 / rowCount) }), false);
+        return static_cast<bool>(file);
+        };
+
+    if (!forEachRowLine(0, rowCount, exportRow))
+        return false;
+
+    // Hits of an unreadable spill page would be exported as zeros
+    if (_hits.spillReadFailures() != readFailures)
+        return false;
+
+    writer.flush();
+    outCount = static_cast<size_t>(writer.recordCount());
+    return static_cast<bool>(file);
+}
+
+// ------------------------- Refine -------------------------
+
+// Rows are collected batch by batch on this thread (the hit store and the
+// spill file are not thread-safe), then the line tests of a batch run on
+// all cores. Kept lines are copied verbatim, so their line number and
+// match spans stay valid; only the file headers are rebuilt.
+bool ResultDock::refineHits(const ResultFilter& filter, size_t first, size_t end,
+    const std::wstring& label, size_t& outHits, size_t& outFiles, std::string& outError)
+{
+    outHits = 0;
+    outFiles = 0;
+    outError.clear();
+    if (!_hSci) return true;
+
+    constexpr size_t kBatchRows = 65536;
+    const int rule = filter.rule();
+    auto keepMatch = [&](size_t m) { return rule < 0 || _hits.matchListIndex(m) == rule; };
+
+    // Per file id: -1 = not checked yet, 0 = filtered out, 1 = passes
+    std::vector<signed char> fileOk(_hits.fileCount(), -1);
+
+    struct Line { size_t row; size_t offset; size_t length; };
+    std::string       keptText;  // kept lines back to back
+    std::vector<Line> kept;
+
+    std::string                   batchText;
+    std::vector<Line>             batch;
+    std::vector<std::string_view> batchLines;
+    std::vector<std::uint8_t>     pass;
+
+    auto runBatch = [&]() {
+        // Test the line text behind "Line N: " only
+        batchLines.clear();
+        for (const Line& b : batch) {
+            const size_t prefix = static_cast<size_t>(_hits.rowNumberStart(b.row) + _hits.rowNumberLen(b.row)) + 2;
+            const size_t skip = (std::min)(prefix, b.length);
+            batchLines.emplace_back(batchText.data() + b.offset + skip, b.length - skip);
+        }
+        if (!filter.matchLines(batchLines, pass, outError))
+            return;
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (!pass[i]) continue;
+            kept.push_back({ batch[i].row, keptText.size(), batch[i].length });
+            keptText.append(batchText, batch[i].offset, batch[i].length);
+        }
+        batch.clear();
+        batchText.clear();
+        };
+
+    forEachRowLine(first, end, [&](size_t r, std::string_view line) {
+        signed char& ok = fileOk[_hits.rowFileId(r)];
+        if (ok < 0) ok = filter.pathMatches(_hits.rowFilePath(r)) ? 1 : 0;
+        if (!ok) return true;
+
+        if (rule >= 0) {
+            bool any = false;
+            for (size_t m = _hits.matchBegin(r); m < _hits.matchEnd(r) && !any; ++m)
+                any = keepMatch(m);
+            if (!any) return true;
+        }
+
+        batch.push_back({ r, batchText.size(), line.size() });
+        batchText.append(line.data(), line.size());
+        if (batch.size() >= kBatchRows) runBatch();
+        return outError.empty();
+        });
+    if (outError.empty()) runBatch();
+
+    // The regex gave up on a line: no partial block
+    if (!outError.empty())
+        return false;
+
+    // Files in order of first appearance, rows of a file by line
+    std::vector<std::uint32_t> fileRank(_hits.fileCount(), ResultHitStore::kNoId);
+    std::vector<size_t> fileHits;
+    for (const Line& k : kept) {
+        std::uint32_t& rank = fileRank[_hits.rowFileId(k.row)];
+        if (rank == ResultHitStore::kNoId) {
+            rank = static_cast<std::uint32_t>(fileHits.size());
+            fileHits.push_back(0);
+        }
+        for (size_t m = _hits.matchBegin(k.row); m < _hits.matchEnd(k.row); ++m)
+            fileHits[rank] += keepMatch(m) ? 1 : 0;
+    }
+    std::stable_sort(kept.begin(), kept.end(), [&](const Line& a, const Line& b) {
+        const std::uint32_t ra = fileRank[_hits.rowFileId(a.row)];
+        const std::uint32_t rb = fileRank[_hits.rowFileId(b.row)];
+        return (ra != rb) ? ra < rb : _hits.rowDocLine(a.row) < _hits.rowDocLine(b.row);
+        });
+    for (const size_t n : fileHits) outHits += n;
+    outFiles = fileHits.size();
+
+    std::string text = getIndentStringU8(LineLevel::SearchHdr);
+    text += Encoding::wstringToUtf8(LM.get(L"dock_refine_header",
+        { label, std::to_wstring(outHits), std::to_wstring(outFiles) }));
+    text += "\r\n";
+    text.reserve(text.size() + keptText.size() + 2 * kept.size());
+
+    ResultHitStore newHits;
+    applyMemoryLimit(newHits);
+    newHits.reserve(kept.size(), outHits);
+    std::vector<std::uint32_t> patternMap;
+    std::uint32_t fileId = ResultHitStore::kNoId;
+
+    for (size_t i = 0; i < kept.size(); ++i) {
+        const size_t r = kept[i].row;
+        const std::uint32_t srcFile = _hits.rowFileId(r);
+        if (i == 0 || srcFile != _hits.rowFileId(kept[i - 1].row)) {
+            const std::string& path = _hits.filePath(srcFile);
+            text += getIndentStringU8(LineLevel::FileHdr);
+            text += path;
+            text += ' ';
+            text += Encoding::wstringToUtf8(LM.get(L"dock_hits_suffix", { std::to_wstring(fileHits[fileRank[srcFile]]) }));
+            text += "\r\n";
+            fileId = newHits.internFile(path);
+        }
+
+        newHits.beginRow(fileId, _hits.rowDocLine(r), static_cast<int>(text.size()),
+            _hits.rowNumberStart(r), _hits.rowNumberLen(r));
+        for (size_t m = _hits.matchBegin(r); m < _hits.matchEnd(r); ++m) {
+            if (!keepMatch(m)) continue;
+            const std::uint32_t src = _hits.matchPatternId(m);
+            if (src >= patternMap.size()) patternMap.resize(src + 1, ResultHitStore::kNoId);
+            if (patternMap[src] == ResultHitStore::kNoId)
+                patternMap[src] = newHits.internPattern(_hits.matchFindText(m), _hits.matchSearchFlags(m));
+            newHits.addMatch(_hits.matchPos(m), _hits.matchLength(m), patternMap[src], _hits.matchColor(m),
+                _hits.matchListIndex(m), _hits.matchDisplayStart(m), _hits.matchDisplayLen(m));
+        }
+        text.append(keptText, kept[i].offset, kept[i].length);
+        text += "\r\n";
+    }
+
+    prependBlock(text, newHits);
+
+    ::RedrawWindow(_hSci, nullptr, nullptr,
+        RDW_INVALIDATE | RDW_ERASE | RDW_UPDATENOW | RDW_ALLCHILDREN);
+    return true;
+}
+
 // ---------------------- Formatting ------------------------
 
 void ResultDock::buildListText(
@@ -1172,7 +2211,8 @@ void ResultDock::buildListText(
     const std::wstring& header,
     const SciSendFn& sciSend,
     std::string& outTextU8,
-    std::vector<Hit>& outHits) const
+    ResultHitStore& outHits,
+    int& bodyLines) const
 {
     std::string body;
 
@@ -1205,18 +2245,9 @@ void ResultDock::buildListText(
             for (auto& c : f.crits)
             {
                 appendIndented(LineLevel::CritHdr, LM.get(L"dock_crit_header", { c.text, std::to_wstring(c.hits.size()) }));
+                ++bodyLines;
 
-                // Move c.hits into hitsCopy: each crit is processed once,
-                // and c.hits is not used afterwards.
-                std::vector<Hit> hitsCopy = std::move(c.hits);
-
-                // pass the copy to formatHitsLines instead of const c.hits
-                formatHitsLines(sciSend, hitsCopy, body);
-
-                // move results from hitsCopy into outHits
-                outHits.insert(outHits.end(),
-                    std::make_move_iterator(hitsCopy.begin()),
-                    std::make_move_iterator(hitsCopy.end()));
+                formatHitsLines(sciSend, c.hits, body, outHits, bodyLines);
             }
         }
         else
@@ -1253,11 +2284,7 @@ void ResultDock::buildListText(
                     merged.end());
             }
 
-            formatHitsLines(sciSend, merged, body);
-
-            outHits.insert(outHits.end(),
-                std::make_move_iterator(merged.begin()),
-                std::make_move_iterator(merged.end()));
+            formatHitsLines(sciSend, merged, body, outHits, bodyLines);
         }
     }
 
@@ -1265,8 +2292,10 @@ void ResultDock::buildListText(
 }
 
 void ResultDock::formatHitsLines(const SciSendFn& sciSend,
-    std::vector<Hit>& hits,
-    std::string& out) const
+    const std::vector<Hit>& hits,
+    std::string& out,
+    ResultHitStore& outRows,
+    int& bodyLines) const
 {
     const UINT docCp = (UINT)sciSend(SCI_GETCODEPAGE, 0, 0);
     const bool isUtf8Doc = (docCp == SC_CP_UTF8);
@@ -1279,22 +2308,19 @@ void ResultDock::formatHitsLines(const SciSendFn& sciSend,
     const size_t       kLineU8 = kLineU8_str.size();
     constexpr size_t    kColonSpaceU8 = 2; // ": "
 
-    constexpr size_t kMaxHitTextUtf8 = 2048; // cap display text to limit memory/rendering cost on very long lines
-
-    auto capUtf8WithEllipsis = [](std::string& s, size_t maxBytes) {
-        if (s.size() <= maxBytes) return;
-        if (maxBytes <= 3) { s.assign("..."); return; }
-        size_t cut = maxBytes - 3;
-        while (cut > 0 && (static_cast<unsigned char>(s[cut]) & 0xC0) == 0x80) --cut;
-        s.resize(cut);
-        s.append("...");
-        };
+    // One walk over the document bytes yields every hit's line and its
+    // bounds; no per-hit Scintilla message (see DocLineCursor).
+    struct HitLine { int line1; Sci_Position start; Sci_Position end; };
+    const char* docText = reinterpret_cast<const char*>(sciSend(SCI_GETCHARACTERPOINTER, 0, 0));
+    DocLineCursor lineCursor(docText, static_cast<Sci_Position>(sciSend(SCI_GETLENGTH, 0, 0)));
 
-    std::vector<int> lineNumbers; lineNumbers.reserve(hits.size());
+    std::vector<HitLine> hitLines; hitLines.reserve(hits.size());
     size_t maxDigits = 0;
     for (const Hit& h : hits) {
-        int line1 = static_cast<int>(sciSend(SCI_LINEFROMPOSITION, h.pos, 0)) + 1;
-        lineNumbers.push_back(line1);
+        lineCursor.seek(h.pos);
+        int line1 = lineCursor.line() + 1;
+        hitLines.push_back({ line1, static_cast<Sci_Position>(lineCursor.lineStart()),
+            static_cast<Sci_Position>(lineCursor.lineEnd()) });
         // Count digits without creating temporary string
         int temp = line1;
         size_t digits = 0;
@@ -1325,10 +2351,39 @@ void ResultDock::formatHitsLines(const SciSendFn& sciSend,
         dst.append(buf, len);
         };
 
-    int   prevDocLine = -1;
-    Hit* firstHitOnRow = nullptr;
+    int    prevDocLine = -1;
+    size_t rowPrefixU8Len = 0;
     size_t hitIdx = 0;
 
+    // Rows past the eager budget of the block are deferred by the dock and
+    // formatted when rendered (see renderDeferredChunk): they keep the text
+    // as found, and their matches keep offsets into it.
+    bool   lazyRow = false;
+
+    // Hits arrive grouped by file and mostly by pattern: remember the last
+    // interned ids so the hash tables are only consulted on a change.
+    const std::string*  lastPath = nullptr;
+    std::uint32_t       lastFileId = ResultHitStore::kNoId;
+    const std::wstring* lastFindText = nullptr;
+    int                 lastFlags = 0;
+    std::uint32_t       lastPatternId = ResultHitStore::kNoId;
+
+    auto fileIdFor = [&](const Hit& h) -> std::uint32_t {
+        if (!lastPath || *lastPath != h.fullPathUtf8) {
+            lastFileId = outRows.internFile(h.fullPathUtf8);
+            lastPath = &h.fullPathUtf8;
+        }
+        return lastFileId;
+        };
+    auto patternIdFor = [&](const Hit& h) -> std::uint32_t {
+        if (!lastFindText || lastFlags != h.searchFlags || *lastFindText != h.findTextW) {
+            lastPatternId = outRows.internPattern(h.findTextW, h.searchFlags);
+            lastFindText = &h.findTextW;
+            lastFlags = h.searchFlags;
+        }
+        return lastPatternId;
+        };
+
     std::string  cachedRaw;
     std::string  cachedRawFiltered;  // Only populated when FlowTabs padding exists
     std::string  origU8Owned;          // populated only for non-UTF-8 docs
@@ -1363,20 +2418,14 @@ void ResultDock::formatHitsLines(const SciSendFn& sciSend,
     std::vector<size_t> mapOrigToDisp;
     std::unordered_map<size_t, size_t> u8PrefixLenByByte;
 
-    auto loadLineIfNeeded = [&](int line0)
+    auto loadLineIfNeeded = [&](int line0, const HitLine& hl)
         {
             if (line0 == prevDocLine)
                 return;
 
-            // raw line
-            const int rawLen = static_cast<int>(sciSend(SCI_LINELENGTH, line0, 0));
-            cachedRaw.resize(rawLen + 1);
-            sciSend(SCI_GETLINE, line0, reinterpret_cast<LPARAM>(cachedRaw.data()));
-            cachedRaw.resize(rawLen);
-            while (!cachedRaw.empty() && (cachedRaw.back() == '\r' || cachedRaw.back() == '\n'))
-                cachedRaw.pop_back();
-
-            cachedAbsLineStart = sciSend(SCI_POSITIONFROMLINE, line0, 0);
+            // raw line without its EOL, straight from the document bytes
+            cachedRaw.assign(docText + hl.start, static_cast<size_t>(hl.end - hl.start));
+            cachedAbsLineStart = hl.start;
 
             // Filter out FlowTabs padding using range-based indicator scan
             mapRawToFiltered.clear();
@@ -1449,73 +2498,15 @@ void ResultDock::formatHitsLines(const SciSendFn& sciSend,
                 origU8Owned = Encoding::bytesToUtf8(effectiveRaw->data(), effectiveRaw->size(), docCp);
                 origU8Ptr = &origU8Owned;
             }
-            const std::string& origU8 = *origU8Ptr;
-
-            // classify helpers (codepoint-based; both old paths used the same rules)
-            auto isCtlCp = [](uint32_t cp)->bool {
-                if (cp == 0x0000) return true;
-                if ((cp <= 0x1Fu) && cp != 0x09 && cp != 0x0A && cp != 0x0D) return true;
-                if (cp == 0x007Fu) return true;
-                if (cp >= 0x80u && cp <= 0x9Fu) return true;
-                if (cp == 0x2028 || cp == 0x2029) return true;
-                return false;
-                };
-            auto isNbspCp = [](uint32_t cp)->bool { return cp == 0x00A0; };
-
-            // Single-pass transform on UTF-8: build displayU8 and mapOrigToDisp
-            // in one walk over origU8. Same cleanup rules as before
-            // (SHY drop / NBSP+Ctl -> ASCII space / else verbatim).
-            displayU8.clear();
-            displayU8.reserve(origU8.size());
-            mapOrigToDisp.assign(origU8.size() + 1, 0);
-
-            size_t o = 0, d = 0;
-            while (o < origU8.size())
-            {
-                unsigned char c = (unsigned char)origU8[o];
-                size_t clen;
-                if ((c & 0x80) == 0x00) clen = 1;
-                else if ((c & 0xE0) == 0xC0 && o + 1 < origU8.size()) clen = 2;
-                else if ((c & 0xF0) == 0xE0 && o + 2 < origU8.size()) clen = 3;
-                else if ((c & 0xF8) == 0xF0 && o + 3 < origU8.size()) clen = 4;
-                else clen = 1;
-
-                uint32_t cp = 0;
-                if (clen == 1) cp = c;
-                else if (clen == 2) cp = ((c & 0x1Fu) << 6) | (uint32_t(origU8[o + 1]) & 0x3Fu);
-                else if (clen == 3) cp = ((c & 0x0Fu) << 12) |
-                    ((uint32_t(origU8[o + 1]) & 0x3Fu) << 6) |
-                    (uint32_t(origU8[o + 2]) & 0x3Fu);
-                else cp = ((c & 0x07u) << 18) |
-                    ((uint32_t(origU8[o + 1]) & 0x3Fu) << 12) |
-                    ((uint32_t(origU8[o + 2]) & 0x3Fu) << 6) |
-                    (uint32_t(origU8[o + 3]) & 0x3Fu);
-
-                if (cp == 0x00AD) {
-                    // SHY drop
-                    for (size_t k = 0; k < clen && (o + k) < origU8.size(); ++k)
-                        mapOrigToDisp[o + k] = d;
-                    // no d++, no append
-                }
-                else if (isNbspCp(cp) || isCtlCp(cp)) {
-                    for (size_t k = 0; k < clen && (o + k) < origU8.size(); ++k)
-                        mapOrigToDisp[o + k] = d;
-                    displayU8.push_back(' ');
-                    ++d; // one visible ASCII space per replaced codepoint
-                }
-                else {
-                    for (size_t k = 0; k < clen && (o + k) < origU8.size(); ++k)
-                        mapOrigToDisp[o + k] = d + k;
-                    displayU8.append(origU8, o, clen);
-                    d += clen;
-                }
 
-                o += clen;
+            // A lazy row is cleaned when it is rendered
+            if (lazyRow) {
+                displayU8.clear();
+                mapOrigToDisp.clear();
+            }
+            else {
+                cleanHitText(*origU8Ptr, displayU8, &mapOrigToDisp);
             }
-            if (!mapOrigToDisp.empty()) mapOrigToDisp.back() = d;
-
-            // finalize
-            capUtf8WithEllipsis(displayU8, kMaxHitTextUtf8);
 
             u8PrefixLenByByte.clear();
             // prevDocLine is set by the caller when the row is actually written
@@ -1541,11 +2532,16 @@ void ResultDock::formatHitsLines(const SciSendFn& sciSend,
         return val;
         };
 
-    for (Hit& h : hits) {
-        int line1 = lineNumbers[hitIdx++];
+    outRows.reserve(outRows.rowCount() + hits.size(), outRows.matchCount() + hits.size());
+
+    for (const Hit& h : hits) {
+        const HitLine& hl = hitLines[hitIdx++];
+        int line1 = hl.line1;
         int line0 = line1 - 1;
 
-        loadLineIfNeeded(line0);
+        if (line0 != prevDocLine)
+            lazyRow = bodyLines >= kEagerBodyLines;
+        loadLineIfNeeded(line0, hl);
 
 
         size_t relBytes = (size_t)(h.pos - cachedAbsLineStart);
@@ -1559,15 +2555,6 @@ void ResultDock::formatHitsLines(const SciSendFn& sciSend,
             ? filteredLen
             : Encoding::bytesToUtf8(effectiveRaw->data() + filteredStart, filteredLen, docCp).size();
 
-
-        auto mapToDisp = [&](size_t offU8) -> size_t {
-            if (offU8 >= mapOrigToDisp.size()) return mapOrigToDisp.empty() ? 0 : mapOrigToDisp.back();
-            return mapOrigToDisp[offU8];
-            };
-        size_t dispStart = mapToDisp(hitStartU8_orig);
-        size_t dispEnd = mapToDisp(hitStartU8_orig + hitLenU8_orig);
-        size_t dispLen = (dispEnd > dispStart ? dispEnd - dispStart : 0);
-
         if (line0 != prevDocLine) {
             const size_t line1Digits = countDigits(line1);
             const size_t padCount = (maxDigits > line1Digits) ? (maxDigits - line1Digits) : 0;
@@ -1583,87 +2570,36 @@ void ResultDock::formatHitsLines(const SciSendFn& sciSend,
             out.append(padCount, ' ');
             appendIntU8(out, line1);
             out.append(": ", 2);
-            out.append(displayU8);
+            if (lazyRow)
+                out.append(*origU8Ptr, 0, keptHitTextLen(*origU8Ptr));
+            else
+                out.append(displayU8);
             out.append("\r\n", 2);
 
-            // Look ahead: how many subsequent hits share this line1?
-            // We know lineNumbers[] is in pos-order, and pos-order matches
-            // by-line aggregation. Reserve exact capacity to avoid reallocations
-            // in the per-hit push_back chain below.
-            size_t lineHitCount = 1;
-            for (size_t j = hitIdx; j < lineNumbers.size() && lineNumbers[j] == line1; ++j)
-                ++lineHitCount;
-
-            h.displayLineStart = (int)rowStartPos;
-            h.numberStart = (int)(indentHitU8 + kLineU8 + maxDigits - line1Digits);
-            h.numberLen = (int)line1Digits;
-
-            h.matchStarts.clear();
-            h.matchLens.clear();
-            h.matchColors.clear();
-            h.matchStarts.reserve(lineHitCount);
-            h.matchLens.reserve(lineHitCount);
-            h.matchColors.reserve(lineHitCount);
-
-            firstHitOnRow = &h;
-            firstHitOnRow->allFindTexts.clear();
-            firstHitOnRow->allPositions.clear();
-            firstHitOnRow->allLengths.clear();
-            firstHitOnRow->allSearchFlags.clear();
-            firstHitOnRow->allFindTexts.reserve(lineHitCount);
-            firstHitOnRow->allPositions.reserve(lineHitCount);
-            firstHitOnRow->allLengths.reserve(lineHitCount);
-            firstHitOnRow->allSearchFlags.reserve(lineHitCount);
-            firstHitOnRow->allFindTexts.push_back(h.findTextW);
-            firstHitOnRow->allPositions.push_back(h.pos);
-            firstHitOnRow->allLengths.push_back(h.length);
-            firstHitOnRow->allSearchFlags.push_back(h.searchFlags);
-
-            if (dispStart < displayU8.size()) {
-                size_t safeLen = dispLen;
-                if (dispStart + safeLen > displayU8.size()) safeLen = displayU8.size() - dispStart;
-                if (safeLen > 0) {
-                    h.matchStarts.push_back((int)(prefixU8Len + dispStart));
-                    h.matchLens.push_back((int)safeLen);
-
-                    h.matchColors.push_back(h.colorIndex);
-                }
-            }
+            // New row; this hit and every following hit on the same line
+            // become its matches.
+            outRows.beginRow(fileIdFor(h), h.docLine, (int)rowStartPos,
+                (int)(indentHitU8 + kLineU8 + maxDigits - line1Digits), (int)line1Digits, lazyRow);
+            rowPrefixU8Len = prefixU8Len;
+            ++bodyLines;
 
             prevDocLine = line0;
         }
-        else {
-            if (firstHitOnRow) {
-                const size_t line1Digits = countDigits(line1);
-                const size_t prefixU8Len = indentHitU8 + kLineU8
-                    + line1Digits
-                    + (maxDigits - line1Digits)
-                    + kColonSpaceU8;
-
-                if (dispStart < displayU8.size()) {
-                    size_t safeLen = dispLen;
-                    if (dispStart + safeLen > displayU8.size()) safeLen = displayU8.size() - dispStart;
-                    if (safeLen > 0) {
-                        firstHitOnRow->matchStarts.push_back((int)(prefixU8Len + dispStart));
-                        firstHitOnRow->matchLens.push_back((int)safeLen);
-
-                        firstHitOnRow->matchColors.push_back(h.colorIndex);
-                    }
-                }
 
-                firstHitOnRow->allFindTexts.push_back(h.findTextW);
-                firstHitOnRow->allPositions.push_back(h.pos);
-                firstHitOnRow->allLengths.push_back(h.length);
-                firstHitOnRow->allSearchFlags.push_back(h.searchFlags);
-            }
-            h.displayLineStart = -1;
+        // Highlight span inside the row; a lazy row keeps the match's
+        // offset into its kept text instead.
+        int matchDispStart = 0;
+        int matchDispLen = 0;
+        if (lazyRow) {
+            matchDispStart = (int)(std::min)(hitStartU8_orig, kMaxKeptHitTextUtf8);
+            matchDispLen = (int)(std::min)(hitLenU8_orig, kMaxKeptHitTextUtf8);
+        }
+        else {
+            hitDisplaySpan(mapOrigToDisp, displayU8.size(), rowPrefixU8Len,
+                hitStartU8_orig, hitLenU8_orig, matchDispStart, matchDispLen);
         }
+        outRows.addMatch(h.pos, h.length, patternIdFor(h), h.colorIndex, h.listIndex, matchDispStart, matchDispLen);
     }
-
-    hits.erase(std::remove_if(hits.begin(), hits.end(),
-        [](const Hit& e) { return e.displayLineStart < 0; }),
-        hits.end());
-
 }
 
 // --------------------- Line helpers -----------------------
@@ -1703,12 +2639,6 @@ size_t ResultDock::getIndentUtf8Length(ResultDock::LineLevel lvl) {
     return static_cast<size_t>(INDENT_SPACES[static_cast<int>(lvl)]);
 }
 
-void ResultDock::shiftHits(std::vector<ResultDock::Hit>& v, size_t delta)
-{
-    for (auto& h : v)
-        h.displayLineStart += static_cast<int>(delta);
-}
-
 std::wstring ResultDock::stripHitPrefix(const std::wstring& w)
 {
     const int indentLen = ResultDock::INDENT_SPACES[static_cast<int>(ResultDock::LineLevel::HitLine)];
@@ -1999,6 +2929,17 @@ void ResultDock::NavigateToHit(const Hit& hit)
     if (!hEd)
         return;
 
+    const int docCp = static_cast<int>(::SendMessage(hEd, SCI_GETCODEPAGE, 0, 0));
+    const std::string findBytes = hit.findTextW.empty()
+        ? std::string() : Encoding::wstringToBytes(hit.findTextW, docCp);
+
+    // ---- Tracked position: edits since the search moved it along ----
+    Sci_Position trackedLen = 0;
+    if (matchStartsAt(hEd, hit.pos, findBytes, hit.searchFlags, trackedLen)) {
+        JumpSelectCenterActiveEditor(hit.pos, trackedLen);
+        return;
+    }
+
     // ---- Line-based re-search: find the match closest to stored position ----
     if (hit.docLine < 0) {
         JumpSelectCenterActiveEditor(hit.pos, hit.length);
@@ -2014,13 +2955,6 @@ void ResultDock::NavigateToHit(const Hit& hit)
     const Sci_Position lineStart = ::SendMessage(hEd, SCI_POSITIONFROMLINE, hit.docLine, 0);
     const Sci_Position lineEnd = ::SendMessage(hEd, SCI_GETLINEENDPOSITION, hit.docLine, 0);
 
-    if (hit.findTextW.empty()) {
-        JumpSelectCenterActiveEditor(hit.pos, hit.length);
-        return;
-    }
-
-    const int docCp = static_cast<int>(::SendMessage(hEd, SCI_GETCODEPAGE, 0, 0));
-    const std::string findBytes = Encoding::wstringToBytes(hit.findTextW, docCp);
     if (findBytes.empty()) {
         JumpSelectCenterActiveEditor(hit.pos, hit.length);
         return;
@@ -2079,64 +3013,31 @@ void ResultDock::adjustHitPositionsForFlowTab(
         return;
 
     // paddingRanges: sorted by position, pairs of (start, end) for each padding region.
+    // Replayed as single edits on the position index, so each range costs
+    // O(log n) instead of a pass over every match of the file.
     //
     // REMOVAL (added=false):
     //   paddingRanges are in pre-removal coordinates (same as hit.pos).
-    //   For each hit, count total padding bytes before hit.pos, then subtract.
+    //   Removed back to front, so the ranges not yet applied keep their coordinates.
     //
     // INSERTION (added=true):
     //   paddingRanges are in post-insertion coordinates.
-    //   hit.pos is in pre-insertion coordinates (no pads yet).
-    //   We track cumulative delta: a padding at post-pos P corresponds to
-    //   original pos (P - cumulativeDeltaSoFar). If that original pos <= hit.pos,
-    //   this padding shifts the hit forward.
+    //   Inserted front to back: each range's start is then exactly where the
+    //   text before it already sits; hits at the insertion point move along.
+
+    // Every match of the file's rows, primary and merged alike
+    for (std::uint32_t id = 0; id < _hits.fileCount(); ++id)
+    {
+        if (!pathsEqualUtf8(_hits.filePath(id), filePathUtf8))
+            continue;
 
-    auto computeDelta = [&](Sci_Position hitPos) -> Sci_Position {
-        Sci_Position delta = 0;
         if (added) {
-            // Post-insertion ranges: need to find how many pad bytes map to original positions <= hitPos
             for (const auto& [padStart, padEnd] : paddingRanges)
-            {
-                const Sci_Position padLen = padEnd - padStart;
-                // The original position of this padding (before it was inserted) is padStart - delta
-                const Sci_Position origPadPos = padStart - delta;
-                if (origPadPos <= hitPos)
-                    delta += padLen;
-                else
-                    break; // Sorted: remaining pads are after hitPos in original coords
-            }
+                _hits.shiftPositions(id, padStart, padEnd - padStart);
         }
         else {
-            // Pre-removal ranges: same coordinate system as hitPos
-            for (const auto& [padStart, padEnd] : paddingRanges)
-            {
-                if (padStart < hitPos)
-                    delta += (padEnd - padStart);
-                else
-                    break; // Sorted: remaining pads are at or after hitPos
-            }
-        }
-        return delta;
-        };
-
-    const Sci_Position sign = added ? 1 : -1;
-
-    for (auto& hit : _hits)
-    {
-        if (!pathsEqualUtf8(hit.fullPathUtf8, filePathUtf8))
-            continue;
-
-        // Adjust primary position
-        Sci_Position d = computeDelta(hit.pos);
-        hit.pos += sign * d;
-        if (hit.pos < 0) hit.pos = 0;
-
-        // Adjust merged positions (multiple hits on same display row)
-        for (auto& aPos : hit.allPositions)
-        {
-            d = computeDelta(aPos);
-            aPos += sign * d;
-            if (aPos < 0) aPos = 0;
+            for (auto it = paddingRanges.rbegin(); it != paddingRanges.rend(); ++it)
+                _hits.shiftPositions(id, it->first, -(it->second - it->first));
         }
     }
 }
@@ -2253,58 +3154,41 @@ void ResultDock::gotoAdjacentHit(int direction)
     int blockEnd = static_cast<int>(S(SCI_GETLASTCHILD, blockStart, searchHdrLevel));
     if (blockEnd < blockStart) blockEnd = static_cast<int>(S(SCI_GETLINECOUNT)) - 1;
 
-    // Collect hit indices within this block's line range
+    // Rows are in display order: the block's hits are one index range
     Sci_Position blockStartPos = S(SCI_POSITIONFROMLINE, blockStart, 0);
     Sci_Position blockEndPos = S(SCI_GETLINEENDPOSITION, blockEnd, 0);
-    std::vector<size_t> blockHits;
-    for (size_t i = 0; i < _hits.size(); ++i) {
-        int dls = _hits[i].displayLineStart;
-        if (dls >= static_cast<int>(blockStartPos) && dls <= static_cast<int>(blockEndPos))
-            blockHits.push_back(i);
-    }
-    if (blockHits.empty()) return;
+    const size_t first = _hits.lowerBoundDisplay(static_cast<int>(blockStartPos));
+    const size_t end = _hits.lowerBoundDisplay(static_cast<int>(blockEndPos) + 1);
+    if (first >= end) return;
 
     // Find current position among block hits and step in the given direction
-    const size_t n = blockHits.size();
+    const size_t n = end - first;
     Sci_Position curLineStart = S(SCI_POSITIONFROMLINE, curLine, 0);
 
     // Default: first hit (forward) or last hit (backward)
     size_t pick = (direction > 0) ? 0 : n - 1;
 
-    auto curIt = _lineStartToHitIndex.find(static_cast<int>(curLineStart));
-    if (curIt != _lineStartToHitIndex.end()) {
+    const size_t curHit = getHitIndexAtLineStart(static_cast<int>(curLineStart));
+    if (curHit >= first && curHit < end) {
         // Currently on a hit line — advance by one step in direction
-        for (size_t b = 0; b < n; ++b) {
-            if (blockHits[b] == static_cast<size_t>(curIt->second)) {
-                pick = (b + direction + n) % n;
-                break;
-            }
-        }
+        pick = (curHit - first + direction + n) % n;
     }
     else {
-        // Not on a hit line — find nearest hit in the travel direction
-        if (direction > 0) {
-            for (size_t b = 0; b < n; ++b) {
-                if (_hits[blockHits[b]].displayLineStart > static_cast<int>(curLineStart)) {
-                    pick = b;
-                    break;
-                }
-            }
-        }
-        else {
-            for (size_t b = n; b-- > 0;) {
-                if (_hits[blockHits[b]].displayLineStart < static_cast<int>(curLineStart)) {
-                    pick = b;
-                    break;
-                }
-            }
-        }
+        // Not on a hit line — nearest hit in the travel direction
+        const size_t next = _hits.lowerBoundDisplay(static_cast<int>(curLineStart) + 1);
+        const size_t prev = _hits.lowerBoundDisplay(static_cast<int>(curLineStart));
+        if (direction > 0 && next < end)
+            pick = (std::max)(next, first) - first;
+        else if (direction < 0 && prev > first)
+            pick = (std::min)(prev, end) - 1 - first;
     }
 
-    size_t hitIdx = blockHits[pick];
+    size_t hitIdx = first + pick;
+    ensureRowRendered(hitIdx);
+    const int rowStart = _hits.rowDisplayStart(hitIdx);
     navigateFromDockLine(_hSci,
-        static_cast<int>(S(SCI_LINEFROMPOSITION, _hits[hitIdx].displayLineStart, 0)));
-    scrollToHitAndHighlight(_hits[hitIdx].displayLineStart);
+        static_cast<int>(S(SCI_LINEFROMPOSITION, rowStart, 0)));
+    scrollToHitAndHighlight(rowStart);
 }
 
 ResultDock::CursorHitInfo ResultDock::getCurrentCursorHitInfo() const {
@@ -2317,11 +3201,8 @@ ResultDock::CursorHitInfo ResultDock::getCurrentCursorHitInfo() const {
     Sci_Position lineStart = S(SCI_POSITIONFROMLINE, line, 0);
 
     // Lookup hit index from line start position
-    auto it = _lineStartToHitIndex.find(static_cast<int>(lineStart));
-    if (it == _lineStartToHitIndex.end()) return info;
-
-    size_t hitIdx = it->second;
-    if (hitIdx >= _hits.size()) return info;
+    const size_t hitIdx = getHitIndexAtLineStart(static_cast<int>(lineStart));
+    if (hitIdx == SIZE_MAX) return info;
 
     info.valid = true;
     info.hitIndex = hitIdx;
@@ -2332,12 +3213,18 @@ ResultDock::CursorHitInfo ResultDock::getCurrentCursorHitInfo() const {
 ResultDock::BlockRange ResultDock::getBlockRangeForHit(size_t hitIndex) const
 {
     BlockRange br;
-    if (!_hSci || hitIndex >= _hits.size()) return br;
+    if (!_hSci || hitIndex >= _hits.rowCount()) return br;
 
-    int dls = _hits[hitIndex].displayLineStart;
+    int dls = _hits.rowDisplayStart(hitIndex);
     if (dls < 0) return br;
 
-    int curLine = static_cast<int>(S(SCI_LINEFROMPOSITION, dls, 0));
+    return getBlockRangeAtLine(static_cast<int>(S(SCI_LINEFROMPOSITION, dls, 0)));
+}
+
+ResultDock::BlockRange ResultDock::getBlockRangeAtLine(int curLine) const
+{
+    BlockRange br;
+    if (!_hSci || curLine < 0) return br;
 
     // Walk up to the SearchHeader via fold parents
     const int searchHdrLevel = SC_FOLDLEVELBASE + static_cast<int>(LineLevel::SearchHdr);
@@ -2360,39 +3247,19 @@ ResultDock::BlockRange ResultDock::getBlockRangeForHit(size_t hitIndex) const
     Sci_Position blockEndPos = S(SCI_GETLINEENDPOSITION, blockEndLine, 0);
 
     // Find first and last hit index within this block
-    br.first = _hits.size();
-    br.last = 0;
-    for (size_t i = 0; i < _hits.size(); ++i) {
-        int d = _hits[i].displayLineStart;
-        if (d >= static_cast<int>(blockStartPos) && d <= static_cast<int>(blockEndPos)) {
-            if (i < br.first) br.first = i;
-            br.last = i;
-        }
+    const size_t first = _hits.lowerBoundDisplay(static_cast<int>(blockStartPos));
+    const size_t end = _hits.lowerBoundDisplay(static_cast<int>(blockEndPos) + 1);
+    br.valid = (first < end);
+    if (br.valid) {
+        br.first = first;
+        br.last = end - 1;
     }
-    br.valid = (br.first <= br.last);
     return br;
 }
 
 size_t ResultDock::getHitIndexAtLineStart(int lineStartPos) const
 {
-    auto it = _lineStartToHitIndex.find(lineStartPos);
-    if (it == _lineStartToHitIndex.end()) return SIZE_MAX;
-
-    size_t hitIdx = it->second;
-    if (hitIdx >= _hits.size()) return SIZE_MAX;
-
-    return hitIdx;
-}
-
-void ResultDock::rebuildHitLineIndex()
-{
-    _lineStartToHitIndex.clear();
-    _lineStartToHitIndex.reserve(_hits.size());
-    for (int i = 0; i < (int)_hits.size(); ++i)
-    {
-        const int pos = _hits[i].displayLineStart;
-        if (pos >= 0) _lineStartToHitIndex[pos] = i;
-    }
+    return _hits.rowAtDisplayStart(lineStartPos);
 }
 
 // --------------- Context Menu Command Handlers ------------
@@ -2427,6 +3294,8 @@ void ResultDock::copySelectedLines(HWND hSci) {
             raw.resize(strnlen(raw.c_str(), len));
             if (classify(raw) == LineKind::HitLine)
                 out.emplace_back(stripHitPrefix(Encoding::utf8ToWString(raw)));
+            else
+                appendDeferredHitLines(hSci, l, out);
         }
     }
     else {                                    // ----- caret hierarchy walk
@@ -2451,6 +3320,8 @@ void ResultDock::copySelectedLines(HWND hSci) {
 
                 if (classify(raw) == LineKind::HitLine)
                     out.emplace_back(stripHitPrefix(Encoding::utf8ToWString(raw)));
+                else
+                    appendDeferredHitLines(hSci, l, out);
             }
             };
 
@@ -2623,6 +3494,222 @@ void ResultDock::openSelectedPaths(HWND hSci) {
     }
 }
 
+void ResultDock::exportResults(HWND hSci)
+{
+    ResultDock& dock = instance();
+    if (dock._hits.empty()) return;
+
+    // Filter 0 = CSV, 1 = JSON Lines; the picked filter decides the format
+    FileDialogUtil::Params dlg;
+    dlg.owner = hSci;
+    dlg.title = LM.get(L"dock_export_title");
+    dlg.filters = {
+        { LM.get(L"filetype_csv_excel"), L"*.csv" },
+        { LM.get(L"filetype_jsonl"),     L"*.jsonl" }
+    };
+    dlg.defaultPath = L"SearchResults.csv";
+    dlg.defaultExtension = L"csv";
+    dlg.pathMustExist = true;
+
+    const FileDialogUtil::Result picked = FileDialogUtil::showSave(dlg);
+    if (!picked.ok) return;
+
+    const auto format = (picked.filterIndex == 1)
+        ? ResultExportWriter::Format::Jsonl
+        : ResultExportWriter::Format::Csv;
+
+    HCURSOR oldCursor = ::SetCursor(::LoadCursor(nullptr, IDC_WAIT));
+    size_t count = 0;
+    const bool ok = dock.exportHits(picked.path, format, count);
+    ::SetCursor(oldCursor);
+
+    if (_statusCallback) {
+        if (ok)
+            _statusCallback(LM.get(L"status_export_done", { std::to_wstring(count) }), false);
+        else
+            _statusCallback(LM.get(L"status_export_failed", { picked.path }), true);
+    }
+}
+
+namespace {
+
+    // Last refine input; prefills the dialog next time
+    struct RefineInput {
+        std::wstring pathFilter;
+        std::wstring text;
+        bool         regex = false;
+        bool         matchCase = false;
+        std::wstring entry;             // 1-based list entry, empty = any
+    };
+    RefineInput s_refine;
+
+    enum : int {
+        IDC_REFINE_PATH = 1001,
+        IDC_REFINE_TEXT = 1002,
+        IDC_REFINE_REGEX = 1003,
+        IDC_REFINE_MATCHCASE = 1004,
+        IDC_REFINE_ENTRY = 1005
+    };
+
+    std::wstring dlgItemText(HWND dlg, int id)
+    {
+        HWND h = ::GetDlgItem(dlg, id);
+        std::wstring s(static_cast<size_t>(::GetWindowTextLengthW(h)) + 1, L'\0');
+        s.resize(static_cast<size_t>(::GetWindowTextW(h, s.data(), static_cast<int>(s.size()))));
+        return s;
+    }
+
+    INT_PTR CALLBACK refineDlgProc(HWND h, UINT m, WPARAM w, LPARAM)
+    {
+        switch (m) {
+        case WM_INITDIALOG:
+            ::SetDlgItemTextW(h, IDC_REFINE_PATH, s_refine.pathFilter.c_str());
+            ::SetDlgItemTextW(h, IDC_REFINE_TEXT, s_refine.text.c_str());
+            ::SetDlgItemTextW(h, IDC_REFINE_ENTRY, s_refine.entry.c_str());
+            ::CheckDlgButton(h, IDC_REFINE_REGEX, s_refine.regex ? BST_CHECKED : BST_UNCHECKED);
+            ::CheckDlgButton(h, IDC_REFINE_MATCHCASE, s_refine.matchCase ? BST_CHECKED : BST_UNCHECKED);
+            return TRUE;
+        case WM_COMMAND:
+            if (LOWORD(w) == IDOK) {
+                s_refine.pathFilter = dlgItemText(h, IDC_REFINE_PATH);
+                s_refine.text = dlgItemText(h, IDC_REFINE_TEXT);
+                s_refine.entry = dlgItemText(h, IDC_REFINE_ENTRY);
+                s_refine.regex = ::IsDlgButtonChecked(h, IDC_REFINE_REGEX) == BST_CHECKED;
+                s_refine.matchCase = ::IsDlgButtonChecked(h, IDC_REFINE_MATCHCASE) == BST_CHECKED;
+            }
+            if (LOWORD(w) == IDOK || LOWORD(w) == IDCANCEL) {
+                ::EndDialog(h, LOWORD(w));
+                return TRUE;
+            }
+            break;
+        }
+        return FALSE;
+    }
+
+} // namespace
+
+// In-memory dialog template (no .rc), laid out like the FlowTabs intro dialog.
+bool ResultDock::showRefineDialog(HWND owner)
+{
+    std::wstring okTxt = LM.get(L"msgbox_button_ok");         if (okTxt.empty())     okTxt = L"OK";
+    std::wstring cancelTxt = LM.get(L"msgbox_button_cancel"); if (cancelTxt.empty()) cancelTxt = L"Cancel";
+
+    // Layout (DLUs)
+    const short W = 260, H = 104, Mx = 7, My = 7;
+    const short Lw = 62, Ex = Mx + Lw + 4, Ew = W - Ex - Mx;
+    const short Rh = 18, Eh = 12, Bw = 60, Bh = 14, Bp = 6;
+
+    struct Item { DWORD style; short x, y, cx, cy; WORD id; WORD cls; std::wstring text; };
+    const Item items[] = {
+        { SS_LEFT | SS_NOPREFIX, Mx, My + 2, Lw, 8, 0xFFFF, 0x0082, LM.get(L"dock_refine_path") },
+        { WS_BORDER | WS_TABSTOP | ES_AUTOHSCROLL, Ex, My, Ew, Eh, IDC_REFINE_PATH, 0x0081, L"" },
+        { SS_LEFT | SS_NOPREFIX, Mx, My + Rh + 2, Lw, 8, 0xFFFF, 0x0082, LM.get(L"dock_refine_text") },
+        { WS_BORDER | WS_TABSTOP | ES_AUTOHSCROLL, Ex, My + Rh, Ew, Eh, IDC_REFINE_TEXT, 0x0081, L"" },
+        { WS_TABSTOP | BS_AUTOCHECKBOX, Ex, My + 2 * Rh - 2, Ew / 2, 10, IDC_REFINE_REGEX, 0x0080, LM.get(L"dock_refine_regex") },
+        { WS_TABSTOP | BS_AUTOCHECKBOX, Ex + Ew / 2, My + 2 * Rh - 2, Ew / 2, 10, IDC_REFINE_MATCHCASE, 0x0080, LM.get(L"dock_refine_matchcase") },
+        { SS_LEFT | SS_NOPREFIX, Mx, My + 3 * Rh - 2, Lw, 8, 0xFFFF, 0x0082, LM.get(L"dock_refine_entry") },
+        { WS_BORDER | WS_TABSTOP | ES_NUMBER, Ex, My + 3 * Rh - 4, 40, Eh, IDC_REFINE_ENTRY, 0x0081, L"" },
+        { WS_TABSTOP | BS_DEFPUSHBUTTON, W - Mx - 2 * Bw - Bp, H - My - Bh, Bw, Bh, IDOK, 0x0080, okTxt },
+        { WS_TABSTOP | BS_PUSHBUTTON, W - Mx - Bw, H - My - Bh, Bw, Bh, IDCANCEL, 0x0080, cancelTxt },
+    };
+    const std::wstring title = LM.get(L"dock_refine_title");
+
+    size_t needBytes = 1024 + (title.size() + 1) * sizeof(wchar_t);
+    for (const Item& it : items) needBytes += sizeof(DLGITEMTEMPLATE) + 16 + (it.text.size() + 1) * sizeof(wchar_t);
+
+    std::vector<BYTE> buf((std::max)(needBytes, (size_t)4096));
+    DLGTEMPLATE* dlg = reinterpret_cast<DLGTEMPLATE*>(buf.data());
+    dlg->style = DS_SETFONT | DS_CENTER | WS_POPUP | WS_CAPTION | WS_SYSMENU | DS_MODALFRAME;
+    dlg->cdit = static_cast<WORD>(std::size(items));
+    dlg->x = 0; dlg->y = 0; dlg->cx = W; dlg->cy = H;
+
+    BYTE* p = buf.data() + sizeof(DLGTEMPLATE);
+    auto W16 = [&](WORD v) { *reinterpret_cast<WORD*>(p) = v; p += sizeof(WORD); };
+    auto WSTR = [&](const std::wstring& s) {
+        const size_t n = (s.size() + 1) * sizeof(wchar_t);
+        memcpy(p, s.c_str(), n);
+        p += n;
+        };
+    auto AL = [&]() {                 // DWORD align
+        uintptr_t a = reinterpret_cast<uintptr_t>(p);
+        a = (a + 3) & ~(uintptr_t)3;
+        p = reinterpret_cast<BYTE*>(a);
+        };
+
+    // Menu=0, Class=0, Title, font
+    W16(0); W16(0); WSTR(title);
+    W16(9); WSTR(L"Segoe UI");
+
+    for (const Item& it : items) {
+        AL();
+        auto* t = reinterpret_cast<DLGITEMTEMPLATE*>(p);
+        t->style = WS_CHILD | WS_VISIBLE | it.style;
+        t->dwExtendedStyle = 0;
+        t->x = it.x; t->y = it.y; t->cx = it.cx; t->cy = it.cy; t->id = it.id;
+        p += sizeof(DLGITEMTEMPLATE);
+        W16(0xFFFF); W16(it.cls);
+        WSTR(it.text);
+        W16(0); // no creation data
+    }
+
+    return ::DialogBoxIndirectParamW(instance()._hInst, dlg, owner, refineDlgProc, 0) == IDOK;
+}
+
+// Refine the search block under the caret (every block when the caret is
+// outside of one) into a new block on top.
+void ResultDock::refineResults(HWND hSci)
+{
+    ResultDock& dock = instance();
+    if (dock._hits.empty() || !showRefineDialog(hSci)) return;
+
+    ResultFilter::Criteria criteria;
+    criteria.pathFilter = Encoding::wstringToUtf8(s_refine.pathFilter);
+    criteria.text = s_refine.text;
+    criteria.regex = s_refine.regex;
+    criteria.matchCase = s_refine.matchCase;
+    const int entry = s_refine.entry.empty() ? 0 : _wtoi(s_refine.entry.c_str());
+    criteria.rule = (entry > 0) ? entry - 1 : -1;
+
+    const ResultFilter filter(criteria);
+    if (!filter.valid()) {
+        if (_statusCallback)
+            _statusCallback(LM.get(L"status_refine_invalid_regex", { Encoding::utf8ToWString(filter.error()) }), true);
+        return;
+    }
+    if (!filter.hasPathFilter() && !filter.hasTextFilter() && filter.rule() < 0)
+        return;
+
+    const int caretLine = static_cast<int>(::SendMessage(hSci, SCI_LINEFROMPOSITION,
+        ::SendMessage(hSci, SCI_GETCURRENTPOS, 0, 0), 0));
+    const BlockRange block = dock.getBlockRangeAtLine(caretLine);
+    const size_t first = block.valid ? block.first : 0;
+    const size_t end = block.valid ? block.last + 1 : dock._hits.rowCount();
+
+    // Header label: the criteria that were given
+    std::wstring label;
+    for (const std::wstring& part : { s_refine.pathFilter, s_refine.text,
+        criteria.rule >= 0 ? L"#" + std::to_wstring(entry) : std::wstring() }) {
+        if (part.empty()) continue;
+        if (!label.empty()) label += L", ";
+        label += part;
+    }
+
+    HCURSOR oldCursor = ::SetCursor(::LoadCursor(nullptr, IDC_WAIT));
+    size_t hits = 0, files = 0;
+    std::string error;
+    const bool ok = dock.refineHits(filter, first, end, label, hits, files, error);
+    ::SetCursor(oldCursor);
+
+    if (_statusCallback) {
+        if (!ok)
+            _statusCallback(LM.get(L"status_refine_regex_failed", { Encoding::utf8ToWString(error) }), true);
+        else if (hits == 0)
+            _statusCallback(LM.get(L"status_no_matches_found"), true);
+        else
+            _statusCallback(LM.get(L"status_refine_done", { std::to_wstring(hits) }), false);
+    }
+}
+
 void ResultDock::deleteSelectedItems(HWND hSci)
 {
     auto& dock = ResultDock::instance();
@@ -2730,15 +3817,31 @@ void ResultDock::deleteSelectedItems(HWND hSci)
 
         const int delta = (int)(p1 - p0);
 
-        // remove hits inside [p0, p1)
-        dock._hits.erase(
-            std::remove_if(dock._hits.begin(), dock._hits.end(),
-                [&](const Hit& h) { return h.displayLineStart >= (int)p0 && h.displayLineStart < (int)p1; }),
-            dock._hits.end());
-        // shift hits at/after p1 back by delta
-        for (auto& h : dock._hits)
-            if (h.displayLineStart >= (int)p1)
-                h.displayLineStart -= delta;
+        // Deferred lines go with their placeholder. The line that moves up
+        // into l0 keeps l0's line state, so carry its own state over.
+        const bool trackStates = !dock._deferred.empty();
+        int nextState = 0;
+        if (trackStates) {
+            for (int l = l0; l <= l1; ++l) {
+                const int id = static_cast<int>(Sx(SCI_GETLINESTATE, l));
+                auto deferred = (id != 0) ? dock._deferred.find(id) : dock._deferred.end();
+                if (deferred != dock._deferred.end()) {
+                    dock.releaseDeferred(deferred->second);
+                    dock._deferred.erase(deferred);
+                }
+            }
+            if (l1 < totalLines - 1)
+                nextState = static_cast<int>(Sx(SCI_GETLINESTATE, l1 + 1));
+        }
+
+        // Pins of removed headers would be merged into l0
+        const int pinMask = 1 << MARKER_PINNED;
+        for (int l = static_cast<int>(Sx(SCI_MARKERNEXT, l0, pinMask)); l >= 0 && l <= l1;
+            l = static_cast<int>(Sx(SCI_MARKERNEXT, l + 1, pinMask)))
+            Sx(SCI_MARKERDELETE, l, MARKER_PINNED);
+
+        // remove hits inside [p0, p1), shift hits at/after p1 back by delta
+        dock._hits.eraseDisplayRange((int)p0, (int)p1);
 
         // per-range redraw/read-only toggling
         ::SendMessage(hSci, WM_SETREDRAW, FALSE, 0);
@@ -2746,12 +3849,15 @@ void ResultDock::deleteSelectedItems(HWND hSci)
         Sx(SCI_DELETERANGE, (uptr_t)p0, (sptr_t)delta);
         Sx(SCI_SETREADONLY, TRUE);
         ::SendMessage(hSci, WM_SETREDRAW, TRUE, 0);
+
+        if (trackStates)
+            Sx(SCI_SETLINESTATE, l0, nextState);
     }
 
     // Rebuild dock caches as before
     dock.rebuildFolding();
     dock.applyStyling();
-    dock.rebuildHitLineIndex();
+    dock.updateHistoryInfo(dock.collectSearchHeaders().size());
 
     // force a synchronous repaint (matches prependBlock's explicit refresh idea) ---
     ::RedrawWindow(hSci, nullptr, nullptr,
@@ -2788,9 +3894,8 @@ bool ResultDock::navigateFromDockLine(HWND hwnd, int dispLine)
     const size_t hitIndex = dock.getHitIndexAtLineStart(static_cast<int>(lineStartPos));
     if (hitIndex == SIZE_MAX) return false;
 
-    const auto& allHits = dock.hits();
-    if (hitIndex >= allHits.size()) return false;
-    const Hit& hit = allHits[hitIndex];
+    if (hitIndex >= dock.hits().rowCount()) return false;
+    const Hit hit = dock.hitAt(hitIndex);
 
     const std::wstring wPath = Encoding::utf8ToWString(hit.fullPathUtf8);
     if (wPath.empty()) return false;
@@ -2885,6 +3990,12 @@ LRESULT CALLBACK ResultDock::sciSubclassProc(HWND hwnd, UINT msg, WPARAM wp, LPA
 
     case WM_TIMER:
     {
+        if (wp == s_renderTimerId)
+        {
+            ::KillTimer(hwnd, s_renderTimerId);
+            ResultDock::instance().renderVisibleDeferred();
+            return 0;
+        }
         if (wp == s_timerId)
         {
             ::KillTimer(hwnd, s_timerId);
@@ -2893,6 +4004,19 @@ LRESULT CALLBACK ResultDock::sciSubclassProc(HWND hwnd, UINT msg, WPARAM wp, LPA
                 HWND hEd = s_pending.targetEditor;
                 bool jumped = false;
 
+                // Tracked position first, as in NavigateToHit
+                if (!s_pending.findTextW.empty())
+                {
+                    const int docCp = static_cast<int>(::SendMessage(hEd, SCI_GETCODEPAGE, 0, 0));
+                    Sci_Position len = 0;
+                    if (matchStartsAt(hEd, s_pending.fallbackPos, Encoding::wstringToBytes(s_pending.findTextW, docCp),
+                        s_pending.searchFlags, len))
+                    {
+                        JumpSelectCenterActiveEditor(s_pending.fallbackPos, len);
+                        jumped = true;
+                    }
+                }
+
                 // Line-based re-search: find match closest to stored position
                 if (!jumped && s_pending.docLine >= 0 && !s_pending.findTextW.empty())
                 {
@@ -2999,6 +4123,12 @@ LRESULT CALLBACK ResultDock::sciSubclassProc(HWND hwnd, UINT msg, WPARAM wp, LPA
         break;
     }
 
+    case WM_PAINT:
+        // Placeholders of deferred hit lines that came into view (scroll,
+        // fold expand) are rendered right after this paint.
+        ResultDock::instance().scheduleDeferredRender();
+        break;
+
     case WM_NCDESTROY:
         s_prevSciProc = nullptr;
         break;
@@ -3036,6 +4166,18 @@ LRESULT CALLBACK ResultDock::sciSubclassProc(HWND hwnd, UINT msg, WPARAM wp, LPA
         ::AppendMenuW(hMenu, MF_SEPARATOR, 0, nullptr);
 
         add(IDM_RD_OPEN_PATHS, L"rdmenu_open_paths");
+        add(IDM_RD_EXPORT, L"rdmenu_export",
+            MF_STRING | (ResultDock::instance().hits().empty() ? MF_GRAYED : 0));
+        add(IDM_RD_REFINE, L"rdmenu_refine",
+            MF_STRING | (ResultDock::instance().hits().empty() ? MF_GRAYED : 0));
+        {
+            const int caretLine = static_cast<int>(::SendMessage(hwnd, SCI_LINEFROMPOSITION,
+                ::SendMessage(hwnd, SCI_GETCURRENTPOS, 0, 0), 0));
+            const int header = ResultDock::instance().searchHeaderAtLine(caretLine);
+            add(IDM_RD_TOGGLE_PIN, L"rdmenu_pin_search",
+                MF_STRING | (header < 0 ? MF_GRAYED : 0)
+                | (header >= 0 && ResultDock::instance().isPinned(header) ? MF_CHECKED : 0));
+        }
         ::AppendMenuW(hMenu, MF_SEPARATOR, 0, nullptr);
 
         add(IDM_RD_TOGGLE_WRAP, L"rdmenu_wrap",
@@ -3105,6 +4247,22 @@ LRESULT CALLBACK ResultDock::sciSubclassProc(HWND hwnd, UINT msg, WPARAM wp, LPA
             openSelectedPaths(hwnd);
             return 0;
 
+            // ── export ──────────────────────────────
+        case IDM_RD_EXPORT:
+            exportResults(hwnd);
+            return 0;
+
+            // ── refine ──────────────────────────────
+        case IDM_RD_REFINE:
+            refineResults(hwnd);
+            return 0;
+
+            // ── pin search ──────────────────────────
+        case IDM_RD_TOGGLE_PIN:
+            ResultDock::instance().togglePinAtLine(static_cast<int>(::SendMessage(hwnd, SCI_LINEFROMPOSITION,
+                ::SendMessage(hwnd, SCI_GETCURRENTPOS, 0, 0), 0)));
+            return 0;
+
             // ── toggle word-wrap ──────────────────────────
         case IDM_RD_TOGGLE_WRAP:
             ResultDock::_wrapEnabled = !ResultDock::_wrapEnabled;
@@ -3134,6 +4292,12 @@ void ResultDock::onNppNotification(const SCNotification* notify)
     if (!notify)
         return;
 
+    if (notify->nmhdr.code == SCN_MODIFIED)
+    {
+        trackDocumentEdit(notify);
+        return;
+    }
+
     if (!s_pending.active || s_pending.path.empty())
         return;
 
@@ -3163,6 +4327,91 @@ void ResultDock::onNppNotification(const SCNotification* notify)
     }
 }
 
+// ------------------- Edit Tracking ------------------------
+
+// Keep the stored hit positions on the text while the user edits a file
+// that has results. Only the active view is followed: a document shown in
+// both views reports every change twice. Edits made with modification
+// events off are not seen here: Replace All reports its replacements
+// itself (trackReplacement); after any other (FlowTab padding, column
+// and line deletes) navigation falls back to the line re-search.
+void ResultDock::trackDocumentEdit(const SCNotification* notify)
+{
+    if (_hits.empty() || !(notify->modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT)))
+        return;
+
+    HWND hEd = notify->nmhdr.hwndFrom;
+    int whichView = 0;
+    ::SendMessage(nppData._nppHandle, NPPM_GETCURRENTSCINTILLA, 0, reinterpret_cast<LPARAM>(&whichView));
+    if (hEd != ((whichView == 0) ? nppData._scintillaMainHandle : nppData._scintillaSecondHandle))
+        return;
+
+    // Replacing the whole text (reload from disk, select all + undo) keeps
+    // the hits where they were instead of collapsing them to the start.
+    const bool inserted = (notify->modificationType & SC_MOD_INSERTTEXT) != 0;
+    if (notify->position == 0) {
+        const Sci_Position docLen = ::SendMessage(hEd, SCI_GETLENGTH, 0, 0);
+        if (inserted ? docLen == notify->length : docLen == 0)
+            return;
+    }
+
+    wchar_t cur[MAX_PATH] = {};
+    ::SendMessage(nppData._nppHandle, NPPM_GETFULLCURRENTPATH, MAX_PATH, reinterpret_cast<LPARAM>(cur));
+    if (!cur[0])
+        return;
+
+    const ResultHitStore::Pos delta = inserted
+        ? notify->length : -static_cast<ResultHitStore::Pos>(notify->length);
+    for (const std::uint32_t id : trackedFileIds(cur))
+        _hits.shiftPositions(id, notify->position, delta);
+}
+
+void ResultDock::beginReplaceAllTracking()
+{
+    _replaceAllIds.clear();
+    if (_hits.empty()) return;
+
+    wchar_t cur[MAX_PATH] = {};
+    ::SendMessage(nppData._nppHandle, NPPM_GETFULLCURRENTPATH, MAX_PATH, reinterpret_cast<LPARAM>(cur));
+    if (cur[0])
+        _replaceAllIds = trackedFileIds(cur);
+}
+
+// One replacement moves what follows it by the length difference. A match
+// at its start stays there; others inside the replaced text stay in the
+// replacement, or collapse onto its end when it is shorter. Undo comes
+// back as SCN_MODIFIED and moves them like any other edit.
+void ResultDock::trackReplacement(Sci_Position pos, Sci_Position removed, Sci_Position inserted)
+{
+    if (_replaceAllIds.empty() || removed == inserted) return;
+
+    const ResultHitStore::Pos at = pos + (std::min)(removed, inserted);
+    for (const std::uint32_t id : _replaceAllIds)
+        _hits.shiftPositions(id, at, inserted - removed);
+}
+
+void ResultDock::endReplaceAllTracking()
+{
+    _replaceAllIds.clear();
+}
+
+// Ids of every stored path equal to `path`; cached across keystrokes and
+// rebuilt on a tab switch or when a search adds files.
+const std::vector<std::uint32_t>& ResultDock::trackedFileIds(const std::wstring& path)
+{
+    if (_trackedFileCount == _hits.fileCount() && _wcsicmp(_trackedPath.c_str(), path.c_str()) == 0)
+        return _trackedIds;
+
+    _trackedPath = path;
+    _trackedFileCount = _hits.fileCount();
+    _trackedIds.clear();
+    const std::string pathUtf8 = Encoding::wstringToUtf8(path);
+    for (std::uint32_t id = 0; id < _hits.fileCount(); ++id)
+        if (pathsEqualUtf8(_hits.filePath(id), pathUtf8))
+            _trackedIds.push_back(id);
+    return _trackedIds;
+}
+
 // ------------------- Color Utilities ----------------------
 
 COLORREF ResultDock::hslToRgb(double hue01, double s, double l)
@@ -20,11 +20,15 @@
 
 #include <windows.h>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <functional>
 #include <unordered_map>
 
 #include "Encoding.h"
+#include "ResultExport.h"
+#include "ResultFilter.h"
+#include "ResultHitStore.h"
 #include "Sci_Position.h"
 #include "PluginDefinition.h"
 #include "StaticDialog/DockingDlgInterface.h"
@@ -39,7 +43,8 @@ class ResultDock final
 {
 public:
     // --------------------- Hit definition ---------------------
-    // Represents one visible "Line N:" entry in the dock
+    // One match as produced by a search. The dock interns it into its
+    // ResultHitStore; hitAt() materializes it again for navigation.
     struct Hit
     {
         std::string  fullPathUtf8;
@@ -59,21 +64,8 @@ public:
 
         std::wstring findTextW;
 
-        std::vector<std::wstring> allFindTexts;
-        std::vector<Sci_Position> allPositions;
-        std::vector<Sci_Position> allLengths;
-        std::vector<int>          allSearchFlags;
-
-        int displayLineStart{ -1 };
-        int numberStart{ 0 };
-        int numberLen{ 0 };
-
-        std::vector<int> matchStarts;
-        std::vector<int> matchLens;
-
-        std::vector<int> matchColors;
-
         int colorIndex{ -1 };
+        int listIndex{ -1 };             // list entry that found it; -1 = no list
     };
 
     // Cursor position info for navigation anchoring
@@ -87,6 +79,7 @@ public:
     // search block as the given hitIndex.  Both bounds are inclusive.
     struct BlockRange { size_t first = 0; size_t last = 0; bool valid = false; };
     BlockRange getBlockRangeForHit(size_t hitIndex) const;
+    BlockRange getBlockRangeAtLine(int line) const;
 
     // Get hit index at a specific line start position (for double-click navigation)
     // Returns SIZE_MAX if no hit found at that position
@@ -113,16 +106,61 @@ public:
     void onThemeChanged();     // Called on N++ dark mode toggle
     void updateTabIcon();      // Update tab icon for current theme
 
-    const std::vector<Hit>& hits() const { return _hits; }
+    // One row per visible "Line N:" entry; see ResultHitStore.
+    const ResultHitStore& hits() const { return _hits; }
+
+    // Hit for a match of the given row (default: the row's first match).
+    Hit hitAt(size_t rowIndex, size_t matchIndex = SIZE_MAX) const;
+
+    // Render the deferred lines in front of a pending row so it has a
+    // real dock position (navigation to a hit that was never shown).
+    void ensureRowRendered(size_t rowIndex);
 
     // Check if ResultDock has any hits for a given file path
     bool hasHitsForFile(const std::string& fullPathUtf8) const;
 
+    // Replace All edits the current document with modification events
+    // off, so trackDocumentEdit does not see it. The panel reports each
+    // replacement in between instead: [pos, pos + removed) became
+    // `inserted` bytes.
+    void beginReplaceAllTracking();
+    void trackReplacement(Sci_Position pos, Sci_Position removed, Sci_Position inserted);
+    void endReplaceAllTracking();
+
+    // Write one record per stored match to `path`, deferred lines
+    // included, without rendering them. outCount receives the number of
+    // records; false when the file cannot be written.
+    bool exportHits(const std::wstring& path, ResultExportWriter::Format format, size_t& outCount);
+
+    // Put the rows [first, end) that pass `filter` on top as a new search
+    // block, built from the stored lines without reopening any file. Only
+    // matches of the filter's rule are kept. outHits / outFiles receive
+    // the counts shown in the header. Returns false and adds nothing when
+    // the text regex failed on a line; outError has the reason.
+    bool refineHits(const ResultFilter& filter, size_t first, size_t end,
+        const std::wstring& label, size_t& outHits, size_t& outFiles, std::string& outError);
+
     static bool  wrapEnabled() { return _wrapEnabled; }
     static bool  purgeEnabled() { return _purgeOnNextSearch; }
     static void  setWrapEnabled(bool v) { _wrapEnabled = v; }
     static void  setPurgeEnabled(bool v) { _purgeOnNextSearch = v; }
 
+    // Memory ceiling for the dock's result data in MB (0 = unlimited).
+    // Half of it goes to the hit columns, half to deferred lines; beyond
+    // that both spill to a temp file (see ResultSpill.h).
+    static int   memoryLimitMB() { return _memoryLimitMB; }
+    static void  setMemoryLimitMB(int mb) { _memoryLimitMB = (mb < 0) ? 0 : mb; }
+
+    // Caps on the retained search history (0 = no cap). After a new block
+    // goes in, the oldest searches are evicted until every cap holds
+    // again; pinned searches and the newest one are never evicted.
+    static int   historyMaxSearches() { return _historyMaxSearches; }
+    static int   historyMaxHits() { return _historyMaxHits; }
+    static int   historyMaxMB() { return _historyMaxMB; }
+    static void  setHistoryMaxSearches(int n) { _historyMaxSearches = (n < 0) ? 0 : n; }
+    static void  setHistoryMaxHits(int n) { _historyMaxHits = (n < 0) ? 0 : n; }
+    static void  setHistoryMaxMB(int mb) { _historyMaxMB = (mb < 0) ? 0 : mb; }
+
     // Per-entry coloring option (colors matches based on list entry)
     static bool  perEntryColorsEnabled() { return _perEntryColorsEnabled; }
     static void  setPerEntryColorsEnabled(bool v) { _perEntryColorsEnabled = v; }
@@ -158,7 +196,9 @@ public:
 
     // ------------------- FlowTab Position Adjustment -----------
     // Adjust stored hit positions when FlowTabs insert/remove padding characters.
-    // paddingRanges: pairs of (startPos, length) for each padding range, collected
+    // Padding is applied with modification events off, so it is not seen by
+    // the edit tracking in onNppNotification.
+    // paddingRanges: pairs of (startPos, endPos) for each padding range, collected
     //   BEFORE removal (for turn-off) or AFTER insertion (for turn-on).
     // added: true if padding was added (positions shift forward), false if removed (shift back).
     void adjustHitPositionsForFlowTab(const std::string& filePathUtf8,
@@ -218,24 +258,114 @@ private:
     void applyTheme();
 
     // -------- Range styling / folding (partial updates) -------
-    void applyStylingRange(Sci_Position pos0, Sci_Position len, const std::vector<Hit>& newHits) const;
+    // Both take the text that was just put at pos0 / firstLine and work
+    // from it and the hit arrays, so their cost follows the new lines
+    // only, not the size of the dock.
+    void applyStylingRange(Sci_Position pos0, const std::string& dockTextU8, const ResultHitStore& hits,
+        size_t firstRow = 0, size_t endRow = SIZE_MAX) const;
     void rebuildFoldingRange(int firstLine, int lastLine, const std::string& dockTextU8) const;
 
+    // Indicator ranges in display order. Touching or overlapping ranges
+    // are merged, so a run of adjacent lines or matches costs one fill.
+    struct IndicatorRuns {
+        std::vector<std::pair<Sci_Position, Sci_Position>> runs;  // [start, end)
+        void add(Sci_Position start, Sci_Position len);
+    };
+    void fillIndicatorRuns(int indicator, const IndicatorRuns& runs) const;
+    void fillMatchIndicators(const ResultHitStore& hits, size_t firstRow, size_t endRow) const;
+
     // ---------------- Block building / insertion --------------
-    void prependBlock(const std::string& dockTextU8, std::vector<Hit>& newHits);
+    // Returns the number of lines inserted (deferred lines not counted).
+    int  prependBlock(const std::string& dockTextU8, ResultHitStore& newHits);
     void collapseOldSearches();
 
+    // ---------------- Deferred (lazy) hit lines ---------------
+    // Hit lines beyond the eager budget of one insertion are kept out of
+    // Scintilla. A placeholder line ("... N more hits") stands in for the
+    // rest of a file body and carries the entry id in its line state; the
+    // lines are rendered chunk-wise once the placeholder scrolls into view
+    // or its fold is expanded. Hit lines are cleaned as they render: rows
+    // built past the eager budget hold their document text as found (see
+    // formatHitsLines).
+    //
+    // Above the memory ceiling the text goes to the spill file as one
+    // record per render chunk; textU8 is then empty and offsets still
+    // count bytes of the whole text.
+    struct DeferredLines {
+        std::string      textU8;            // remaining body lines, CRLF-terminated
+        size_t           size = 0;          // bytes of the whole text
+        size_t           consumed = 0;      // bytes of textU8 already rendered
+        std::vector<int> rowOffsets;        // byte offset of each pending row in textU8
+        size_t           rowsConsumed = 0;
+        size_t           matchesLeft = 0;   // shown in the placeholder caption
+        std::vector<std::pair<uint64_t, uint32_t>> chunks;  // spilled records (offset, bytes)
+        size_t           nextChunk = 0;     // first chunk not rendered yet
+    };
+
+    static constexpr int kEagerBodyLines = 1000;    // body lines inserted at once per block
+    static constexpr int kRenderChunkLines = 1000;  // lines rendered per placeholder visit
+    static constexpr int PLACEHOLDER_INDENT = 5;    // deeper than HitLine: no LineKind, HitLine fold level
+
+    bool deferBodyLines(const std::string& dockTextU8, ResultHitStore& rows,
+        std::string& outShownU8, std::vector<std::pair<int, int>>& outPlaceholders);
+    std::string placeholderLineU8(size_t matchesLeft) const;
+    bool renderDeferredChunk(int placeholderLine);
+    int  nextDeferredChunk(DeferredLines& d, std::string& outU8);
+    static size_t deferredChunkEnd(const std::string& text, size_t from, int& lines);
+    void spillDeferred(DeferredLines& d);
+    void releaseDeferred(DeferredLines& d);
+    static void applyMemoryLimit(ResultHitStore& store);
+    int  firstVisibleDeferredLine() const;
+    void scheduleDeferredRender();
+    void renderVisibleDeferred();
+    static void appendDeferredHitLines(HWND hSci, int line, std::vector<std::wstring>& out);
+
+    // Append the display form of pending row r, stored as `line` (no EOL):
+    // its "Line N: " prefix, then the cleaned text. An unformatted row's
+    // match spans are converted on the way.
+    void formatDeferredRow(size_t r, std::string_view line, std::string& out);
+
+    // ------------------- Result history -----------------------
+    // Search header lines, newest (top) first, found through the fold
+    // levels. A pinned search carries MARKER_PINNED on its header line;
+    // markers travel with the text, so no line bookkeeping is needed.
+    static constexpr int MARKER_PINNED = 20;
+
+    std::vector<int> collectSearchHeaders() const;
+    int    searchHeaderAtLine(int line) const;  // -1 outside of a search block
+    bool   isPinned(int headerLine) const;
+    void   togglePinAtLine(int line);
+    void   trimHistory();
+    int    evictLines(int firstLine, int endLine);  // returns the lines removed
+    size_t historyBytes() const;
+    void   updateHistoryInfo(size_t searches);
+
+    // Visit rows [first, end) in display order with their dock line
+    // (without EOL), pending rows included in the form they render in;
+    // fn returns false to stop.
+    using RowLineFn = std::function<bool(size_t row, std::string_view line)>;
+    bool forEachRowLine(size_t first, size_t end, const RowLineFn& fn);
+
+    // ------------------- Edit Tracking ------------------------
+    void trackDocumentEdit(const SCNotification* notify);
+    const std::vector<std::uint32_t>& trackedFileIds(const std::wstring& path);
+
     // ---------------------- Formatting ------------------------
     void buildListText(FileMap& files,
         bool groupView,
         const std::wstring& header,
         const SciSendFn& sciSend,
         std::string& outTextU8,
-        std::vector<Hit>& outHits) const;
+        ResultHitStore& outHits,
+        int& bodyLines) const;
 
+    // bodyLines counts the crit headers and hit lines of the block so
+    // far; rows past kEagerBodyLines are left unformatted.
     void formatHitsLines(const SciSendFn& sciSend,
-        std::vector<Hit>& hitsInOut,
-        std::string& outBlockU8) const;
+        const std::vector<Hit>& hits,
+        std::string& outBlockU8,
+        ResultHitStore& outRows,
+        int& bodyLines) const;
 
     // --------------------- Line helpers -----------------------
     enum class LineLevel : int { SearchHdr = 0, FileHdr = 1, CritHdr = 2, HitLine = 3 };
@@ -247,7 +377,6 @@ private:
     static std::wstring getIndentString(LineLevel lvl);
     static std::string  getIndentStringU8(LineLevel lvl);  // ASCII spaces, UTF-8
     static size_t getIndentUtf8Length(LineLevel lvl);
-    static void shiftHits(std::vector<Hit>& v, size_t delta);
     static std::wstring stripHitPrefix(const std::wstring& w);
     static std::wstring pathFromFileHdr(const std::wstring& w);
     static int ancestorFileLine(HWND hSci, int startLine);
@@ -267,6 +396,9 @@ private:
     static void copySelectedLines(HWND hSci);
     static void copySelectedPaths(HWND hSci);
     static void openSelectedPaths(HWND hSci);
+    static void exportResults(HWND hSci);
+    static void refineResults(HWND hSci);
+    static bool showRefineDialog(HWND owner);
     static void copyTextToClipboard(HWND owner, const std::wstring& w);
     static void deleteSelectedItems(HWND hSci);
 
@@ -343,7 +475,10 @@ private:
         IDM_RD_COPY_PATHS = 60007,
         IDM_RD_OPEN_PATHS = 60008,
         IDM_RD_TOGGLE_WRAP = 60009,
-        IDM_RD_TOGGLE_PURGE = 60010
+        IDM_RD_TOGGLE_PURGE = 60010,
+        IDM_RD_EXPORT = 60011,
+        IDM_RD_REFINE = 60012,
+        IDM_RD_TOGGLE_PIN = 60013
     };
 
     static constexpr int INDIC_LINE_BACKGROUND = 28;
@@ -362,21 +497,40 @@ private:
     HWND      _hDock{ nullptr };
 
     // Core data
-    std::vector<Hit> _hits;
+    ResultHitStore _hits;
     tTbData _dockData{};
+    wchar_t _historyInfo[128] = L"";        // dock caption suffix (pszAddInfo)
 
     // Pending block build state (UTF-8)
     std::string      _pendingText;
-    std::vector<Hit> _pendingHits;
+    ResultHitStore   _pendingHits;
     bool             _groupViewPending = false;
+    int              _pendingBodyLines = 0;     // see formatHitsLines
     bool             _blockOpen = false;
 
     // Track header line indices for collapse logic
     std::vector<int> _searchHeaderLines;
 
+    // Deferred hit lines by placeholder id (line state of the placeholder)
+    std::unordered_map<int, DeferredLines> _deferred;
+    int  _nextDeferredId = 1;
+    bool _deferredRenderQueued = false;
+    size_t _deferredBytesInMemory = 0;
+    ResultSpillFile _spillFile;             // spilled deferred lines
+
+    // File ids of the document being edited (see trackDocumentEdit)
+    std::wstring               _trackedPath;
+    std::vector<std::uint32_t> _trackedIds;
+    size_t                     _trackedFileCount = 0;
+    std::vector<std::uint32_t> _replaceAllIds;    // between begin/endReplaceAllTracking
+
     // UI Option Flags
     inline static bool _wrapEnabled = false;
     inline static bool _purgeOnNextSearch = false;
+    inline static int  _memoryLimitMB = 1024;
+    inline static int  _historyMaxSearches = 100;
+    inline static int  _historyMaxHits = 0;
+    inline static int  _historyMaxMB = 0;
     inline static bool _perEntryColorsEnabled = false;  // Per-entry coloring option
     inline static StatusCallback _statusCallback;
 
@@ -388,8 +542,4 @@ private:
     inline LRESULT S(UINT m, WPARAM w = 0, LPARAM l = 0) const {
         return _sciFn ? _sciFn(_sciPtr, m, w, l) : ::SendMessage(_hSci, m, w, l);
     }
-
-    // O(1) mapping from absolute line start to hit index
-    void rebuildHitLineIndex();
-    std::unordered_map<int, int> _lineStartToHitIndex;
 };
\ No newline at end of file
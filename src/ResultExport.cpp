@@ -0,0 +1,148 @@
+// This file is part of MultiReplace.
+//
+// MultiReplace is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// ResultExport.cpp
+
+#include "ResultExport.h"
+
+namespace {
+
+    bool needsJsonEscape(unsigned char c)
+    {
+        return c < 0x20 || c == '"' || c == '\\';
+    }
+
+    bool needsCsvQuotes(std::string_view s)
+    {
+        for (const char c : s)
+            if (c == ',' || c == '"' || c == '\r' || c == '\n') return true;
+        return false;
+    }
+
+} // namespace
+
+void ResultExportWriter::writeHeader()
+{
+    if (_format == Format::Csv)
+        _buf += "file,line,column,length,match,line_text,rule\r\n";
+}
+
+void ResultExportWriter::write(const Record& r)
+{
+    if (_format == Format::Csv) {
+        appendCsvField(r.file);
+        _buf += ',';
+        appendInt(r.line);
+        _buf += ',';
+        if (r.column > 0) appendInt(r.column);
+        _buf += ',';
+        appendInt(r.length);
+        _buf += ',';
+        appendCsvField(r.matchText);
+        _buf += ',';
+        appendCsvField(r.lineText);
+        _buf += ',';
+        if (r.rule >= 0) appendInt(r.rule);
+        _buf += "\r\n";
+    }
+    else {
+        _buf += "{\"file\":";
+        appendJsonString(r.file);
+        _buf += ",\"line\":";
+        appendInt(r.line);
+        _buf += ",\"column\":";
+        if (r.column > 0) appendInt(r.column); else _buf += "null";
+        _buf += ",\"length\":";
+        appendInt(r.length);
+        _buf += ",\"match\":";
+        appendJsonString(r.matchText);
+        _buf += ",\"line_text\":";
+        appendJsonString(r.lineText);
+        _buf += ",\"rule\":";
+        if (r.rule >= 0) appendInt(r.rule); else _buf += "null";
+        _buf += "}\n";
+    }
+
+    ++_records;
+    if (_buf.size() >= kFlushBytes)
+        flush();
+}
+
+bool ResultExportWriter::flush()
+{
+    if (!_buf.empty() && _out) {
+        _out.write(_buf.data(), static_cast<std::streamsize>(_buf.size()));
+        _written += _buf.size();
+    }
+    _buf.clear();
+    return static_cast<bool>(_out);
+}
+
+// Quoted only when it has to be; quotes inside are doubled.
+void ResultExportWriter::appendCsvField(std::string_view s)
+{
+    if (!needsCsvQuotes(s)) {
+        _buf.append(s.data(), s.size());
+        return;
+    }
+
+    _buf += '"';
+    for (std::size_t pos = 0;;) {
+        const std::size_t q = s.find('"', pos);
+        if (q == std::string_view::npos) {
+            _buf.append(s.data() + pos, s.size() - pos);
+            break;
+        }
+        _buf.append(s.data() + pos, q + 1 - pos);
+        _buf += '"';
+        pos = q + 1;
+    }
+    _buf += '"';
+}
+
+void ResultExportWriter::appendJsonString(std::string_view s)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    _buf += '"';
+    std::size_t run = 0;  // start of the bytes copied as they are
+    for (std::size_t i = 0; i < s.size(); ++i) {
+        const unsigned char c = static_cast<unsigned char>(s[i]);
+        if (!needsJsonEscape(c)) continue;
+
+        _buf.append(s.data() + run, i - run);
+        run = i + 1;
+        switch (c) {
+        case '"':  _buf += "\\\""; break;
+        case '\\': _buf += "\\\\"; break;
+        case '\n': _buf += "\\n"; break;
+        case '\r': _buf += "\\r"; break;
+        case '\t': _buf += "\\t"; break;
+        default:
+            _buf += "\\u00";
+            _buf += hex[c >> 4];
+            _buf += hex[c & 0xF];
+            break;
+        }
+    }
+    _buf.append(s.data() + run, s.size() - run);
+    _buf += '"';
+}
+
+void ResultExportWriter::appendInt(std::int64_t v)
+{
+    char digits[24];
+    int len = 0;
+    const bool neg = v < 0;
+    std::uint64_t u = neg ? ~static_cast<std::uint64_t>(v) + 1 : static_cast<std::uint64_t>(v);
+    do {
+        digits[len++] = static_cast<char>('0' + u % 10);
+        u /= 10;
+    } while (u > 0);
+    if (neg) _buf += '-';
+    while (len > 0) _buf += digits[--len];
+}
@@ -0,0 +1,76 @@
+// This file is part of MultiReplace.
+//
+// MultiReplace is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// ResultExport.h
+// Serializer for exporting result dock hits to CSV or JSON Lines.
+//
+// Copying millions of dock lines through the clipboard builds the whole
+// text twice in memory. The export streams one record per match instead:
+// records are formatted into a small buffer that is written out whenever
+// it fills, so memory stays flat however many hits are exported.
+//
+// Record fields: file, line (1-based), column (1-based, in characters of
+// the line text; 0 = unknown), length (document bytes), match text, line
+// text and rule (0-based list entry of the match; -1 = none). CSV
+// follows RFC 4180 with a header row and CRLF records; unknown column and
+// rule are left empty. JSONL writes one object per line with null for unknowns.
+// Text is passed through as UTF-8.
+//
+// No Windows or Scintilla dependency, so the serializer can be tested and
+// benchmarked headless.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+class ResultExportWriter
+{
+public:
+    enum class Format { Csv, Jsonl };
+
+    struct Record {
+        std::string_view file;
+        int              line = 0;
+        int              column = 0;
+        std::int64_t     length = 0;
+        std::string_view matchText;
+        std::string_view lineText;
+        int              rule = -1;
+    };
+
+    static constexpr std::size_t kFlushBytes = std::size_t{ 1 } << 16;
+
+    ResultExportWriter(std::ostream& out, Format format) : _out(out), _format(format) {}
+    ~ResultExportWriter() { flush(); }
+    ResultExportWriter(const ResultExportWriter&) = delete;
+    ResultExportWriter& operator=(const ResultExportWriter&) = delete;
+
+    // CSV column names; JSONL has no header.
+    void writeHeader();
+    void write(const Record& r);
+
+    // Write out the buffer; false once the stream has failed.
+    bool flush();
+
+    std::uint64_t recordCount() const { return _records; }
+    std::uint64_t bytesWritten() const { return _written + _buf.size(); }
+
+private:
+    void appendCsvField(std::string_view s);
+    void appendJsonString(std::string_view s);
+    void appendInt(std::int64_t v);
+
+    std::ostream& _out;
+    Format        _format;
+    std::string   _buf;
+    std::uint64_t _records = 0;
+    std::uint64_t _written = 0;
+};
@@ -0,0 +1,271 @@
+// This file is part of MultiReplace.
+//
+// MultiReplace is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// ResultFilter.cpp
+
+#include "ResultFilter.h"
+
+#include <algorithm>
+#include <cwctype>
+#include <exception>
+#include <thread>
+
+namespace {
+
+    constexpr std::size_t kMinLinesPerThread = 2048;
+
+    bool isSeparator(char c) { return c == '\\' || c == '/'; }
+
+    char foldPathChar(char c)
+    {
+        if (c == '/') return '\\';
+        return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+
+    std::string_view trim(std::string_view s)
+    {
+        while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+        while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+        return s;
+    }
+
+    bool hasSeparator(std::string_view s)
+    {
+        return std::any_of(s.begin(), s.end(), isSeparator);
+    }
+
+    void foldCase(std::wstring& s)
+    {
+        for (wchar_t& c : s)
+            c = static_cast<wchar_t>(std::towlower(static_cast<std::wint_t>(c)));
+    }
+
+} // namespace
+
+ResultFilter::ResultFilter(const Criteria& criteria)
+    : _rule(criteria.rule)
+{
+    // Same list syntax as the Replace-in-Files filter field
+    std::string_view rest = criteria.pathFilter;
+    while (!rest.empty()) {
+        const std::size_t sep = rest.find(';');
+        std::string_view pattern = trim(rest.substr(0, sep));
+        rest = (sep == std::string_view::npos) ? std::string_view{} : rest.substr(sep + 1);
+        if (pattern.empty()) continue;
+
+        const bool exclude = pattern.front() == '!';
+        if (exclude) pattern = trim(pattern.substr(1));
+        if (pattern.empty() || (!exclude && (pattern == "*" || pattern == "*.*"))) continue;
+        (exclude ? _exclude : _include).emplace_back(pattern);
+    }
+
+    if (criteria.text.empty())
+        return;
+
+    if (criteria.regex) {
+        auto flags = std::regex_constants::ECMAScript;
+        if (!criteria.matchCase) flags |= std::regex_constants::icase;
+        try {
+            _regex.assign(criteria.text, flags);
+            _textKind = TextKind::Regex;
+        }
+        catch (const std::regex_error& e) {
+            _error = e.what();
+        }
+    }
+    else if (criteria.matchCase) {
+        // Case-sensitive literals compare the UTF-8 bytes directly
+        const std::wstring& text = criteria.text;
+        for (std::size_t i = 0; i < text.size(); ++i) {
+            std::uint32_t cp = static_cast<std::uint32_t>(text[i]);
+            if (sizeof(wchar_t) == 2 && cp >= 0xD800 && cp <= 0xDBFF && i + 1 < text.size()) {
+                const std::uint32_t low = static_cast<std::uint32_t>(text[i + 1]);
+                if (low >= 0xDC00 && low <= 0xDFFF) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    ++i;
+                }
+            }
+            if (cp < 0x80) {
+                _needleU8 += static_cast<char>(cp);
+            }
+            else if (cp < 0x800) {
+                _needleU8 += static_cast<char>(0xC0 | (cp >> 6));
+                _needleU8 += static_cast<char>(0x80 | (cp & 0x3F));
+            }
+            else if (cp < 0x10000) {
+                _needleU8 += static_cast<char>(0xE0 | (cp >> 12));
+                _needleU8 += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                _needleU8 += static_cast<char>(0x80 | (cp & 0x3F));
+            }
+            else {
+                _needleU8 += static_cast<char>(0xF0 | (cp >> 18));
+                _needleU8 += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+                _needleU8 += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                _needleU8 += static_cast<char>(0x80 | (cp & 0x3F));
+            }
+        }
+        _textKind = TextKind::Bytes;
+    }
+    else {
+        _needleFolded = criteria.text;
+        foldCase(_needleFolded);
+        _textKind = TextKind::Folded;
+    }
+}
+
+bool ResultFilter::wildcardMatch(std::string_view pattern, std::string_view s)
+{
+    // Greedy with a single backtrack point: the last '*' seen
+    std::size_t p = 0, i = 0;
+    std::size_t starP = std::string_view::npos, starI = 0;
+    while (i < s.size()) {
+        if (p < pattern.size() && pattern[p] == '*') {
+            starP = p++;
+            starI = i;
+        }
+        else if (p < pattern.size() && (pattern[p] == '?' || foldPathChar(pattern[p]) == foldPathChar(s[i]))) {
+            ++p;
+            ++i;
+        }
+        else if (starP != std::string_view::npos) {
+            p = starP + 1;
+            i = ++starI;
+        }
+        else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') ++p;
+    return p == pattern.size();
+}
+
+bool ResultFilter::pathMatches(std::string_view pathUtf8) const
+{
+    std::size_t nameStart = pathUtf8.size();
+    while (nameStart > 0 && !isSeparator(pathUtf8[nameStart - 1])) --nameStart;
+    const std::string_view name = pathUtf8.substr(nameStart);
+
+    auto matches = [&](const std::string& pattern) {
+        return wildcardMatch(pattern, hasSeparator(pattern) ? pathUtf8 : name);
+        };
+
+    if (std::any_of(_exclude.begin(), _exclude.end(), matches))
+        return false;
+    return _include.empty() || std::any_of(_include.begin(), _include.end(), matches);
+}
+
+bool ResultFilter::textMatches(std::string_view lineUtf8, std::wstring& scratch) const
+{
+    switch (_textKind) {
+    case TextKind::None:
+        return true;
+    case TextKind::Bytes:
+        return lineUtf8.find(_needleU8) != std::string_view::npos;
+    case TextKind::Folded:
+        scratch.clear();
+        appendWide(lineUtf8, scratch);
+        foldCase(scratch);
+        return scratch.find(_needleFolded) != std::wstring::npos;
+    case TextKind::Regex:
+        scratch.clear();
+        appendWide(lineUtf8, scratch);
+        return std::regex_search(scratch, _regex);
+    }
+    return false;
+}
+
+bool ResultFilter::matchLines(const std::vector<std::string_view>& lines, std::vector<std::uint8_t>& out,
+    std::string& error, unsigned threads) const
+{
+    out.assign(lines.size(), 1);
+    error.clear();
+    if (_textKind == TextKind::None || lines.empty())
+        return true;
+
+    if (threads == 0) threads = (std::max)(std::thread::hardware_concurrency(), 1u);
+    const std::size_t maxWorkers = (lines.size() + kMinLinesPerThread - 1) / kMinLinesPerThread;
+    const std::size_t workers = (std::max)((std::min)(static_cast<std::size_t>(threads), maxWorkers), std::size_t{ 1 });
+
+    // One error slot per slice. An exception escaping a std::thread
+    // would terminate the process, so nothing may leave `work`.
+    std::vector<std::string> errors(workers);
+    auto work = [&](std::size_t slice, std::size_t begin, std::size_t end) {
+        std::wstring scratch;
+        for (std::size_t i = begin; i < end; ++i) {
+            try {
+                out[i] = textMatches(lines[i], scratch) ? 1 : 0;
+            }
+            catch (const std::exception& e) {
+                out[i] = 0;
+                if (errors[slice].empty()) errors[slice] = e.what();
+            }
+        }
+        };
+
+    if (workers == 1) {
+        work(0, 0, lines.size());
+    }
+    else {
+        // Contiguous slices; the last one is run on this thread
+        const std::size_t per = (lines.size() + workers - 1) / workers;
+        std::vector<std::thread> pool;
+        pool.reserve(workers - 1);
+        for (std::size_t w = 0; w + 1 < workers; ++w)
+            pool.emplace_back(work, w, w * per, (std::min)((w + 1) * per, lines.size()));
+        work(workers - 1, (workers - 1) * per, lines.size());
+        for (std::thread& t : pool) t.join();
+    }
+
+    // First error in line order
+    for (const std::string& e : errors) {
+        if (!e.empty()) {
+            error = e;
+            return false;
+        }
+    }
+    return true;
+}
+
+// UTF-8 to wchar_t (UTF-16 on Windows); malformed bytes become U+FFFD.
+void ResultFilter::appendWide(std::string_view utf8, std::wstring& out)
+{
+    out.reserve(out.size() + utf8.size());
+    for (std::size_t i = 0; i < utf8.size();) {
+        const unsigned char c = static_cast<unsigned char>(utf8[i]);
+        std::uint32_t cp = 0xFFFD;
+        std::size_t len = 1;
+        if (c < 0x80) {
+            cp = c;
+        }
+        else {
+            const std::size_t need = (c >= 0xF0 && c < 0xF8) ? 4 : (c >= 0xE0) ? 3 : (c >= 0xC0) ? 2 : 0;
+            if (need > 0 && i + need <= utf8.size()) {
+                std::uint32_t v = c & (0x7F >> need);
+                std::size_t k = 1;
+                for (; k < need; ++k) {
+                    const unsigned char cc = static_cast<unsigned char>(utf8[i + k]);
+                    if ((cc & 0xC0) != 0x80) break;
+                    v = (v << 6) | (cc & 0x3F);
+                }
+                if (k == need) {
+                    cp = v;
+                    len = need;
+                }
+            }
+        }
+        i += len;
+
+        if (sizeof(wchar_t) == 2 && cp >= 0x10000) {
+            cp -= 0x10000;
+            out += static_cast<wchar_t>(0xD800 + (cp >> 10));
+            out += static_cast<wchar_t>(0xDC00 + (cp & 0x3FF));
+        }
+        else {
+            out += static_cast<wchar_t>(cp);
+        }
+    }
+}
@@ -0,0 +1,93 @@
+// This file is part of MultiReplace.
+//
+// MultiReplace is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// ResultFilter.h
+// Criteria for refining stored result dock hits without searching again.
+//
+// A refine keeps the rows of a search block whose file, line text and
+// list entry pass all given criteria; empty criteria pass everything:
+//
+//   - pathFilter: semicolon-separated wildcards with the syntax of the
+//     Replace-in-Files filter field ("*.cpp;!*Test*"). '*' and '?' match
+//     any run / any single character, case-insensitive for ASCII, '/' and
+//     '\' are the same. A pattern with a separator is matched against the
+//     full path ("C:\src\*"), one without against the file name.
+//   - text: literal or ECMAScript regex searched in the row's line text
+//     as shown in the dock (UTF-8, control characters already blanked).
+//   - rule: 0-based list entry of at least one match; -1 = any.
+//
+// Paths and rules are cheap and checked per file / per match by the
+// caller. The line text test is the expensive part: matchLines() runs it
+// on a batch of lines over all cores. It only reads the batch and the
+// compiled criteria, so the caller collects the lines first and the hit
+// store (not thread-safe once spilled) is never touched by the workers.
+// Exceptions never leave a worker; a failed regex match is reported back
+// to the caller.
+//
+// No Windows or Scintilla dependency, so the filter can be tested and
+// benchmarked headless.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class ResultFilter
+{
+public:
+    struct Criteria {
+        std::string  pathFilter;        // UTF-8
+        std::wstring text;
+        bool         regex = false;
+        bool         matchCase = false;
+        int          rule = -1;
+    };
+
+    explicit ResultFilter(const Criteria& criteria);
+
+    // False when the regex did not compile; error() has the reason.
+    bool valid() const { return _error.empty(); }
+    const std::string& error() const { return _error; }
+
+    bool hasPathFilter() const { return !_include.empty() || !_exclude.empty(); }
+    bool hasTextFilter() const { return _textKind != TextKind::None; }
+    int  rule() const { return _rule; }
+
+    bool pathMatches(std::string_view pathUtf8) const;
+
+    // scratch is reused between calls of one thread.
+    bool textMatches(std::string_view lineUtf8, std::wstring& scratch) const;
+
+    // out[i] = textMatches(lines[i]), evaluated by up to `threads` workers
+    // (0 = one per core). A regex can still throw while matching (the
+    // library gives up on too complex a match); such a line counts as
+    // not matching, the first error goes to `error` and false is returned.
+    bool matchLines(const std::vector<std::string_view>& lines, std::vector<std::uint8_t>& out,
+        std::string& error, unsigned threads = 0) const;
+
+    // Wildcard match of one pattern against a whole string.
+    static bool wildcardMatch(std::string_view pattern, std::string_view s);
+
+private:
+    enum class TextKind { None, Bytes, Folded, Regex };
+
+    static void appendWide(std::string_view utf8, std::wstring& out);
+
+    std::vector<std::string> _include;  // positive patterns
+    std::vector<std::string> _exclude;  // '!' patterns, without the '!'
+    int                      _rule = -1;
+
+    TextKind     _textKind = TextKind::None;
+    std::string  _needleU8;             // Bytes: case-sensitive literal
+    std::wstring _needleFolded;         // Folded: lowercased literal
+    std::wregex  _regex;
+    std::string  _error;
+};
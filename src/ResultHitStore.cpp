@@ -0,0 +1,616 @@
+// This file is part of MultiReplace.
+//
+// MultiReplace is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// ResultHitStore.cpp
+
+#include "ResultHitStore.h"
+
+#include <algorithm>
+#include <climits>
+#include <functional>
+
+namespace {
+
+    template <typename T>
+    std::size_t capacityBytes(const std::vector<T>& v) {
+        return v.capacity() * sizeof(T);
+    }
+
+    // Column share of one hit (one row, one match) for the page budget
+    constexpr std::size_t kBytesPerHit = 4 + 4 + 4 + 2 + 1 + 1 + 4 + 8 + 4 + 4 + 1 + 4 + 2 + 2;
+
+    std::uint16_t clampU16(int v) {
+        if (v < 0) return 0;
+        if (v > 0xFFFF) return 0xFFFF;
+        return static_cast<std::uint16_t>(v);
+    }
+}
+
+std::size_t ResultHitStore::PatternKeyHash::operator()(const Pattern& p) const noexcept
+{
+    return std::hash<std::wstring>{}(p.text) ^ (static_cast<std::size_t>(p.searchFlags) * 0x9E3779B97F4A7C15ull);
+}
+
+// ------------------------- Interning ----------------------
+
+std::uint32_t ResultHitStore::internFile(const std::string& pathUtf8)
+{
+    auto it = _fileIds.find(pathUtf8);
+    if (it != _fileIds.end()) return it->second;
+
+    const auto id = static_cast<std::uint32_t>(_files.size());
+    _files.push_back(pathUtf8);
+    _fileIds.emplace(pathUtf8, id);
+    return id;
+}
+
+std::uint32_t ResultHitStore::internPattern(const std::wstring& findText, int searchFlags)
+{
+    Pattern key{ findText, searchFlags };
+    auto it = _patternIds.find(key);
+    if (it != _patternIds.end()) return it->second;
+
+    const auto id = static_cast<std::uint32_t>(_patterns.size());
+    _patterns.push_back(key);
+    _patternIds.emplace(std::move(key), id);
+    return id;
+}
+
+// ------------------------- Building -----------------------
+
+void ResultHitStore::beginRow(std::uint32_t fileId, int docLine, int displayStart,
+    int numberStart, int numberLen, bool unformatted)
+{
+    if (_blockRowEnd.empty()) {
+        _blockRowEnd.push_back(0);
+        _blockLenEnd.push_back(0);
+    }
+
+    _rowFile.push_back(fileId);
+    _rowDocLine.push_back(docLine);
+    _rowDisplayStart.push_back(displayStart);
+    _rowNumberStart.push_back(clampU16(numberStart));
+    _rowNumberLen.push_back(static_cast<std::uint8_t>((std::min)((std::max)(numberLen, 0), 0xFF)));
+    _rowState.push_back(unformatted ? kRowUnformatted : 0);
+    _rowMatchBegin.push_back(static_cast<std::uint32_t>(_matchPos.size()));
+
+    // New rows land in the newest block (the only one while building)
+    ++_blockRowEnd.back();
+}
+
+void ResultHitStore::addMatch(Pos pos, Pos length, std::uint32_t patternId, int colorIndex, int listIndex,
+    int displayStart, int displayLen)
+{
+    _matchPos.push_back(pos);
+    _matchLen.push_back(static_cast<std::int32_t>((std::min)(length, static_cast<Pos>(INT32_MAX))));
+    _matchPattern.push_back(patternId);
+    _matchColor.push_back(static_cast<std::int8_t>((colorIndex < -1 || colorIndex > 127) ? -1 : colorIndex));
+    _matchList.push_back(listIndex < 0 ? -1 : listIndex);
+    _matchDispStart.push_back(clampU16(displayStart));
+    _matchDispLen.push_back(clampU16(displayLen));
+}
+
+void ResultHitStore::reserve(std::size_t rows, std::size_t matches)
+{
+    _rowFile.reserve(rows);
+    _rowDocLine.reserve(rows);
+    _rowDisplayStart.reserve(rows);
+    _rowNumberStart.reserve(rows);
+    _rowNumberLen.reserve(rows);
+    _rowState.reserve(rows);
+    _rowMatchBegin.reserve(rows);
+
+    _matchPos.reserve(matches);
+    _matchLen.reserve(matches);
+    _matchPattern.reserve(matches);
+    _matchColor.reserve(matches);
+    _matchList.reserve(matches);
+    _matchDispStart.reserve(matches);
+    _matchDispLen.reserve(matches);
+}
+
+// ------------------------- Blocks -------------------------
+
+std::size_t ResultHitStore::slotInBlocks(std::size_t r) const
+{
+    // Display order runs from the newest block (last in storage) to the
+    // oldest. Block b covers display rows [N - rowEnd[b], N - rowEnd[b-1]).
+    const std::size_t n = _rowFile.size();
+    const auto x = static_cast<std::uint32_t>(n - r);
+    const std::size_t b = static_cast<std::size_t>(
+        std::lower_bound(_blockRowEnd.begin(), _blockRowEnd.end(), x) - _blockRowEnd.begin());
+    return blockFirstRow(b) + (r - (n - _blockRowEnd[b]));
+}
+
+std::size_t ResultHitStore::blockOfSlot(std::size_t s) const
+{
+    return static_cast<std::size_t>(
+        std::upper_bound(_blockRowEnd.begin(), _blockRowEnd.end(), static_cast<std::uint32_t>(s)) - _blockRowEnd.begin());
+}
+
+std::size_t ResultHitStore::blockAtDisplay(int pos) const
+{
+    // Block b covers [total - lenEnd[b], total - lenEnd[b-1]); positions
+    // past the end belong to the oldest block, before 0 to the newest.
+    const int y = _blockLenEnd.back() - pos;
+    const std::size_t b = static_cast<std::size_t>(
+        std::lower_bound(_blockLenEnd.begin(), _blockLenEnd.end(), y) - _blockLenEnd.begin());
+    return (std::min)(b, _blockLenEnd.size() - 1);
+}
+
+int ResultHitStore::blockBase(std::size_t block) const
+{
+    return _blockLenEnd.back() - _blockLenEnd[block];
+}
+
+int ResultHitStore::rowDisplayStart(std::size_t r) const
+{
+    if (_blockRowEnd.size() <= 1) return _rowDisplayStart[r];
+    const std::size_t s = slotInBlocks(r);
+    return blockBase(blockOfSlot(s)) + _rowDisplayStart[s];
+}
+
+void ResultHitStore::placeRow(std::size_t r, int displayStart)
+{
+    const std::size_t s = slot(r);
+    _rowDisplayStart.set(s, displayStart - blockBase(blockOfSlot(s)));
+    _rowState.set(s, static_cast<std::uint8_t>(_rowState[s] & ~kRowPending));
+}
+
+void ResultHitStore::deferRow(std::size_t r, int anchor)
+{
+    const std::size_t s = slot(r);
+    _rowDisplayStart.set(s, anchor - blockBase(blockOfSlot(s)));
+    _rowState.set(s, static_cast<std::uint8_t>(_rowState[s] | kRowPending));
+}
+
+void ResultHitStore::markRowFormatted(std::size_t r)
+{
+    const std::size_t s = slot(r);
+    _rowState.set(s, static_cast<std::uint8_t>(_rowState[s] & ~kRowUnformatted));
+}
+
+void ResultHitStore::setMatchDisplay(std::size_t m, int displayStart, int displayLen)
+{
+    _matchDispStart.set(m, clampU16(displayStart));
+    _matchDispLen.set(m, clampU16(displayLen));
+}
+
+std::size_t ResultHitStore::lowerBoundDisplay(int pos) const
+{
+    if (_blockRowEnd.empty()) return 0;
+
+    // Find the block, then search its rows (relative starts are sorted)
+    const std::size_t b = blockAtDisplay(pos);
+    const int rel = pos - blockBase(b);
+    std::size_t lo = blockFirstRow(b);
+    std::size_t hi = _blockRowEnd[b];
+    const std::size_t first = lo;
+    while (lo < hi) {
+        const std::size_t mid = lo + (hi - lo) / 2;
+        if (_rowDisplayStart[mid] < rel) lo = mid + 1;
+        else hi = mid;
+    }
+    return (_rowFile.size() - _blockRowEnd[b]) + (lo - first);
+}
+
+std::size_t ResultHitStore::rowAtDisplayStart(int pos) const
+{
+    const std::size_t r = lowerBoundDisplay(pos);
+    if (r < rowCount() && rowDisplayStart(r) == pos && !rowPending(r))
+        return r;
+    return SIZE_MAX;
+}
+
+// ------------------------- Bulk edits ---------------------
+
+void ResultHitStore::append(const ResultHitStore& other, int displayDelta)
+{
+    if (other.empty()) return;
+    if (_blockRowEnd.empty()) {
+        _blockRowEnd.push_back(0);
+        _blockLenEnd.push_back(0);
+    }
+    // The last display block is the oldest one, first in storage
+    insertRows(other, displayDelta, 0);
+}
+
+void ResultHitStore::prependBlock(const ResultHitStore& other, int blockLength)
+{
+    // A newest block without rows (a lone search header) is folded into
+    // the new one: its bytes simply extend the new block's extent.
+    if (!_blockRowEnd.empty() && _blockRowEnd.back() == blockFirstRow(_blockRowEnd.size() - 1)) {
+        blockLength += _blockLenEnd.back() - (_blockLenEnd.size() > 1 ? _blockLenEnd[_blockLenEnd.size() - 2] : 0);
+        _blockRowEnd.pop_back();
+        _blockLenEnd.pop_back();
+    }
+
+    _blockRowEnd.push_back(static_cast<std::uint32_t>(_rowFile.size()));
+    _blockLenEnd.push_back((_blockLenEnd.empty() ? 0 : _blockLenEnd.back()) + blockLength);
+    insertRows(other, 0, _blockRowEnd.size() - 1);
+}
+
+void ResultHitStore::insertRows(const ResultHitStore& other, int displayDelta, std::size_t block)
+{
+    if (other.empty()) return;
+    flushPositions();
+
+    // Map the other store's ids into this store's tables. Both tables are
+    // small (files and patterns of one search), so this is cheap.
+    std::vector<std::uint32_t> fileMap(other._files.size());
+    for (std::size_t i = 0; i < other._files.size(); ++i)
+        fileMap[i] = internFile(other._files[i]);
+
+    std::vector<std::uint32_t> patternMap(other._patterns.size());
+    for (std::size_t i = 0; i < other._patterns.size(); ++i)
+        patternMap[i] = internPattern(other._patterns[i].text, other._patterns[i].searchFlags);
+
+    const std::size_t at = _blockRowEnd[block];
+    const std::size_t matchAt = (at < _rowFile.size()) ? _rowMatchBegin[at] : _matchPos.size();
+    const std::size_t oldRows = _rowFile.size();
+    const std::size_t oldMatches = _matchPos.size();
+
+    // Rows go to the end of the columns in display order, streamed page
+    // by page; an insertion in front of newer blocks then rotates them
+    // into place (only building stores do that).
+    const std::size_t addRows = other.rowCount();
+    for (std::size_t r = 0; r < addRows; ++r) {
+        const std::size_t s = other.slot(r);
+        _rowFile.push_back(fileMap[other._rowFile[s]]);
+        _rowDocLine.push_back(other._rowDocLine[s]);
+        _rowDisplayStart.push_back(other.rowDisplayStart(r) + displayDelta);
+        _rowNumberStart.push_back(other._rowNumberStart[s]);
+        _rowNumberLen.push_back(other._rowNumberLen[s]);
+        _rowState.push_back(other._rowState[s]);
+        _rowMatchBegin.push_back(static_cast<std::uint32_t>(matchAt + (_matchPos.size() - oldMatches)));
+
+        for (std::size_t m = other.matchBegin(r), e = other.matchEnd(r); m < e; ++m) {
+            _matchPos.push_back(other.matchPos(m));
+            _matchLen.push_back(other._matchLen[m]);
+            _matchPattern.push_back(patternMap[other._matchPattern[m]]);
+            _matchColor.push_back(other._matchColor[m]);
+            _matchList.push_back(other._matchList[m]);
+            _matchDispStart.push_back(other._matchDispStart[m]);
+            _matchDispLen.push_back(other._matchDispLen[m]);
+        }
+    }
+    const std::size_t addMatches = _matchPos.size() - oldMatches;
+
+    if (at < oldRows) {
+        _rowFile.rotateTail(at, oldRows);
+        _rowDocLine.rotateTail(at, oldRows);
+        _rowDisplayStart.rotateTail(at, oldRows);
+        _rowNumberStart.rotateTail(at, oldRows);
+        _rowNumberLen.rotateTail(at, oldRows);
+        _rowState.rotateTail(at, oldRows);
+        _rowMatchBegin.rotateTail(at, oldRows);
+
+        _matchPos.rotateTail(matchAt, oldMatches);
+        _matchLen.rotateTail(matchAt, oldMatches);
+        _matchPattern.rotateTail(matchAt, oldMatches);
+        _matchColor.rotateTail(matchAt, oldMatches);
+        _matchList.rotateTail(matchAt, oldMatches);
+        _matchDispStart.rotateTail(matchAt, oldMatches);
+        _matchDispLen.rotateTail(matchAt, oldMatches);
+
+        // Rows stored behind the insertion point now sit behind the new matches
+        for (std::size_t s = at + addRows; s < _rowMatchBegin.size(); ++s)
+            _rowMatchBegin.set(s, _rowMatchBegin[s] + static_cast<std::uint32_t>(addMatches));
+    }
+    for (std::size_t b = block; b < _blockRowEnd.size(); ++b)
+        _blockRowEnd[b] += static_cast<std::uint32_t>(addRows);
+}
+
+void ResultHitStore::shiftDisplay(int delta, int fromPos)
+{
+    if (delta == 0 || _blockRowEnd.empty()) return;
+
+    // Only the block that holds fromPos changes its rows; the blocks
+    // behind it move through its length.
+    const std::size_t b = blockAtDisplay(fromPos);
+    const int rel = fromPos - blockBase(b);
+    for (std::size_t s = blockFirstRow(b); s < _blockRowEnd[b]; ++s)
+        if (_rowDisplayStart[s] >= rel) _rowDisplayStart.set(s, _rowDisplayStart[s] + delta);
+    for (std::size_t j = b; j < _blockLenEnd.size(); ++j)
+        _blockLenEnd[j] += delta;
+}
+
+void ResultHitStore::eraseDisplayRange(int p0, int p1)
+{
+    if (p1 <= p0 || _blockRowEnd.empty()) return;
+    flushPositions();
+
+    const std::size_t blocks = _blockRowEnd.size();
+    std::vector<std::uint32_t> rowEnd;
+    std::vector<std::int32_t>  len;
+    rowEnd.reserve(blocks);
+    len.reserve(blocks);
+
+    // Compact rows and their match runs in place, keeping order. Each
+    // block loses the part of [p0, p1) that overlaps it.
+    std::size_t rowOut = 0;
+    std::size_t matchOut = 0;
+    for (std::size_t b = 0; b < blocks; ++b) {
+        const int base = blockBase(b);
+        const int blockLen = _blockLenEnd[b] - (b ? _blockLenEnd[b - 1] : 0);
+        const int rel0 = (std::max)(p0 - base, 0);
+        const int rel1 = p1 - base;
+        const int cut = (std::max)(rel1 - rel0, 0);
+        // The oldest block runs to the end of the dock whatever its length
+        const int extent = b ? blockLen : INT_MAX;
+
+        for (std::size_t r = blockFirstRow(b); r < _blockRowEnd[b]; ++r) {
+            const int d = _rowDisplayStart[r];
+            const std::size_t mb = _rowMatchBegin[r];
+            const std::size_t me = (r + 1 < _rowMatchBegin.size()) ? _rowMatchBegin[r + 1] : _matchPos.size();
+            if (d >= rel0 && d < rel1) continue;
+
+            _rowFile.set(rowOut, _rowFile[r]);
+            _rowDocLine.set(rowOut, _rowDocLine[r]);
+            _rowDisplayStart.set(rowOut, (d >= rel1) ? d - cut : d);
+            _rowNumberStart.set(rowOut, _rowNumberStart[r]);
+            _rowNumberLen.set(rowOut, _rowNumberLen[r]);
+            _rowState.set(rowOut, _rowState[r]);
+            _rowMatchBegin.set(rowOut, static_cast<std::uint32_t>(matchOut));
+
+            for (std::size_t m = mb; m < me; ++m, ++matchOut) {
+                _matchPos.set(matchOut, _matchPos[m]);
+                _matchLen.set(matchOut, _matchLen[m]);
+                _matchPattern.set(matchOut, _matchPattern[m]);
+                _matchColor.set(matchOut, _matchColor[m]);
+                _matchList.set(matchOut, _matchList[m]);
+                _matchDispStart.set(matchOut, _matchDispStart[m]);
+                _matchDispLen.set(matchOut, _matchDispLen[m]);
+            }
+            ++rowOut;
+        }
+
+        rowEnd.push_back(static_cast<std::uint32_t>(rowOut));
+        len.push_back(blockLen - (std::max)((std::min)(rel1, extent) - rel0, 0));
+    }
+
+    _rowFile.resize(rowOut);
+    _rowDocLine.resize(rowOut);
+    _rowDisplayStart.resize(rowOut);
+    _rowNumberStart.resize(rowOut);
+    _rowNumberLen.resize(rowOut);
+    _rowState.resize(rowOut);
+    _rowMatchBegin.resize(rowOut);
+
+    _matchPos.resize(matchOut);
+    _matchLen.resize(matchOut);
+    _matchPattern.resize(matchOut);
+    _matchColor.resize(matchOut);
+    _matchList.resize(matchOut);
+    _matchDispStart.resize(matchOut);
+    _matchDispLen.resize(matchOut);
+
+    // Rebuild the table. A block left without rows hands its bytes to the
+    // next newer block; the newest one is kept while it still has bytes.
+    _blockRowEnd.clear();
+    _blockLenEnd.clear();
+    int carry = 0;
+    int lenSum = 0;
+    for (std::size_t b = 0; b < blocks; ++b) {
+        const bool noRows = rowEnd[b] == (b ? rowEnd[b - 1] : 0);
+        const int blockLen = len[b] + carry;
+        carry = 0;
+        if (noRows && (b + 1 < blocks || blockLen <= 0)) {
+            carry = blockLen;
+            continue;
+        }
+        lenSum += blockLen;
+        _blockRowEnd.push_back(rowEnd[b]);
+        _blockLenEnd.push_back(lenSum);
+    }
+}
+
+// ------------------------- Edit tracking ------------------
+
+void ResultHitStore::PositionIndex::add(std::size_t slot, Pos d)
+{
+    for (std::size_t i = slot + 1; i < tree.size(); i += i & (~i + 1))
+        tree[i] += d;
+}
+
+ResultHitStore::Pos ResultHitStore::PositionIndex::delta(std::size_t slot) const
+{
+    Pos sum = 0;
+    for (std::size_t i = slot + 1; i > 0; i -= i & (~i + 1))
+        sum += tree[i];
+    return sum;
+}
+
+ResultHitStore::Pos ResultHitStore::trackedPos(std::size_t m) const
+{
+    return _matchPos[m] + _posIndex->delta(_posIndex->slotOfMatch[m]);
+}
+
+ResultHitStore::Pos ResultHitStore::slotPos(std::size_t slot) const
+{
+    return _matchPos[_posIndex->matchOfSlot[slot]] + _posIndex->delta(slot);
+}
+
+void ResultHitStore::buildPositionIndex()
+{
+    auto ix = std::make_unique<PositionIndex>();
+    const std::size_t n = _matchPos.size();
+
+    // Bucket the matches by file, then sort each file's run by position
+    std::vector<std::uint32_t> fileOfMatch(n);
+    std::vector<Pos> pos(n);
+    ix->fileBegin.assign(_files.size() + 1, 0);
+    for (std::size_t s = 0; s < _rowFile.size(); ++s) {
+        const std::uint32_t f = _rowFile[s];
+        const std::size_t e = (s + 1 < _rowMatchBegin.size()) ? _rowMatchBegin[s + 1] : n;
+        for (std::size_t m = _rowMatchBegin[s]; m < e; ++m) {
+            fileOfMatch[m] = f;
+            pos[m] = _matchPos[m];
+        }
+        ix->fileBegin[f + 1] += static_cast<std::uint32_t>(e - _rowMatchBegin[s]);
+    }
+    for (std::size_t f = 1; f < ix->fileBegin.size(); ++f)
+        ix->fileBegin[f] += ix->fileBegin[f - 1];
+
+    std::vector<std::uint32_t> next(ix->fileBegin.begin(), ix->fileBegin.end() - 1);
+    ix->matchOfSlot.resize(n);
+    for (std::size_t m = 0; m < n; ++m)
+        ix->matchOfSlot[next[fileOfMatch[m]]++] = static_cast<std::uint32_t>(m);
+    for (std::size_t f = 0; f + 1 < ix->fileBegin.size(); ++f)
+        std::stable_sort(ix->matchOfSlot.begin() + ix->fileBegin[f], ix->matchOfSlot.begin() + ix->fileBegin[f + 1],
+            [&pos](std::uint32_t a, std::uint32_t b) { return pos[a] < pos[b]; });
+
+    ix->slotOfMatch.resize(n);
+    for (std::size_t slot = 0; slot < n; ++slot)
+        ix->slotOfMatch[ix->matchOfSlot[slot]] = static_cast<std::uint32_t>(slot);
+    ix->tree.assign(n + 1, 0);
+    _posIndex = std::move(ix);
+}
+
+void ResultHitStore::flushPositions()
+{
+    if (!_posIndex) return;
+    for (std::size_t slot = 0; slot < _posIndex->matchOfSlot.size(); ++slot) {
+        const Pos d = _posIndex->delta(slot);
+        if (d == 0) continue;
+        const std::size_t m = _posIndex->matchOfSlot[slot];
+        _matchPos.set(m, _matchPos[m] + d);
+    }
+    _posIndex.reset();
+}
+
+void ResultHitStore::shiftPositions(std::uint32_t fileId, Pos pos, Pos delta)
+{
+    if (delta == 0) return;
+    if (!_posIndex) buildPositionIndex();
+
+    PositionIndex& ix = *_posIndex;
+    if (static_cast<std::size_t>(fileId) + 1 >= ix.fileBegin.size()) return;
+    const std::size_t begin = ix.fileBegin[fileId];
+    const std::size_t end = ix.fileBegin[fileId + 1];
+    if (begin == end) return;
+
+    // First slot of the file at or after p; edits keep each run sorted
+    auto firstAtOrAfter = [&](Pos p) {
+        std::size_t lo = begin;
+        std::size_t hi = end;
+        while (lo < hi) {
+            const std::size_t mid = lo + (hi - lo) / 2;
+            if (slotPos(mid) < p) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+        };
+
+    // Range [from, end) of the file's run moves by delta
+    auto shiftRun = [&](std::size_t from, Pos d) {
+        ix.add(from, d);
+        ix.add(end, -d);
+        };
+
+    if (delta > 0) {
+        shiftRun(firstAtOrAfter(pos), delta);
+        return;
+    }
+
+    // Matches inside the removed text collapse onto its start
+    const std::size_t cut = firstAtOrAfter(pos);
+    const std::size_t behind = firstAtOrAfter(pos - delta);
+    for (std::size_t s = cut; s < behind; ++s) {
+        const Pos d = pos - slotPos(s);
+        ix.add(s, d);
+        ix.add(s + 1, -d);
+    }
+    shiftRun(behind, delta);
+}
+
+bool ResultHitStore::hasRowsForFile(std::uint32_t fileId) const
+{
+    for (std::size_t s = 0; s < _rowFile.size(); ++s)
+        if (_rowFile[s] == fileId) return true;
+    return false;
+}
+
+void ResultHitStore::clear()
+{
+    // Swap with empty containers so a cleared dock gives its memory back
+    // (and drops its spill file); the limit stays.
+    const std::size_t limit = _memoryLimit;
+    *this = ResultHitStore{};
+    setMemoryLimit(limit);
+}
+
+// ------------------------- Spill --------------------------
+
+void ResultHitStore::setMemoryLimit(std::size_t bytes)
+{
+    _memoryLimit = bytes;
+    if (bytes == 0) {
+        attachColumns(nullptr);
+        _pager.reset();
+        return;
+    }
+
+    if (!_pager) _pager = std::make_unique<SpillPager>();
+    _pager->pagesPerColumn = bytes / (kBytesPerHit * PagedColumn<std::uint8_t>::kPageSize);
+    attachColumns(_pager.get());
+}
+
+void ResultHitStore::attachColumns(SpillPager* pager)
+{
+    _rowFile.attach(pager);
+    _rowDocLine.attach(pager);
+    _rowDisplayStart.attach(pager);
+    _rowNumberStart.attach(pager);
+    _rowNumberLen.attach(pager);
+    _rowState.attach(pager);
+    _rowMatchBegin.attach(pager);
+
+    _matchPos.attach(pager);
+    _matchLen.attach(pager);
+    _matchPattern.attach(pager);
+    _matchColor.attach(pager);
+    _matchList.attach(pager);
+    _matchDispStart.attach(pager);
+    _matchDispLen.attach(pager);
+}
+
+std::uint64_t ResultHitStore::spilledBytes() const
+{
+    return _pager ? _pager->file.bytesInUse() : 0;
+}
+
+std::uint64_t ResultHitStore::spillReadFailures() const
+{
+    return _pager ? _pager->readFailures : 0;
+}
+
+std::size_t ResultHitStore::memoryBytes() const
+{
+    std::size_t bytes = capacityBytes(_blockRowEnd) + capacityBytes(_blockLenEnd);
+
+    bytes += _rowFile.residentBytes() + _rowDocLine.residentBytes() + _rowDisplayStart.residentBytes()
+        + _rowNumberStart.residentBytes() + _rowNumberLen.residentBytes() + _rowState.residentBytes()
+        + _rowMatchBegin.residentBytes();
+    bytes += _matchPos.residentBytes() + _matchLen.residentBytes() + _matchPattern.residentBytes()
+        + _matchColor.residentBytes() + _matchList.residentBytes() + _matchDispStart.residentBytes() + _matchDispLen.residentBytes();
+
+    if (_posIndex) {
+        bytes += capacityBytes(_posIndex->matchOfSlot) + capacityBytes(_posIndex->slotOfMatch)
+            + capacityBytes(_posIndex->fileBegin) + capacityBytes(_posIndex->tree);
+    }
+
+    // Intern tables: strings stored twice (vector + map key), plus a rough
+    // per-node overhead for the hash maps.
+    constexpr std::size_t kNodeOverhead = 4 * sizeof(void*);
+    for (const auto& f : _files)
+        bytes += 2 * (sizeof(std::string) + f.capacity() + kNodeOverhead);
+    for (const auto& p : _patterns)
+        bytes += 2 * (sizeof(Pattern) + p.text.capacity() * sizeof(wchar_t) + kNodeOverhead);
+
+    return bytes;
+}
@@ -0,0 +1,299 @@
+// This file is part of MultiReplace.
+//
+// MultiReplace is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// ResultHitStore.h
+// Column-wise storage for the hits shown in the result dock.
+//
+// The dock used to keep one struct per "Line N:" row that carried its
+// own UTF-8 path, search text and six per-match vectors. A Find in Files
+// with millions of hits repeated the same path and pattern millions of
+// times and paid several heap blocks per row. The store keeps:
+//
+//   - one interned table of file paths and one of patterns (search text
+//     plus Scintilla search flags); rows and matches refer to them by id,
+//   - per-row columns: file id, document line, dock position of the row
+//     and the line-number span inside it,
+//   - per-match columns in one shared array: 64-bit document position,
+//     length, pattern id, color slot, list entry and the highlighted span
+//     in the row.
+//
+// The color slot is clamped to the slots the dock can color, so several
+// list entries can share one. The list entry is the index of the list row
+// that found the match (-1 outside list searches); exports report it
+// and refine filters on it.
+//
+// Row r owns matches [matchBegin(r), matchEnd(r)). The first match of a
+// row is its primary hit, the one a double-click navigates to. Matches
+// that fall behind the display cap of a long line keep a zero display
+// length; they are still navigable, just not highlighted.
+//
+// Display positions are kept per block. A block is one insertion into
+// the dock; its rows store positions relative to the block start, and a
+// small block table (cumulative row counts and byte lengths) maps blocks
+// to absolute dock positions. Blocks are stored oldest first, so putting
+// a new search on top of the dock appends its rows and one table entry:
+// no existing row is touched, and older blocks move only through the
+// lengths in front of them. Row indices in the API are in display order.
+//
+// Rows the dock has not rendered yet (see ResultDock's deferred lines)
+// are marked pending. A pending row keeps its place in display order and
+// points at the placeholder line that stands in for it until rendered.
+// A row built for deferral may also be unformatted: its dock line still
+// holds the document text as found, and the display columns of its
+// matches hold byte offsets into that text. The dock formats it (and
+// rewrites the spans) when the row leaves the deferral.
+//
+// Document edits move matches through a position index: matches sorted
+// by file and position with a Fenwick tree of deltas over that order, so
+// an edit shifts every later match of its file in O(log n). The index is
+// built on the first edit and folded back into the position column by
+// the next bulk edit.
+//
+// The columns are paged (see ResultSpill.h). With a memory limit set,
+// pages beyond the limit go to a temp file and are read back when an
+// accessor touches them; then even const access must stay on one thread.
+//
+// No Windows or Scintilla dependency, so the store can be tested and
+// benchmarked headless.
+
+#pragma once
+
+#include "ResultSpill.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class ResultHitStore
+{
+public:
+    using Pos = std::int64_t;
+
+    static constexpr std::uint32_t kNoId = 0xFFFFFFFFu;
+
+    // ------------------------- Interning ----------------------
+    std::uint32_t internFile(const std::string& pathUtf8);
+    std::uint32_t internPattern(const std::wstring& findText, int searchFlags);
+
+    const std::string& filePath(std::uint32_t fileId) const { return _files[fileId]; }
+    std::size_t fileCount() const { return _files.size(); }
+
+    // ------------------------- Building -----------------------
+    // Open a new row; matches added afterwards belong to it. Building
+    // stores hold a single block, so displayStart is absolute there.
+    void beginRow(std::uint32_t fileId, int docLine, int displayStart,
+        int numberStart, int numberLen, bool unformatted = false);
+
+    // Add a match to the current row. displayStart is relative to the
+    // row start; displayLen == 0 marks a match that is not highlighted.
+    // listIndex is the list entry that found it, -1 for none.
+    void addMatch(Pos pos, Pos length, std::uint32_t patternId, int colorIndex, int listIndex,
+        int displayStart, int displayLen);
+
+    void reserve(std::size_t rows, std::size_t matches);
+
+    // ------------------------- Rows ---------------------------
+    std::size_t rowCount() const { return _rowFile.size(); }
+    bool empty() const { return _rowFile.empty(); }
+
+    std::uint32_t rowFileId(std::size_t r) const { return _rowFile[slot(r)]; }
+    const std::string& rowFilePath(std::size_t r) const { return _files[_rowFile[slot(r)]]; }
+    int rowDocLine(std::size_t r) const { return _rowDocLine[slot(r)]; }
+    int rowDisplayStart(std::size_t r) const;
+    int rowNumberStart(std::size_t r) const { return _rowNumberStart[slot(r)]; }
+    int rowNumberLen(std::size_t r) const { return _rowNumberLen[slot(r)]; }
+
+    bool rowPending(std::size_t r) const { return (_rowState[slot(r)] & kRowPending) != 0; }
+    bool rowUnformatted(std::size_t r) const { return (_rowState[slot(r)] & kRowUnformatted) != 0; }
+
+    // The row's line was formatted and its spans rewritten (setMatchDisplay).
+    void markRowFormatted(std::size_t r);
+
+    // Rendered rows get their real display start; pending rows all point
+    // at the start of the placeholder line that covers them.
+    void placeRow(std::size_t r, int displayStart);
+    void deferRow(std::size_t r, int anchor);
+
+    // First row whose display start is >= pos (rows are kept in display
+    // order): a binary search over the block table, then within the block.
+    std::size_t lowerBoundDisplay(int pos) const;
+
+    // Row whose line starts exactly at pos, or SIZE_MAX (pending rows have
+    // no line of their own).
+    std::size_t rowAtDisplayStart(int pos) const;
+
+    std::size_t matchBegin(std::size_t r) const { return _rowMatchBegin[slot(r)]; }
+    std::size_t matchEnd(std::size_t r) const {
+        const std::size_t s = slot(r);
+        return (s + 1 < _rowMatchBegin.size()) ? _rowMatchBegin[s + 1] : _matchPos.size();
+    }
+
+    // ------------------------- Matches ------------------------
+    std::size_t matchCount() const { return _matchPos.size(); }
+
+    Pos matchPos(std::size_t m) const { return _posIndex ? trackedPos(m) : _matchPos[m]; }
+    Pos matchLength(std::size_t m) const { return _matchLen[m]; }
+    std::uint32_t matchPatternId(std::size_t m) const { return _matchPattern[m]; }
+    const std::wstring& matchFindText(std::size_t m) const { return _patterns[_matchPattern[m]].text; }
+    int matchSearchFlags(std::size_t m) const { return _patterns[_matchPattern[m]].searchFlags; }
+    int matchColor(std::size_t m) const { return _matchColor[m]; }
+    int matchListIndex(std::size_t m) const { return _matchList[m]; }
+    int matchDisplayStart(std::size_t m) const { return _matchDispStart[m]; }
+    int matchDisplayLen(std::size_t m) const { return _matchDispLen[m]; }
+    void setMatchDisplay(std::size_t m, int displayStart, int displayLen);
+
+    // ------------------------- Bulk edits ---------------------
+    // Move every row of `other` behind the rows of this store (into its
+    // last display block), remapping file and pattern ids. displayDelta is
+    // added to the moved rows' display starts.
+    void append(const ResultHitStore& other, int displayDelta);
+
+    // Move every row of `other` into a new block in front of all others.
+    // blockLength is the number of dock bytes the block occupies; older
+    // blocks move back by that much without touching their rows.
+    void prependBlock(const ResultHitStore& other, int blockLength);
+
+    std::size_t blockCount() const { return _blockRowEnd.size(); }
+
+    // Text of `delta` bytes was inserted (or removed) at fromPos: rows of
+    // that block at or after fromPos move, later blocks follow its length.
+    void shiftDisplay(int delta, int fromPos = 0);
+
+    // Drop the rows whose display start lies in [p0, p1) and close the
+    // gap by moving the rows behind it back by (p1 - p0).
+    void eraseDisplayRange(int p0, int p1);
+
+    // Rewrite the document positions of every match in the given file.
+    template <typename Fn>
+    void adjustPositions(std::uint32_t fileId, Fn&& fn) {
+        flushPositions();
+        // Storage order: match runs are contiguous per storage row
+        for (std::size_t s = 0; s < _rowFile.size(); ++s) {
+            if (_rowFile[s] != fileId) continue;
+            const std::size_t e = (s + 1 < _rowMatchBegin.size()) ? _rowMatchBegin[s + 1] : _matchPos.size();
+            for (std::size_t m = _rowMatchBegin[s]; m < e; ++m)
+                _matchPos.set(m, fn(_matchPos[m]));
+        }
+    }
+
+    // The document of fileId changed: `delta` bytes were inserted at pos
+    // (delta > 0), or [pos, pos - delta) was removed (delta < 0). Matches
+    // at or after the edit move with the text; matches inside a removed
+    // range collapse to its start.
+    void shiftPositions(std::uint32_t fileId, Pos pos, Pos delta);
+
+    bool hasRowsForFile(std::uint32_t fileId) const;
+
+    void clear();
+
+    // Heap bytes held by the columns and intern tables (capacity based);
+    // spilled pages are not included.
+    std::size_t memoryBytes() const;
+
+    // ------------------------- Spill --------------------------
+    // Keep the columns within roughly `bytes` of memory and spill the
+    // rest to a temp file; 0 (the default) keeps everything in memory.
+    void setMemoryLimit(std::size_t bytes);
+    std::size_t memoryLimit() const { return _memoryLimit; }
+
+    // Bytes currently held in the spill file.
+    std::uint64_t spilledBytes() const;
+
+    // Spilled pages that could not be read back since the limit was set;
+    // their hits read as zeros until a later read succeeds.
+    std::uint64_t spillReadFailures() const;
+
+private:
+    struct Pattern {
+        std::wstring text;
+        int          searchFlags = 0;
+    };
+
+    struct PatternKeyHash {
+        std::size_t operator()(const Pattern& p) const noexcept;
+    };
+    struct PatternKeyEq {
+        bool operator()(const Pattern& a, const Pattern& b) const noexcept {
+            return a.searchFlags == b.searchFlags && a.text == b.text;
+        }
+    };
+
+    void attachColumns(SpillPager* pager);
+
+    // Bits of _rowState
+    static constexpr std::uint8_t kRowPending = 1;
+    static constexpr std::uint8_t kRowUnformatted = 2;
+
+    // Matches in (file, position) order plus a Fenwick tree over that
+    // order holding the position delta of each slot as a prefix sum.
+    struct PositionIndex {
+        std::vector<std::uint32_t> matchOfSlot;
+        std::vector<std::uint32_t> slotOfMatch;
+        std::vector<std::uint32_t> fileBegin;   // first slot of each file id, plus the end
+        std::vector<Pos>           tree;        // 1-based
+
+        void add(std::size_t slot, Pos delta);  // slot and every slot behind it
+        Pos  delta(std::size_t slot) const;
+    };
+
+    Pos  trackedPos(std::size_t m) const;
+    Pos  slotPos(std::size_t slot) const;
+    void buildPositionIndex();
+    void flushPositions();
+
+    // Insert the rows of `other` at the end of storage block `block`.
+    void insertRows(const ResultHitStore& other, int displayDelta, std::size_t block);
+
+    // Display row -> storage index. Building stores (one block) map 1:1.
+    std::size_t slot(std::size_t r) const { return _blockRowEnd.size() <= 1 ? r : slotInBlocks(r); }
+    std::size_t slotInBlocks(std::size_t r) const;
+    std::size_t blockOfSlot(std::size_t s) const;
+    std::size_t blockAtDisplay(int pos) const;
+    int blockBase(std::size_t block) const;
+    std::size_t blockFirstRow(std::size_t block) const { return block ? _blockRowEnd[block - 1] : 0; }
+
+    // Intern tables
+    std::vector<std::string> _files;
+    std::unordered_map<std::string, std::uint32_t> _fileIds;
+    std::vector<Pattern> _patterns;
+    std::unordered_map<Pattern, std::uint32_t, PatternKeyHash, PatternKeyEq> _patternIds;
+
+    // Block table in storage order (oldest block first): cumulative row
+    // counts and cumulative dock byte lengths. A block's display base is
+    // the length of all newer blocks.
+    std::vector<std::uint32_t> _blockRowEnd;
+    std::vector<std::int32_t>  _blockLenEnd;
+
+    // Per-row columns, in storage order
+    PagedColumn<std::uint32_t> _rowFile;
+    PagedColumn<std::int32_t>  _rowDocLine;
+    PagedColumn<std::int32_t>  _rowDisplayStart;   // relative to the row's block
+    PagedColumn<std::uint16_t> _rowNumberStart;
+    PagedColumn<std::uint8_t>  _rowNumberLen;
+    PagedColumn<std::uint8_t>  _rowState;          // kRowPending | kRowUnformatted
+    PagedColumn<std::uint32_t> _rowMatchBegin;
+
+    // Per-match columns
+    PagedColumn<Pos>           _matchPos;
+    PagedColumn<std::int32_t>  _matchLen;
+    PagedColumn<std::uint32_t> _matchPattern;
+    PagedColumn<std::int8_t>   _matchColor;
+    PagedColumn<std::int32_t>  _matchList;
+    PagedColumn<std::uint16_t> _matchDispStart;
+    PagedColumn<std::uint16_t> _matchDispLen;
+
+    // Built by the first shiftPositions, dropped by the next bulk edit
+    std::unique_ptr<PositionIndex> _posIndex;
+
+    // Spill state; the columns point into it, so it lives on the heap and
+    // moves with the store.
+    std::size_t                 _memoryLimit = 0;
+    std::unique_ptr<SpillPager> _pager;
+};
@@ -0,0 +1,175 @@
+// This file is part of MultiReplace.
+//
+// MultiReplace is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// ResultSpill.cpp
+
+#include "ResultSpill.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <system_error>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+    std::mutex& directoryMutex()
+    {
+        static std::mutex m;
+        return m;
+    }
+
+    std::filesystem::path& directoryOverride()
+    {
+        static std::filesystem::path dir;
+        return dir;
+    }
+
+    // Unique name per file within the process; the process id keeps two
+    // Notepad++ instances apart.
+    std::filesystem::path nextSpillPath(const std::filesystem::path& dir)
+    {
+        static std::atomic<unsigned> counter{ 0 };
+#ifdef _WIN32
+        const unsigned long pid = GetCurrentProcessId();
+#else
+        const unsigned long pid = static_cast<unsigned long>(getpid());
+#endif
+        return dir / ("hits-" + std::to_string(pid) + "-" + std::to_string(++counter) + ".spill");
+    }
+}
+
+void ResultSpillFile::setDirectory(const std::filesystem::path& dir)
+{
+    std::lock_guard<std::mutex> lock(directoryMutex());
+    directoryOverride() = dir;
+}
+
+std::filesystem::path ResultSpillFile::directory()
+{
+    std::lock_guard<std::mutex> lock(directoryMutex());
+    if (!directoryOverride().empty()) return directoryOverride();
+    std::error_code ec;
+    return std::filesystem::temp_directory_path(ec) / "MultiReplace" / "spill";
+}
+
+bool ResultSpillFile::open()
+{
+#ifdef _WIN32
+    if (_handle) return true;
+#else
+    if (_fd >= 0) return true;
+#endif
+    if (_failed) return false;
+
+    std::error_code ec;
+    const std::filesystem::path dir = directory();
+    std::filesystem::create_directories(dir, ec);
+    const std::filesystem::path path = nextSpillPath(dir);
+
+#ifdef _WIN32
+    // Deleted by the system when the handle closes, also on a crash
+    HANDLE h = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+        FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+    if (h == INVALID_HANDLE_VALUE) {
+        _failed = true;
+        return false;
+    }
+    _handle = h;
+#else
+    // Unlinked right away; the open descriptor keeps the data alive
+    _fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (_fd < 0) {
+        _failed = true;
+        return false;
+    }
+    ::unlink(path.c_str());
+#endif
+    return true;
+}
+
+std::uint64_t ResultSpillFile::write(const void* data, std::size_t bytes)
+{
+    if (!open()) return kNoOffset;
+
+    // Reuse a released slot of the same size; pages are mostly full
+    std::uint64_t offset = _end;
+    bool reused = false;
+    auto it = _freeSlots.find(bytes);
+    if (it != _freeSlots.end() && !it->second.empty()) {
+        offset = it->second.back();
+        it->second.pop_back();
+        reused = true;
+    }
+
+#ifdef _WIN32
+    OVERLAPPED ov{};
+    ov.Offset = static_cast<DWORD>(offset);
+    ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD written = 0;
+    const bool ok = bytes <= 0xFFFFFFFFu
+        && WriteFile(static_cast<HANDLE>(_handle), data, static_cast<DWORD>(bytes), &written, &ov)
+        && written == bytes;
+#else
+    const bool ok = ::pwrite(_fd, data, bytes, static_cast<off_t>(offset)) == static_cast<ssize_t>(bytes);
+#endif
+    if (!ok) {
+        if (reused) _freeSlots[bytes].push_back(offset);
+        return kNoOffset;
+    }
+
+    if (!reused) _end += bytes;
+    _inUse += bytes;
+    return offset;
+}
+
+bool ResultSpillFile::read(std::uint64_t offset, void* data, std::size_t bytes) const
+{
+    if (bytes == 0) return true;
+#ifdef _WIN32
+    if (!_handle) return false;
+    OVERLAPPED ov{};
+    ov.Offset = static_cast<DWORD>(offset);
+    ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD got = 0;
+    return bytes <= 0xFFFFFFFFu
+        && ReadFile(static_cast<HANDLE>(_handle), data, static_cast<DWORD>(bytes), &got, &ov)
+        && got == bytes;
+#else
+    if (_fd < 0) return false;
+    return ::pread(_fd, data, bytes, static_cast<off_t>(offset)) == static_cast<ssize_t>(bytes);
+#endif
+}
+
+void ResultSpillFile::release(std::uint64_t offset, std::size_t bytes)
+{
+    if (offset == kNoOffset) return;
+    _freeSlots[bytes].push_back(offset);
+    _inUse -= (std::min)(static_cast<std::uint64_t>(bytes), _inUse);
+}
+
+void ResultSpillFile::close()
+{
+#ifdef _WIN32
+    if (_handle) CloseHandle(static_cast<HANDLE>(_handle));
+    _handle = nullptr;
+#else
+    if (_fd >= 0) ::close(_fd);
+    _fd = -1;
+#endif
+    _failed = false;
+    _end = 0;
+    _inUse = 0;
+    _freeSlots.clear();
+}
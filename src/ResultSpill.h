@@ -0,0 +1,324 @@
+// This file is part of MultiReplace.
+//
+// MultiReplace is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// ResultSpill.h
+// Disk spill for very large result sets.
+//
+// A search with tens of millions of hits can outgrow the memory budget
+// of the result dock. Above a configurable ceiling the dock moves hit
+// columns and not yet rendered lines to a temp file and reads them back
+// on demand:
+//
+//   - ResultSpillFile is the temp file: records are written once, read
+//     back by offset and their slots reused after release. It lives in
+//     <temp>/MultiReplace/spill and is deleted when closed (on Windows
+//     also when the process dies).
+//   - PagedColumn<T> is a column split into fixed pages. With a pager
+//     attached, a column keeps at most pagesPerColumn pages in memory
+//     and writes the least recently used one out when it needs room;
+//     evicted pages are faulted back in by the next access.
+//
+// A page that cannot be read back (a short or failed read) stays
+// evicted and is retried by the next access; meanwhile it reads as
+// zeros, changes to it are dropped and SpillPager::readFailures counts
+// the failure so the caller can report it.
+//
+// Without a pager a PagedColumn never touches the disk and behaves like
+// a chunked vector. With one, reads fault pages in, so even const access
+// is not thread-safe.
+//
+// No Windows or Scintilla dependency in the interface, so the spill can
+// be tested headless.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class ResultSpillFile
+{
+public:
+    static constexpr std::uint64_t kNoOffset = ~std::uint64_t{ 0 };
+
+    ResultSpillFile() = default;
+    ~ResultSpillFile() { close(); }
+    ResultSpillFile(const ResultSpillFile&) = delete;
+    ResultSpillFile& operator=(const ResultSpillFile&) = delete;
+
+    // Store a record; returns its offset, or kNoOffset when the file
+    // cannot be created or written (callers then keep the data).
+    std::uint64_t write(const void* data, std::size_t bytes);
+    bool read(std::uint64_t offset, void* data, std::size_t bytes) const;
+
+    // The record's slot may be reused by a later write of the same size.
+    void release(std::uint64_t offset, std::size_t bytes);
+
+    // Bytes of live records.
+    std::uint64_t bytesInUse() const { return _inUse; }
+
+    // Delete the file and forget every record.
+    void close();
+
+    // Directory for spill files; the default is <temp>/MultiReplace/spill.
+    static void setDirectory(const std::filesystem::path& dir);
+    static std::filesystem::path directory();
+
+private:
+    bool open();
+
+#ifdef _WIN32
+    void* _handle = nullptr;
+#else
+    int _fd = -1;
+#endif
+    bool          _failed = false;
+    std::uint64_t _end = 0;
+    std::uint64_t _inUse = 0;
+    std::unordered_map<std::size_t, std::vector<std::uint64_t>> _freeSlots;
+};
+
+// Shared by the columns of one store.
+struct SpillPager
+{
+    ResultSpillFile file;
+    std::size_t     pagesPerColumn = 0;   // resident pages each column may hold
+    std::uint64_t   clock = 0;            // LRU stamp source
+    std::uint64_t   readFailures = 0;     // page reads that failed
+};
+
+template <typename T>
+class PagedColumn
+{
+public:
+    static constexpr std::size_t kPageShift = 14;
+    static constexpr std::size_t kPageSize = std::size_t{ 1 } << kPageShift;
+    static constexpr std::size_t kPageMask = kPageSize - 1;
+
+    PagedColumn() = default;
+    PagedColumn(PagedColumn&& other) noexcept { *this = std::move(other); }
+    PagedColumn& operator=(PagedColumn&& other) noexcept
+    {
+        _pages = std::move(other._pages);
+        _resident = other._resident;
+        _size = other._size;
+        _pager = other._pager;
+        other._pages.clear();
+        other._resident = 0;
+        other._size = 0;
+        other._pager = nullptr;
+        return *this;
+    }
+
+    // Attach (or detach with nullptr) the pager; attaching evicts down to
+    // the pager's budget right away.
+    void attach(SpillPager* pager)
+    {
+        if (!pager) fetchAll();
+        _pager = pager;
+        trim(nullptr);
+    }
+
+    std::size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+
+    T operator[](std::size_t i) const { return page(i >> kPageShift).data[i & kPageMask]; }
+
+    void set(std::size_t i, T v)
+    {
+        Page& p = page(i >> kPageShift);
+        p.data[i & kPageMask] = v;
+        p.dirty = true;
+    }
+
+    void push_back(T v)
+    {
+        if ((_size & kPageMask) == 0) {
+            _pages.emplace_back();
+            ++_resident;
+            trim(&_pages.back());
+        }
+        Page& p = resizablePage(_size >> kPageShift);
+        p.data.push_back(v);
+        p.dirty = true;
+        ++_size;
+    }
+
+    void reserve(std::size_t n) { _pages.reserve((n + kPageMask) >> kPageShift); }
+
+    // Move the elements [from, size) to position at, shifting [at, from)
+    // behind them (rows appended at the end and then put into place).
+    void rotateTail(std::size_t at, std::size_t from)
+    {
+        if (at >= from || from >= _size) return;
+        std::vector<T> tail;
+        tail.reserve(_size - from);
+        for (std::size_t i = from; i < _size; ++i) tail.push_back((*this)[i]);
+        const std::size_t k = tail.size();
+        for (std::size_t i = from; i-- > at;) set(i + k, (*this)[i]);
+        for (std::size_t i = 0; i < k; ++i) set(at + i, tail[i]);
+    }
+
+    // Shrink or grow (with value-initialized elements).
+    void resize(std::size_t n)
+    {
+        while (_size < n) push_back(T{});
+        if (n >= _size) return;
+
+        const std::size_t keepPages = (n + kPageMask) >> kPageShift;
+        for (std::size_t p = keepPages; p < _pages.size(); ++p) dropPage(_pages[p]);
+        _pages.resize(keepPages);
+        if (n & kPageMask) {
+            Page& last = resizablePage(keepPages - 1);
+            last.data.resize(n & kPageMask);
+            last.dirty = true;
+        }
+        _size = n;
+    }
+
+    // Heap bytes of the resident pages.
+    std::size_t residentBytes() const
+    {
+        std::size_t bytes = _pages.capacity() * sizeof(Page);
+        for (const Page& p : _pages) bytes += p.data.capacity() * sizeof(T);
+        return bytes;
+    }
+
+private:
+    struct Page {
+        std::vector<T> data;
+        std::uint64_t  offset = ResultSpillFile::kNoOffset;  // record on disk, if any
+        std::size_t    count = 0;                            // elements while evicted
+        std::uint64_t  lastUse = 0;
+        bool           resident = true;
+        bool           dirty = true;
+    };
+
+    Page& page(std::size_t p) const
+    {
+        Page& pg = _pages[p];
+        if (_pager) {
+            if (!pg.resident && !fault(pg)) {
+                // Unreadable: hand out zeros and keep the page evicted
+                _unreadable.data.assign(pg.count, T{});
+                return _unreadable;
+            }
+            pg.lastUse = ++_pager->clock;
+        }
+        return pg;
+    }
+
+    // page() for changes to the page's size, which cannot go to the
+    // stand-in of an unreadable page: its contents are given up for zeros.
+    Page& resizablePage(std::size_t p)
+    {
+        Page& pg = page(p);
+        if (&pg != &_unreadable) return pg;
+        Page& lost = _pages[p];
+        _pager->file.release(lost.offset, lost.count * sizeof(T));
+        lost.offset = ResultSpillFile::kNoOffset;
+        lost.data.assign(lost.count, T{});
+        lost.resident = true;
+        lost.dirty = true;
+        lost.lastUse = ++_pager->clock;
+        ++_resident;
+        trim(&lost);
+        return lost;
+    }
+
+    // Read the page's record into pg.data, retrying once; counts a
+    // failure and leaves pg.data empty when both reads come up short.
+    bool readBack(Page& pg) const
+    {
+        pg.data.resize(pg.count);
+        const std::size_t bytes = pg.count * sizeof(T);
+        if (_pager->file.read(pg.offset, pg.data.data(), bytes)
+            || _pager->file.read(pg.offset, pg.data.data(), bytes))
+            return true;
+        std::vector<T>().swap(pg.data);
+        ++_pager->readFailures;
+        return false;
+    }
+
+    bool fault(Page& pg) const
+    {
+        if (!readBack(pg)) return false;
+        pg.resident = true;
+        pg.dirty = false;
+        ++_resident;
+        trim(&pg);
+        return true;
+    }
+
+    // Write least recently used pages out until the column fits its budget.
+    void trim(const Page* keep) const
+    {
+        if (!_pager) return;
+        const std::size_t budget = (std::max)(_pager->pagesPerColumn, std::size_t{ 2 });
+        while (_resident > budget) {
+            Page* victim = nullptr;
+            for (Page& p : _pages)
+                if (p.resident && &p != keep && !p.data.empty() && (!victim || p.lastUse < victim->lastUse))
+                    victim = &p;
+            if (!victim || !evict(*victim)) return;
+        }
+    }
+
+    bool evict(Page& pg) const
+    {
+        const std::size_t bytes = pg.data.size() * sizeof(T);
+        if (pg.dirty || pg.offset == ResultSpillFile::kNoOffset) {
+            if (pg.offset != ResultSpillFile::kNoOffset)
+                _pager->file.release(pg.offset, pg.count * sizeof(T));
+            pg.offset = _pager->file.write(pg.data.data(), bytes);
+            if (pg.offset == ResultSpillFile::kNoOffset) return false;  // stays in memory
+        }
+        pg.count = pg.data.size();
+        std::vector<T>().swap(pg.data);
+        pg.resident = false;
+        pg.dirty = false;
+        --_resident;
+        return true;
+    }
+
+    void dropPage(Page& pg)
+    {
+        // count is the size of the record on disk
+        if (_pager && pg.offset != ResultSpillFile::kNoOffset)
+            _pager->file.release(pg.offset, pg.count * sizeof(T));
+        if (pg.resident) --_resident;
+    }
+
+    // Read every evicted page back and give up the records (detaching).
+    // Without a pager a page cannot stay evicted, so one that does not
+    // read back is counted and comes back as zeros.
+    void fetchAll()
+    {
+        if (!_pager) return;
+        for (Page& pg : _pages) {
+            if (pg.offset == ResultSpillFile::kNoOffset) continue;
+            if (!pg.resident) {
+                if (!readBack(pg)) pg.data.assign(pg.count, T{});
+                pg.resident = true;
+                ++_resident;
+            }
+            _pager->file.release(pg.offset, pg.count * sizeof(T));
+            pg.offset = ResultSpillFile::kNoOffset;
+            pg.dirty = true;
+        }
+    }
+
+    mutable std::vector<Page> _pages;
+    mutable std::size_t       _resident = 0;
+    mutable Page              _unreadable;    // stand-in while a page read fails
+    std::size_t               _size = 0;
+    SpillPager*               _pager = nullptr;
+};
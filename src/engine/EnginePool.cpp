@@ -0,0 +1,108 @@
+// This file is part of MultiReplace.
+//
+// MultiReplace is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// EnginePool.cpp
+// Lease bookkeeping for EnginePool. See EnginePool.h for the per-file
+// contract workers follow.
+
+#include "EnginePool.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace MultiReplaceEngine {
+
+    // ---------------------------------------------------------------------
+    // Lease
+    // ---------------------------------------------------------------------
+
+    EnginePool::Lease::Lease(EnginePool* pool, FormulaEnginePtr engine)
+        : _pool(pool)
+        , _engine(std::move(engine))
+    {
+    }
+
+    EnginePool::Lease::Lease(Lease&& other) noexcept
+        : _pool(std::exchange(other._pool, nullptr))
+        , _engine(std::move(other._engine))
+    {
+    }
+
+    EnginePool::Lease& EnginePool::Lease::operator=(Lease&& other) noexcept
+    {
+        if (this != &other) {
+            release();
+            _pool = std::exchange(other._pool, nullptr);
+            _engine = std::move(other._engine);
+        }
+        return *this;
+    }
+
+    EnginePool::Lease::~Lease()
+    {
+        release();
+    }
+
+    void EnginePool::Lease::release()
+    {
+        if (_pool && _engine) {
+            _pool->release(std::move(_engine));
+        }
+        _pool = nullptr;
+        _engine.reset();
+    }
+
+    // ---------------------------------------------------------------------
+    // EnginePool
+    // ---------------------------------------------------------------------
+
+    EnginePool::EnginePool(const IFormulaEngine& prototype, std::size_t capacity)
+        : _prototype(prototype)
+        , _capacity(std::max<std::size_t>(capacity, 1))
+    {
+        _idle.reserve(_capacity);
+    }
+
+    EnginePool::Lease EnginePool::acquire()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _returned.wait(lock, [this] {
+            return !_idle.empty() || _created < _capacity;
+            });
+
+        if (!_idle.empty()) {
+            FormulaEnginePtr engine = std::move(_idle.back());
+            _idle.pop_back();
+            return Lease(this, std::move(engine));
+        }
+
+        // Cloning reads the prototype, so it stays under the lock: two
+        // workers starting at once build their clones one after the other.
+        FormulaEnginePtr engine = _prototype.clone();
+        if (!engine) {
+            return Lease();
+        }
+        ++_created;
+        return Lease(this, std::move(engine));
+    }
+
+    std::size_t EnginePool::created() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _created;
+    }
+
+    void EnginePool::release(FormulaEnginePtr engine)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _idle.push_back(std::move(engine));
+        }
+        _returned.notify_one();
+    }
+
+} // namespace MultiReplaceEngine
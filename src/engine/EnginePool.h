@@ -0,0 +1,105 @@
+// This file is part of MultiReplace.
+//
+// MultiReplace is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// EnginePool.h
+// Bounded set of engine clones for workers that evaluate formulas in
+// parallel, one file per worker at a time.
+//
+// An engine is single-threaded: its match history, run counters and
+// script state belong to one run. The pool hands each worker its own
+// clone of a prototype engine (IFormulaEngine::clone()) and takes it
+// back when the worker is done, creating at most `capacity` clones.
+//
+// Per-file semantics match the serial Replace in Files, which already
+// treats every file as a run of its own:
+//
+//   - The worker calls beginRun() on the leased engine before each
+//     file, runs the init rows, then the file's matches, and reads
+//     endRunSummary() afterwards.
+//   - Match history (numprev, txtout, ...) and the skip counters start
+//     empty for every file; nothing leaks between files or workers.
+//   - seq() and CNT count from 1 within the file.
+//   - rnd()/rndnorm() and math.random are reproducible only when an
+//     init row seeds them (rndseed(n), math.randomseed(n)). The seed
+//     is then applied per file, so each file draws the same sequence
+//     whichever worker processes it. Unseeded streams differ per clone.
+//     ExprTk's rndkey(n) goes further: each draw depends only on the
+//     file, rule and match, so matches may even be split across workers.
+//
+// With these rules a file's output depends only on the file, and the
+// result is the same for one worker as for many.
+
+#pragma once
+
+#include "IFormulaEngine.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace MultiReplaceEngine {
+
+    class EnginePool {
+    public:
+        // Engine on loan to one worker. Returned to the pool when the
+        // lease is destroyed. Empty when the pool could not create a
+        // clone; check with operator bool before use.
+        class Lease {
+        public:
+            Lease() = default;
+            Lease(Lease&& other) noexcept;
+            Lease& operator=(Lease&& other) noexcept;
+            Lease(const Lease&) = delete;
+            Lease& operator=(const Lease&) = delete;
+            ~Lease();
+
+            IFormulaEngine* get() const { return _engine.get(); }
+            IFormulaEngine* operator->() const { return _engine.get(); }
+            explicit operator bool() const { return _engine != nullptr; }
+
+        private:
+            friend class EnginePool;
+            Lease(EnginePool* pool, FormulaEnginePtr engine);
+            void release();
+
+            EnginePool*      _pool = nullptr;
+            FormulaEnginePtr _engine;
+        };
+
+        // The prototype must outlive the pool and must not be used while
+        // acquire() may be creating clones from it. A capacity of 0 is
+        // treated as 1.
+        EnginePool(const IFormulaEngine& prototype, std::size_t capacity);
+
+        EnginePool(const EnginePool&) = delete;
+        EnginePool& operator=(const EnginePool&) = delete;
+
+        // Hand out an idle clone, create one while fewer than capacity
+        // exist, or block until a lease is returned. Clones are created
+        // on first demand, so a pool with few files never builds more
+        // engines than it uses.
+        Lease acquire();
+
+        std::size_t capacity() const { return _capacity; }
+
+        // Number of clones built so far; never exceeds capacity().
+        std::size_t created() const;
+
+    private:
+        void release(FormulaEnginePtr engine);
+
+        const IFormulaEngine&          _prototype;
+        const std::size_t              _capacity;
+
+        mutable std::mutex             _mutex;
+        std::condition_variable        _returned;
+        std::vector<FormulaEnginePtr>  _idle;
+        std::size_t                    _created = 0;
+    };
+
+} // namespace MultiReplaceEngine
@@ -13,6 +13,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -50,6 +51,10 @@ namespace MultiReplaceEngine {
         // regex search. Index 0 corresponds to CAP1 (CAP0 is intentionally
         // omitted; users address captures starting at 1).
         std::vector<std::string> captures;
+
+        // 0-based list row of the rule being evaluated, -1 when the caller
+        // has none. Not exposed to scripts; keys ExprTk's rndkey() mode.
+        int ruleIndex = -1;
     };
 
     // Result handed back from any engine after evaluating a script.
@@ -63,6 +68,17 @@ namespace MultiReplaceEngine {
         bool        outputIsRegexSafe = false;
     };
 
+    // Evaluation budgets the host hands to every engine at beginRun().
+    // Zero disables a limit. The per-match limits bound one execute()
+    // call; the run limit bounds the time spent inside formula code
+    // across one Replace-All, so time spent in host dialogs (debug
+    // window, error prompts) is not charged against it.
+    struct FormulaLimits {
+        std::uint64_t luaInstructionsPerMatch = 0;  // Lua VM instructions
+        std::uint64_t loopIterationsPerMatch = 0;   // ExprTk loop iterations
+        std::uint32_t secondsPerRun = 0;
+    };
+
     // String round-trip for INI persistence. Keeping these inline makes
     // the mapping obvious in one place.
     inline const wchar_t* engineTypeToString(EngineType t) {
@@ -25,9 +25,11 @@
 #include <iomanip>
 #include <limits>
 #include <sstream>
+#include <string_view>
 #include <system_error>
 
 #include "../StringUtils.h"
+#include "../exprtk/BlockDependencyAnalysis.h"
 #include "../exprtk/DateParse.h"
 #include "../exprtk/MatchHistoryAnalysis.h"
 #include "../exprtk/NumberParse.h"
@@ -52,6 +54,22 @@ namespace MultiReplaceEngine {
             return scalar_t(p)();
         }
 
+        // String parameter as a view into ExprTk's own buffer, valid for
+        // the duration of the call. The string built-ins read their
+        // arguments through this instead of copying them: each call's
+        // result goes into the buffer ExprTk keeps per call site, which
+        // holds its capacity from match to match, so a chain like
+        // trim(replace(split(...))) runs without heap allocations once
+        // the buffers have grown to size.
+        template <typename P>
+        inline std::string_view readString(const P& p)
+        {
+            using gen_t = typename exprtk::igeneric_function<double>::generic_type;
+            using string_t = typename gen_t::string_view;
+            const string_t sv(p);
+            return std::string_view(sv.begin(), sv.size());
+        }
+
         // Turn a possibly-fractional, possibly-negative double into a
         // non-negative integral index. Returns false (and leaves out
         // untouched) for NaN, infinity, a value outside the int64 range,
@@ -79,7 +97,7 @@ namespace MultiReplaceEngine {
         inline bool isLeadByte(unsigned char b) { return (b & 0xC0) != 0x80; }
 
         // Number of UTF-8 codepoints in s.
-        inline std::size_t cpLen(const std::string& s)
+        inline std::size_t cpLen(std::string_view s)
         {
             std::size_t n = 0;
             for (unsigned char b : s) if (isLeadByte(b)) ++n;
@@ -88,7 +106,7 @@ namespace MultiReplaceEngine {
 
         // Byte offset of the cp-th codepoint (0-based cp). Returns s.size()
         // if cp is at or past the end.
-        inline std::size_t cpOffset(const std::string& s, std::size_t cp)
+        inline std::size_t cpOffset(std::string_view s, std::size_t cp)
         {
             std::size_t seen = 0;
             for (std::size_t i = 0; i < s.size(); ++i) {
@@ -102,7 +120,7 @@ namespace MultiReplaceEngine {
 
         // Decode the first UTF-8 codepoint of s into out. Returns false for
         // empty input or a malformed leading sequence.
-        inline bool cpDecodeFirst(const std::string& s, unsigned int& out)
+        inline bool cpDecodeFirst(std::string_view s, unsigned int& out)
         {
             if (s.empty()) return false;
             const unsigned char b0 = static_cast<unsigned char>(s[0]);
@@ -155,7 +173,7 @@ namespace MultiReplaceEngine {
 
         // Decode the UTF-8 codepoint starting at s[idx]. Returns the sequence
         // length in bytes (1-4) on success, 0 on malformed input or out-of-range.
-        inline int cpDecodeAt(const std::string& s, std::size_t idx, unsigned int& out)
+        inline int cpDecodeAt(std::string_view s, std::size_t idx, unsigned int& out)
         {
             if (idx >= s.size()) return 0;
             const unsigned char b0 = static_cast<unsigned char>(s[idx]);
@@ -215,32 +233,20 @@ namespace MultiReplaceEngine {
         , _txtPrevFunction(this)
         , _numColFunction(this)
         , _txtColFunction(this)
-        , _isNumFunction()
-        , _rndFunction()
+        , _rndFunction(this)
         , _rndSeedFunction(&_rndFunction)
+        , _rndKeyFunction(&_rndFunction)
         , _rndNormFunction(&_rndFunction)
-        , _nowFunction()
-        , _todayFunction()
         , _todateFunction(this)
         , _hex2numFunction(this, 16)
         , _bin2numFunction(this, 2)
         , _oct2numFunction(this, 8)
         , _num2romFunction(this)
         , _rom2numFunction(this)
-        , _lenFunction()
-        , _findFunction()
-        , _sliceFunction()
-        , _splitFunction()
-        , _trimFunction(0)
-        , _ltrimFunction(1)
-        , _rtrimFunction(2)
-        , _replaceFunction()
-        , _reptxtFunction()
-        , _tonumFunction()
-        , _chr2numFunction()
-        , _num2chrFunction()
         , _totxtFunction()
+        , _lkpFunction(this)
         , _ecmdLoaderFunction(this)
+        , _loopBudget(this)
     {
     }
 
@@ -320,18 +326,13 @@ namespace MultiReplaceEngine {
         _symbolTable.add_function("numcol", _numColFunction);
         _symbolTable.add_function("txtcol", _txtColFunction);
 
-        // isnum(x) - finite-number predicate, accepts scalar or string.
-        _symbolTable.add_function("isnum", _isNumFunction);
-
-        // Pseudo-random number generator (mt19937_64, properly seeded).
+        // Pseudo-random number generator (mt19937_64, properly seeded),
+        // and rndkey(n) for the order-independent counter mode.
         _symbolTable.add_function("rnd", _rndFunction);
         _symbolTable.add_function("rndseed", _rndSeedFunction);
+        _symbolTable.add_function("rndkey", _rndKeyFunction);
         _symbolTable.add_function("rndnorm", _rndNormFunction);
 
-        // now() / today() - current time built-ins.
-        _symbolTable.add_function("now", _nowFunction);
-        _symbolTable.add_function("today", _todayFunction);
-
         // Register todate(str, fmt) - the inverse of d:fmt output.
         // Returns Unix timestamp on success, NaN on parse failure.
         _symbolTable.add_function("todate", _todateFunction);
@@ -350,33 +351,89 @@ namespace MultiReplaceEngine {
         _symbolTable.add_function("num2rom", _num2romFunction);
         _symbolTable.add_function("rom2num", _rom2numFunction);
 
-        // String pack: codepoint-based, 1-based indices.
-        _symbolTable.add_function("len", _lenFunction);
-        _symbolTable.add_function("find", _findFunction);
-        _symbolTable.add_function("slice", _sliceFunction);
-        _symbolTable.add_function("split", _splitFunction);
-        _symbolTable.add_function("trim", _trimFunction);
-        _symbolTable.add_function("ltrim", _ltrimFunction);
-        _symbolTable.add_function("rtrim", _rtrimFunction);
-        _symbolTable.add_function("replace", _replaceFunction);
-        _symbolTable.add_function("reptxt", _reptxtFunction);
-        _symbolTable.add_function("tonum", _tonumFunction);
-        _symbolTable.add_function("chr2num", _chr2numFunction);
-        _symbolTable.add_function("num2chr", _num2chrFunction);
+        // totxt(x[, fmt]) from the string pack; the rest of the pack,
+        // isnum, now, today and the math constants come from the shared
+        // base table registered in compile().
         _symbolTable.add_function("totxt", _totxtFunction);
 
+        // Lookup tables shared with the Lua lkp() helper.
+        _symbolTable.add_function("lkp", _lkpFunction);
+
         // Register loadlib("path") - the library loader. Functions loaded
         // through it land in _ecmdLibrary's own symbol_table, which we
         // register against every compiled expression in compile().
         _symbolTable.add_function("loadlib", _ecmdLoaderFunction);
         _ecmdLibrary = std::make_unique<EcmdLibrary>();
 
-        // ExprTk's standard math constants (pi, epsilon, infinity).
-        _symbolTable.add_constants();
+        // Build the shared table now rather than in the first compile(),
+        // so a failure to construct it surfaces here.
+        baseSymbolTable();
 
         return true;
     }
 
+    // ---------------------------------------------------------------------
+    // Shared base symbol table
+    // ---------------------------------------------------------------------
+
+    struct ExprTkEngine::BaseBuiltins {
+        IsNumFunction   isnum;
+        NowFunction     now;
+        TodayFunction   today;
+        LenFunction     len;
+        FindFunction    find;
+        SliceFunction   slice;
+        SplitFunction   split;
+        TrimFunction    trim{ 0 };
+        TrimFunction    ltrim{ 1 };
+        TrimFunction    rtrim{ 2 };
+        ReplaceFunction replace;
+        ReptxtFunction  reptxt;
+        TonumFunction   tonum;
+        Chr2NumFunction chr2num;
+        Num2ChrFunction num2chr;
+
+        // Declared last so it is destroyed first, while the functions it
+        // points to still exist.
+        symbol_table_t  table{ symbol_table_t::e_immutable };
+
+        BaseBuiltins() {
+            // isnum(x) - finite-number predicate, accepts scalar or string.
+            table.add_function("isnum", isnum);
+
+            // now() / today() - current time built-ins.
+            table.add_function("now", now);
+            table.add_function("today", today);
+
+            // String pack: codepoint-based, 1-based indices.
+            table.add_function("len", len);
+            table.add_function("find", find);
+            table.add_function("slice", slice);
+            table.add_function("split", split);
+            table.add_function("trim", trim);
+            table.add_function("ltrim", ltrim);
+            table.add_function("rtrim", rtrim);
+            table.add_function("replace", replace);
+            table.add_function("reptxt", reptxt);
+            table.add_function("tonum", tonum);
+            table.add_function("chr2num", chr2num);
+            table.add_function("num2chr", num2chr);
+
+            // ExprTk's standard math constants (pi, epsilon, infinity).
+            table.add_constants();
+        }
+    };
+
+    ExprTkEngine::symbol_table_t& ExprTkEngine::baseSymbolTable()
+    {
+        // Function-local static: constructed once, thread-safe, on the
+        // first engine's initialize(). ExprTk shares a symbol_table's
+        // contents between copies through a reference count, which the
+        // vendored exprtk.hpp makes atomic for exactly this table.
+        static BaseBuiltins builtins;
+        return builtins.table;
+    }
+
     void ExprTkEngine::shutdown()
     {
         _compiledExpressions.clear();
@@ -385,6 +442,8 @@ namespace MultiReplaceEngine {
         _lastCompiledScript.clear();
         _haveCompiled = false;
         _ecmdLibrary.reset();
+        _memo.clear();
+        _memoEnabled = false;
 
         // We deliberately do NOT clear the symbol table here - if the
         // engine gets compile()'d again later, the same variable bindings
@@ -414,10 +473,30 @@ namespace MultiReplaceEngine {
         _segmentSpecs.clear();
         _loadlibFailed = false;
         _loadlibError.clear();
+        _loadedLibraries.clear();
+        _lookupTables.clear();
+
+        // Loops compiled this run carry the budget check only when a
+        // limit is set; the compile cache was dropped above, so every
+        // template is compiled again under the new setting.
+        _limits = _host ? _host->formulaLimits() : FormulaLimits{};
+        if (_limits.loopIterationsPerMatch != 0 || _limits.secondsPerRun != 0) {
+            _parser.register_loop_runtime_check(_loopBudget);
+            _ecmdLibrary->registerLoopCheck(_loopBudget);
+        }
+        else {
+            _parser.clear_loop_runtime_check();
+        }
+
         _parsedTemplate = ExprTkPatternParser::ParseResult();
         _lastCompiledScript.clear();
         _haveCompiled = false;
 
+        // Counter mode is switched on by an rndkey() init row, which runs
+        // again in every run. The stream generator keeps its state, as
+        // before.
+        _rndFunction.setStreamMode();
+
         // Discard match history from any previous run. Each Replace-All
         // starts with an empty ring; the first match in the run sees
         // _history.size() == 0, so numprev() / numout() bootstrap with
@@ -426,6 +505,58 @@ namespace MultiReplaceEngine {
         _currentBlockIndex = 0;
         // _currentBlockOutputs and _captureSlotsForHistory keep their
         // capacity; their content is overwritten on the next match.
+
+        // The template is recompiled on the first match, which resets the
+        // memo itself; only the run totals need clearing here.
+        _memo.clear();
+        _memoEnabled = false;
+        _memoRunHits = 0;
+        _memoRunLookups = 0;
+    }
+
+    std::wstring ExprTkEngine::endRunSummary()
+    {
+        std::wstring summary = IFormulaEngine::endRunSummary();
+
+        const std::size_t lookups = _memoRunLookups + _memo.lookups();
+        if (lookups == 0) {
+            return summary;
+        }
+        const std::size_t hits = _memoRunHits + _memo.hits();
+        if (!summary.empty()) {
+            summary += L" ";
+        }
+        summary += localiseCounts(L"status_formula_memo_summary", hits, lookups);
+        return summary;
+    }
+
+    // ---------------------------------------------------------------------
+    // Loop budget
+    // ---------------------------------------------------------------------
+
+    ExprTkEngine::LoopBudget::LoopBudget(ExprTkEngine* owner)
+        : _owner(owner)
+    {
+        // ExprTk's own iteration cap is per loop; the budget counts all
+        // loops of a match together in check(), so disable the former.
+        loop_set = e_all_loops;
+        max_loop_iterations = std::numeric_limits<exprtk::details::_uint64_t>::max();
+    }
+
+    bool ExprTkEngine::LoopBudget::check()
+    {
+        if (_exceeded) {
+            return false;
+        }
+        ++_iterations;
+        const std::uint64_t limit = _owner->_limits.loopIterationsPerMatch;
+        // The clock is read only every 4096 iterations.
+        if ((limit != 0 && _iterations > limit)
+            || ((_iterations & 0xFFF) == 0 && _owner->runTimeLimitReached())) {
+            _exceeded = true;
+            return false;
+        }
+        return true;
     }
 
     // ---------------------------------------------------------------------
@@ -438,6 +569,7 @@ namespace MultiReplaceEngine {
         if (!_host || !_host->isFormulaErrorDialogEnabled()) {
             return;
         }
+        endEvaluation();  // time in the dialog is not formula time
         _host->showErrorMessage(category, "ExprTk", details);
     }
 
@@ -449,10 +581,40 @@ namespace MultiReplaceEngine {
         // and Inf, since both indicate an unusable numeric result and
         // letting either reach the output would silently corrupt the
         // text.
+        endEvaluation();  // time in the dialog is not formula time
         handleRecoverableSkip(_host, L"ExprTk",
             L"msgbox_recoverable_error_details_exprtk", exprText);
     }
 
+    // ---------------------------------------------------------------------
+    // Clone
+    // ---------------------------------------------------------------------
+
+    FormulaEnginePtr ExprTkEngine::clone() const
+    {
+        auto copy = std::make_unique<ExprTkEngine>(_host);
+        if (!copy->initialize()) {
+            return nullptr;
+        }
+
+        // beginRun() picks up the same host limits and registers the
+        // copy's own loop budget.
+        copy->beginRun();
+
+        for (const LoadedLibrary& library : _loadedLibraries) {
+            std::string err;
+            if (!copy->_ecmdLibrary->load(library.content, library.label, err)) {
+                return nullptr;
+            }
+            copy->_loadedLibraries.push_back(library);
+        }
+
+        if (_haveCompiled && !copy->compile(_lastCompiledScript)) {
+            return nullptr;
+        }
+        return copy;
+    }
+
     // ---------------------------------------------------------------------
     // Compile
     // ---------------------------------------------------------------------
@@ -485,6 +647,16 @@ namespace MultiReplaceEngine {
         _currentBlockOutputs.clear();
         _captureSlotsForHistory.clear();
 
+        // The memo belongs to the template being replaced. Keep its
+        // counters for the run summary, then start over.
+        _memoRunHits += _memo.hits();
+        _memoRunLookups += _memo.lookups();
+        _memo.clear();
+        _memoEnabled = false;
+        _memoVariables = 0;
+        _memoCaptures.clear();
+        _memoAllCaptures = false;
+
         // Step 1: split the template into literal/expression segments.
         auto parseRes = ExprTkPatternParser::parse(scriptUtf8);
         if (!parseRes.success) {
@@ -501,6 +673,8 @@ namespace MultiReplaceEngine {
 
         // Step 2: pre-compile every Expression segment. We allocate one
         // expression per segment; literals are not compiled.
+        bool memoDeterministic = true;
+        bool anyPerMatch = false;
         _compiledExpressions.resize(parseRes.segments.size());
         _segmentSpecs.assign(parseRes.segments.size(), SegmentSpec{});
         for (std::size_t i = 0; i < parseRes.segments.size(); ++i) {
@@ -514,6 +688,24 @@ namespace MultiReplaceEngine {
             // right is an optional output-format spec.
             auto split = FormatSpec::splitFormulaSpec(seg.text);
 
+            // Scope of the block's result: once per run, once per file,
+            // or every match. Decides whether execute() may replay the
+            // previous rendering instead of evaluating again. The inputs
+            // the block reads are merged into the memo key layout.
+            const BlockInputs inputs = analyzeBlockInputs(split.formula);
+            _segmentSpecs[i].dependency = inputs.dependency;
+            memoDeterministic = memoDeterministic && inputs.deterministic;
+            anyPerMatch = anyPerMatch
+                || inputs.dependency == BlockDependency::PerMatch;
+            _memoVariables |= inputs.variables;
+            _memoAllCaptures = _memoAllCaptures || inputs.allCaptures;
+            for (const std::size_t idx : inputs.captures) {
+                const auto pos = std::lower_bound(_memoCaptures.begin(), _memoCaptures.end(), idx);
+                if (pos == _memoCaptures.end() || *pos != idx) {
+                    _memoCaptures.insert(pos, idx);
+                }
+            }
+
             if (split.hasSpec) {
                 FormatSpec::Spec parsed = FormatSpec::parse(
                     std::wstring(split.spec.begin(), split.spec.end()));
@@ -533,6 +725,7 @@ namespace MultiReplaceEngine {
 
             expression_t expr;
             expr.register_symbol_table(_symbolTable);
+            expr.register_symbol_table(baseSymbolTable());
             if (_ecmdLibrary) {
                 // Calls into ecmd-loaded functions resolve against the
                 // library's own symbol table. Registering it here lets
@@ -642,6 +835,12 @@ namespace MultiReplaceEngine {
             // index via a running counter. (Empty staging vectors at
             // this point - they were cleared at the top of compile().)
             _currentBlockOutputs.assign(blockCount, BlockOutput{});
+
+            // Memoise only where it can pay off: a template without any
+            // per-match block is already fully folded, and one reading
+            // CNT or APOS never sees the same key twice.
+            _memoEnabled = memoDeterministic && anyPerMatch && !ha.hasHistory
+                && (_memoVariables & (VarCNT | VarAPOS)) == 0;
         }
 
         // Step 3: cache for re-use.
@@ -672,6 +871,12 @@ namespace MultiReplaceEngine {
         // the replace template and have them expand normally.
         const bool escapeOutput = isRegexMatch;
 
+        // The run's time budget is spent: the remaining matches stay as
+        // they are.
+        if (_runTimeLimitReached) {
+            return budgetSkip(true, isRegexMatch);
+        }
+
         // Lazy compile: if compile() was never called, or the script has
         // changed since the last compile, run it now. compile() has
         // already shown any error dialog; we just propagate the failure
@@ -698,11 +903,30 @@ namespace MultiReplaceEngine {
         _strMATCH = vars.MATCH;
         _strFPATH = vars.FPATH;
         _strFNAME = vars.FNAME;
+        _ruleIndex = vars.ruleIndex;
+        _rndFunction.beginMatch();
 
         _wantSkip = false;
         _wantStop = false;
         _outputHadInvalid = false;
 
+        // Memoised template: the output depends only on the inputs the
+        // compile-time scan found, so an earlier match with the same
+        // inputs has already rendered it. Bypassed in debug mode, where
+        // every match has to pass through the debug window.
+        const bool useMemo = _memoEnabled && _memo.active()
+            && !(_host && _host->isDebugModeEnabled());
+        if (useMemo) {
+            buildMemoKey(vars, isRegexMatch);
+            if (const FormulaMemo::Entry* hit = _memo.find(_memoKey)) {
+                result.output = hit->output;
+                result.success = true;
+                result.skip = hit->skip;
+                result.outputIsRegexSafe = isRegexMatch;
+                return result;
+            }
+        }
+
         _captures.clear();
         _captures.reserve(vars.captures.size() + 1);
         _captures.push_back(parseCaptureToDouble(vars.MATCH));
@@ -778,6 +1002,15 @@ namespace MultiReplaceEngine {
         std::string out;
         out.reserve(scriptUtf8.size());
 
+        // Charge the evaluation to the run's time budget. The scope ends
+        // it on every return path; the dialog paths end it earlier.
+        _loopBudget.beginMatch();
+        beginEvaluation();
+        struct EvaluationScope {
+            ExprTkEngine* engine;
+            ~EvaluationScope() { engine->endEvaluation(); }
+        } evaluationScope{ this };
+
         // Helper: build the FormulaResult for an invalid-result match
         // (NaN or Inf). Used by both the numeric and return-list paths.
         // Sets success=false when the user picked "Stop" in the dialog;
@@ -824,6 +1057,25 @@ namespace MultiReplaceEngine {
                 continue;
             }
 
+            // Folded block: a Constant block rendered earlier in this run,
+            // or a PerFile block rendered earlier for the same document,
+            // cannot produce anything different now. Replay the bytes and
+            // the history slot. The escape mode is part of the key because
+            // the rendering differs between regex and plain replaces.
+            SegmentSpec& segSpec = _segmentSpecs[i];
+            if (segSpec.folded && segSpec.foldedEscaped == escapeOutput
+                && (segSpec.dependency == BlockDependency::Constant
+                    || (segSpec.foldedFPATH == _strFPATH
+                        && segSpec.foldedFNAME == _strFNAME))) {
+                out.append(segSpec.foldedOutput);
+                if (expressionIdx < _currentBlockOutputs.size()) {
+                    _currentBlockOutputs[expressionIdx] = segSpec.foldedBlockOutput;
+                }
+                ++expressionIdx;
+                continue;
+            }
+            const std::size_t renderStart = out.size();
+
             // Set the running block index BEFORE eval so numprev/txtprev
             // inside this expression know their implicit n. The
             // within-match guard in lookupBlockOutputAt uses this value
@@ -868,7 +1120,13 @@ namespace MultiReplaceEngine {
             // semantic payload is the string).
             if (_segmentSpecs[i].isString) {
                 std::string strOut;
-                if (!exprtk::expression_helper<double>::get_string(expr, strOut)) {
+                const bool gotString =
+                    exprtk::expression_helper<double>::get_string(expr, strOut);
+                // A loop cut short by the budget leaves a partial result.
+                if (_loopBudget.exceeded()) {
+                    return budgetSkip(_runTimeLimitReached, isRegexMatch);
+                }
+                if (!gotString) {
                     // is_string() was true at compile but get_string()
                     // failed at eval. Should not happen for any node type
                     // we know of, but report as a soft skip so a
@@ -895,28 +1153,33 @@ namespace MultiReplaceEngine {
                 // Apply text format spec if present. The compile-time
                 // check upstream guaranteed that any spec attached here
                 // is of Kind::Text, so the string overload is safe.
-                std::string formatted;
-                if (_segmentSpecs[i].hasSpec) {
-                    std::wstring w = FormatSpec::apply(_segmentSpecs[i].spec, strOut);
-                    formatted.reserve(w.size());
-                    for (wchar_t wc : w) {
-                        formatted.push_back(static_cast<char>(wc));
+                // Without regex escaping the spec renders straight into
+                // `out`; escaping needs the formatted text on its own.
+                if (escapeOutput && _host) {
+                    if (_segmentSpecs[i].hasSpec) {
+                        std::string formatted;
+                        FormatSpec::applyTo(formatted, _segmentSpecs[i].spec, strOut);
+                        out.append(_host->escapeForRegex(formatted));
+                    }
+                    else {
+                        out.append(_host->escapeForRegex(strOut));
                     }
                 }
-                else {
-                    formatted = strOut;
-                }
-                if (escapeOutput && _host) {
-                    out.append(_host->escapeForRegex(formatted));
+                else if (_segmentSpecs[i].hasSpec) {
+                    FormatSpec::applyTo(out, _segmentSpecs[i].spec, strOut);
                 }
                 else {
-                    out.append(formatted);
+                    out.append(strOut);
                 }
+                foldBlock(segSpec, expressionIdx, out, renderStart, escapeOutput);
                 ++expressionIdx;
                 continue;
             }
 
             const double value = expr.value();
+            if (_loopBudget.exceeded()) {
+                return budgetSkip(_runTimeLimitReached, isRegexMatch);
+            }
 
             // A failed loadlib() latches here. It is a structural failure
             // (the library and everything depending on it is unavailable),
@@ -962,6 +1225,7 @@ namespace MultiReplaceEngine {
                         std::string_view(out.data() + outSizeBefore,
                             out.size() - outSizeBefore));
                 }
+                foldBlock(segSpec, expressionIdx, out, renderStart, escapeOutput);
                 ++expressionIdx;
                 continue;
             }
@@ -981,24 +1245,26 @@ namespace MultiReplaceEngine {
             if (expressionIdx < _currentBlockOutputs.size()) {
                 _currentBlockOutputs[expressionIdx].setNumber(value);
             }
-            ++expressionIdx;
 
             // Format through spec, or fall back to shortest round-trip.
-            // apply() returns UTF-8 packed one byte per wchar (applyFrame's
-            // wstring(out.begin(),out.end())), so extracting the low byte of
-            // each wchar reconstructs the UTF-8 - including localized date
-            // names. Text specs never reach this path - they are string-typed
-            // and handled in the isString branch above.
+            // applyTo() appends UTF-8 directly to `out` - including
+            // localized date names - with no wide intermediate. Text specs
+            // never reach this path - they are string-typed and handled in
+            // the isString branch above.
             if (_segmentSpecs[i].hasSpec) {
-                std::wstring formatted = FormatSpec::apply(_segmentSpecs[i].spec, value);
-                out.reserve(out.size() + formatted.size());
-                for (wchar_t wc : formatted) {
-                    out.push_back(static_cast<char>(wc));
-                }
+                FormatSpec::applyTo(out, _segmentSpecs[i].spec, value);
             }
             else {
                 out.append(formatDouble(value));
             }
+            foldBlock(segSpec, expressionIdx, out, renderStart, escapeOutput);
+            ++expressionIdx;
+        }
+
+        // Only a fully successful render is memoised; invalid results
+        // returned early above and keep going through the error dialog.
+        if (useMemo) {
+            _memo.insert(_memoKey, out, _wantSkip);
         }
 
         result.output = std::move(out);
@@ -1060,6 +1326,83 @@ namespace MultiReplaceEngine {
         return result;
     }
 
+    // ---------------------------------------------------------------------
+    // Block folding
+    // ---------------------------------------------------------------------
+
+    void ExprTkEngine::foldBlock(SegmentSpec& segSpec,
+        std::size_t expressionIdx,
+        const std::string& out,
+        std::size_t renderStart,
+        bool escaped)
+    {
+        if (segSpec.dependency == BlockDependency::PerMatch) {
+            return;
+        }
+        segSpec.foldedOutput.assign(out, renderStart, std::string::npos);
+        if (expressionIdx < _currentBlockOutputs.size()) {
+            segSpec.foldedBlockOutput = _currentBlockOutputs[expressionIdx];
+        }
+        segSpec.foldedEscaped = escaped;
+        if (segSpec.dependency == BlockDependency::PerFile) {
+            segSpec.foldedFPATH = _strFPATH;
+            segSpec.foldedFNAME = _strFNAME;
+        }
+        segSpec.folded = true;
+    }
+
+    // ---------------------------------------------------------------------
+    // Result memo key
+    // ---------------------------------------------------------------------
+
+    void ExprTkEngine::buildMemoKey(const FormulaVars& vars, bool isRegexMatch)
+    {
+        // Fixed-width integers and length-prefixed strings, so two
+        // different input tuples can never produce the same byte string.
+        // The escape mode leads because it changes the rendering.
+        _memoKey.clear();
+        _memoKey.push_back(isRegexMatch ? '\1' : '\0');
+
+        const auto appendInt = [this](long long v) {
+            char raw[sizeof(v)];
+            std::memcpy(raw, &v, sizeof(v));
+            _memoKey.append(raw, sizeof(v));
+            };
+        const auto appendText = [this, &appendInt](const std::string& text) {
+            appendInt(static_cast<long long>(text.size()));
+            _memoKey.append(text);
+            };
+
+        if (_memoVariables & VarCNT)   appendInt(vars.CNT);
+        if (_memoVariables & VarLCNT)  appendInt(vars.LCNT);
+        if (_memoVariables & VarLINE)  appendInt(vars.LINE);
+        if (_memoVariables & VarLPOS)  appendInt(vars.LPOS);
+        if (_memoVariables & VarAPOS)  appendInt(vars.APOS);
+        if (_memoVariables & VarCOL)   appendInt(vars.COL);
+        if (_memoVariables & VarFPATH) appendText(vars.FPATH);
+        if (_memoVariables & VarFNAME) appendText(vars.FNAME);
+
+        if (_memoAllCaptures) {
+            appendInt(static_cast<long long>(vars.captures.size()));
+            appendText(vars.MATCH);
+            for (const auto& cap : vars.captures) {
+                appendText(cap);
+            }
+            return;
+        }
+        for (const std::size_t idx : _memoCaptures) {
+            if (idx == 0) {
+                appendText(vars.MATCH);
+            }
+            else if (idx - 1 < vars.captures.size()) {
+                appendText(vars.captures[idx - 1]);
+            }
+            else {
+                appendInt(-1);      // group absent in this regex
+            }
+        }
+    }
+
     // ---------------------------------------------------------------------
     // Help URL
     // ---------------------------------------------------------------------
@@ -1351,71 +1694,20 @@ namespace MultiReplaceEngine {
             return nanResult;
         }
 
-        const string_t sv0(parameters[0]);
-        const string_t sv1(parameters[1]);
-        std::string input(sv0.begin(), sv0.end());
-        std::string fmt(sv1.begin(), sv1.end());
-
-        // Optional "utc:" keyword in the format means "treat result as
-        // UTC"; bare format is local. Mirrors d:utc: on the output side.
-        bool utc = false;
-        if (fmt.compare(0, 4, "utc:") == 0) {
-            utc = true;
-            fmt.erase(0, 4);
-        }
-
-        // Run the parser. tm starts zeroed so unset fields contribute
-        // 0/Jan/1/midnight - sensible defaults.
-        std::tm tm{};
-        tm.tm_isdst = -1;  // let mktime figure out DST for local time
-        const bool ok = MultiReplace::parseDateTime(input, fmt, tm);
-        if (!ok) {
+        if (!_owner) {
             return nanResult;
         }
 
-        // Convert tm to time_t. Local time uses mktime (which honors the
-        // current TZ); UTC needs a manual roll since C++17 has no portable
-        // timegm.
-        std::time_t t;
-        if (utc) {
-            // Manual day count from 1970-01-01 plus h/m/s.
-            static const int days_per_month[] =
-            { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
-            const long long year = tm.tm_year + 1900;
-            const long long month = tm.tm_mon;       // 0..11
-            const long long day = tm.tm_mday - 1;  // 0-indexed
-
-            if (year < 1970) return nanResult;
-
-            long long days = 0;
-            for (long long y = 1970; y < year; ++y) {
-                const bool leap = (y % 4 == 0 && y % 100 != 0) || (y % 400 == 0);
-                days += leap ? 366 : 365;
-            }
-            for (long long m = 0; m < month; ++m) {
-                int dm = days_per_month[m];
-                if (m == 1) {
-                    const bool leap = (year % 4 == 0 && year % 100 != 0) || (year % 400 == 0);
-                    if (leap) dm = 29;
-                }
-                days += dm;
-            }
-            days += day;
-
-            const long long total = days * 86400
-                + tm.tm_hour * 3600
-                + tm.tm_min * 60
-                + tm.tm_sec;
-            t = static_cast<std::time_t>(total);
-        }
-        else {
-            t = std::mktime(&tm);
-            if (t == static_cast<std::time_t>(-1)) {
-                return nanResult;
-            }
-        }
-
-        return static_cast<double>(t);
+        // The format is compiled once per distinct string and reused
+        // from the engine's cache; the input is parsed in place without
+        // copying either argument. "utc:" handling and the tm ->
+        // timestamp conversion live in DateParse, shared with Lua.
+        const string_t sv0(parameters[0]);
+        const string_t sv1(parameters[1]);
+        return MultiReplace::parseTimestamp(
+            std::string_view(sv0.begin(), sv0.size()),
+            std::string_view(sv1.begin(), sv1.size()),
+            _owner->_dateFormats);
     }
 
     // ---------------------------------------------------------------------
@@ -1447,8 +1739,9 @@ namespace MultiReplaceEngine {
         // isUnicodeWhiteCp (ASCII + NBSP + the U+2000..U+200A space family +
         // line/paragraph separators + ideographic space + stray BOM). Used
         // so hex2num(" ff" + U+00A0) still parses cleanly. Malformed UTF-8
-        // halts trimming and leaves the remaining bytes untouched.
-        std::string trimUnicode(const std::string& s)
+        // halts trimming and leaves the remaining bytes untouched. The
+        // result is a view into s.
+        std::string_view trimUnicode(std::string_view s)
         {
             // Leading: advance whole codepoints while they are whitespace.
             std::size_t first = 0;
@@ -1477,7 +1770,7 @@ namespace MultiReplaceEngine {
             return s.substr(first, last - first);
         }
 
-        std::string ltrimUnicode(const std::string& s)
+        std::string_view ltrimUnicode(std::string_view s)
         {
             std::size_t first = 0;
             while (first < s.size()) {
@@ -1489,7 +1782,7 @@ namespace MultiReplaceEngine {
             return s.substr(first);
         }
 
-        std::string rtrimUnicode(const std::string& s)
+        std::string_view rtrimUnicode(std::string_view s)
         {
             std::size_t last = s.size();
             while (last > 0) {
@@ -1512,7 +1805,7 @@ namespace MultiReplaceEngine {
         // Removes a leading base-prefix if present (0x/0X for hex,
         // 0b/0B for binary, 0o/0O for octal). Returns the offset to
         // continue parsing from.
-        std::size_t skipBasePrefix(const std::string& s, int base)
+        std::size_t skipBasePrefix(std::string_view s, int base)
         {
             if (s.size() < 2 || s[0] != '0') return 0;
             const char p = s[1];
@@ -1532,8 +1825,7 @@ namespace MultiReplaceEngine {
         if (parameters.size() != 1) {
             return nanResult;
         }
-        const string_t sv(parameters[0]);
-        const std::string raw = trimUnicode(exprtk::to_str(sv));
+        const std::string_view raw = trimUnicode(readString(parameters[0]));
         if (raw.empty()) {
             return nanResult;
         }
@@ -1648,8 +1940,7 @@ namespace MultiReplaceEngine {
         constexpr double nanResult = std::numeric_limits<double>::quiet_NaN();
 
         if (parameters.size() != 1) return nanResult;
-        const string_t sv(parameters[0]);
-        const std::string raw = trimUnicode(exprtk::to_str(sv));
+        const std::string_view raw = trimUnicode(readString(parameters[0]));
         if (raw.empty()) return nanResult;
 
         // Left-to-right scan: when a glyph's value is smaller than the
@@ -1680,20 +1971,19 @@ namespace MultiReplaceEngine {
         parameter_list_t parameters)
     {
         if (parameters.size() != 1) return 0.0;
-        const string_t sv(parameters[0]);
-        return static_cast<double>(cpLen(exprtk::to_str(sv)));
+        return static_cast<double>(cpLen(readString(parameters[0])));
     }
 
     double ExprTkEngine::FindFunction::operator()(
         parameter_list_t parameters)
     {
         if (parameters.size() != 2) return 0.0;
-        const std::string hay = exprtk::to_str(string_t(parameters[0]));
-        const std::string needle = exprtk::to_str(string_t(parameters[1]));
+        const std::string_view hay = readString(parameters[0]);
+        const std::string_view needle = readString(parameters[1]);
 
         if (needle.empty()) return 1.0;
         const std::size_t bytePos = hay.find(needle);
-        if (bytePos == std::string::npos) return 0.0;
+        if (bytePos == std::string_view::npos) return 0.0;
 
         // Count codepoints from the start up to the match, no copy.
         std::size_t cp = 0;
@@ -1710,7 +2000,7 @@ namespace MultiReplaceEngine {
         result.clear();
         if (parameters.size() != 3) return 0.0;
 
-        const std::string s = exprtk::to_str(string_t(parameters[0]));
+        const std::string_view s = readString(parameters[0]);
         long long startVal = 0, nVal = 0;
         if (!toIndex(readScalar(parameters[1]), startVal)) return 0.0;
         if (!toIndex(readScalar(parameters[2]), nVal)) return 0.0;
@@ -1727,7 +2017,7 @@ namespace MultiReplaceEngine {
             ? static_cast<std::size_t>(nVal) : avail;
         const std::size_t b0 = cpOffset(s, startCp);
         const std::size_t b1 = cpOffset(s, startCp + take);
-        result = s.substr(b0, b1 - b0);
+        result.assign(s.data() + b0, b1 - b0);
         return 0.0;
     }
 
@@ -1738,15 +2028,15 @@ namespace MultiReplaceEngine {
         result.clear();
         if (parameters.size() != 3) return 0.0;
 
-        const std::string s = exprtk::to_str(string_t(parameters[0]));
-        const std::string sep = exprtk::to_str(string_t(parameters[1]));
+        const std::string_view s = readString(parameters[0]);
+        const std::string_view sep = readString(parameters[1]);
         long long iVal = 0;
         if (!toIndex(readScalar(parameters[2]), iVal)) return 0.0;
         if (iVal < 1) return 0.0;
 
         // Empty separator: whole string is field 1, nothing beyond.
         if (sep.empty()) {
-            if (iVal == 1) result = s;
+            if (iVal == 1) result.assign(s.data(), s.size());
             return 0.0;
         }
 
@@ -1755,11 +2045,11 @@ namespace MultiReplaceEngine {
         while (true) {
             const std::size_t pos = s.find(sep, fieldStart);
             if (field == iVal) {
-                const std::size_t end = (pos == std::string::npos) ? s.size() : pos;
-                result = s.substr(fieldStart, end - fieldStart);
+                const std::size_t end = (pos == std::string_view::npos) ? s.size() : pos;
+                result.assign(s.data() + fieldStart, end - fieldStart);
                 return 0.0;
             }
-            if (pos == std::string::npos) return 0.0;  // i past last field
+            if (pos == std::string_view::npos) return 0.0;  // i past last field
             fieldStart = pos + sep.size();
             ++field;
         }
@@ -1771,12 +2061,14 @@ namespace MultiReplaceEngine {
     {
         result.clear();
         if (parameters.size() != 1) return 0.0;
-        const std::string s = exprtk::to_str(string_t(parameters[0]));
+        const std::string_view s = readString(parameters[0]);
+        std::string_view trimmed;
         switch (_mode) {
-        case 1:  result = ltrimUnicode(s); break;
-        case 2:  result = rtrimUnicode(s); break;
-        default: result = trimUnicode(s);  break;
+        case 1:  trimmed = ltrimUnicode(s); break;
+        case 2:  trimmed = rtrimUnicode(s); break;
+        default: trimmed = trimUnicode(s);  break;
         }
+        result.assign(trimmed.data(), trimmed.size());
         return 0.0;
     }
 
@@ -1787,20 +2079,20 @@ namespace MultiReplaceEngine {
         result.clear();
         if (parameters.size() != 3) return 0.0;
 
-        const std::string s = exprtk::to_str(string_t(parameters[0]));
-        const std::string from = exprtk::to_str(string_t(parameters[1]));
-        const std::string to = exprtk::to_str(string_t(parameters[2]));
+        const std::string_view s = readString(parameters[0]);
+        const std::string_view from = readString(parameters[1]);
+        const std::string_view to = readString(parameters[2]);
 
-        if (from.empty()) { result = s; return 0.0; }
+        if (from.empty()) { result.assign(s.data(), s.size()); return 0.0; }
 
         std::size_t pos = 0;
         while (true) {
             const std::size_t found = s.find(from, pos);
-            if (found == std::string::npos) {
-                result.append(s, pos, std::string::npos);
+            if (found == std::string_view::npos) {
+                result.append(s.substr(pos));
                 break;
             }
-            result.append(s, pos, found - pos);
+            result.append(s.substr(pos, found - pos));
             result.append(to);
             pos = found + from.size();
         }
@@ -1814,7 +2106,7 @@ namespace MultiReplaceEngine {
         result.clear();
         if (parameters.size() != 2) return 0.0;
 
-        const std::string s = exprtk::to_str(string_t(parameters[0]));
+        const std::string_view s = readString(parameters[0]);
         long long nVal = 0;
         if (!toIndex(readScalar(parameters[1]), nVal)) return 0.0;
         if (nVal < 1 || s.empty()) return 0.0;
@@ -1843,9 +2135,8 @@ namespace MultiReplaceEngine {
     {
         constexpr double nan = std::numeric_limits<double>::quiet_NaN();
         if (parameters.size() != 1) return nan;
-        const string_t sv(parameters[0]);
         unsigned int cp = 0;
-        if (!cpDecodeFirst(exprtk::to_str(sv), cp)) return nan;
+        if (!cpDecodeFirst(readString(parameters[0]), cp)) return nan;
         return static_cast<double>(cp);
     }
 
@@ -1880,25 +2171,109 @@ namespace MultiReplaceEngine {
             return 0.0;
         }
 
-        // totxt(n, fmt): parse fmt per call and apply. Widen byte-per-wchar
-        // to match the main spec-parse path; FormatSpec works in this packed
-        // form throughout. Invalid fmt or a text spec on a number yields ""
-        // (FormatSpec::apply returns empty for those).
-        const string_t fv(parameters[1]);
-        const std::string fmt = exprtk::to_str(fv);
-        const std::wstring wfmt(fmt.begin(), fmt.end());
+        // totxt(n, fmt): parse fmt and apply. Widen byte-per-wchar to
+        // match the main spec-parse path. The format is nearly always a
+        // literal, so the last parsed spec is kept and fmt only parsed
+        // again when it changes. Invalid fmt or a text spec on a number
+        // yields "" (FormatSpec::applyTo appends nothing for those).
+        const std::string_view fmt = readString(parameters[1]);
+        if (!_haveSpec || fmt != _lastFormat) {
+            _lastFormat.assign(fmt.data(), fmt.size());
+            _lastSpec = FormatSpec::parse(std::wstring(fmt.begin(), fmt.end()));
+            _haveSpec = true;
+        }
+        if (!_lastSpec.valid) return 0.0;
+
+        FormatSpec::applyTo(result, _lastSpec, v);
+        return 0.0;
+    }
+
+    // Detects control characters (CR/LF/TAB/BS etc.) in a path. Their
+    // presence means the user wrote backslashes that ExprTk's string
+    // lexer consumed as escapes ('\t' -> TAB, '\n' -> LF, ...), destroying
+    // the path. A real filesystem path never contains them.
+    static bool pathHasControlChars(const std::string& p)
+    {
+        for (unsigned char c : p) {
+            if (c < 0x20) return true;
+        }
+        return false;
+    }
+
+    double ExprTkEngine::LkpFunction::operator()(
+        const std::size_t& psi,
+        std::string& result,
+        parameter_list_t parameters)
+    {
+        result.clear();
+
+        // psi 0/2: string key, 1/3: numeric key.
+        std::string key;
+        if (psi == 1 || psi == 3) {
+            const double v = scalar_t(parameters[0])();
+            if (std::isfinite(v)) {
+                key = LookupStore::numberKey(v);
+            }
+        }
+        else {
+            key = exprtk::to_str(string_t(parameters[0]));
+        }
+        const std::string path = exprtk::to_str(string_t(parameters[1]));
 
-        const FormatSpec::Spec spec = FormatSpec::parse(wfmt);
-        if (!spec.valid) return 0.0;
+        const LookupTable* table = _owner->lookupTable(path);
+        if (!table) {
+            return 0.0;
+        }
 
-        // apply() returns UTF-8 packed one byte per wchar; extract the low
-        // byte of each to rebuild the UTF-8 result.
-        const std::wstring out = FormatSpec::apply(spec, v);
-        result.reserve(out.size());
-        for (wchar_t wc : out) result.push_back(static_cast<char>(wc));
+        LookupTable::Value value;
+        if (table->find(key, value)) {
+            result.assign(value.text.data(), value.text.size());
+        }
+        else if (parameters.size() == 3) {
+            result = exprtk::to_str(string_t(parameters[2]));
+        }
+        else {
+            result = std::move(key);
+        }
         return 0.0;
     }
 
+    const LookupTable* ExprTkEngine::lookupTable(const std::string& utf8Path)
+    {
+        if (auto it = _lookupTables.find(utf8Path); it != _lookupTables.end()) {
+            return it->second.get();
+        }
+        // A failed open shares the loadlib() latch: it is the same kind
+        // of structural, run-ending error and execute() already checks it.
+        if (_loadlibFailed) {
+            return nullptr;
+        }
+        if (pathHasControlChars(utf8Path)) {
+            _loadlibFailed = true;
+            _loadlibError =
+                "lkp: path contains control characters - backslashes are "
+                "interpreted as escapes. Use forward slashes (C:/dir/data.lkp) "
+                "or doubled backslashes (C:\\\\dir\\\\data.lkp).";
+            return nullptr;
+        }
+
+        LookupStore::OpenResult opened = LookupStore::open(utf8Path);
+        if (opened.status == LookupStore::Status::CannotRead) {
+            _loadlibFailed = true;
+            _loadlibError = "lkp: cannot open file '" + utf8Path + "'";
+            return nullptr;
+        }
+        if (opened.status == LookupStore::Status::Unsupported) {
+            _loadlibFailed = true;
+            _loadlibError = "lkp: only literal tables are supported here ("
+                + opened.error + ")";
+            return nullptr;
+        }
+        const LookupTable* table = opened.table.get();
+        _lookupTables.emplace(utf8Path, std::move(opened.table));
+        return table;
+    }
+
     // ---------------------------------------------------------------------
     // EcmdFunctionInstance
     // ---------------------------------------------------------------------
@@ -2102,10 +2477,16 @@ namespace MultiReplaceEngine {
         // Pass 2: compile bodies. Cross-calls and recursion resolve now
         // because all names from this load (plus any previously loaded)
         // are visible in _libTable.
+        if (!_parser) {
+            _parser = std::make_unique<parser_t>();
+            if (_loopCheck) {
+                _parser->register_loop_runtime_check(*_loopCheck);
+            }
+        }
         for (auto& inst : pending) {
             inst->prepareSymbolTables(_libTable);
             std::string err;
-            if (!inst->compileBody(_parser, err)) {
+            if (!inst->compileBody(*_parser, err)) {
                 errorOut = sourceLabel + ": " + err;
                 for (auto& priorInst : pending) {
                     _libTable.remove_function(priorInst->name());
@@ -2146,18 +2527,6 @@ namespace MultiReplaceEngine {
     // loadEcmdFile
     // ---------------------------------------------------------------------
 
-    // Detects control characters (CR/LF/TAB/BS etc.) in a path. Their
-    // presence means the user wrote backslashes that ExprTk's string
-    // lexer consumed as escapes ('\t' -> TAB, '\n' -> LF, ...), destroying
-    // the path. A real filesystem path never contains them.
-    static bool pathHasControlChars(const std::string& p)
-    {
-        for (unsigned char c : p) {
-            if (c < 0x20) return true;
-        }
-        return false;
-    }
-
     bool ExprTkEngine::loadEcmdFile(const std::string& utf8Path)
     {
         if (!_ecmdLibrary) {
@@ -2209,6 +2578,7 @@ namespace MultiReplaceEngine {
             _loadlibError = err;
             return false;
         }
+        _loadedLibraries.push_back({ std::move(content), utf8Path });
         return true;
     }
 
@@ -2640,8 +3010,68 @@ namespace MultiReplaceEngine {
     // Random number generator: rnd() / rnd(hi) / rnd(lo, hi)
     // ---------------------------------------------------------------------
 
-    ExprTkEngine::RndFunction::RndFunction()
+    namespace {
+
+        // SplitMix64 finaliser. Every bit of the input affects every bit
+        // of the output, so consecutive counters give independent-looking
+        // values. Used as the counter-mode generator: draw k of a match
+        // is mix64(matchKey + k * kGolden), which is SplitMix64's own
+        // sequence started at matchKey.
+        constexpr std::uint64_t kGolden = 0x9E3779B97F4A7C15ull;
+
+        inline std::uint64_t mix64(std::uint64_t z)
+        {
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        }
+
+        // FNV-1a over the file identity, so the same path always yields
+        // the same key independent of process, run or worker.
+        inline std::uint64_t hashFileIdentity(const std::string& s)
+        {
+            std::uint64_t h = 14695981039346656037ull;
+            for (unsigned char c : s) {
+                h ^= c;
+                h *= 1099511628211ull;
+            }
+            return h;
+        }
+
+        // High 64 bits of the 128-bit product a * b, from 32-bit halves
+        // so it builds the same on every compiler.
+        inline std::uint64_t mulHigh64(std::uint64_t a, std::uint64_t b)
+        {
+            const std::uint64_t aLo = a & 0xFFFFFFFFull, aHi = a >> 32;
+            const std::uint64_t bLo = b & 0xFFFFFFFFull, bHi = b >> 32;
+            const std::uint64_t lolo = aLo * bLo;
+            const std::uint64_t hilo = aHi * bLo;
+            const std::uint64_t lohi = aLo * bHi;
+            const std::uint64_t mid = (lolo >> 32) + (hilo & 0xFFFFFFFFull) + lohi;
+            return aHi * bHi + (hilo >> 32) + (mid >> 32);
+        }
+
+        // Top 53 bits as a double in [0, 1).
+        inline double bitsToUnit(std::uint64_t bits)
+        {
+            return static_cast<double>(bits >> 11) * 0x1.0p-53;
+        }
+
+        // Same double-to-integer rule rnd() and rndseed() apply to their
+        // arguments: non-finite or out-of-range inputs become 0, the
+        // rest truncate.
+        inline long long rndToInt(double d)
+        {
+            if (!std::isfinite(d)) return 0;
+            if (d < -9223372036854775808.0 || d >= 9223372036854775808.0) return 0;
+            return static_cast<long long>(d);
+        }
+
+    } // anonymous namespace
+
+    ExprTkEngine::RndFunction::RndFunction(ExprTkEngine* owner)
         : igenfunct_t("Z|T|TT")
+        , _owner(owner)
     {
         // Allow the zero-argument variant rnd().
         exprtk::enable_zero_parameters(*this);
@@ -2655,6 +3085,32 @@ namespace MultiReplaceEngine {
         _engine.seed(seq);
     }
 
+    std::uint64_t ExprTkEngine::RndFunction::nextCounterBits()
+    {
+        // The match key folds in the file, the rule and CNT once per
+        // match; each draw after that is one add and one mix64. FPATH is
+        // empty for unsaved documents, so FNAME ("new 1") stands in.
+        if (!_matchKeyValid) {
+            std::uint64_t key = _counterKey;
+            if (_owner) {
+                const std::string& file =
+                    _owner->_strFPATH.empty() ? _owner->_strFNAME : _owner->_strFPATH;
+                if (file != _fileIdentity) {
+                    _fileIdentity = file;
+                    _fileHash = hashFileIdentity(file);
+                }
+                key = mix64(key ^ _fileHash);
+                key = mix64(key ^ static_cast<std::uint64_t>(
+                    static_cast<std::int64_t>(_owner->_ruleIndex)));
+                key = mix64(key ^ static_cast<std::uint64_t>(
+                    rndToInt(_owner->_varCNT)));
+            }
+            _matchKey = key;
+            _matchKeyValid = true;
+        }
+        return mix64(_matchKey + ++_drawIndex * kGolden);
+    }
+
     double ExprTkEngine::RndFunction::operator()(
         const std::size_t& /*psi*/,
         parameter_list_t parameters)
@@ -2663,6 +3119,9 @@ namespace MultiReplaceEngine {
 
         // rnd() - uniform real in [0, 1).
         if (arity == 0) {
+            if (_counterMode) {
+                return bitsToUnit(nextCounterBits());
+            }
             std::uniform_real_distribution<double> dist(0.0, 1.0);
             return dist(_engine);
         }
@@ -2670,28 +3129,49 @@ namespace MultiReplaceEngine {
         // Convert scalar args. Non-finite or out-of-range inputs collapse
         // to 0; integer truncation is intentional - "between 1 and 10.7"
         // means 1..10.
-        auto toInt = [](double d) -> long long {
-            if (!std::isfinite(d)) return 0;
-            if (d < -9223372036854775808.0 || d >= 9223372036854775808.0) return 0;
-            return static_cast<long long>(d);
-            };
-
+        long long lo = 1;
+        long long hi = 0;
         if (arity == 1) {
             const scalar_t s(parameters[0]);
-            const long long hi = toInt(s());
+            hi = rndToInt(s());
             if (hi < 1) return 0.0;  // rnd(0) or rnd(negative): degenerate
-            std::uniform_int_distribution<long long> dist(1, hi);
+        }
+        else {
+            // arity == 2
+            const scalar_t a(parameters[0]);
+            const scalar_t b(parameters[1]);
+            lo = rndToInt(a());
+            hi = rndToInt(b());
+            if (hi < lo) std::swap(lo, hi);  // tolerate reversed args
+        }
+
+        if (!_counterMode) {
+            std::uniform_int_distribution<long long> dist(lo, hi);
             return static_cast<double>(dist(_engine));
         }
 
-        // arity == 2
-        const scalar_t a(parameters[0]);
-        const scalar_t b(parameters[1]);
-        long long lo = toInt(a());
-        long long hi = toInt(b());
-        if (hi < lo) std::swap(lo, hi);  // tolerate reversed args
-        std::uniform_int_distribution<long long> dist(lo, hi);
-        return static_cast<double>(dist(_engine));
+        // Counter mode spells the mapping out rather than using
+        // uniform_int_distribution, whose algorithm differs between
+        // standard libraries. Lemire's multiply-and-reject: the high word
+        // of bits * span is the result, and the rare draws that would
+        // make some values more likely are redrawn. The division only
+        // runs when a draw lands in that zone. A span of 0 is the full
+        // 64-bit range.
+        const std::uint64_t span = static_cast<std::uint64_t>(hi)
+            - static_cast<std::uint64_t>(lo) + 1;
+        std::uint64_t offset = nextCounterBits();
+        if (span != 0) {
+            std::uint64_t bits = offset;
+            if (bits * span < span) {
+                const std::uint64_t threshold = (0 - span) % span;
+                while (bits * span < threshold) {
+                    bits = nextCounterBits();
+                }
+            }
+            offset = mulHigh64(bits, span);
+        }
+        return static_cast<double>(
+            static_cast<long long>(static_cast<std::uint64_t>(lo) + offset));
     }
 
     double ExprTkEngine::RndSeedFunction::operator()(const double& seed)
@@ -2702,18 +3182,29 @@ namespace MultiReplaceEngine {
         // seed, which is deterministic for a given input. Non-finite or
         // out-of-range values seed with 0 (an out-of-range double->int
         // conversion would otherwise be undefined).
-        long long s = 0;
-        if (std::isfinite(seed)
-            && seed >= -9223372036854775808.0
-            && seed < 9223372036854775808.0) {
-            s = static_cast<long long>(seed);
-        }
-        _rnd->reseed(static_cast<std::uint64_t>(s));
+        _rnd->reseed(static_cast<std::uint64_t>(rndToInt(seed)));
         return seed;
     }
 
+    double ExprTkEngine::RndKeyFunction::operator()(const double& key)
+    {
+        if (!_rnd) return 0.0;
+        // Same conversion as rndseed().
+        _rnd->setCounterKey(static_cast<std::uint64_t>(rndToInt(key)));
+        return key;
+    }
+
     double ExprTkEngine::RndFunction::nextNormal(double mean, double stddev)
     {
+        if (_counterMode) {
+            // Box-Muller from two draws, keeping only the cosine half:
+            // normal_distribution caches its spare value, which would tie
+            // a draw to the one before it.
+            const double u1 = 1.0 - bitsToUnit(nextCounterBits());  // (0, 1]
+            const double u2 = bitsToUnit(nextCounterBits());
+            const double r = std::sqrt(-2.0 * std::log(u1));
+            return mean + stddev * r * std::cos(6.283185307179586 * u2);
+        }
         std::normal_distribution<double> dist(mean, stddev);
         return dist(_engine);
     }
@@ -49,6 +49,9 @@
 //                return [...] list.
 //     loadlib(p) -> load a library of user-defined functions from path p
 //                (typically used in an empty-Find init slot)
+//     lkp(k, p[, fb])
+//             -> value stored for key k in the .lkp file at path p;
+//                k itself (or fb) when the file has no such key
 //
 // The match text is intentionally not exposed as a string variable.
 // Use txt(0) for the raw match string, HIT or num(0) for the numeric
@@ -71,8 +74,12 @@
 
 #pragma once
 
+#include "FormulaMemo.h"
+#include "LookupStore.h"
 #include "IFormulaEngine.h"
 #include "ILuaEngineHost.h"
+#include "../exprtk/BlockDependencyAnalysis.h"
+#include "../exprtk/DateParse.h"
 #include "../exprtk/ExprTkPatternParser.h"
 #include "../exprtk/EcmdParser.h"
 #include "../exprtk/FormatSpec.h"
@@ -86,6 +93,7 @@
 #include <memory>
 #include <random>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace MultiReplaceEngine {
@@ -111,6 +119,10 @@ namespace MultiReplaceEngine {
         // _errorSkipCount / _skipAllErrors are still reset by the base.
         void beginRun() override;
 
+        // Base skip summary, followed by the result-memo hit rate when a
+        // template in this run was memoised.
+        std::wstring endRunSummary() override;
+
         bool compile(const std::string& scriptUtf8) override;
 
         FormulaResult execute(
@@ -120,6 +132,10 @@ namespace MultiReplaceEngine {
             int  documentCodepage
         ) override;
 
+        // Replays the .elib sources loaded this run from memory rather
+        // than re-reading them, so every clone sees the same library.
+        FormulaEnginePtr clone() const override;
+
         EngineType   type()        const override { return EngineType::ExprTk; }
         std::wstring shortName()   const override { return L"ExprTk"; }
         std::wstring shortLetter() const override { return L"E"; }
@@ -481,6 +497,12 @@ namespace MultiReplaceEngine {
         // std::random_device via std::seed_seq with 4 words (good initial
         // state distribution per C++ standard guidance). rndseed(n) below
         // can reseed for reproducible sequences.
+        //
+        // rndkey(n) switches to counter mode instead: no generator state
+        // is carried from match to match. The k-th draw of a match is a
+        // hash of (n, file, rule index, CNT, k), so a match gets the same
+        // numbers whatever order, batch or worker evaluates it in. The
+        // mode lasts until rndseed() or the next beginRun().
         class RndFunction : public exprtk::igeneric_function<double> {
         public:
             using igenfunct_t = exprtk::igeneric_function<double>;
@@ -488,13 +510,35 @@ namespace MultiReplaceEngine {
             using parameter_list_t = typename igenfunct_t::parameter_list_t;
             using scalar_t = typename generic_t::scalar_view;
 
-            RndFunction();
+            explicit RndFunction(ExprTkEngine* owner);
 
             double operator()(const std::size_t& psi,
                 parameter_list_t parameters) override;
 
-            // Reseed for reproducibility. Used by RndSeedFunction.
-            void reseed(std::uint64_t s) { _engine.seed(s); }
+            // Reseed for reproducibility and leave counter mode. Used by
+            // RndSeedFunction.
+            void reseed(std::uint64_t s) {
+                _engine.seed(s);
+                _counterMode = false;
+            }
+
+            // Enter counter mode keyed by `key`. Used by RndKeyFunction.
+            void setCounterKey(std::uint64_t key) {
+                _counterMode = true;
+                _counterKey = key;
+                _matchKeyValid = false;
+            }
+
+            // Back to the Mersenne Twister stream. Called by beginRun().
+            void setStreamMode() { _counterMode = false; }
+
+            // Start a match's draws. Called by execute() for every match;
+            // the match key itself is only built on the first counter
+            // draw.
+            void beginMatch() {
+                _matchKeyValid = false;
+                _drawIndex = 0;
+            }
 
             // Draw from a normal distribution on the shared engine, so
             // rndseed() makes rndnorm() reproducible too. Used by
@@ -502,7 +546,22 @@ namespace MultiReplaceEngine {
             double nextNormal(double mean, double stddev);
 
         private:
+            // Next 64 bits of the match's counter sequence.
+            std::uint64_t nextCounterBits();
+
+            ExprTkEngine*   _owner;
             std::mt19937_64 _engine;
+
+            bool            _counterMode = false;
+            std::uint64_t   _counterKey = 0;
+            std::uint64_t   _matchKey = 0;
+            bool            _matchKeyValid = false;
+            std::uint64_t   _drawIndex = 0;
+
+            // Hash of the file identity, recomputed when the file changes.
+            // Starts as the FNV-1a hash of the empty string.
+            std::string     _fileIdentity;
+            std::uint64_t   _fileHash = 14695981039346656037ull;
         };
 
         // rndseed(n) - reseed the rnd() generator for reproducible
@@ -519,6 +578,19 @@ namespace MultiReplaceEngine {
             RndFunction* _rnd;
         };
 
+        // rndkey(n) - switch rnd() and rndnorm() to counter mode keyed by
+        // n. Returns n unchanged, like rndseed().
+        class RndKeyFunction : public exprtk::ifunction<double> {
+        public:
+            explicit RndKeyFunction(RndFunction* rnd)
+                : exprtk::ifunction<double>(1), _rnd(rnd) {}
+
+            double operator()(const double& key) override;
+
+        private:
+            RndFunction* _rnd;
+        };
+
         // rndnorm(mean, std) - Gaussian (normal) random number, drawn from
         // the same engine as rnd() so rndseed() makes it reproducible too.
         // A non-positive or non-finite std collapses to the mean (a
@@ -820,8 +892,9 @@ namespace MultiReplaceEngine {
 
         // totxt(n) -> n as a string (shortest round-trip, same as the
         // default number output). totxt(n, fmt) -> n formatted with the
-        // '~ fmt' grammar. fmt is parsed per call; an invalid fmt, or a
-        // text spec (t:...) applied to a number, yields "".
+        // '~ fmt' grammar. fmt is parsed when it differs from the previous
+        // call's; an invalid fmt, or a text spec (t:...) applied to a
+        // number, yields "".
         class TotxtFunction : public exprtk::igeneric_function<double> {
         public:
             using igenfunct_t = exprtk::igeneric_function<double>;
@@ -835,8 +908,48 @@ namespace MultiReplaceEngine {
             double operator()(const std::size_t& psi,
                 std::string& result,
                 parameter_list_t parameters) override;
+
+        private:
+            // Last fmt seen by totxt(n, fmt) and its parsed spec.
+            std::string      _lastFormat;
+            FormatSpec::Spec _lastSpec;
+            bool             _haveSpec = false;
         };
 
+        // lkp(key, path) -> the value stored for key in the .lkp file at
+        // path, or key itself when there is none. lkp(key, path, fb)
+        // returns fb instead for a missing key. A numeric key is matched
+        // by its default number text, so lkp(num(1), p) finds "42".
+        //
+        // Files are opened through LookupStore once per run and shared
+        // with every other engine in the process. A file that cannot be
+        // read or is not a literal table fails the run through the
+        // loadlib() latch.
+        class LkpFunction : public exprtk::igeneric_function<double> {
+        public:
+            using igenfunct_t = exprtk::igeneric_function<double>;
+            using generic_t = typename igenfunct_t::generic_type;
+            using parameter_list_t = typename igenfunct_t::parameter_list_t;
+            using scalar_t = typename generic_t::scalar_view;
+            using string_t = typename generic_t::string_view;
+
+            explicit LkpFunction(ExprTkEngine* owner)
+                : igenfunct_t("SS|TS|SSS|TSS", igenfunct_t::e_rtrn_string)
+                , _owner(owner) {
+            }
+
+            double operator()(const std::size_t& psi,
+                std::string& result,
+                parameter_list_t parameters) override;
+
+        private:
+            ExprTkEngine* _owner;
+        };
+
+        // Table for lkp(): opened on first use in a run, then served from
+        // _lookupTables. Null (with the latch set) on failure.
+        const LookupTable* lookupTable(const std::string& utf8Path);
+
         // ----- ecmd library plumbing ---------------------------------------
         //
         // A user-defined function loaded from a .elib file. One instance
@@ -934,6 +1047,33 @@ namespace MultiReplaceEngine {
             std::vector<ArgRoute>                       _argRoutes;
         };
 
+        // Loop-iteration and run-time budget (see FormulaLimits), consulted
+        // by ExprTk on every iteration of a for / while / repeat loop.
+        // beginRun() registers it with both parsers only when a limit is
+        // set, so unlimited runs compile their loops without the check.
+        // Once exceeded, check() keeps returning false, which ends the
+        // running loop and every loop around it; execute() then discards
+        // the match through exceeded().
+        class LoopBudget : public exprtk::loop_runtime_check {
+        public:
+            explicit LoopBudget(ExprTkEngine* owner);
+
+            void beginMatch() { _iterations = 0; _exceeded = false; }
+            bool exceeded() const { return _exceeded; }
+
+            bool check() override;
+
+            // ExprTk's default throws; the latch is all execute() needs.
+            void handle_runtime_violation(const violation_context&) override {
+                _exceeded = true;
+            }
+
+        private:
+            ExprTkEngine* _owner;
+            std::uint64_t _iterations = 0;
+            bool          _exceeded = false;
+        };
+
         // Owns all ecmd functions loaded during the current run. Lifetime
         // is one Replace-All: re-created in beginRun(). The library's own
         // symbol_table is what holds the function registrations; the
@@ -962,12 +1102,25 @@ namespace MultiReplaceEngine {
 
             bool empty() const { return _instances.empty(); }
 
+            // Loops in function bodies compiled from now on are bounded
+            // by `check` (the engine's LoopBudget).
+            void registerLoopCheck(exprtk::loop_runtime_check& check) {
+                _loopCheck = &check;
+                if (_parser) {
+                    _parser->register_loop_runtime_check(check);
+                }
+            }
+
         private:
             symbol_table_t                                       _libTable;
             std::vector<std::unique_ptr<EcmdFunctionInstance>>   _instances;
             // Parser is owned by the library so its diagnostic state
-            // doesn't leak across loads from different files.
-            parser_t                                             _parser;
+            // doesn't leak across loads from different files. Created by
+            // the first load(): every run starts a new library, and most
+            // runs never call loadlib(), so constructing an ExprTk parser
+            // up front would only add to the cost of each beginRun().
+            std::unique_ptr<parser_t>                            _parser;
+            exprtk::loop_runtime_check*                          _loopCheck = nullptr;
         };
 
         // ExprTk-callable: loadlib("path") -> 0. The user invokes this from
@@ -1006,6 +1159,16 @@ namespace MultiReplaceEngine {
         // follow-up "undefined symbol" errors.
         bool loadEcmdFile(const std::string& utf8Path);
 
+        // Process-wide table of the built-ins that hold no state: isnum,
+        // now, today, the string pack except totxt, and ExprTk's math
+        // constants. Built once on first use, never modified afterwards,
+        // and registered by every engine next to its own _symbolTable, so
+        // creating an engine no longer re-registers them. Everything
+        // registered here must be safe to call from several engines on
+        // different threads at once.
+        struct BaseBuiltins;
+        static symbol_table_t& baseSymbolTable();
+
         // ----- state -------------------------------------------------------
 
         ILuaEngineHost* _host;            // accepted, currently unused
@@ -1020,7 +1183,10 @@ namespace MultiReplaceEngine {
         std::string _lastCompiledScript;
         bool        _haveCompiled = false;
 
-        // ExprTk plumbing
+        // ExprTk plumbing. _symbolTable holds what belongs to this engine:
+        // the match variables and every built-in that reads engine state.
+        // compile() layers it over baseSymbolTable(), so run variables win
+        // a name lookup over the shared built-ins.
         symbol_table_t              _symbolTable;
         parser_t                    _parser;
         std::vector<expression_t>   _compiledExpressions;
@@ -1030,13 +1196,55 @@ namespace MultiReplaceEngine {
         // isString=true means the root node is string-producing (e.g.
         // (?=num2rom(num(1))) or (?='abc')); the engine reads the string
         // directly via expression_helper::get_string() instead of value().
+        //
+        // dependency is the compile-time scope of the block (see
+        // BlockDependencyAnalysis.h). Constant and PerFile blocks keep
+        // their last rendering in the folded* fields: execute() replays
+        // it instead of evaluating again while the scope still matches -
+        // for PerFile, while FPATH / FNAME are unchanged. Only successful
+        // renderings are stored, so an invalid result keeps going through
+        // the error path on every match.
         struct SegmentSpec {
             bool hasSpec = false;
             bool isString = false;
             FormatSpec::Spec spec;
+
+            BlockDependency dependency = BlockDependency::PerMatch;
+            bool        folded = false;
+            bool        foldedEscaped = false;  // rendered for regex mode
+            std::string foldedOutput;           // bytes appended to out
+            BlockOutput foldedBlockOutput;      // history slot content
+            std::string foldedFPATH;
+            std::string foldedFNAME;
         };
         std::vector<SegmentSpec>    _segmentSpecs;
 
+        // Store the bytes a Constant / PerFile block just appended to
+        // `out` (from renderStart on) together with its history slot, so
+        // the next execute() can replay them. No-op for PerMatch blocks.
+        void foldBlock(SegmentSpec& segSpec, std::size_t expressionIdx,
+            const std::string& out, std::size_t renderStart, bool escaped);
+
+        // Result memo. Enabled by compile() only when every block is a
+        // function of the current match's inputs (BlockInputs::
+        // deterministic), at least one block needs per-match evaluation,
+        // and the inputs exclude CNT / APOS, which never repeat within a
+        // run. The key is built from exactly the inputs the blocks read:
+        // the _memoVariables bits and the _memoCaptures indexes (or every
+        // capture when an index is computed). Hit counters of templates
+        // replaced during the run are folded into the _memoRun* totals
+        // so endRunSummary() covers the whole run.
+        void buildMemoKey(const FormulaVars& vars, bool isRegexMatch);
+
+        FormulaMemo              _memo;
+        bool                     _memoEnabled = false;
+        std::uint32_t            _memoVariables = 0;
+        std::vector<std::size_t> _memoCaptures;
+        bool                     _memoAllCaptures = false;
+        std::string              _memoKey;      // reused across matches
+        std::size_t              _memoRunHits = 0;
+        std::size_t              _memoRunLookups = 0;
+
         // Variables registered with the symbol table. Held as members
         // (not locals) because ExprTk binds them by reference - they must
         // outlive every expression that uses them.
@@ -1075,6 +1283,10 @@ namespace MultiReplaceEngine {
         std::string _strFPATH;
         std::string _strFNAME;
 
+        // FormulaVars::ruleIndex of the current match. Not a script
+        // variable; read by the counter-mode RNG.
+        int _ruleIndex = -1;
+
         // Per-match flags, reset at the start of each execute().
         // _wantStop, _skipAllErrors and _errorSkipCount live in
         // IFormulaEngine and are reset by the base beginRun() / per-match
@@ -1107,22 +1319,19 @@ namespace MultiReplaceEngine {
         NumColFunction _numColFunction;
         TxtColFunction _txtColFunction;
 
-        // isnum(x) - finite check, accepts scalars and strings.
-        IsNumFunction _isNumFunction;
-
-        // rnd() / rnd(hi) / rnd(lo, hi) and rndseed(n). RndSeedFunction
-        // holds a pointer to _rndFunction to reseed its engine in place.
+        // rnd() / rnd(hi) / rnd(lo, hi), rndseed(n) and rndkey(n).
+        // RndSeedFunction and RndKeyFunction hold a pointer to
+        // _rndFunction to switch its generator in place.
         RndFunction _rndFunction;
         RndSeedFunction _rndSeedFunction;
+        RndKeyFunction _rndKeyFunction;
         RndNormFunction _rndNormFunction;
 
-        // now() and today() - current time built-ins.
-        NowFunction _nowFunction;
-        TodayFunction _todayFunction;
-
         // The todate(str, fmt) callable for string-to-timestamp
-        // parsing - the inverse of d:fmt output.
+        // parsing - the inverse of d:fmt output. Compiled formats are
+        // cached per engine so a literal fmt is tokenised only once.
         TodateFunction _todateFunction;
+        MultiReplace::DateFormatCache _dateFormats;
 
         // Base-parsing built-ins: hex/bin/oct string -> numeric. The
         // parameterised class carries its base (16/2/8) so one operator()
@@ -1138,21 +1347,17 @@ namespace MultiReplaceEngine {
         Num2RomFunction _num2romFunction;
         Rom2NumFunction _rom2numFunction;
 
-        // String pack.
-        LenFunction _lenFunction;
-        FindFunction _findFunction;
-        SliceFunction _sliceFunction;
-        SplitFunction _splitFunction;
-        TrimFunction _trimFunction;
-        TrimFunction _ltrimFunction;
-        TrimFunction _rtrimFunction;
-        ReplaceFunction _replaceFunction;
-        ReptxtFunction _reptxtFunction;
-        TonumFunction _tonumFunction;
-        Chr2NumFunction _chr2numFunction;
-        Num2ChrFunction _num2chrFunction;
+        // totxt() from the string pack. Kept per engine because it caches
+        // the last parsed format spec; the rest of the pack is stateless
+        // and lives in the shared base table (see baseSymbolTable()).
         TotxtFunction _totxtFunction;
 
+        // lkp(key, path[, fallback]) and the tables it opened this run.
+        // Cleared in beginRun() so an edited .lkp is picked up by the
+        // next Replace-All; the store itself keeps the compiled image.
+        LkpFunction _lkpFunction;
+        std::unordered_map<std::string, std::shared_ptr<const LookupTable>> _lookupTables;
+
         // The loadlib("path") loader callable, registered with the symbol
         // table at initialize().
         EcmdLoaderFunction _ecmdLoaderFunction;
@@ -1170,6 +1375,17 @@ namespace MultiReplaceEngine {
         bool        _loadlibFailed = false;
         std::string _loadlibError;
 
+        // Sources of the libraries loaded this run, in load order, kept
+        // for clone(). Cleared in beginRun() with the library itself.
+        struct LoadedLibrary {
+            std::string content;
+            std::string label;
+        };
+        std::vector<LoadedLibrary> _loadedLibraries;
+
+        // Per-match loop budget; reset at the start of each evaluation.
+        LoopBudget  _loopBudget;
+
         // -----------------------------------------------------------------
         // Match-history storage
         //
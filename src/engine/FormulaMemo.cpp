@@ -0,0 +1,96 @@
+// This file is part of MultiReplace.
+//
+// MultiReplace is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// FormulaMemo.cpp
+// LRU list plus hash index. See header for the contract.
+
+#include "FormulaMemo.h"
+
+namespace MultiReplaceEngine {
+
+    const FormulaMemo::Entry* FormulaMemo::find(std::string_view key)
+    {
+        if (!_active) {
+            return nullptr;
+        }
+
+        ++_lookups;
+        const auto it = _index.find(key);
+        if (it != _index.end()) {
+            ++_hits;
+            // splice keeps the node (and the key view into it) in place.
+            _lru.splice(_lru.begin(), _lru, it->second);
+            return &*it->second;
+        }
+
+        // End of the probe window: keep going only if enough lookups hit.
+        // Entries are released right away so a template that gave up does
+        // not hold its memory for the rest of the run.
+        if (_lookups == kProbeLookups && _hits * kMinHitDivisor < _lookups) {
+            _active = false;
+            _index.clear();
+            _lru.clear();
+            _bytes = 0;
+        }
+        return nullptr;
+    }
+
+    void FormulaMemo::insert(std::string_view key, std::string_view output, bool skip)
+    {
+        if (!_active) {
+            return;
+        }
+
+        Entry entry;
+        entry.key.assign(key.data(), key.size());
+        entry.output.assign(output.data(), output.size());
+        entry.skip = skip;
+
+        const std::size_t cost = costOf(entry);
+        if (cost > _limits.maxBytes || _limits.maxEntries == 0) {
+            return;
+        }
+
+        // Callers insert after a miss, but stay correct if the key is
+        // already present: replace the old entry instead of duplicating.
+        if (const auto it = _index.find(key); it != _index.end()) {
+            _bytes -= costOf(*it->second);
+            _lru.erase(it->second);
+            _index.erase(it);
+        }
+
+        while (!_lru.empty()
+            && (_lru.size() >= _limits.maxEntries || _bytes + cost > _limits.maxBytes)) {
+            evictColdest();
+        }
+
+        _lru.push_front(std::move(entry));
+        _index.emplace(std::string_view(_lru.front().key), _lru.begin());
+        _bytes += cost;
+    }
+
+    void FormulaMemo::clear()
+    {
+        _index.clear();
+        _lru.clear();
+        _bytes = 0;
+        _hits = 0;
+        _lookups = 0;
+        _evictions = 0;
+        _active = true;
+    }
+
+    void FormulaMemo::evictColdest()
+    {
+        const Entry& cold = _lru.back();
+        _index.erase(std::string_view(cold.key));
+        _bytes -= costOf(cold);
+        _lru.pop_back();
+        ++_evictions;
+    }
+
+} // namespace MultiReplaceEngine
@@ -0,0 +1,109 @@
+// This file is part of MultiReplace.
+//
+// MultiReplace is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// FormulaMemo.h
+// Bounded LRU cache of rendered formula results, keyed by an opaque
+// byte string the engine builds from the inputs a template reads. The
+// engine decides whether a template may be memoised at all (only when
+// the result is provably a function of those inputs); this class just
+// stores, evicts and counts.
+//
+// Two limits bound the cache: an entry count and a byte budget covering
+// keys and outputs. Whichever is hit first evicts from the cold end.
+//
+// A template whose inputs rarely repeat (line numbers, positions) would
+// pay for key building and insertion without ever hitting. After a
+// probe window the cache therefore checks its own hit rate and, if it
+// is too low, stops storing and answering for the rest of the run. The
+// counters then stay at their probe-window values, which is what
+// endRunSummary() reports.
+
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace MultiReplaceEngine {
+
+    class FormulaMemo {
+    public:
+        struct Limits {
+            std::size_t maxEntries = 4096;
+            std::size_t maxBytes = 4 * 1024 * 1024;
+        };
+
+        struct Entry {
+            std::string key;
+            std::string output;
+            bool        skip = false;
+        };
+
+        FormulaMemo() = default;
+        explicit FormulaMemo(Limits limits) : _limits(limits) {}
+
+        FormulaMemo(const FormulaMemo&) = delete;
+        FormulaMemo& operator=(const FormulaMemo&) = delete;
+
+        // Look up `key`. A hit moves the entry to the hot end and
+        // returns it; the pointer stays valid until the next insert() or
+        // clear(). Returns nullptr on a miss or once the cache has given
+        // up (see active()).
+        const Entry* find(std::string_view key);
+
+        // Store a result under `key`, evicting cold entries until both
+        // limits hold again. A single result larger than the byte budget
+        // is not stored. No-op once the cache has given up.
+        void insert(std::string_view key, std::string_view output, bool skip);
+
+        // Drop every entry and reset the counters and the give-up state.
+        // Called when a new template is compiled.
+        void clear();
+
+        // False once the probe window showed too few hits to pay off.
+        bool active() const noexcept { return _active; }
+
+        std::size_t hits() const noexcept { return _hits; }
+        std::size_t lookups() const noexcept { return _lookups; }
+        std::size_t evictions() const noexcept { return _evictions; }
+        std::size_t size() const noexcept { return _lru.size(); }
+        std::size_t bytes() const noexcept { return _bytes; }
+
+    private:
+        // Lookups before the hit rate is judged, and the minimum share of
+        // hits (1 / kMinHitDivisor) needed to stay active after that.
+        static constexpr std::size_t kProbeLookups = 1024;
+        static constexpr std::size_t kMinHitDivisor = 8;
+
+        // Bookkeeping charged per entry on top of key and output bytes:
+        // list node, hash node and the two string headers.
+        static constexpr std::size_t kEntryOverhead = 96;
+
+        static std::size_t costOf(const Entry& e) noexcept {
+            return e.key.size() + e.output.size() + kEntryOverhead;
+        }
+
+        void evictColdest();
+
+        Limits _limits;
+
+        // Most recently used at the front. The index keys are views into
+        // Entry::key; list nodes never move, so the views stay valid for
+        // as long as the entry lives.
+        std::list<Entry> _lru;
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> _index;
+
+        std::size_t _bytes = 0;
+        std::size_t _hits = 0;
+        std::size_t _lookups = 0;
+        std::size_t _evictions = 0;
+        bool        _active = true;
+    };
+
+} // namespace MultiReplaceEngine
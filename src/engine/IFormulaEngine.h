@@ -23,6 +23,7 @@
 #include "EngineTypes.h"
 #include "ILuaEngineHost.h"
 
+#include <chrono>
 #include <memory>
 #include <string>
 
@@ -62,14 +63,40 @@ namespace MultiReplaceEngine {
         virtual void beginRun() {
             _skipAllErrors = false;
             _errorSkipCount = 0;
+            _limits = FormulaLimits{};
+            _stepLimitSkipCount = 0;
+            _timeLimitSkipCount = 0;
+            _runTimeLimitReached = false;
+            _evaluating = false;
+            _runEvalTime = Clock::duration::zero();
         }
 
         virtual std::wstring endRunSummary() {
-            if (_errorSkipCount == 0) {
-                return std::wstring{};
+            std::wstring summary;
+            const auto append = [&summary](std::wstring part) {
+                if (!summary.empty()) {
+                    summary += L" ";
+                }
+                summary += part;
+                };
+            if (_errorSkipCount != 0) {
+                append(localiseCount(L"status_recoverable_errors_skipped_summary",
+                    _errorSkipCount));
             }
-            return localiseCount(L"status_recoverable_errors_skipped_summary",
-                _errorSkipCount);
+            if (_stepLimitSkipCount != 0) {
+                append(localiseCount(L"status_formula_step_limit_summary",
+                    _stepLimitSkipCount));
+            }
+            if (_timeLimitSkipCount != 0) {
+                append(localiseCount(L"status_formula_time_limit_summary",
+                    _timeLimitSkipCount));
+            }
+            return summary;
+        }
+
+        // Matches of this run left unchanged by an evaluation budget.
+        std::size_t budgetSkipCount() const {
+            return _stepLimitSkipCount + _timeLimitSkipCount;
         }
 
         virtual std::wstring endRunSkipAllNoticeText() {
@@ -116,6 +143,21 @@ namespace MultiReplaceEngine {
             int documentCodepage
         ) = 0;
 
+        // ----- Cloning ----------------------------------------------------
+
+        // Build an independent engine of the same type on the same host,
+        // initialised and in a fresh run: same settings, the currently
+        // compiled template compiled again, and (ExprTk) the libraries
+        // loaded so far this run. Run-scoped state is not copied - match
+        // history, skip counters, the RNG stream and Lua globals start
+        // empty, exactly as after beginRun(). Returns nullptr when the
+        // copy cannot be initialised or the template does not compile.
+        //
+        // The clone shares nothing mutable with this engine, so the two
+        // may run on different threads. clone() itself reads this
+        // engine's state and must not overlap with calls on it.
+        virtual std::unique_ptr<IFormulaEngine> clone() const = 0;
+
         // ----- Metadata ---------------------------------------------------
 
         // Identity of this concrete engine.
@@ -178,10 +220,83 @@ namespace MultiReplaceEngine {
             const std::wstring& detailKey,
             const std::string& exprText);
 
+        // ----- Shared evaluation budget -----------------------------------
+        //
+        // _limits is copied from the host by the engine's beginRun(). A
+        // match that exceeds a per-match limit is skipped and counted in
+        // _stepLimitSkipCount. Once the run has spent secondsPerRun inside
+        // formula code, _runTimeLimitReached latches and every remaining
+        // match is skipped unevaluated, counted in _timeLimitSkipCount.
+        // Both counts are reported by endRunSummary(); neither raises a
+        // dialog, so a runaway formula cannot stall the run.
+        //
+        // Only the time between beginEvaluation() and endEvaluation() is
+        // charged, so engines bracket their script calls and leave host
+        // dialogs outside.
+        using Clock = std::chrono::steady_clock;
+
+        FormulaLimits     _limits;
+        std::size_t       _stepLimitSkipCount = 0;
+        std::size_t       _timeLimitSkipCount = 0;
+        bool              _runTimeLimitReached = false;
+        bool              _evaluating = false;
+        Clock::time_point _evalStart{};
+        Clock::duration   _runEvalTime = Clock::duration::zero();
+
+        bool budgetEnabled() const {
+            return _limits.luaInstructionsPerMatch != 0
+                || _limits.loopIterationsPerMatch != 0
+                || _limits.secondsPerRun != 0;
+        }
+
+        void beginEvaluation() {
+            if (_limits.secondsPerRun != 0 && !_evaluating) {
+                _evaluating = true;
+                _evalStart = Clock::now();
+            }
+        }
+
+        void endEvaluation() {
+            if (_evaluating) {
+                _evaluating = false;
+                _runEvalTime += Clock::now() - _evalStart;
+            }
+        }
+
+        // True once the run has used up secondsPerRun; latches. Cheap
+        // enough for the Lua hook and the ExprTk loop check to poll.
+        bool runTimeLimitReached() {
+            if (_runTimeLimitReached || _limits.secondsPerRun == 0) {
+                return _runTimeLimitReached;
+            }
+            Clock::duration spent = _runEvalTime;
+            if (_evaluating) {
+                spent += Clock::now() - _evalStart;
+            }
+            _runTimeLimitReached =
+                spent >= std::chrono::seconds(_limits.secondsPerRun);
+            return _runTimeLimitReached;
+        }
+
+        // Result for a match abandoned because a budget ran out: the
+        // match text stays as it is and the run continues.
+        FormulaResult budgetSkip(bool timeLimit, bool isRegexMatch) {
+            endEvaluation();
+            ++(timeLimit ? _timeLimitSkipCount : _stepLimitSkipCount);
+            FormulaResult result;
+            result.skip = true;
+            result.outputIsRegexSafe = isRegexMatch;
+            return result;
+        }
+
         // Helper for the default endRun* hooks: pulls a translation key
         // and substitutes the count as $REPLACE_STRING.
         static std::wstring localiseCount(const std::wstring& key,
             std::size_t count);
+
+        // Same for two-count templates ($REPLACE_STRING1 / 2).
+        static std::wstring localiseCounts(const std::wstring& key,
+            std::size_t first, std::size_t second);
     };
 
     // Convenience alias used throughout the rest of the codebase to keep
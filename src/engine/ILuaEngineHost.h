@@ -13,10 +13,25 @@
 
 #pragma once
 
+#include "EngineTypes.h"
+
 #include <string>
 
 namespace MultiReplaceEngine {
 
+    // Garbage collector setup LuaEngine applies at beginRun(). Zero for
+    // pause / stepMul keeps Lua's own default (200 / 100); both only
+    // apply to incremental mode. The defaults here are plain Lua; the
+    // panel's INI defaults are tuned. reportStats adds the run's
+    // allocation figures to endRunSummary().
+    struct LuaGcSettings {
+        enum class Mode { Incremental, Generational };
+        Mode mode = Mode::Incremental;
+        int  pause = 0;
+        int  stepMul = 0;
+        bool reportStats = false;
+    };
+
     // Callback hooks the engine needs back into the host. Lua scripts can
     // trigger UI (the debug window, error message boxes), and the result of
     // set() may need to be regex-escaped before going back into a regex
@@ -73,6 +88,13 @@ namespace MultiReplaceEngine {
         virtual bool isLuaSafeModeEnabled()    const = 0;
         virtual bool isDebugModeEnabled()      const = 0;
 
+        // Evaluation budgets for the next run. Read once per run in
+        // beginRun(); see FormulaLimits.
+        virtual FormulaLimits formulaLimits() const = 0;
+
+        // Lua collector mode for the next run, read in beginRun().
+        virtual LuaGcSettings luaGcSettings() const = 0;
+
         // CSV column access for the line containing the current match.
         // Index is 1-based; addressing by name uses the document's first
         // line as a header row, parsed lazily on first use. Returns false
@@ -25,6 +25,13 @@ namespace MultiReplaceEngine {
             key, { std::to_wstring(count) });
     }
 
+    std::wstring IFormulaEngine::localiseCounts(const std::wstring& key,
+        std::size_t first, std::size_t second)
+    {
+        return LanguageManager::instance().get(
+            key, { std::to_wstring(first), std::to_wstring(second) });
+    }
+
     ILuaEngineHost::RecoverableErrorChoice
         IFormulaEngine::handleRecoverableSkip(
             ILuaEngineHost* host,
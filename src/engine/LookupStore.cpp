@@ -0,0 +1,1016 @@
+// This file is part of MultiReplace.
+//
+// MultiReplace is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// LookupStore.cpp
+// Literal parser, image builder, file mapping and the process-wide
+// table registry. See header for the contract.
+//
+// Image layout (native byte order; the image never leaves the machine
+// that wrote it):
+//
+//   ImageHeader
+//   source key bytes (the normalised source path), padded to 8
+//   buckets: bucketCount x { u64 hash, u64 keyRecordOffset }   (0 = empty)
+//   records: key    { u32 size, u64 valueRecordOffset, bytes }
+//            value  { u32 size, u8 type, bytes }
+//
+// Buckets use FNV-1a and linear probing at a load factor of at most
+// one half. Values are stored once per source entry, so the keys of a
+// { {"US", "USA"}, "United States" } row share one value record.
+
+#include "LookupStore.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include "../Encoding.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace MultiReplaceEngine {
+
+    namespace {
+
+        constexpr char          kMagic[8] = { 'M', 'R', 'L', 'K', 'P', 0, 0, 0 };
+        constexpr std::uint32_t kVersion = 2;   // 2: integral float keys also keyed as integers
+
+        struct ImageHeader {
+            char          magic[8];
+            std::uint32_t version;
+            std::uint32_t sourceKeySize;
+            std::uint64_t sourceSize;
+            std::int64_t  sourceTime;
+            std::uint64_t entryCount;
+            std::uint64_t bucketCount;
+            std::uint64_t bucketsOffset;
+            std::uint64_t recordsOffset;
+            std::uint64_t imageSize;
+        };
+        static_assert(sizeof(ImageHeader) == 72, "ImageHeader must not carry padding");
+
+        constexpr std::size_t kBucketSize = 16;
+        constexpr std::size_t kKeyRecordHead = 12;     // u32 size + u64 value offset
+        constexpr std::size_t kValueRecordHead = 5;    // u32 size + u8 type
+
+        std::uint64_t fnv1a(std::string_view s) noexcept
+        {
+            std::uint64_t h = 14695981039346656037ull;
+            for (unsigned char c : s) {
+                h ^= c;
+                h *= 1099511628211ull;
+            }
+            return h;
+        }
+
+        template <typename T>
+        T readAt(const unsigned char* p) noexcept
+        {
+            T v;
+            std::memcpy(&v, p, sizeof(T));
+            return v;
+        }
+
+        template <typename T>
+        void appendRaw(std::string& out, T v)
+        {
+            out.append(reinterpret_cast<const char*>(&v), sizeof(T));
+        }
+
+        std::filesystem::path pathFromUtf8(const std::string& utf8)
+        {
+#ifdef _WIN32
+            return std::filesystem::path(Encoding::utf8ToWString(utf8));
+#else
+            return std::filesystem::path(utf8);
+#endif
+        }
+
+        // ---------------------------------------------------------------------
+        // Lua number rendering
+        // ---------------------------------------------------------------------
+        //
+        // Keys and values that are numbers in the source are stored as
+        // the text tostring() gives in Lua 5.4: integers in decimal,
+        // floats as "%.14g" with ".0" appended when the result would read
+        // as an integer.
+
+        std::string luaIntegerText(long long v)
+        {
+            char buf[32];
+            const int n = std::snprintf(buf, sizeof(buf), "%lld", v);
+            return std::string(buf, static_cast<std::size_t>(n));
+        }
+
+        std::string luaFloatText(double v)
+        {
+            char buf[64];
+            int n = std::snprintf(buf, sizeof(buf), "%.14g", v);
+            if (buf[std::strspn(buf, "-0123456789")] == '\0') {
+                buf[n++] = '.';
+                buf[n++] = '0';
+            }
+            return std::string(buf, static_cast<std::size_t>(n));
+        }
+
+        // The integer text of a float that holds an integral value in
+        // the int64 range, as math.tointeger() would give it.
+        bool integralFloatText(double v, std::string& out)
+        {
+            if (!std::isfinite(v) || v != std::floor(v)
+                || v < -9223372036854775808.0 || v >= 9223372036854775808.0) {
+                return false;
+            }
+            out = luaIntegerText(static_cast<long long>(v));
+            return true;
+        }
+
+        // ---------------------------------------------------------------------
+        // Literal parser
+        // ---------------------------------------------------------------------
+        //
+        // Accepts exactly the shape lkp() documents:
+        //
+        //   return { { key | { key, ... }, value }, ... }
+        //
+        // with keys and values as string or numeric literals and nil
+        // values (the row is dropped, as lkp() did). Anything else is
+        // "not a literal table" and left to Lua.
+
+        struct ParsedValue {
+            std::string             text;
+            LookupTable::ValueType  type = LookupTable::ValueType::String;
+        };
+
+        class LiteralParser {
+        public:
+            explicit LiteralParser(std::string_view text) : _s(text) {}
+
+            // Calls onRow(keys, value) for every row whose value is not nil.
+            template <typename OnRow>
+            bool parse(OnRow&& onRow)
+            {
+                skipSpace();
+                if (!keyword("return")) {
+                    return fail("expected 'return'");
+                }
+                if (!expect('{')) return false;
+                std::vector<std::string> keys;
+                ParsedValue value;
+                for (;;) {
+                    skipSpace();
+                    if (peek() == '}') { ++_pos; break; }
+
+                    if (!expect('{')) return false;
+                    keys.clear();
+                    bool nilValue = false;
+                    if (!parseKeys(keys) || !expectSeparator()
+                        || !parseValue(value, nilValue)) {
+                        return false;
+                    }
+                    skipSpace();
+                    if (peek() == ',' || peek() == ';') {
+                        ++_pos;
+                        skipSpace();
+                    }
+                    if (!expect('}')) return false;
+                    if (!nilValue) {
+                        onRow(keys, value);
+                    }
+
+                    skipSpace();
+                    if (peek() == ',' || peek() == ';') {
+                        ++_pos;
+                    }
+                    else if (peek() != '}') {
+                        return fail("expected ',' or '}'");
+                    }
+                }
+                skipSpace();
+                if (peek() == ';') {
+                    ++_pos;
+                    skipSpace();
+                }
+                if (_pos != _s.size()) {
+                    return fail("unexpected text after the table");
+                }
+                return true;
+            }
+
+            const std::string& error() const { return _error; }
+
+        private:
+            char peek() const { return _pos < _s.size() ? _s[_pos] : '\0'; }
+
+            bool fail(const std::string& what)
+            {
+                _error = "line " + std::to_string(_line) + ": " + what;
+                return false;
+            }
+
+            bool expect(char c)
+            {
+                skipSpace();
+                if (peek() != c) {
+                    return fail(std::string("expected '") + c + "'");
+                }
+                ++_pos;
+                return true;
+            }
+
+            bool expectSeparator()
+            {
+                skipSpace();
+                if (peek() != ',' && peek() != ';') {
+                    return fail("expected ','");
+                }
+                ++_pos;
+                return true;
+            }
+
+            bool keyword(std::string_view word)
+            {
+                if (_s.compare(_pos, word.size(), word) != 0) {
+                    return false;
+                }
+                const std::size_t end = _pos + word.size();
+                if (end < _s.size() && (std::isalnum(static_cast<unsigned char>(_s[end])) || _s[end] == '_')) {
+                    return false;
+                }
+                _pos = end;
+                return true;
+            }
+
+            // Whitespace and comments (-- line, --[[ block ]], --[==[ ]==]).
+            void skipSpace()
+            {
+                while (_pos < _s.size()) {
+                    const char c = _s[_pos];
+                    if (c == '\n') { ++_line; ++_pos; continue; }
+                    if (c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v') { ++_pos; continue; }
+                    if (c == '-' && _pos + 1 < _s.size() && _s[_pos + 1] == '-') {
+                        _pos += 2;
+                        std::size_t level = 0;
+                        if (longBracketLevel(level)) {
+                            std::string ignored;
+                            readLongBracket(level, ignored);
+                        }
+                        else {
+                            while (_pos < _s.size() && _s[_pos] != '\n') ++_pos;
+                        }
+                        continue;
+                    }
+                    break;
+                }
+            }
+
+            // At '[' followed by '='* and '['? Consumes the opener.
+            bool longBracketLevel(std::size_t& level)
+            {
+                if (peek() != '[') return false;
+                std::size_t p = _pos + 1;
+                while (p < _s.size() && _s[p] == '=') ++p;
+                if (p >= _s.size() || _s[p] != '[') return false;
+                level = p - _pos - 1;
+                _pos = p + 1;
+                return true;
+            }
+
+            bool readLongBracket(std::size_t level, std::string& out)
+            {
+                // A newline right after the opener is not part of the string.
+                if (peek() == '\r') { ++_pos; if (peek() == '\n') ++_pos; ++_line; }
+                else if (peek() == '\n') { ++_pos; if (peek() == '\r') ++_pos; ++_line; }
+                while (_pos < _s.size()) {
+                    const char c = _s[_pos];
+                    if (c == ']') {
+                        std::size_t p = _pos + 1;
+                        while (p < _s.size() && _s[p] == '=') ++p;
+                        if (p < _s.size() && _s[p] == ']' && p - _pos - 1 == level) {
+                            _pos = p + 1;
+                            return true;
+                        }
+                    }
+                    if (c == '\n') ++_line;
+                    out.push_back(c);
+                    ++_pos;
+                }
+                return fail("unfinished long string");
+            }
+
+            static void appendUtf8(std::string& out, std::uint32_t cp)
+            {
+                if (cp < 0x80) {
+                    out.push_back(static_cast<char>(cp));
+                }
+                else if (cp < 0x800) {
+                    out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+                    out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+                }
+                else if (cp < 0x10000) {
+                    out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+                    out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+                    out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+                }
+                else {
+                    out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+                    out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+                    out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+                    out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+                }
+            }
+
+            static int hexDigit(char c)
+            {
+                if (c >= '0' && c <= '9') return c - '0';
+                if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+                if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+                return -1;
+            }
+
+            // Quoted string with Lua's escape set.
+            bool readQuoted(std::string& out)
+            {
+                const char quote = _s[_pos++];
+                while (_pos < _s.size()) {
+                    // Copy the plain run up to the next quote, escape or
+                    // newline in one go.
+                    const std::size_t plain = _s.find_first_of(
+                        quote == '"' ? std::string_view("\"\\\n") : std::string_view("'\\\n"), _pos);
+                    const std::size_t runEnd = plain == std::string_view::npos ? _s.size() : plain;
+                    out.append(_s.data() + _pos, runEnd - _pos);
+                    _pos = runEnd;
+                    if (_pos >= _s.size()) break;
+
+                    const char c = _s[_pos++];
+                    if (c == quote) return true;
+                    if (c == '\n') return fail("unfinished string");
+                    if (c != '\\') { out.push_back(c); continue; }
+                    if (_pos >= _s.size()) break;
+
+                    const char e = _s[_pos++];
+                    switch (e) {
+                    case 'n':  out.push_back('\n'); break;
+                    case 't':  out.push_back('\t'); break;
+                    case 'r':  out.push_back('\r'); break;
+                    case 'a':  out.push_back('\a'); break;
+                    case 'b':  out.push_back('\b'); break;
+                    case 'f':  out.push_back('\f'); break;
+                    case 'v':  out.push_back('\v'); break;
+                    case '\\': out.push_back('\\'); break;
+                    case '"':  out.push_back('"'); break;
+                    case '\'': out.push_back('\''); break;
+                    case '\n': out.push_back('\n'); ++_line; if (peek() == '\r') ++_pos; break;
+                    case '\r': out.push_back('\n'); ++_line; if (peek() == '\n') ++_pos; break;
+                    case 'z':
+                        while (_pos < _s.size() && std::isspace(static_cast<unsigned char>(_s[_pos]))) {
+                            if (_s[_pos] == '\n') ++_line;
+                            ++_pos;
+                        }
+                        break;
+                    case 'x': {
+                        const int hi = _pos < _s.size() ? hexDigit(_s[_pos]) : -1;
+                        const int lo = _pos + 1 < _s.size() ? hexDigit(_s[_pos + 1]) : -1;
+                        if (hi < 0 || lo < 0) return fail("invalid \\x escape");
+                        out.push_back(static_cast<char>(hi * 16 + lo));
+                        _pos += 2;
+                        break;
+                    }
+                    case 'u': {
+                        if (peek() != '{') return fail("invalid \\u escape");
+                        ++_pos;
+                        std::uint32_t cp = 0;
+                        int digits = 0;
+                        while (_pos < _s.size() && hexDigit(_s[_pos]) >= 0) {
+                            cp = cp * 16 + static_cast<std::uint32_t>(hexDigit(_s[_pos++]));
+                            if (++digits > 6 || cp > 0x7FFFFFFFu) return fail("invalid \\u escape");
+                        }
+                        if (digits == 0 || peek() != '}' || cp > 0x10FFFF) return fail("invalid \\u escape");
+                        ++_pos;
+                        appendUtf8(out, cp);
+                        break;
+                    }
+                    default:
+                        if (e >= '0' && e <= '9') {
+                            int v = e - '0';
+                            for (int k = 0; k < 2 && _pos < _s.size()
+                                && _s[_pos] >= '0' && _s[_pos] <= '9'; ++k) {
+                                v = v * 10 + (_s[_pos++] - '0');
+                            }
+                            if (v > 255) return fail("decimal escape too large");
+                            out.push_back(static_cast<char>(v));
+                            break;
+                        }
+                        return fail("invalid escape sequence");
+                    }
+                }
+                return fail("unfinished string");
+            }
+
+            // Numeric literal, optionally negated, rendered as tostring().
+            bool readNumber(std::string& out)
+            {
+                bool negative = false;
+                if (peek() == '-') {
+                    negative = true;
+                    ++_pos;
+                    skipSpace();
+                }
+                const std::size_t start = _pos;
+                while (_pos < _s.size()) {
+                    const char c = _s[_pos];
+                    const bool exponentSign = (c == '+' || c == '-') && _pos > start
+                        && (_s[_pos - 1] == 'e' || _s[_pos - 1] == 'E')
+                        && !(_s.size() > start + 1 && (_s[start + 1] == 'x' || _s[start + 1] == 'X'));
+                    if (std::isalnum(static_cast<unsigned char>(c)) || c == '.' || exponentSign) {
+                        ++_pos;
+                        continue;
+                    }
+                    break;
+                }
+                const std::string_view tok = _s.substr(start, _pos - start);
+                if (tok.empty()) return fail("expected a value");
+
+                // Hexadecimal integer; wraps around like Lua's.
+                if (tok.size() > 2 && tok[0] == '0' && (tok[1] == 'x' || tok[1] == 'X')) {
+                    std::uint64_t v = 0;
+                    for (std::size_t i = 2; i < tok.size(); ++i) {
+                        const int d = hexDigit(tok[i]);
+                        if (d < 0) return fail("unsupported number literal");
+                        v = v * 16 + static_cast<std::uint64_t>(d);
+                    }
+                    if (negative) v = 0 - v;
+                    out = luaIntegerText(static_cast<long long>(v));
+                    return true;
+                }
+
+                const bool isFloat = tok.find_first_of(".eE") != std::string_view::npos;
+                if (!isFloat) {
+                    std::uint64_t v = 0;
+                    bool overflow = false;
+                    for (char c : tok) {
+                        if (c < '0' || c > '9') return fail("unsupported number literal");
+                        const std::uint64_t d = static_cast<std::uint64_t>(c - '0');
+                        if (v > (UINT64_MAX - d) / 10) { overflow = true; break; }
+                        v = v * 10 + d;
+                    }
+                    // Lua reads a decimal integer that does not fit as a float.
+                    if (!overflow && v <= static_cast<std::uint64_t>(INT64_MAX)) {
+                        const long long iv = static_cast<long long>(v);
+                        out = luaIntegerText(negative ? -iv : iv);
+                        return true;
+                    }
+                    if (!overflow && negative && v == static_cast<std::uint64_t>(INT64_MAX) + 1) {
+                        out = luaIntegerText(INT64_MIN);
+                        return true;
+                    }
+                }
+
+                double d = 0.0;
+                const auto res = std::from_chars(tok.data(), tok.data() + tok.size(), d);
+                if (res.ec != std::errc() || res.ptr != tok.data() + tok.size()) {
+                    return fail("unsupported number literal");
+                }
+                out = luaFloatText(negative ? -d : d);
+                return true;
+            }
+
+            bool parseScalar(std::string& out, LookupTable::ValueType& type)
+            {
+                skipSpace();
+                const char c = peek();
+                out.clear();
+                if (c == '"' || c == '\'') {
+                    type = LookupTable::ValueType::String;
+                    return readQuoted(out);
+                }
+                std::size_t level = 0;
+                if (longBracketLevel(level)) {
+                    type = LookupTable::ValueType::String;
+                    return readLongBracket(level, out);
+                }
+                if (c == '-' || c == '.' || (c >= '0' && c <= '9')) {
+                    type = LookupTable::ValueType::Number;
+                    return readNumber(out);
+                }
+                return fail("expected a string or number literal");
+            }
+
+            bool parseKeys(std::vector<std::string>& keys)
+            {
+                skipSpace();
+                LookupTable::ValueType type;
+                std::string key;
+                if (peek() != '{') {
+                    if (!parseScalar(key, type)) return false;
+                    pushKey(keys, key, type);
+                    return true;
+                }
+                ++_pos;
+                for (;;) {
+                    skipSpace();
+                    if (peek() == '}') { ++_pos; return true; }
+                    if (!parseScalar(key, type)) return false;
+                    pushKey(keys, key, type);
+                    skipSpace();
+                    if (peek() == ',' || peek() == ';') {
+                        ++_pos;
+                    }
+                    else if (peek() != '}') {
+                        return fail("expected ',' or '}'");
+                    }
+                }
+            }
+
+            // A float key with an integral value (2.0, 1e3) is stored under
+            // its tostring() text and under the integer's, which is what
+            // LookupStore::numberKey() looks up.
+            void pushKey(std::vector<std::string>& keys, const std::string& key,
+                LookupTable::ValueType type)
+            {
+                keys.push_back(key);
+                if (type != LookupTable::ValueType::Number
+                    || key.find_first_of(".eE") == std::string::npos) {
+                    return;
+                }
+                double d = 0.0;
+                const auto res = std::from_chars(key.data(), key.data() + key.size(), d);
+                std::string alias;
+                if (res.ec == std::errc() && integralFloatText(d, alias)) {
+                    keys.push_back(std::move(alias));
+                }
+            }
+
+            bool parseValue(ParsedValue& value, bool& isNil)
+            {
+                skipSpace();
+                isNil = keyword("nil");
+                if (isNil) return true;
+                return parseScalar(value.text, value.type);
+            }
+
+            std::string_view _s;
+            std::size_t      _pos = 0;
+            int              _line = 1;
+            std::string      _error;
+        };
+
+        // ---------------------------------------------------------------------
+        // Source reading
+        // ---------------------------------------------------------------------
+
+        struct SourceStamp {
+            std::uint64_t size = 0;
+            std::int64_t  time = 0;
+        };
+
+        bool statSource(const std::filesystem::path& path, SourceStamp& stamp)
+        {
+            std::error_code ec;
+            const auto size = std::filesystem::file_size(path, ec);
+            if (ec) return false;
+            const auto time = std::filesystem::last_write_time(path, ec);
+            if (ec) return false;
+            stamp.size = static_cast<std::uint64_t>(size);
+            stamp.time = static_cast<std::int64_t>(time.time_since_epoch().count());
+            return true;
+        }
+
+        // Same normalisation as the Lua sandbox loader: BOM stripped,
+        // non-UTF-8 text read in the ANSI codepage.
+        bool readSourceText(const std::filesystem::path& path, std::string& text)
+        {
+            std::ifstream in(path, std::ios::binary);
+            if (!in) return false;
+            std::string raw((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            if (raw.size() >= 3
+                && static_cast<unsigned char>(raw[0]) == 0xEF
+                && static_cast<unsigned char>(raw[1]) == 0xBB
+                && static_cast<unsigned char>(raw[2]) == 0xBF) {
+                raw.erase(0, 3);
+            }
+            if (Encoding::isValidUtf8(raw.data(), raw.size())) {
+                text = std::move(raw);
+            }
+            else {
+                text = Encoding::bytesToUtf8(raw.data(), raw.size(), CP_ACP);
+            }
+            return true;
+        }
+
+        std::string hexName(std::uint64_t h)
+        {
+            char buf[17];
+            std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(h));
+            return std::string(buf, 16);
+        }
+
+        // ---------------------------------------------------------------------
+        // Registry
+        // ---------------------------------------------------------------------
+
+        struct Registry {
+            std::mutex mutex;
+            std::unordered_map<std::string, std::weak_ptr<const LookupTable>> tables;
+            std::filesystem::path cacheDir;
+        };
+
+        Registry& registry()
+        {
+            static Registry r;
+            return r;
+        }
+
+    } // anonymous namespace
+
+    // -------------------------------------------------------------------------
+    // Storage: a read-only file mapping, or an in-memory image
+    // -------------------------------------------------------------------------
+
+    struct LookupTable::Storage {
+        std::string owned;          // in-memory image when not mapped
+        const unsigned char* data = nullptr;
+        std::size_t size = 0;
+#ifdef _WIN32
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = nullptr;
+#else
+        void* view = nullptr;
+#endif
+
+        ~Storage()
+        {
+#ifdef _WIN32
+            if (mapping) {
+                UnmapViewOfFile(data);
+                CloseHandle(mapping);
+            }
+            if (file != INVALID_HANDLE_VALUE) {
+                CloseHandle(file);
+            }
+#else
+            if (view) {
+                munmap(view, size);
+            }
+#endif
+        }
+
+        bool isMapped() const noexcept
+        {
+#ifdef _WIN32
+            return mapping != nullptr;
+#else
+            return view != nullptr;
+#endif
+        }
+
+        static std::unique_ptr<Storage> fromImage(std::string image)
+        {
+            auto s = std::make_unique<Storage>();
+            s->owned = std::move(image);
+            s->data = reinterpret_cast<const unsigned char*>(s->owned.data());
+            s->size = s->owned.size();
+            return s;
+        }
+
+        static std::unique_ptr<Storage> map(const std::filesystem::path& path)
+        {
+            auto s = std::make_unique<Storage>();
+#ifdef _WIN32
+            s->file = CreateFileW(path.c_str(), GENERIC_READ,
+                FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (s->file == INVALID_HANDLE_VALUE) return nullptr;
+            LARGE_INTEGER size{};
+            if (!GetFileSizeEx(s->file, &size) || size.QuadPart < static_cast<LONGLONG>(sizeof(ImageHeader))) {
+                return nullptr;
+            }
+            s->mapping = CreateFileMappingW(s->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (!s->mapping) return nullptr;
+            s->data = static_cast<const unsigned char*>(MapViewOfFile(s->mapping, FILE_MAP_READ, 0, 0, 0));
+            if (!s->data) {
+                CloseHandle(s->mapping);
+                s->mapping = nullptr;
+                return nullptr;
+            }
+            s->size = static_cast<std::size_t>(size.QuadPart);
+#else
+            const int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) return nullptr;
+            struct stat st {};
+            if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(ImageHeader))) {
+                ::close(fd);
+                return nullptr;
+            }
+            void* view = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (view == MAP_FAILED) return nullptr;
+            s->view = view;
+            s->data = static_cast<const unsigned char*>(view);
+            s->size = static_cast<std::size_t>(st.st_size);
+#endif
+            return s;
+        }
+    };
+
+    // -------------------------------------------------------------------------
+    // LookupTable
+    // -------------------------------------------------------------------------
+
+    LookupTable::~LookupTable() = default;
+
+    bool LookupTable::isMapped() const noexcept
+    {
+        return _storage && _storage->isMapped();
+    }
+
+    bool LookupTable::attach(std::unique_ptr<Storage> storage, const std::string& sourceKey,
+        std::uint64_t sourceSize, std::int64_t sourceTime)
+    {
+        if (!storage || storage->size < sizeof(ImageHeader)) return false;
+
+        const ImageHeader h = readAt<ImageHeader>(storage->data);
+        if (std::memcmp(h.magic, kMagic, sizeof(kMagic)) != 0 || h.version != kVersion
+            || h.imageSize != storage->size
+            || h.sourceSize != sourceSize || h.sourceTime != sourceTime
+            || h.sourceKeySize != sourceKey.size()
+            || sizeof(ImageHeader) + h.sourceKeySize > storage->size
+            || std::memcmp(storage->data + sizeof(ImageHeader), sourceKey.data(), sourceKey.size()) != 0) {
+            return false;
+        }
+        // Power-of-two bucket count, bucket array and records in bounds.
+        if (h.bucketCount == 0 || (h.bucketCount & (h.bucketCount - 1)) != 0
+            || h.bucketsOffset > storage->size
+            || h.bucketCount > (storage->size - h.bucketsOffset) / kBucketSize
+            || h.recordsOffset > storage->size) {
+            return false;
+        }
+
+        _storage = std::move(storage);
+        _base = _storage->data;
+        _imageSize = _storage->size;
+        _entryCount = h.entryCount;
+        _bucketMask = h.bucketCount - 1;
+        _bucketsOffset = h.bucketsOffset;
+        _sourceSize = sourceSize;
+        _sourceTime = sourceTime;
+        return true;
+    }
+
+    bool LookupTable::find(std::string_view key, Value& out) const noexcept
+    {
+        if (!_base) return false;
+
+        const std::uint64_t hash = fnv1a(key);
+        std::uint64_t slot = hash & _bucketMask;
+        for (std::uint64_t probes = 0; probes <= _bucketMask; ++probes) {
+            const unsigned char* bucket = _base + _bucketsOffset + slot * kBucketSize;
+            const std::uint64_t keyOffset = readAt<std::uint64_t>(bucket + 8);
+            if (keyOffset == 0) {
+                return false;
+            }
+            if (readAt<std::uint64_t>(bucket) == hash
+                && keyOffset + kKeyRecordHead <= _imageSize) {
+                const std::uint32_t keySize = readAt<std::uint32_t>(_base + keyOffset);
+                const unsigned char* keyBytes = _base + keyOffset + kKeyRecordHead;
+                if (keySize == key.size()
+                    && keyOffset + kKeyRecordHead + keySize <= _imageSize
+                    && std::memcmp(keyBytes, key.data(), keySize) == 0) {
+                    const std::uint64_t valueOffset = readAt<std::uint64_t>(_base + keyOffset + 4);
+                    if (valueOffset + kValueRecordHead > _imageSize) return false;
+                    const std::uint32_t valueSize = readAt<std::uint32_t>(_base + valueOffset);
+                    if (valueOffset + kValueRecordHead + valueSize > _imageSize) return false;
+                    out.type = static_cast<ValueType>(_base[valueOffset + 4]);
+                    out.text = std::string_view(
+                        reinterpret_cast<const char*>(_base + valueOffset + kValueRecordHead), valueSize);
+                    return true;
+                }
+            }
+            slot = (slot + 1) & _bucketMask;
+        }
+        return false;
+    }
+
+    // -------------------------------------------------------------------------
+    // LookupStore
+    // -------------------------------------------------------------------------
+
+    std::string LookupStore::numberKey(double v)
+    {
+        std::string text;
+        if (integralFloatText(v, text)) {
+            return text;
+        }
+        return luaFloatText(v);
+    }
+
+    bool LookupStore::compileImage(std::string_view text, const std::string& sourceKey,
+        std::uint64_t sourceSize, std::int64_t sourceTime,
+        std::string& image, std::string& error)
+    {
+        // Last row wins for a repeated key, as with lkp()'s table fill.
+        std::vector<ParsedValue> values;
+        std::unordered_map<std::string, std::uint32_t> index;
+        std::vector<std::pair<const std::string, std::uint32_t>*> keyOrder;
+
+        LiteralParser parser(text);
+        const bool ok = parser.parse([&](std::vector<std::string>& keys, const ParsedValue& value) {
+            const std::uint32_t valueIndex = static_cast<std::uint32_t>(values.size());
+            values.push_back(value);
+            for (std::string& k : keys) {
+                auto [it, inserted] = index.try_emplace(std::move(k), valueIndex);
+                if (inserted) {
+                    keyOrder.push_back(&*it);
+                }
+                else {
+                    it->second = valueIndex;
+                }
+            }
+        });
+        if (!ok) {
+            error = parser.error();
+            return false;
+        }
+
+        std::uint64_t bucketCount = 8;
+        while (bucketCount < index.size() * 2) bucketCount <<= 1;
+
+        ImageHeader h{};
+        std::memcpy(h.magic, kMagic, sizeof(kMagic));
+        h.version = kVersion;
+        h.sourceKeySize = static_cast<std::uint32_t>(sourceKey.size());
+        h.sourceSize = sourceSize;
+        h.sourceTime = sourceTime;
+        h.entryCount = index.size();
+        h.bucketCount = bucketCount;
+        h.bucketsOffset = (sizeof(ImageHeader) + sourceKey.size() + 7) & ~std::uint64_t(7);
+        h.recordsOffset = h.bucketsOffset + bucketCount * kBucketSize;
+
+        // Records first (into their own buffer), buckets filled as the
+        // key offsets become known.
+        std::string records;
+        std::vector<std::uint64_t> valueOffsets(values.size(), 0);
+        std::vector<unsigned char> buckets(static_cast<std::size_t>(bucketCount * kBucketSize), 0);
+        const std::uint64_t mask = bucketCount - 1;
+
+        for (const auto* entry : keyOrder) {
+            const std::string* key = &entry->first;
+            const std::uint32_t vi = entry->second;
+            if (valueOffsets[vi] == 0) {
+                valueOffsets[vi] = h.recordsOffset + records.size();
+                appendRaw(records, static_cast<std::uint32_t>(values[vi].text.size()));
+                appendRaw(records, static_cast<std::uint8_t>(values[vi].type));
+                records.append(values[vi].text);
+            }
+            const std::uint64_t keyOffset = h.recordsOffset + records.size();
+            appendRaw(records, static_cast<std::uint32_t>(key->size()));
+            appendRaw(records, valueOffsets[vi]);
+            records.append(*key);
+
+            const std::uint64_t hash = fnv1a(*key);
+            std::uint64_t slot = hash & mask;
+            while (readAt<std::uint64_t>(buckets.data() + slot * kBucketSize + 8) != 0) {
+                slot = (slot + 1) & mask;
+            }
+            std::memcpy(buckets.data() + slot * kBucketSize, &hash, 8);
+            std::memcpy(buckets.data() + slot * kBucketSize + 8, &keyOffset, 8);
+        }
+
+        h.imageSize = h.recordsOffset + records.size();
+
+        image.clear();
+        image.reserve(static_cast<std::size_t>(h.imageSize));
+        image.append(reinterpret_cast<const char*>(&h), sizeof(h));
+        image.append(sourceKey);
+        image.resize(static_cast<std::size_t>(h.bucketsOffset), '\0');
+        image.append(reinterpret_cast<const char*>(buckets.data()), buckets.size());
+        image.append(records);
+        return true;
+    }
+
+    void LookupStore::setCacheDirectory(const std::filesystem::path& dir)
+    {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.cacheDir = dir;
+    }
+
+    std::filesystem::path LookupStore::cacheDirectory()
+    {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        if (r.cacheDir.empty()) {
+            std::error_code ec;
+            r.cacheDir = std::filesystem::temp_directory_path(ec) / "MultiReplace" / "lookup";
+        }
+        return r.cacheDir;
+    }
+
+    LookupStore::OpenResult LookupStore::open(const std::string& utf8Path)
+    {
+        OpenResult result;
+
+        std::error_code ec;
+        const std::filesystem::path source =
+            std::filesystem::absolute(pathFromUtf8(utf8Path), ec).lexically_normal();
+        SourceStamp stamp;
+        if (ec || !statSource(source, stamp)) {
+            result.status = Status::CannotRead;
+            result.error = "Cannot open file: " + utf8Path;
+            return result;
+        }
+
+        const std::filesystem::path cacheDir = cacheDirectory();
+        const auto genericPath = source.generic_u8string();
+        const std::string sourceKey(genericPath.begin(), genericPath.end());
+        const std::filesystem::path cacheFile = cacheDir / (hexName(fnv1a(sourceKey)) + ".mrlkp");
+
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+
+        // Already open in this process and still current.
+        if (auto it = r.tables.find(sourceKey); it != r.tables.end()) {
+            if (auto table = it->second.lock()) {
+                if (table->_sourceSize == stamp.size && table->_sourceTime == stamp.time) {
+                    result.table = std::move(table);
+                    result.status = Status::Ok;
+                    return result;
+                }
+            }
+        }
+
+        // A current image on disk from an earlier run or another process.
+        std::shared_ptr<LookupTable> table(new LookupTable());
+        if (!table->attach(LookupTable::Storage::map(cacheFile), sourceKey, stamp.size, stamp.time)) {
+            std::string text;
+            if (!readSourceText(source, text)) {
+                result.status = Status::CannotRead;
+                result.error = "Cannot open file: " + utf8Path;
+                return result;
+            }
+            std::string image;
+            std::string parseError;
+            if (!compileImage(text, sourceKey, stamp.size, stamp.time, image, parseError)) {
+                result.status = Status::Unsupported;
+                result.error = utf8Path + ": " + parseError;
+                return result;
+            }
+
+            // Write beside the target and rename, so a reader never maps
+            // a half-written image. If any step fails (read-only temp,
+            // target still mapped by another process) keep the image in
+            // memory for this process.
+            bool written = false;
+            std::filesystem::create_directories(cacheDir, ec);
+            std::filesystem::path tmpFile = cacheFile;
+            tmpFile += ".tmp";
+            {
+                std::ofstream out(tmpFile, std::ios::binary | std::ios::trunc);
+                if (out) {
+                    out.write(image.data(), static_cast<std::streamsize>(image.size()));
+                    written = static_cast<bool>(out);
+                }
+            }
+            if (written) {
+                std::filesystem::rename(tmpFile, cacheFile, ec);
+                written = !ec;
+            }
+            if (!written) {
+                std::filesystem::remove(tmpFile, ec);
+            }
+
+            table.reset(new LookupTable());
+            if (!written || !table->attach(LookupTable::Storage::map(cacheFile), sourceKey, stamp.size, stamp.time)) {
+                table.reset(new LookupTable());
+                table->attach(LookupTable::Storage::fromImage(std::move(image)), sourceKey, stamp.size, stamp.time);
+            }
+        }
+
+        r.tables[sourceKey] = table;
+        result.table = std::move(table);
+        result.status = Status::Ok;
+        return result;
+    }
+
+} // namespace MultiReplaceEngine
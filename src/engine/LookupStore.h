@@ -0,0 +1,139 @@
+// This file is part of MultiReplace.
+//
+// MultiReplace is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// LookupStore.h
+// Native store for .lkp lookup tables, shared by the Lua lkp() helper
+// and the ExprTk lkp() built-in.
+//
+// A .lkp file is a Lua chunk returning a list of { keys, value } pairs.
+// Evaluating it in every Lua state (one per tab, rebuilt on every run)
+// costs seconds and hundreds of MB for a table with millions of rows.
+// The store instead:
+//
+//   - reads the file once with a small literal parser (strings,
+//     numbers, nested braces, comments - no Lua state involved),
+//   - writes a compiled hash file to the cache directory, keyed by the
+//     source path and stamped with the source's size and mtime,
+//   - maps that file read-only and hands out shared handles, so every
+//     engine in the process reads the same pages.
+//
+// A source whose size or mtime no longer matches the stamp is compiled
+// again on the next open(). Callers open once per run, so edits to a
+// .lkp take effect on the next Replace-All.
+//
+// Files that are not a plain literal table (computed values, function
+// calls, ...) are reported as Unsupported; the Lua helper then falls
+// back to evaluating them as before. If the cache file cannot be
+// written the compiled image is kept in memory instead - still shared
+// within the process, just not across processes.
+//
+// Keys and values are stored as text exactly as Lua's tostring() would
+// render them, so a numeric key 10 matches the match text "10" and a
+// numeric value keeps its number type for Lua callers. A float key with
+// an integral value is stored under its integer text as well, so the
+// number 2 finds a key written 2.0 (see numberKey()).
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace MultiReplaceEngine {
+
+    class LookupTable {
+    public:
+        enum class ValueType : std::uint8_t {
+            String = 0,
+            Number = 1
+        };
+
+        struct Value {
+            std::string_view text;
+            ValueType        type = ValueType::String;
+        };
+
+        ~LookupTable();
+
+        LookupTable(const LookupTable&) = delete;
+        LookupTable& operator=(const LookupTable&) = delete;
+
+        // Look up `key`. The returned view points into the mapping and
+        // stays valid for as long as the table is alive.
+        bool find(std::string_view key, Value& out) const noexcept;
+
+        std::size_t size() const noexcept { return static_cast<std::size_t>(_entryCount); }
+
+        // False when the image could not be written to or mapped from
+        // the cache directory and is held in memory instead.
+        bool isMapped() const noexcept;
+
+    private:
+        friend class LookupStore;
+
+        struct Storage;
+
+        LookupTable() = default;
+
+        // Validate the image header against the expected source stamp
+        // and set up the bucket view. False if the image is unusable.
+        bool attach(std::unique_ptr<Storage> storage, const std::string& sourceKey,
+            std::uint64_t sourceSize, std::int64_t sourceTime);
+
+        std::unique_ptr<Storage> _storage;
+        const unsigned char* _base = nullptr;
+        std::size_t   _imageSize = 0;
+        std::uint64_t _entryCount = 0;
+        std::uint64_t _bucketMask = 0;
+        std::uint64_t _bucketsOffset = 0;
+        std::uint64_t _sourceSize = 0;
+        std::int64_t  _sourceTime = 0;
+    };
+
+    class LookupStore {
+    public:
+        enum class Status {
+            Ok,
+            CannotRead,     // source missing or unreadable
+            Unsupported     // not a literal table; needs a Lua evaluation
+        };
+
+        struct OpenResult {
+            std::shared_ptr<const LookupTable> table;
+            Status      status = Status::CannotRead;
+            std::string error;          // set unless status == Ok
+        };
+
+        // Open the table compiled from the .lkp file at `utf8Path`,
+        // compiling it first if there is no current image. Thread-safe;
+        // concurrent opens of the same file share one table.
+        static OpenResult open(const std::string& utf8Path);
+
+        // Directory for compiled images. Defaults to
+        // <temp>/MultiReplace/lookup; created on first use.
+        static void setCacheDirectory(const std::filesystem::path& dir);
+        static std::filesystem::path cacheDirectory();
+
+        // Key text to look a number up by: tostring() of the number, but
+        // a float with an integral value in the int64 range as the
+        // integer (2.0 -> "2"), the way Lua's tables treat 2.0 and 2 as
+        // one key. The numeric lkp() lookups of both engines use this.
+        static std::string numberKey(double v);
+
+        // Compile `text` (the .lkp contents, UTF-8 without BOM) into an
+        // image in memory. Exposed for the QA harness; open() is the
+        // normal entry point. Returns false with `error` set if the text
+        // is not a literal table.
+        static bool compileImage(std::string_view text, const std::string& sourceKey,
+            std::uint64_t sourceSize, std::int64_t sourceTime,
+            std::string& image, std::string& error);
+    };
+
+} // namespace MultiReplaceEngine
@@ -11,9 +11,14 @@
 // bridge in MultiReplacePanel - only the surface changed.
 
 #include "LuaEngine.h"
+#include "LookupStore.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <iomanip>
 #include <sstream>
+#include <string_view>
 
 // MR-internal helpers used by this engine. Including the actual headers
 // (rather than forward-declaring) keeps the linkage robust against
@@ -33,6 +38,301 @@ namespace SU = StringUtils;
 
 namespace MultiReplaceEngine {
 
+    namespace {
+
+        // ---------------------------------------------------------------------
+        // Variable slots and the key table
+        // ---------------------------------------------------------------------
+        //
+        // The key table is a Lua array of interned name strings, anchored
+        // in the registry. Fixed layout:
+        //
+        //   [1 .. kSlotCount]                  CNT ... REGEX
+        //   [kSlotCount+1 .. 2*kSlotCount]     cnt ... regex
+        //   [kKeyResultTable .. kKeyDebug]     names the engine reads back
+        //   [kFixedKeyCount+1 ...]             CAP1, cap1, CAP2, cap2, ...
+        //
+        // The CAP part grows on demand (ensureCaptureKeys).
+
+        enum Slot : int {
+            SlotCNT = 1,
+            SlotLCNT,
+            SlotLINE,
+            SlotLPOS,
+            SlotAPOS,
+            SlotCOL,
+            SlotMATCH,
+            SlotFPATH,
+            SlotFNAME,
+            SlotREGEX
+        };
+
+        constexpr int kSlotCount = SlotREGEX;
+
+        constexpr int kKeyResultTable = 2 * kSlotCount + 1;
+        constexpr int kKeyResult = kKeyResultTable + 1;
+        constexpr int kKeySkip = kKeyResultTable + 2;
+        constexpr int kKeyDebug = kKeyResultTable + 3;
+        constexpr int kFixedKeyCount = kKeyDebug;
+
+        // Indexed by slot - 1.
+        constexpr const char* SLOT_NAMES[kSlotCount] = {
+            "CNT", "LCNT", "LINE", "LPOS", "APOS", "COL",
+            "MATCH", "FPATH", "FNAME", "REGEX"
+        };
+        constexpr const char* ALIAS_NAMES[kSlotCount] = {
+            "cnt", "lcnt", "line", "lpos", "apos", "col",
+            "match", "fpath", "fname", "regex"
+        };
+
+        // Metatable name of the lookupStoreOpen() handles.
+        constexpr const char* kLookupTableMeta = "MultiReplace.LookupTable";
+
+        using LookupTableHandle = std::shared_ptr<const LookupTable>;
+
+        // VM instructions between two calls of the budget hook. Coarse
+        // enough to stay out of profiles, fine enough that the per-match
+        // limit is honoured to within one interval.
+        constexpr int kBudgetHookInterval = 1000;
+
+        // Metatable of the collection counter, see plantGcSentinel().
+        constexpr const char* kGcSentinelMeta = "MultiReplace.GcSentinel";
+
+        // ---------------------------------------------------------------------
+        // Allocator and collector statistics
+        // ---------------------------------------------------------------------
+
+        // lua_Alloc keeping LuaEngine::MemoryStats (the user data) current.
+        // Same realloc/free behaviour as lauxlib's default allocator.
+        void* trackingAlloc(void* ud, void* ptr, size_t osize, size_t nsize)
+        {
+            auto* stats = static_cast<LuaEngine::MemoryStats*>(ud);
+            // For a fresh block osize holds the object type, not a size.
+            const size_t oldSize = ptr ? osize : 0;
+            if (nsize == 0) {
+                std::free(ptr);
+                stats->currentBytes -= oldSize;
+                return nullptr;
+            }
+            void* block = std::realloc(ptr, nsize);
+            if (!block) {
+                return nullptr;
+            }
+            if (!ptr) {
+                ++stats->allocations;
+            }
+            if (nsize > oldSize) {
+                stats->allocatedBytes += nsize - oldSize;
+            }
+            stats->currentBytes = stats->currentBytes - oldSize + nsize;
+            stats->peakBytes = std::max(stats->peakBytes, stats->currentBytes);
+            return block;
+        }
+
+        // lauxlib's panic handler, which luaL_newstate would install.
+        int luaPanic(lua_State* L)
+        {
+            const char* msg = lua_tostring(L, -1);
+            lua_writestringerror("PANIC: unprotected error in call to Lua API (%s)\n",
+                msg ? msg : "error object is not a string");
+            return 0;
+        }
+
+        // Leave an unreferenced object behind. Its finaliser counts the
+        // collection that reclaimed it and plants the next one, so
+        // MemoryStats::gcCycles follows the collector without a hook
+        // into it. lua_close() does not finalise the last one again.
+        void plantGcSentinel(lua_State* L)
+        {
+            lua_newuserdatauv(L, 0, 0);
+            luaL_setmetatable(L, kGcSentinelMeta);
+            lua_pop(L, 1);
+        }
+
+        int gcSentinelFinalize(lua_State* L)
+        {
+            auto* stats = static_cast<LuaEngine::MemoryStats*>(
+                lua_touserdata(L, lua_upvalueindex(1)));
+            ++stats->gcCycles;
+            plantGcSentinel(L);
+            return 0;
+        }
+
+        inline std::uint32_t aliasBit(int slot) { return 1u << (slot - 1); }
+
+        inline int captureKey(int index) { return kFixedKeyCount + 2 * index + 1; }
+        inline int captureAliasKey(int index) { return kFixedKeyCount + 2 * index + 2; }
+
+        // Slot of a lowercase alias name, or 0.
+        int aliasSlotOf(std::string_view name)
+        {
+            for (int i = 0; i < kSlotCount; ++i) {
+                if (name == ALIAS_NAMES[i]) {
+                    return i + 1;
+                }
+            }
+            return 0;
+        }
+
+        // "cap" followed by at least one digit.
+        bool isCaptureAlias(std::string_view name)
+        {
+            if (name.size() < 4 || name.compare(0, 3, "cap") != 0) {
+                return false;
+            }
+            for (std::size_t i = 3; i < name.size(); ++i) {
+                if (name[i] < '0' || name[i] > '9') {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        inline bool isIdentStart(char c)
+        {
+            return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+        }
+
+        inline bool isIdentChar(char c)
+        {
+            return isIdentStart(c) || (c >= '0' && c <= '9');
+        }
+
+        // Helpers that report through the global resultTable, and the
+        // table itself. A script naming any of them uses the legacy
+        // protocol.
+        constexpr std::string_view RESULT_TABLE_NAMES[] = {
+            "set", "cond", "vars", "init", "lkp", "lvars", "lcmd", "resultTable"
+        };
+
+        // What the compile step needs to know about a script's names.
+        struct ScriptNames {
+            std::uint32_t aliasMask = 0;        // aliasBit() of each lowercase alias
+            bool          aliasCaptures = false; // any cap#
+            bool          resultTable = false;   // any RESULT_TABLE_NAMES entry
+        };
+
+        // Level of a long bracket ("[[", "[==[") opening at i, or -1.
+        int longBracketLevel(const std::string& s, std::size_t i)
+        {
+            if (i >= s.size() || s[i] != '[') {
+                return -1;
+            }
+            std::size_t j = i + 1;
+            while (j < s.size() && s[j] == '=') {
+                ++j;
+            }
+            return (j < s.size() && s[j] == '[') ? static_cast<int>(j - i - 1) : -1;
+        }
+
+        // Position behind the long string or comment body that starts
+        // after its opening bracket at i (level `level`), or s.size().
+        std::size_t skipLongBracket(const std::string& s, std::size_t i, int level)
+        {
+            const std::string close = "]" + std::string(static_cast<std::size_t>(level), '=') + "]";
+            const std::size_t end = s.find(close, i + static_cast<std::size_t>(level) + 2);
+            return (end == std::string::npos) ? s.size() : end + close.size();
+        }
+
+        // Collect the names a script mentions, skipping string literals
+        // and comments: a return-protocol script that says "set" in a
+        // string must not be taken for a legacy one. A dynamic access
+        // such as _G["cnt"] is served by the _G fallback.
+        ScriptNames scanScriptNames(const std::string& script)
+        {
+            ScriptNames names;
+            std::size_t i = 0;
+            while (i < script.size()) {
+                const char c = script[i];
+                if (c == '-' && i + 1 < script.size() && script[i + 1] == '-') {
+                    const int level = longBracketLevel(script, i + 2);
+                    if (level >= 0) {
+                        i = skipLongBracket(script, i + 2, level);
+                    }
+                    else {
+                        const std::size_t eol = script.find('\n', i);
+                        i = (eol == std::string::npos) ? script.size() : eol + 1;
+                    }
+                    continue;
+                }
+                if (c == '\'' || c == '"') {
+                    ++i;
+                    while (i < script.size() && script[i] != c && script[i] != '\n') {
+                        i += (script[i] == '\\') ? 2 : 1;
+                    }
+                    ++i;
+                    continue;
+                }
+                if (c == '[') {
+                    const int level = longBracketLevel(script, i);
+                    if (level >= 0) {
+                        i = skipLongBracket(script, i, level);
+                        continue;
+                    }
+                }
+                if (!isIdentStart(c)) {
+                    ++i;
+                    continue;
+                }
+                const std::size_t start = i;
+                while (i < script.size() && isIdentChar(script[i])) {
+                    ++i;
+                }
+                const std::string_view name(script.data() + start, i - start);
+                if (const int slot = aliasSlotOf(name)) {
+                    names.aliasMask |= aliasBit(slot);
+                }
+                else if (isCaptureAlias(name)) {
+                    names.aliasCaptures = true;
+                }
+                else if (std::find(std::begin(RESULT_TABLE_NAMES), std::end(RESULT_TABLE_NAMES), name)
+                    != std::end(RESULT_TABLE_NAMES)) {
+                    names.resultTable = true;
+                }
+            }
+            return names;
+        }
+
+        // ---------------------------------------------------------------------
+        // Helper library bytecode
+        // ---------------------------------------------------------------------
+        //
+        // Every initialize() (one per engine, plus one per beginRun) used
+        // to parse the whole helper script again. It is compiled once per
+        // process instead, in a scratch state, and each new state loads
+        // the dumped bytecode. Debug info is kept so error messages from
+        // the helpers (cond: ..., set: ...) carry the same chunk name and
+        // line numbers as before.
+
+        int appendChunk(lua_State*, const void* data, size_t size, void* userData)
+        {
+            static_cast<std::string*>(userData)->append(static_cast<const char*>(data), size);
+            return 0;
+        }
+
+        // Empty if the helper script failed to compile; initialize() then
+        // loads the source and reports the error as it always did.
+        const std::string& helperBytecode()
+        {
+            static const std::string bytecode = [] {
+                std::string out;
+                lua_State* L = luaL_newstate();
+                if (!L) {
+                    return out;
+                }
+                if (luaL_loadstring(L, luaSourceCode) == LUA_OK) {
+                    if (lua_dump(L, &appendChunk, &out, 0) != 0) {
+                        out.clear();
+                    }
+                }
+                lua_close(L);
+                return out;
+            }();
+            return bytecode;
+        }
+
+    } // anonymous namespace
+
     // ---------------------------------------------------------------------
     // Lifecycle
     // ---------------------------------------------------------------------
@@ -52,19 +352,30 @@ namespace MultiReplaceEngine {
         // Reset any prior state (idempotent re-init).
         shutdown();
 
-        _luaState = luaL_newstate();
+        _luaState = lua_newstate(&trackingAlloc, &_memoryStats);
         if (!_luaState) {
             return false;
         }
+        lua_atpanic(_luaState, &luaPanic);
 
         luaL_openlibs(_luaState);
 
+        // The budget hook finds its engine through the state's extra
+        // space; see luaBudgetHook().
+        *static_cast<LuaEngine**>(lua_getextraspace(_luaState)) = this;
+
         if (_host && _host->isLuaSafeModeEnabled()) {
             applyLuaSafeMode(_luaState);
         }
 
         // Load and execute the bundled helper script (set/skip/cond/lkp).
-        if (luaL_loadstring(_luaState, luaSourceCode) != LUA_OK) {
+        // The chunk name matches what luaL_loadstring would have used.
+        const std::string& bytecode = helperBytecode();
+        const int loadStatus = bytecode.empty()
+            ? luaL_loadstring(_luaState, luaSourceCode)
+            : luaL_loadbufferx(_luaState, bytecode.data(), bytecode.size(),
+                luaSourceCode, "b");
+        if (loadStatus != LUA_OK) {
             const char* errMsg = lua_tostring(_luaState, -1);
             if (_host && _host->isFormulaErrorDialogEnabled()) {
                 _host->showErrorMessage(
@@ -95,6 +406,25 @@ namespace MultiReplaceEngine {
         lua_pushcfunction(_luaState, &LuaEngine::safeLoadFileSandbox);
         lua_setglobal(_luaState, "safeLoadFileSandbox");
 
+        // Native todate(): the format is compiled once and cached on the
+        // engine, so a per-match call costs a single parse of the input.
+        lua_pushlightuserdata(_luaState, &_dateFormats);
+        lua_pushcclosure(_luaState, &LuaEngine::luaTodate, 1);
+        lua_setglobal(_luaState, "todate");
+
+        // Shared lookup tables for lkp(); see LookupStore.h.
+        luaL_newmetatable(_luaState, kLookupTableMeta);
+        lua_pushcfunction(_luaState, &LuaEngine::luaLookupTableIndex);
+        lua_setfield(_luaState, -2, "__index");
+        lua_pushcfunction(_luaState, &LuaEngine::luaLookupTableGc);
+        lua_setfield(_luaState, -2, "__gc");
+        lua_pop(_luaState, 1);
+        lua_pushcfunction(_luaState, &LuaEngine::luaLookupStoreOpen);
+        lua_setglobal(_luaState, "lookupStoreOpen");
+
+        createEnvironment(_luaState);
+        applyGcSettings();
+
         // Reset all per-match optimisation caches; a fresh state has no
         // globals so any "value last pushed" tracking is stale.
         _lastFPATH.clear();
@@ -117,12 +447,18 @@ namespace MultiReplaceEngine {
             lua_close(_luaState);
             _luaState = nullptr;
         }
+        // The remaining refs died with the state.
+        _envRef = LUA_NOREF;
+        _keysRef = LUA_NOREF;
+        _captureKeyCount = 0;
+        _aliasMask = 0;
+        _aliasCaptures = false;
+        _returnsResult = false;
         _lastCompiledScript.clear();
         _lastFPATH.clear();
         _lastFNAME.clear();
         _lastRegexFlag = -1;
         _lastCapCount = 0;
-        _currentCapNames.clear();
         _globalLuaVariablesMap.clear();
     }
 
@@ -139,10 +475,87 @@ namespace MultiReplaceEngine {
         // user-set global, any side-effect from a previous run is gone.
         // Re-runs of the same list now also re-read .lcmd files from
         // disk, so the user's edits take effect on the next click.
+        _gcSettings = _host ? _host->luaGcSettings() : LuaGcSettings{};
         if (_luaState) {
             shutdown();
             initialize();
         }
+
+        // Count from here on: the helper library and the environment
+        // are the same for every run.
+        const std::size_t liveBytes = _memoryStats.currentBytes;
+        _memoryStats = MemoryStats{};
+        _memoryStats.currentBytes = liveBytes;
+        _memoryStats.peakBytes = liveBytes;
+
+        // The count hook costs a C call every kBudgetHookInterval
+        // instructions, so it is only installed when a limit is set.
+        _limits = _host ? _host->formulaLimits() : FormulaLimits{};
+        _matchInstructions = 0;
+        _budgetExceeded = false;
+        if (_luaState && (_limits.luaInstructionsPerMatch != 0
+            || _limits.secondsPerRun != 0)) {
+            lua_sethook(_luaState, &LuaEngine::luaBudgetHook,
+                LUA_MASKCOUNT, kBudgetHookInterval);
+        }
+    }
+
+    FormulaEnginePtr LuaEngine::clone() const
+    {
+        auto copy = std::make_unique<LuaEngine>(_host);
+        if (!copy->initialize()) {
+            return nullptr;
+        }
+
+        // Rebuilds the state with the host's collector settings and
+        // installs the budget hook, as for any run.
+        copy->beginRun();
+
+        if (_compiledReplaceRef != LUA_NOREF && !copy->compile(_lastCompiledScript)) {
+            return nullptr;
+        }
+        return copy;
+    }
+
+    std::wstring LuaEngine::endRunSummary()
+    {
+        std::wstring summary = IFormulaEngine::endRunSummary();
+        if (!_gcSettings.reportStats) {
+            return summary;
+        }
+        if (!summary.empty()) {
+            summary += L" ";
+        }
+        summary += localiseCounts(L"status_lua_memory_summary",
+            static_cast<std::size_t>((_memoryStats.allocatedBytes + 1023) / 1024),
+            static_cast<std::size_t>(_memoryStats.gcCycles));
+        return summary;
+    }
+
+    void LuaEngine::applyGcSettings()
+    {
+        // Generational mode collects the per-match churn (MATCH,
+        // captures, result strings) cheapest while the heap is small,
+        // but its major collections are atomic: with a large long-lived
+        // heap (a big vars() table) one stalls a match for a full mark.
+        // Incremental mode with a shorter pause and a larger step
+        // multiplier keeps every step short. See benchGc in
+        // tests/lua_engine_qa.cpp.
+        if (_gcSettings.mode == LuaGcSettings::Mode::Generational) {
+            lua_gc(_luaState, LUA_GCGEN, 0, 0);
+        }
+        else {
+            lua_gc(_luaState, LUA_GCINC,
+                std::max(0, _gcSettings.pause),
+                std::max(0, _gcSettings.stepMul), 0);
+        }
+
+        luaL_newmetatable(_luaState, kGcSentinelMeta);
+        lua_pushlightuserdata(_luaState, &_memoryStats);
+        lua_pushcclosure(_luaState, &gcSentinelFinalize, 1);
+        lua_setfield(_luaState, -2, "__gc");
+        lua_pop(_luaState, 1);
+        plantGcSentinel(_luaState);
     }
 
     // ---------------------------------------------------------------------
@@ -175,8 +588,33 @@ namespace MultiReplaceEngine {
             return false;
         }
 
+        // The first upvalue of a main chunk is its _ENV; point it at env
+        // so the script reads match variables without a global lookup.
+        lua_rawgeti(_luaState, LUA_REGISTRYINDEX, _envRef);
+        if (!lua_setupvalue(_luaState, -2, 1)) {
+            lua_pop(_luaState, 1);
+        }
+
         _compiledReplaceRef = luaL_ref(_luaState, LUA_REGISTRYINDEX);
         _lastCompiledScript = scriptUtf8;
+
+        const ScriptNames names = scanScriptNames(scriptUtf8);
+        _returnsResult = !names.resultTable;
+
+        // Resolve the lowercase spellings once here instead of writing
+        // every alias on every match. The set only grows within a run:
+        // functions defined by an earlier script may still read theirs.
+        const std::uint32_t aliasMask = _aliasMask | names.aliasMask;
+        const bool aliasCaptures = _aliasCaptures || names.aliasCaptures;
+        if (aliasMask != _aliasMask || aliasCaptures != _aliasCaptures) {
+            _aliasMask = aliasMask;
+            _aliasCaptures = aliasCaptures;
+            // Slots that are only written on change must be rewritten so
+            // the new aliases get their first value.
+            _lastFPATH.clear();
+            _lastFNAME.clear();
+            _lastRegexFlag = -1;
+        }
         return true;
     }
 
@@ -205,6 +643,12 @@ namespace MultiReplaceEngine {
             return result;
         }
 
+        // The run's time budget is spent: leave the rest of the matches
+        // alone instead of starting scripts that would be cut off.
+        if (_runTimeLimitReached) {
+            return budgetSkip(true, isRegexMatch);
+        }
+
         if (!ensureCompiled(scriptUtf8)) {
             result.success = false;
             result.errorMessage = "Compile failed";
@@ -217,117 +661,239 @@ namespace MultiReplaceEngine {
             lua_settop(_luaState, stackBase);
             };
 
-        // ----- Numeric globals --------------------------------------------
-        // Each variable is exposed under both upper- and lowercase
-        // so users may write whichever style they prefer.
-        lua_pushinteger(_luaState, vars.CNT);  lua_setglobal(_luaState, "CNT");
-        lua_pushinteger(_luaState, vars.CNT);  lua_setglobal(_luaState, "cnt");
-        lua_pushinteger(_luaState, vars.LCNT); lua_setglobal(_luaState, "LCNT");
-        lua_pushinteger(_luaState, vars.LCNT); lua_setglobal(_luaState, "lcnt");
-        lua_pushinteger(_luaState, vars.LINE); lua_setglobal(_luaState, "LINE");
-        lua_pushinteger(_luaState, vars.LINE); lua_setglobal(_luaState, "line");
-        lua_pushinteger(_luaState, vars.LPOS); lua_setglobal(_luaState, "LPOS");
-        lua_pushinteger(_luaState, vars.LPOS); lua_setglobal(_luaState, "lpos");
-        lua_pushinteger(_luaState, vars.APOS); lua_setglobal(_luaState, "APOS");
-        lua_pushinteger(_luaState, vars.APOS); lua_setglobal(_luaState, "apos");
-        lua_pushinteger(_luaState, vars.COL);  lua_setglobal(_luaState, "COL");
-        lua_pushinteger(_luaState, vars.COL);  lua_setglobal(_luaState, "col");
-
-        // ----- String globals ---------------------------------------------
+        lua_State* L = _luaState;
+        lua_rawgeti(L, LUA_REGISTRYINDEX, _envRef);
+        const int env = lua_gettop(L);
+        lua_rawgeti(L, LUA_REGISTRYINDEX, _keysRef);
+        const int keys = lua_gettop(L);
+
+        // Write the value on top of the stack into `slot` and, if a
+        // script uses it, its lowercase alias. Leaves the value in place.
+        auto bindTop = [&](int slot) {
+            lua_rawgeti(L, keys, slot);
+            lua_pushvalue(L, -2);
+            lua_rawset(L, env);
+            if (_aliasMask & aliasBit(slot)) {
+                lua_rawgeti(L, keys, slot + kSlotCount);
+                lua_pushvalue(L, -2);
+                lua_rawset(L, env);
+            }
+            };
+        auto bindInteger = [&](int slot, lua_Integer value) {
+            lua_pushinteger(L, value);
+            bindTop(slot);
+            lua_pop(L, 1);
+            };
+        auto bindString = [&](int slot, const std::string& value) {
+            lua_pushlstring(L, value.data(), value.size());
+            bindTop(slot);
+            lua_pop(L, 1);
+            };
+
+        // ----- Numeric variables ------------------------------------------
+        bindInteger(SlotCNT, vars.CNT);
+        bindInteger(SlotLCNT, vars.LCNT);
+        bindInteger(SlotLINE, vars.LINE);
+        bindInteger(SlotLPOS, vars.LPOS);
+        bindInteger(SlotAPOS, vars.APOS);
+        bindInteger(SlotCOL, vars.COL);
+
+        // ----- String variables -------------------------------------------
         // FPATH/FNAME change at most once per replaceAll run; skip the
-        // push+setglobal pair when the value is unchanged since the
-        // previous match.
+        // write when the value is unchanged since the previous match.
         if (vars.FPATH != _lastFPATH) {
-            setLuaVariable(_luaState, "FPATH", vars.FPATH);
-            setLuaVariable(_luaState, "fpath", vars.FPATH);
+            bindString(SlotFPATH, vars.FPATH);
             _lastFPATH = vars.FPATH;
         }
         if (vars.FNAME != _lastFNAME) {
-            setLuaVariable(_luaState, "FNAME", vars.FNAME);
-            setLuaVariable(_luaState, "fname", vars.FNAME);
+            bindString(SlotFNAME, vars.FNAME);
             _lastFNAME = vars.FNAME;
         }
-        setLuaVariable(_luaState, "MATCH", vars.MATCH);
-        setLuaVariable(_luaState, "match", vars.MATCH);
+        bindString(SlotMATCH, vars.MATCH);
 
         // ----- REGEX flag -------------------------------------------------
         const int regexFlag = isRegexMatch ? 1 : 0;
         if (regexFlag != _lastRegexFlag) {
-            lua_pushboolean(_luaState, isRegexMatch);
-            lua_setglobal(_luaState, "REGEX");
-            lua_pushboolean(_luaState, isRegexMatch);
-            lua_setglobal(_luaState, "regex");
+            lua_pushboolean(L, isRegexMatch);
+            bindTop(SlotREGEX);
+            lua_pop(L, 1);
             _lastRegexFlag = regexFlag;
         }
 
-        // ----- CAP# globals (regex only) ----------------------------------
+        // ----- CAP# variables (regex only) --------------------------------
         // Captures arrive pre-extracted from the host; the engine just
-        // pushes them as Lua globals. Encoding conversion already happened
-        // in the pipeline (the host knows the document codepage; the engine
+        // stores them in env. Encoding conversion already happened in
+        // the pipeline (the host knows the document codepage; the engine
         // shouldn't need to).
-        // Each capture is exposed under both CAP# and cap# names.
-        _currentCapNames.clear();
-        if (isRegexMatch) {
-            for (size_t i = 0; i < vars.captures.size(); ++i) {
-                std::string capName = "CAP" + std::to_string(i + 1);
-                std::string capNameLower = "cap" + std::to_string(i + 1);
-                setLuaVariable(_luaState, capName, vars.captures[i]);
-                setLuaVariable(_luaState, capNameLower, vars.captures[i]);
-                _currentCapNames.push_back(capName);
+        const int currentCapCount = isRegexMatch
+            ? static_cast<int>(vars.captures.size()) : 0;
+        ensureCaptureKeys(L, keys, std::max(currentCapCount, _lastCapCount));
+        for (int i = 0; i < currentCapCount; ++i) {
+            const std::string& cap = vars.captures[static_cast<size_t>(i)];
+            lua_pushlstring(L, cap.data(), cap.size());
+            lua_rawgeti(L, keys, captureKey(i));
+            lua_pushvalue(L, -2);
+            lua_rawset(L, env);
+            if (_aliasCaptures) {
+                lua_rawgeti(L, keys, captureAliasKey(i));
+                lua_pushvalue(L, -2);
+                lua_rawset(L, env);
             }
+            lua_pop(L, 1);
         }
 
+        // ----- CAP cleanup ------------------------------------------------
+        // Drop the CAPs a longer previous match left behind, before the
+        // script runs, so it never sees a capture of another match. Both
+        // spellings are cleared; the alias may have been read through
+        // the _G fallback only, clearing it is harmless then.
+        for (int i = currentCapCount; i < _lastCapCount; ++i) {
+            lua_rawgeti(L, keys, captureKey(i));
+            lua_pushnil(L);
+            lua_rawset(L, env);
+            lua_rawgeti(L, keys, captureAliasKey(i));
+            lua_pushnil(L);
+            lua_rawset(L, env);
+        }
+        _lastCapCount = currentCapCount;
+
         // ----- Run pre-compiled chunk -------------------------------------
-        lua_rawgeti(_luaState, LUA_REGISTRYINDEX, _compiledReplaceRef);
-        if (lua_pcall(_luaState, 0, LUA_MULTRET, 0) != LUA_OK) {
-            const char* err = lua_tostring(_luaState, -1);
-            if (_host && _host->isFormulaErrorDialogEnabled()) {
-                _host->showErrorMessage(
-                    ILuaEngineHost::ErrorCategory::ExecutionError,
-                    "Lua",
-                    err ? err : "Lua execution error");
-            }
-            result.success = false;
-            result.errorMessage = err ? err : "Lua execution error";
+        // A script that returns its replacement leaves it on the stack;
+        // legacy scripts are called for their side effect on resultTable.
+        // resultTable is cleared first either way, so afterwards it is
+        // only set if a helper the script called wrote it this match,
+        // never left over from an earlier one.
+        lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
+        lua_rawgeti(L, keys, kKeyResultTable);
+        lua_pushnil(L);
+        lua_rawset(L, -3);
+        lua_pop(L, 1);
+        const int callBase = lua_gettop(L);
+        lua_rawgeti(L, LUA_REGISTRYINDEX, _compiledReplaceRef);
+        _matchInstructions = 0;
+        beginEvaluation();
+        const int callStatus = lua_pcall(L, 0, _returnsResult ? LUA_MULTRET : 0, 0);
+        endEvaluation();
+
+        // Aborted by the budget hook: skip the match without a dialog,
+        // endRunSummary() reports the count.
+        if (_budgetExceeded) {
+            _budgetExceeded = false;
+            lua_sethook(L, &LuaEngine::luaBudgetHook,
+                LUA_MASKCOUNT, kBudgetHookInterval);
             restoreStack();
-            return result;
+            return budgetSkip(_runTimeLimitReached, isRegexMatch);
         }
 
-        // ----- resultTable ------------------------------------------------
-        lua_getglobal(_luaState, "resultTable");
-        if (!lua_istable(_luaState, -1)) {
+        if (callStatus != LUA_OK) {
+            const char* err = lua_tostring(L, -1);
             if (_host && _host->isFormulaErrorDialogEnabled()) {
                 _host->showErrorMessage(
                     ILuaEngineHost::ErrorCategory::ExecutionError,
                     "Lua",
-                    scriptUtf8);
+                    err ? err : "Lua execution error");
             }
             result.success = false;
-            result.errorMessage = "Lua produced no resultTable";
+            result.errorMessage = err ? err : "Lua execution error";
             restoreStack();
             return result;
         }
+        const int returned = lua_gettop(L) - callBase;
+
+        // DEBUG, and resultTable written by the helpers, live in _G
+        // (env forwards new names there); both are read raw from it.
+        lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
+        const int globals = lua_gettop(L);
+
+        // Copy result/skip out of a { result, skip } table at `index`.
+        auto readResultFields = [&](int index) {
+            lua_rawgeti(L, keys, kKeyResult);
+            lua_gettable(L, index);
+            if (lua_isnil(L, -1)) {
+                result.output.clear();
+            }
+            else if (lua_isstring(L, -1) || lua_isnumber(L, -1)) {
+                size_t len = 0;
+                const char* s = lua_tolstring(L, -1, &len);
+                result.output.assign(s, len);
+            }
+            lua_pop(L, 1); // pop result
 
-        // ----- result & skip ----------------------------------------------
-        lua_getfield(_luaState, -1, "result");
-        if (lua_isnil(_luaState, -1)) {
-            result.output.clear();
+            lua_rawgeti(L, keys, kKeySkip);
+            lua_gettable(L, index);
+            result.skip = lua_isboolean(L, -1)
+                && lua_toboolean(L, -1);
+            lua_pop(L, 1); // pop skip
+            };
+
+        // Only the first returned value counts.
+        if (returned > 0) {
+            const int value = callBase + 1;
+            const int valueType = lua_type(L, value);
+            if (valueType == LUA_TSTRING || valueType == LUA_TNUMBER) {
+                size_t len = 0;
+                const char* s = lua_tolstring(L, value, &len);
+                result.output.assign(s, len);
+            }
+            else if (valueType == LUA_TNIL
+                || (valueType == LUA_TBOOLEAN && !lua_toboolean(L, value))) {
+                result.output.clear();
+                result.skip = true;
+            }
+            else if (valueType == LUA_TTABLE) {
+                // A { result, skip } table, as built by the helpers.
+                readResultFields(value);
+            }
+            else {
+                const std::string typeName = luaL_typename(L, value);
+                if (_host && _host->isFormulaErrorDialogEnabled()) {
+                    _host->showErrorMessage(
+                        ILuaEngineHost::ErrorCategory::ExecutionError,
+                        "Lua",
+                        "Script returned a " + typeName
+                        + "; expected a string, a number or nil");
+                }
+                result.success = false;
+                result.errorMessage = "Lua returned a " + typeName;
+                restoreStack();
+                return result;
+            }
         }
-        else if (lua_isstring(_luaState, -1) || lua_isnumber(_luaState, -1)) {
-            result.output = lua_tostring(_luaState, -1);
+        else {
+            // ----- resultTable (legacy protocol) --------------------------
+            // Also reached by a return-protocol script that returned
+            // nothing: if a helper it called (e.g. an lcmd function using
+            // set()) wrote resultTable, that is the result; if not, the
+            // match is skipped.
+            lua_rawgeti(L, keys, kKeyResultTable);
+            lua_rawget(L, globals);
+            if (_returnsResult && lua_isnil(L, -1)) {
+                result.output.clear();
+                result.skip = true;
+            }
+            else if (!lua_istable(L, -1)) {
+                if (_host && _host->isFormulaErrorDialogEnabled()) {
+                    _host->showErrorMessage(
+                        ILuaEngineHost::ErrorCategory::ExecutionError,
+                        "Lua",
+                        scriptUtf8);
+                }
+                result.success = false;
+                result.errorMessage = "Lua produced no resultTable";
+                restoreStack();
+                return result;
+            }
+            else {
+                readResultFields(lua_gettop(L));
+            }
         }
-        lua_pop(_luaState, 1); // pop result
-
-        lua_getfield(_luaState, -1, "skip");
-        result.skip = lua_isboolean(_luaState, -1)
-            && lua_toboolean(_luaState, -1);
-        lua_pop(_luaState, 1); // pop skip
 
         // ----- Debug-window decision --------------------------------------
-        lua_getglobal(_luaState, "DEBUG");
-        const bool luaDebugExists = !lua_isnil(_luaState, -1);
-        const bool luaDebug = luaDebugExists && lua_toboolean(_luaState, -1);
-        lua_pop(_luaState, 1);
+        lua_rawgeti(L, keys, kKeyDebug);
+        lua_rawget(L, globals);
+        const bool luaDebugExists = !lua_isnil(L, -1);
+        const bool luaDebug = luaDebugExists && lua_toboolean(L, -1);
+        lua_pop(L, 1);
         const bool hostDebug = _host && _host->isDebugModeEnabled();
         const bool debugOn = luaDebugExists ? luaDebug : hostDebug;
         const bool needCapDump = debugOn;
@@ -335,50 +901,36 @@ namespace MultiReplaceEngine {
         // ----- CAP dump (only when debug is on) ---------------------------
         std::string capVariablesStr;
         if (needCapDump) {
-            for (const auto& capName : _currentCapNames) {
-                lua_getglobal(_luaState, capName.c_str());
+            for (int i = 0; i < currentCapCount; ++i) {
+                const std::string capName = "CAP" + std::to_string(i + 1);
+                lua_rawgeti(L, keys, captureKey(i));
+                lua_rawget(L, env);
 
-                if (lua_isnumber(_luaState, -1)) {
-                    double n = lua_tonumber(_luaState, -1);
+                if (lua_isnumber(L, -1)) {
+                    double n = lua_tonumber(L, -1);
                     std::ostringstream os;
                     os << std::fixed << std::setprecision(8) << n;
                     capVariablesStr += capName + "\tNumber\t" + os.str() + "\n\n";
                 }
-                else if (lua_isboolean(_luaState, -1)) {
-                    bool b = lua_toboolean(_luaState, -1);
+                else if (lua_isboolean(L, -1)) {
+                    bool b = lua_toboolean(L, -1);
                     capVariablesStr += capName + "\tBoolean\t"
                         + (b ? "true" : "false") + "\n\n";
                 }
-                else if (lua_isstring(_luaState, -1)) {
+                else if (lua_isstring(L, -1)) {
                     capVariablesStr += capName + "\tString\t"
-                        + SU::escapeControlChars(lua_tostring(_luaState, -1))
+                        + SU::escapeControlChars(lua_tostring(L, -1))
                         + "\n\n";
                 }
 
-                lua_pop(_luaState, 1);
+                lua_pop(L, 1);
             }
         }
 
-        // ----- CAP cleanup ------------------------------------------------
-        // Only nil the CAPs that were set last match but not this match.
-        // CAPs set this match get overwritten next time, so they need no
-        // cleanup; only stale CAPs from a longer previous match would leak.
-        // Both upper- and lowercase aliases are cleared.
-        const int currentCapCount = static_cast<int>(_currentCapNames.size());
-        for (int i = currentCapCount; i < _lastCapCount; ++i) {
-            std::string capName = "CAP" + std::to_string(i + 1);
-            std::string capNameLower = "cap" + std::to_string(i + 1);
-            lua_pushnil(_luaState);
-            lua_setglobal(_luaState, capName.c_str());
-            lua_pushnil(_luaState);
-            lua_setglobal(_luaState, capNameLower.c_str());
-        }
-        _lastCapCount = currentCapCount;
-
         // ----- Debug-window display ---------------------------------------
         if (needCapDump && _host) {
             _globalLuaVariablesMap.clear();
-            captureLuaGlobals(_luaState);
+            captureLuaGlobals(L);
 
             std::string globalsStr = "Global Lua variables:\n\n";
             for (const auto& p : _globalLuaVariablesMap) {
@@ -436,51 +988,106 @@ namespace MultiReplaceEngine {
     // Internal helpers
     // ---------------------------------------------------------------------
 
-    void LuaEngine::setLuaVariable(lua_State* L, const std::string& varName, const std::string& value)
+    void LuaEngine::createEnvironment(lua_State* L)
+    {
+        // env, forwarding misses and new names to _G.
+        lua_createtable(L, 0, 2 * kSlotCount + 16);
+        lua_createtable(L, 0, 2);
+        lua_pushglobaltable(L);
+        lua_setfield(L, -2, "__index");
+        lua_pushglobaltable(L);
+        lua_setfield(L, -2, "__newindex");
+        lua_setmetatable(L, -2);
+
+        // _G falls back to env, with lowercase alias mapping.
+        lua_pushglobaltable(L);
+        lua_createtable(L, 0, 1);
+        lua_pushvalue(L, -3);
+        lua_pushcclosure(L, &LuaEngine::luaGlobalsIndex, 1);
+        lua_setfield(L, -2, "__index");
+        lua_setmetatable(L, -2);
+        lua_pop(L, 1);
+
+        _envRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+        lua_createtable(L, kFixedKeyCount, 0);
+        for (int i = 0; i < kSlotCount; ++i) {
+            lua_pushstring(L, SLOT_NAMES[i]);
+            lua_rawseti(L, -2, i + 1);
+            lua_pushstring(L, ALIAS_NAMES[i]);
+            lua_rawseti(L, -2, i + 1 + kSlotCount);
+        }
+        lua_pushstring(L, "resultTable");
+        lua_rawseti(L, -2, kKeyResultTable);
+        lua_pushstring(L, "result");
+        lua_rawseti(L, -2, kKeyResult);
+        lua_pushstring(L, "skip");
+        lua_rawseti(L, -2, kKeySkip);
+        lua_pushstring(L, "DEBUG");
+        lua_rawseti(L, -2, kKeyDebug);
+        _keysRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        _captureKeyCount = 0;
+    }
+
+    void LuaEngine::ensureCaptureKeys(lua_State* L, int keysIndex, int count)
     {
-        lua_pushstring(L, value.c_str());
-        lua_setglobal(L, varName.c_str());
+        for (int i = _captureKeyCount; i < count; ++i) {
+            const std::string number = std::to_string(i + 1);
+            lua_pushstring(L, ("CAP" + number).c_str());
+            lua_rawseti(L, keysIndex, captureKey(i));
+            lua_pushstring(L, ("cap" + number).c_str());
+            lua_rawseti(L, keysIndex, captureAliasKey(i));
+        }
+        if (count > _captureKeyCount) {
+            _captureKeyCount = count;
+        }
     }
 
     void LuaEngine::captureLuaGlobals(lua_State* L)
     {
+        // _G first, then env: the match variables shadow any global of
+        // the same name, as they do for the script.
         lua_pushglobaltable(L);
-        lua_pushnil(L);
-        while (lua_next(L, -2) != 0) {
-            // Skip non-string keys: lua_tostring on a numeric key would
-            // convert it in-place and break lua_next traversal.
-            if (lua_type(L, -2) != LUA_TSTRING) {
-                lua_pop(L, 1);
-                continue;
-            }
+        lua_rawgeti(L, LUA_REGISTRYINDEX, _envRef);
+        for (int table = -2; table <= -1; ++table) {
+            const int index = lua_absindex(L, table);
+            lua_pushnil(L);
+            while (lua_next(L, index) != 0) {
+                // Skip non-string keys: lua_tostring on a numeric key would
+                // convert it in-place and break lua_next traversal.
+                if (lua_type(L, -2) != LUA_TSTRING) {
+                    lua_pop(L, 1);
+                    continue;
+                }
 
-            const char* key = lua_tostring(L, -2);
-            LuaVariableSnapshot snapshot;
-            snapshot.name = key;
+                const char* key = lua_tostring(L, -2);
+                LuaVariableSnapshot snapshot;
+                snapshot.name = key;
 
-            const int valType = lua_type(L, -1);
-            if (valType == LUA_TNUMBER) {
-                snapshot.type = LuaVariableSnapshot::Type::Number;
-                snapshot.numberValue = lua_tonumber(L, -1);
-            }
-            else if (valType == LUA_TSTRING) {
-                snapshot.type = LuaVariableSnapshot::Type::String;
-                snapshot.stringValue = lua_tostring(L, -1);
-            }
-            else if (valType == LUA_TBOOLEAN) {
-                snapshot.type = LuaVariableSnapshot::Type::Boolean;
-                snapshot.booleanValue = lua_toboolean(L, -1);
-            }
-            else {
-                // Skip unsupported types (table, function, userdata, ...)
+                const int valType = lua_type(L, -1);
+                if (valType == LUA_TNUMBER) {
+                    snapshot.type = LuaVariableSnapshot::Type::Number;
+                    snapshot.numberValue = lua_tonumber(L, -1);
+                }
+                else if (valType == LUA_TSTRING) {
+                    snapshot.type = LuaVariableSnapshot::Type::String;
+                    snapshot.stringValue = lua_tostring(L, -1);
+                }
+                else if (valType == LUA_TBOOLEAN) {
+                    snapshot.type = LuaVariableSnapshot::Type::Boolean;
+                    snapshot.booleanValue = lua_toboolean(L, -1);
+                }
+                else {
+                    // Skip unsupported types (table, function, userdata, ...)
+                    lua_pop(L, 1);
+                    continue;
+                }
+
+                _globalLuaVariablesMap[key] = std::move(snapshot);
                 lua_pop(L, 1);
-                continue;
             }
-
-            _globalLuaVariablesMap[key] = std::move(snapshot);
-            lua_pop(L, 1);
         }
-        lua_pop(L, 1); // pop the global table
+        lua_pop(L, 2); // pop env and the global table
     }
 
     // ---------------------------------------------------------------------
@@ -497,6 +1104,149 @@ namespace MultiReplaceEngine {
         return luaSafeLoadFileSandbox_impl(L);
     }
 
+    int LuaEngine::luaTodate(lua_State* L)
+    {
+        size_t inputLen = 0;
+        size_t formatLen = 0;
+        const char* input = luaL_checklstring(L, 1, &inputLen);
+        const char* format = luaL_checklstring(L, 2, &formatLen);
+
+        auto* cache = static_cast<MultiReplace::DateFormatCache*>(
+            lua_touserdata(L, lua_upvalueindex(1)));
+
+        const double ts = MultiReplace::parseTimestamp(
+            std::string_view(input, inputLen),
+            std::string_view(format, formatLen),
+            *cache);
+
+        // NaN is not a useful Lua value (it compares unequal to itself
+        // and prints as "-nan" or "nan" depending on the CRT); nil lets
+        // scripts write `todate(s, f) or 0`.
+        if (std::isnan(ts)) {
+            lua_pushnil(L);
+        }
+        else {
+            lua_pushnumber(L, ts);
+        }
+        return 1;
+    }
+
+    int LuaEngine::luaLookupStoreOpen(lua_State* L)
+    {
+        size_t pathLen = 0;
+        const char* path = luaL_checklstring(L, 1, &pathLen);
+
+        LookupStore::OpenResult opened = LookupStore::open(std::string(path, pathLen));
+        if (opened.status != LookupStore::Status::Ok) {
+            lua_pushnil(L);
+            lua_pushlstring(L, opened.error.data(), opened.error.size());
+            return 2;
+        }
+
+        void* mem = lua_newuserdatauv(L, sizeof(LookupTableHandle), 0);
+        new (mem) LookupTableHandle(std::move(opened.table));
+        luaL_setmetatable(L, kLookupTableMeta);
+        return 1;
+    }
+
+    int LuaEngine::luaLookupTableIndex(lua_State* L)
+    {
+        // (handle, key) -> value | nil. Number keys are looked up by
+        // their tostring() text, which is how the store holds them; a
+        // float goes through numberKey() so 2.0 finds the key 2.
+        const auto* handle = static_cast<const LookupTableHandle*>(lua_touserdata(L, 1));
+        const int keyType = lua_type(L, 2);
+        if (!handle || !*handle || (keyType != LUA_TSTRING && keyType != LUA_TNUMBER)) {
+            lua_pushnil(L);
+            return 1;
+        }
+
+        size_t keyLen = 0;
+        const char* key = nullptr;
+        std::string floatKey;
+        if (keyType == LUA_TNUMBER && !lua_isinteger(L, 2)) {
+            floatKey = LookupStore::numberKey(lua_tonumber(L, 2));
+            key = floatKey.c_str();
+            keyLen = floatKey.size();
+        }
+        else {
+            key = (keyType == LUA_TSTRING)
+                ? lua_tolstring(L, 2, &keyLen)
+                : luaL_tolstring(L, 2, &keyLen);
+        }
+
+        LookupTable::Value value;
+        if (!(*handle)->find(std::string_view(key, keyLen), value)) {
+            lua_pushnil(L);
+            return 1;
+        }
+        lua_pushlstring(L, value.text.data(), value.text.size());
+        if (value.type == LookupTable::ValueType::Number) {
+            // Turn the stored tostring() text back into the number.
+            const char* text = lua_tostring(L, -1);
+            if (lua_stringtonumber(L, text) != 0) {
+                lua_remove(L, -2);
+            }
+        }
+        return 1;
+    }
+
+    int LuaEngine::luaLookupTableGc(lua_State* L)
+    {
+        auto* handle = static_cast<LookupTableHandle*>(luaL_checkudata(L, 1, kLookupTableMeta));
+        handle->~LookupTableHandle();
+        return 0;
+    }
+
+    void LuaEngine::luaBudgetHook(lua_State* L, lua_Debug* /*ar*/)
+    {
+        LuaEngine* self = *static_cast<LuaEngine**>(lua_getextraspace(L));
+        if (!self->_budgetExceeded) {
+            self->_matchInstructions += kBudgetHookInterval;
+            const std::uint64_t limit = self->_limits.luaInstructionsPerMatch;
+            if ((limit == 0 || self->_matchInstructions <= limit)
+                && !self->runTimeLimitReached()) {
+                return;
+            }
+            // Fire on every instruction from here on: a pcall() in the
+            // script may catch the error below, but the next instruction
+            // raises it again until the chunk itself has unwound.
+            self->_budgetExceeded = true;
+            lua_sethook(L, &LuaEngine::luaBudgetHook, LUA_MASKCOUNT, 1);
+        }
+        luaL_error(L, "formula budget exceeded");
+    }
+
+    int LuaEngine::luaGlobalsIndex(lua_State* L)
+    {
+        // (table, key) -> env[key], else env[upper(key)] for an alias.
+        lua_settop(L, 2);
+        lua_pushvalue(L, 2);
+        lua_rawget(L, lua_upvalueindex(1));
+        if (!lua_isnil(L, -1) || lua_type(L, 2) != LUA_TSTRING) {
+            return 1;
+        }
+
+        size_t len = 0;
+        const char* key = lua_tolstring(L, 2, &len);
+        const std::string_view name(key, len);
+        if (const int slot = aliasSlotOf(name)) {
+            lua_pushstring(L, SLOT_NAMES[slot - 1]);
+        }
+        else if (isCaptureAlias(name)) {
+            std::string upper(name);
+            upper[0] = 'C';
+            upper[1] = 'A';
+            upper[2] = 'P';
+            lua_pushlstring(L, upper.data(), upper.size());
+        }
+        else {
+            return 1;   // the nil from the first lookup
+        }
+        lua_rawget(L, lua_upvalueindex(1));
+        return 1;
+    }
+
     void LuaEngine::applyLuaSafeMode(lua_State* L)
     {
         auto removeGlobal = [&](const char* name) {
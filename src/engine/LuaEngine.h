@@ -9,21 +9,44 @@
 // Concrete IFormulaEngine implementation backed by a Lua 5.x state.
 //
 // This is the encapsulation of MR's original Lua bridge. Behaviour is
-// preserved one-to-one - same variables, same set/skip semantics, same
-// per-match optimization caches (FPATH/FNAME/regex flag/cap count) - the
-// surface just lives behind IFormulaEngine now so the replace pipeline
-// can stay engine-agnostic.
+// preserved - same variables, same set/skip semantics, same per-match
+// optimization caches (FPATH/FNAME/regex flag/cap count) - the surface
+// just lives behind IFormulaEngine now so the replace pipeline can stay
+// engine-agnostic.
+//
+// Match variables are not Lua globals. They live in one environment
+// table per Lua state, which is the _ENV of every compiled script:
+//
+//   script --_ENV--> env --__index/__newindex--> _G --__index--> env
+//
+// The script reads CNT, CAP1, ... straight from env; anything else
+// falls through to _G, and assignments to new names land in _G as
+// before, so user globals and init-row functions persist for the run.
+// _G's __index points back at env so the helper functions (which run
+// with _G as their environment), _G.CNT and code loaded via load() or
+// lcmd() still see the match variables.
+//
+// The env slots are written with keys held in a registry table, so a
+// match costs one rawset per variable and no string building or global
+// lookup. Lowercase aliases (cnt, cap1, ...) are only written for the
+// names a compiled script actually mentions; any other lowercase read
+// is resolved on demand by the _G fallback.
+//
+// A script may return its replacement (`return CAP1 .. "x"`, nil to
+// skip) instead of calling set()/cond(). Which protocol a script uses
+// is decided when it is compiled; see _returnsResult.
 
 #pragma once
 
 #include "IFormulaEngine.h"
 #include "ILuaEngineHost.h"
+#include "../exprtk/DateParse.h"
 
 #include <lua.hpp>
 
+#include <cstdint>
 #include <map>
 #include <string>
-#include <vector>
 
 namespace MultiReplaceEngine {
 
@@ -50,6 +73,10 @@ namespace MultiReplaceEngine {
         // functions from the global namespace.
         void beginRun() override;
 
+        // Base skip summary, followed by the run's allocation figures
+        // when LuaGcSettings::reportStats is set.
+        std::wstring endRunSummary() override;
+
         bool compile(const std::string& scriptUtf8) override;
 
         FormulaResult execute(
@@ -59,29 +86,76 @@ namespace MultiReplaceEngine {
             int documentCodepage
         ) override;
 
+        // A Lua state cannot be copied: the clone gets a fresh state with
+        // the template compiled again. Globals and lcmd() functions of
+        // this run are not carried over; the clone's caller re-runs the
+        // init rows after its own beginRun(), as every run does.
+        FormulaEnginePtr clone() const override;
+
         EngineType type() const override { return EngineType::Lua; }
         std::wstring shortName() const override { return L"Lua"; }
         std::wstring shortLetter() const override { return L"L"; }
         std::wstring helpUrl() const override;
 
+        // Allocation figures of the current run, kept by the state's
+        // allocator. Reset by beginRun() after the state is rebuilt, so
+        // they cover the run's scripts and not the helper library.
+        struct MemoryStats {
+            std::uint64_t allocatedBytes = 0;  // requested by allocations and growth
+            std::uint64_t allocations = 0;     // fresh blocks
+            std::size_t   currentBytes = 0;
+            std::size_t   peakBytes = 0;
+            std::uint64_t gcCycles = 0;        // completed collections
+        };
+        const MemoryStats& memoryStats() const { return _memoryStats; }
+
         // ----- Lua-specific helpers (internal use & sandbox callbacks) ----
         //
         // These are public only because Lua's C-API requires C-style free
         // functions for hooks. External callers should not depend on them.
         static int  safeLoadFileSandbox(lua_State* L);
+
+        // todate(str, fmt) -> number | nil. Same parser as the ExprTk
+        // built-in; upvalue 1 is the owning engine's DateFormatCache.
+        static int  luaTodate(lua_State* L);
         static void applyLuaSafeMode(lua_State* L);
 
+        // lookupStoreOpen(path) -> table handle | nil, error. Opens the
+        // .lkp file through LookupStore; the handle answers h[key] from
+        // the shared mapping. nil when the file is not a literal table,
+        // so lkp() can fall back to evaluating it.
+        static int  luaLookupStoreOpen(lua_State* L);
+        static int  luaLookupTableIndex(lua_State* L);
+        static int  luaLookupTableGc(lua_State* L);
+
+        // Count hook enforcing FormulaLimits: raises an error once the
+        // match has run luaInstructionsPerMatch instructions or the run
+        // has used up secondsPerRun. Installed by beginRun() only when
+        // one of them is set.
+        static void luaBudgetHook(lua_State* L, lua_Debug* ar);
+
+        // __index of _G: looks the key up in env (upvalue 1), mapping a
+        // lowercase alias to its uppercase slot when env has no entry.
+        static int  luaGlobalsIndex(lua_State* L);
+
     private:
         // ----- Internal helpers -------------------------------------------
 
-        // Push a string variable to the Lua global table. Centralised so
-        // UTF-8 handling and registry conventions stay in one place.
-        void setLuaVariable(lua_State* L, const std::string& varName, const std::string& value);
+        // Create env, the key table and the _G fallback on a fresh state.
+        void createEnvironment(lua_State* L);
+
+        // Make sure the key table holds CAP#/cap# keys for `count`
+        // captures. Expects the key table at `keysIndex`.
+        void ensureCaptureKeys(lua_State* L, int keysIndex, int count);
 
         // Mirror Lua globals into _globalLuaVariablesMap for the debug
         // window dump.
         void captureLuaGlobals(lua_State* L);
 
+        // Put the collector into the mode of _gcSettings and start the
+        // cycle counter on a fresh state.
+        void applyGcSettings();
+
         // Lazy compile cache: re-uses the previously compiled chunk when
         // the script hasn't changed. Mirrors the behaviour of the former
         // ensureLuaCodeCompiled.
@@ -92,17 +166,51 @@ namespace MultiReplaceEngine {
         ILuaEngineHost* _host;                     // Non-owning, must outlive engine
         lua_State* _luaState = nullptr;
 
+        // Compiled todate() formats. Survives Lua state rebuilds; the
+        // closure only holds a pointer to it.
+        MultiReplace::DateFormatCache _dateFormats;
+
         // Compile cache
         int             _compiledReplaceRef = LUA_NOREF;
         std::string     _lastCompiledScript;
 
-        // Per-match optimisation caches: avoid re-pushing globals that
+        // Registry refs of the script environment and of the key table
+        // (variable names at fixed indices, see LuaEngine.cpp).
+        int             _envRef = LUA_NOREF;
+        int             _keysRef = LUA_NOREF;
+        int             _captureKeyCount = 0;      // CAP# pairs in the key table
+
+        // Lowercase aliases written into env on every match: one bit per
+        // variable slot, plus all cap# once any script mentions one.
+        // Union over every script compiled on this state.
+        std::uint32_t   _aliasMask = 0;
+        bool            _aliasCaptures = false;
+
+        // Result protocol of the compiled script. True when its code
+        // (strings and comments aside) names none of the resultTable
+        // helpers (set, cond, vars, ...): its first return value is the
+        // replacement, nil or false skips, and returning nothing skips
+        // too unless a helper it called wrote resultTable. Otherwise the
+        // chunk is called for its side effect and _G.resultTable, cleared
+        // before each call, is read back.
+        bool            _returnsResult = false;
+
+        // Collector setup for this run, and the allocator's figures. The
+        // allocator writes to _memoryStats through its user-data pointer.
+        LuaGcSettings   _gcSettings;
+        MemoryStats     _memoryStats;
+
+        // Instruction budget: instructions the running match has executed
+        // (counted in hook intervals), and whether the hook aborted it.
+        std::uint64_t   _matchInstructions = 0;
+        bool            _budgetExceeded = false;
+
+        // Per-match optimisation caches: avoid re-pushing slots that
         // didn't change since the previous match.
         std::string     _lastFPATH;
         std::string     _lastFNAME;
         int             _lastRegexFlag = -1;       // -1 = unset
         int             _lastCapCount = 0;
-        std::vector<std::string> _currentCapNames;
 
         // Snapshot of Lua globals captured for the debug window. Cleared
         // and rebuilt on every debug dump.
@@ -7,6 +7,9 @@
 // full engine is built, so the engine code can rely on documented
 // behaviour. When the full engine compiles successfully on Thomas's
 // box, we'll also build proper end-to-end tests.
+//
+// FormulaMemo has no ExprTk dependency either and is linked directly:
+//   g++ -std=c++17 -O2 -I.. test_engine_helpers.cpp ../FormulaMemo.cpp
 
 #include <array>
 #include <cassert>
@@ -21,6 +24,8 @@
 #include <system_error>
 #include <vector>
 
+#include "FormulaMemo.h"
+
 // ---- mirror of ExprTkEngine::parseCaptureToDouble -------------------
 
 static double parseCaptureToDouble(const std::string& s)
@@ -241,6 +246,77 @@ int main()
     check_reg(empty, 0, 0.0);
     check_reg(empty, 5, 0.0);
 
+    std::cout << "\n=== FormulaMemo tests ===\n";
+
+    using MultiReplaceEngine::FormulaMemo;
+    const auto expect = [](bool ok, const char* name) {
+        if (ok) { ++g_pass; std::cout << "[PASS] " << name << "\n"; }
+        else    { ++g_fail; std::cout << "[FAIL] " << name << "\n"; }
+        };
+
+    {
+        FormulaMemo memo;
+        expect(memo.find("a") == nullptr, "memo: miss on empty cache");
+        memo.insert("a", "alpha", false);
+        memo.insert("b", "beta", true);
+        const FormulaMemo::Entry* e = memo.find("b");
+        expect(e && e->output == "beta" && e->skip, "memo: hit returns output and skip");
+        expect(memo.hits() == 1 && memo.lookups() == 2, "memo: hit/lookup counters");
+        memo.insert("a", "again", false);
+        e = memo.find("a");
+        expect(e && e->output == "again" && memo.size() == 2, "memo: re-insert replaces entry");
+    }
+
+    {
+        // Entry limit: "a" is refreshed by find(), so "b" is the coldest.
+        FormulaMemo memo(FormulaMemo::Limits{ 2, 1 << 20 });
+        memo.insert("a", "1", false);
+        memo.insert("b", "2", false);
+        memo.find("a");
+        memo.insert("c", "3", false);
+        expect(memo.size() == 2 && memo.evictions() == 1, "memo: entry limit evicts one");
+        expect(memo.find("b") == nullptr, "memo: least recently used evicted");
+        expect(memo.find("a") != nullptr && memo.find("c") != nullptr, "memo: hot entries kept");
+    }
+
+    {
+        // Byte limit: each entry costs its bytes plus fixed overhead.
+        FormulaMemo memo(FormulaMemo::Limits{ 1000, 400 });
+        const std::string big(150, 'x');
+        memo.insert("k1", big, false);
+        memo.insert("k2", big, false);
+        expect(memo.size() == 1 && memo.bytes() <= 400, "memo: byte limit evicts");
+        memo.insert("huge", std::string(500, 'y'), false);
+        expect(memo.find("huge") == nullptr && memo.find("k2") != nullptr,
+            "memo: oversized result not stored");
+    }
+
+    {
+        // Keys that never repeat: the cache gives up after its probe
+        // window and stops answering, freeing its entries.
+        FormulaMemo memo;
+        for (int i = 0; i < 5000; ++i) {
+            const std::string key = std::to_string(i);
+            if (!memo.find(key)) {
+                memo.insert(key, "v", false);
+            }
+        }
+        expect(!memo.active() && memo.size() == 0, "memo: gives up on unique keys");
+        expect(memo.lookups() == 1024, "memo: counters frozen after giving up");
+
+        // Few distinct keys: stays active with a high hit rate.
+        FormulaMemo hot;
+        for (int i = 0; i < 5000; ++i) {
+            const std::string key = std::to_string(i % 50);
+            if (!hot.find(key)) {
+                hot.insert(key, "v", false);
+            }
+        }
+        expect(hot.active() && hot.hits() == 5000 - 50, "memo: repeating keys hit");
+        hot.clear();
+        expect(hot.size() == 0 && hot.lookups() == 0 && hot.active(), "memo: clear resets");
+    }
+
     // ==============================================================
 
     std::cout << "\n=== summary ===\n";
@@ -2,12 +2,15 @@
 //   g++ -std=c++17 -Wall -Wextra -Wpedantic -O2 \
 //       -I/home/claude/engine \
 //       /home/claude/engine/ExprTkPatternParser.cpp \
+//       /home/claude/engine/BlockDependencyAnalysis.cpp \
 //       /home/claude/engine/test_parser.cpp \
 //       -o /tmp/test_parser
 //
 // The tests cover all 18 edge cases from the design phase plus a few
-// additional adversarial cases.
+// additional adversarial cases, followed by the block dependency
+// classification that runs on the parsed expression segments.
 
+#include "BlockDependencyAnalysis.h"
 #include "ExprTkPatternParser.h"
 
 #include <cassert>
@@ -19,6 +22,9 @@
 
 using MultiReplaceEngine::ExprTkPatternParser;
 using ST = MultiReplaceEngine::ExprTkPatternParser::SegmentType;
+using MultiReplaceEngine::BlockDependency;
+using MultiReplaceEngine::classifyBlock;
+using MultiReplaceEngine::analyzeBlockInputs;
 
 static int g_pass = 0;
 static int g_fail = 0;
@@ -114,6 +120,63 @@ static void check(const std::string& name,
     }
 }
 
+static const char* dependencyName(BlockDependency d)
+{
+    switch (d) {
+    case BlockDependency::Constant: return "Constant";
+    case BlockDependency::PerFile:  return "PerFile";
+    case BlockDependency::PerMatch: return "PerMatch";
+    }
+    return "?";
+}
+
+static void checkDependency(const std::string& name,
+                            const std::string& formula,
+                            BlockDependency expected)
+{
+    const BlockDependency got = classifyBlock(formula);
+    if (got == expected) {
+        ++g_pass;
+        std::cout << "[PASS] " << name << "\n";
+    }
+    else {
+        ++g_fail;
+        std::cout << "[FAIL] " << name << "\n"
+                  << "  formula: \"" << visible(formula) << "\"\n"
+                  << "  expected " << dependencyName(expected)
+                  << " got " << dependencyName(got) << "\n";
+    }
+}
+
+static void checkInputs(const std::string& name,
+                        const std::string& formula,
+                        bool expectDeterministic,
+                        std::uint32_t expectVariables,
+                        const std::vector<std::size_t>& expectCaptures,
+                        bool expectAllCaptures = false)
+{
+    const auto in = analyzeBlockInputs(formula);
+    bool ok = in.deterministic == expectDeterministic;
+    if (expectDeterministic) {
+        ok = ok && in.variables == expectVariables
+                && in.captures == expectCaptures
+                && in.allCaptures == expectAllCaptures;
+    }
+    if (ok) {
+        ++g_pass;
+        std::cout << "[PASS] " << name << "\n";
+    }
+    else {
+        ++g_fail;
+        std::cout << "[FAIL] " << name << "\n"
+                  << "  formula: \"" << visible(formula) << "\"\n"
+                  << "  deterministic=" << in.deterministic
+                  << " variables=" << in.variables
+                  << " captures=" << in.captures.size()
+                  << " allCaptures=" << in.allCaptures << "\n";
+    }
+}
+
 // Convenience constructors
 static ExpectedSeg L(const std::string& t) { return { ST::Literal,    t }; }
 static ExpectedSeg E(const std::string& t) { return { ST::Expression, t }; }
@@ -381,6 +444,57 @@ int main()
         std::cout << "[PASS] hasExpressions: escaped marker -> false\n";
     }
 
+    // ---------- block dependency classification ----------
+
+    const auto C = BlockDependency::Constant;
+    const auto F = BlockDependency::PerFile;
+    const auto M = BlockDependency::PerMatch;
+
+    checkDependency("D01_literal_number",       "42",                        C);
+    checkDependency("D02_pure_builtin",         "num2rom(2024)",             C);
+    checkDependency("D03_math_and_constants",   "round(pi * 2) + sqrt(16)",  C);
+    checkDependency("D04_exponent_literal",     "1e5 + 2.5E-3",              C);
+    checkDependency("D05_string_literal",       "'cnt ' + 'rnd()'",          C);
+    checkDependency("D06_comment_ignored",      "5 /* cnt */ # hit\n + 1",   C);
+    checkDependency("D07_local_var",            "var x := 3; x * 2",         C);
+    checkDependency("D08_for_loop_local",       "var s := 0; for (var i := 0; i < 3; i += 1) { s += i; }; s", C);
+    checkDependency("D09_fname",                "fname",                     F);
+    checkDependency("D10_fpath_upper",          "len(FPATH) + 1",            F);
+    checkDependency("D11_match_var",            "CNT * 2",                   M);
+    checkDependency("D12_capture",              "num(1) + 1",                M);
+    checkDependency("D13_history",              "numprev() + 1",             M);
+    checkDependency("D14_rnd",                  "rnd(10)",                   M);
+    checkDependency("D15_now",                  "now()",                     M);
+    checkDependency("D16_today_mixed_case",     "Today()",                   M);
+    checkDependency("D17_seq",                  "seq(1, 1)",                 M);
+    checkDependency("D18_skip",                 "if (1) skip(); 0",          M);
+    checkDependency("D19_file_then_match",      "fname + txt(0)",            M);
+    checkDependency("D20_unknown_library_func", "myfunc(2)",                 M);
+    checkDependency("D21_loadlib",              "loadlib('lib.elib')",       M);
+    checkDependency("D22_name_prefix",          "numeric_thing",             M);
+    checkDependency("D23_lkp_literal_key",      "lkp('de', 'c.lkp')",        C);
+
+    // ---------- block inputs (memo key layout) ----------
+
+    using namespace MultiReplaceEngine;
+
+    checkInputs("I01_constant",             "num2rom(2024)",           true,  0, {});
+    checkInputs("I02_literal_captures",     "num(2) + num(1) * num(2)", true, 0, { 1, 2 });
+    checkInputs("I03_txt_and_hit",          "txt(3) + totxt(HIT)",     true,  0, { 0, 3 });
+    checkInputs("I04_variables",            "line + col + len(fname)", true,  VarLINE | VarCOL | VarFNAME, {});
+    checkInputs("I05_computed_index",       "num(1 + 1)",              true,  0, {}, true);
+    checkInputs("I06_nested_literal",       "num(num(1))",             true,  0, { 1 }, true);
+    checkInputs("I07_skip_is_result",       "if (num(1) < 0) skip(); num(1)", true, 0, { 1 });
+    checkInputs("I08_negative_legacy",      "num(-1)",                 true,  0, {});
+    checkInputs("I09_history_arity2",       "num(1, 1)",               false, 0, {});
+    checkInputs("I10_numprev",              "num(1) + numprev()",      false, 0, {});
+    checkInputs("I11_rnd",                  "num(1) * rnd()",          false, 0, {});
+    checkInputs("I12_seq",                  "seq(1, 1)",               false, 0, {});
+    checkInputs("I13_numcol",               "numcol(2)",               false, 0, {});
+    checkInputs("I14_unknown",              "myfunc(num(1))",          false, 0, {});
+    checkInputs("I15_string_with_comma",    "txt(1) + ', ' + txt(2)",  true,  0, { 1, 2 });
+    checkInputs("I16_lkp_capture",          "lkp(txt(1), 'c.lkp')",    true,  0, { 1 });
+
     // ---------- summary ----------
     std::cout << "\n=== summary ===\n";
     std::cout << "passed: " << g_pass << "\n";
@@ -0,0 +1,329 @@
+// This file is part of MultiReplace.
+//
+// MultiReplace is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// BlockDependencyAnalysis.cpp
+// Identifier scanner over one formula body. Same lexical rules as the
+// history scanner: ASCII identifiers, case-insensitive names, string
+// literals and the three ExprTk comment styles are skipped.
+
+#include "BlockDependencyAnalysis.h"
+
+#include <algorithm>
+#include <cctype>
+#include <string>
+#include <vector>
+
+namespace MultiReplaceEngine {
+
+    namespace {
+
+        // ---------------------------------------------------------------------
+        // Name tables
+        // ---------------------------------------------------------------------
+        //
+        // Everything in PURE_NAMES is known to be deterministic for the
+        // duration of a run. Names in neither table classify the block as
+        // PerMatch; apart from num, txt and skip (handled in the scanner)
+        // they also rule out memoisation - that covers the history and
+        // column readers and the stateful built-ins (seq, rnd, rndseed,
+        // rndkey, rndnorm, now, today, loadlib), so none of them needs a
+        // table of its own. Entries are lowercase; the lookup folds the
+        // input to match ExprTk's case-insensitive symbol resolution.
+
+        constexpr std::string_view PURE_NAMES[] = {
+            // ExprTk keywords and control structures
+            "and", "assert", "break", "case", "const", "continue",
+            "default", "else", "false", "for", "if", "ilike", "in",
+            "like", "nand", "nor", "not", "null", "or", "repeat",
+            "return", "shl", "shr", "swap", "switch", "true", "until",
+            "var", "while", "xnor", "xor",
+
+            // ExprTk base functions
+            "abs", "acos", "acosh", "asin", "asinh", "atan", "atan2",
+            "atanh", "avg", "ceil", "clamp", "cos", "cosh", "cot", "csc",
+            "deg2grad", "deg2rad", "equal", "erf", "erfc", "exp", "expm1",
+            "floor", "frac", "grad2deg", "hypot", "iclamp", "inrange",
+            "log", "log10", "log1p", "log2", "logn", "mand", "max", "min",
+            "mod", "mor", "mul", "ncdf", "not_equal", "pow", "rad2deg",
+            "root", "round", "roundn", "sec", "sgn", "sin", "sinc", "sinh",
+            "sqrt", "sum", "tan", "tanh", "trunc",
+
+            // symbol_table::add_constants()
+            "pi", "epsilon", "inf",
+
+            // MultiReplace built-ins without state. todate() resolves
+            // local time through mktime, which is fixed within a run;
+            // lkp() reads a table opened once per run.
+            "isnum", "todate", "hex2num", "bin2num", "oct2num",
+            "num2rom", "rom2num", "len", "find", "slice", "split",
+            "trim", "ltrim", "rtrim", "replace", "reptxt", "tonum",
+            "chr2num", "num2chr", "totxt", "lkp"
+        };
+
+        // Engine variables, with the BlockVariable bit each one feeds.
+        // HIT has no bit of its own: it reads the full match, so it is
+        // recorded as capture 0.
+        struct VariableEntry {
+            std::string_view name;
+            std::uint32_t    bit;
+            BlockDependency  dependency;
+        };
+
+        constexpr VariableEntry VARIABLES[] = {
+            { "fpath", VarFPATH, BlockDependency::PerFile  },
+            { "fname", VarFNAME, BlockDependency::PerFile  },
+            { "cnt",   VarCNT,   BlockDependency::PerMatch },
+            { "lcnt",  VarLCNT,  BlockDependency::PerMatch },
+            { "line",  VarLINE,  BlockDependency::PerMatch },
+            { "lpos",  VarLPOS,  BlockDependency::PerMatch },
+            { "apos",  VarAPOS,  BlockDependency::PerMatch },
+            { "col",   VarCOL,   BlockDependency::PerMatch },
+            { "hit",   0,        BlockDependency::PerMatch }
+        };
+
+        template <std::size_t N>
+        bool inTable(const std::string_view (&table)[N], std::string_view name)
+        {
+            return std::find(std::begin(table), std::end(table), name) != std::end(table);
+        }
+
+        inline bool isIdentStart(char c)
+        {
+            const unsigned char uc = static_cast<unsigned char>(c);
+            return (uc >= 'a' && uc <= 'z')
+                || (uc >= 'A' && uc <= 'Z')
+                || uc == '_';
+        }
+
+        inline bool isIdentChar(char c)
+        {
+            return isIdentStart(c) || (c >= '0' && c <= '9');
+        }
+
+        inline char asciiToLower(char c)
+        {
+            const unsigned char uc = static_cast<unsigned char>(c);
+            if (uc >= 'A' && uc <= 'Z') {
+                return static_cast<char>(uc + ('a' - 'A'));
+            }
+            return c;
+        }
+
+        // Insert into the sorted, unique capture list.
+        void addCapture(BlockInputs& in, std::size_t index)
+        {
+            const auto pos = std::lower_bound(in.captures.begin(), in.captures.end(), index);
+            if (pos == in.captures.end() || *pos != index) {
+                in.captures.insert(pos, index);
+            }
+        }
+
+        // Read the argument list of a num / txt call starting at `open`
+        // (the opening paren) and record what it reads into `in`. A
+        // single literal index is recorded as such; a computed index
+        // marks every capture as input; a second argument makes it a
+        // history read, which no set of current-match inputs determines.
+        void recordCaptureCall(std::string_view text, std::size_t open,
+            BlockInputs& in)
+        {
+            std::size_t depth = 1;
+            char        stringQuote = 0;
+            std::size_t i = open + 1;
+            for (; i < text.size(); ++i) {
+                const char c = text[i];
+                if (stringQuote != 0) {
+                    if (c == '\\' && i + 1 < text.size()) {
+                        ++i;
+                    }
+                    else if (c == stringQuote) {
+                        stringQuote = 0;
+                    }
+                    continue;
+                }
+                if (c == '"' || c == '\'') {
+                    stringQuote = c;
+                }
+                else if (c == '(') {
+                    ++depth;
+                }
+                else if (c == ')') {
+                    if (--depth == 0) {
+                        break;
+                    }
+                }
+                else if (c == ',' && depth == 1) {
+                    in.deterministic = false;
+                    return;
+                }
+            }
+
+            // Trim and try the argument as a decimal literal.
+            std::size_t lo = open + 1;
+            std::size_t hi = std::min(i, text.size());
+            while (lo < hi && std::isspace(static_cast<unsigned char>(text[lo]))) ++lo;
+            while (hi > lo && std::isspace(static_cast<unsigned char>(text[hi - 1]))) --hi;
+            const bool negative = (lo < hi && text[lo] == '-');
+            std::size_t index = 0;
+            std::size_t k = negative ? lo + 1 : lo;
+            bool literal = (k < hi);
+            for (; k < hi && literal; ++k) {
+                const char d = text[k];
+                literal = (d >= '0' && d <= '9');
+                index = index * 10 + static_cast<std::size_t>(d - '0');
+            }
+            if (!literal || hi - lo > 9) {
+                in.allCaptures = true;
+                return;
+            }
+            if (!negative) {        // num(-1) / txt(-1): legacy constant 0 / ""
+                addCapture(in, index);
+            }
+        }
+
+    } // anonymous namespace
+
+
+    // ---------------------------------------------------------------------
+    // Public entry point
+    // ---------------------------------------------------------------------
+
+    BlockInputs analyzeBlockInputs(std::string_view text)
+    {
+        BlockInputs in;
+
+        // Names introduced by `var` inside this block. Lowercased, like
+        // every name the scanner compares.
+        std::vector<std::string> locals;
+        bool nextIsLocal = false;
+
+        std::string name;
+        char stringQuote = 0;
+        std::size_t i = 0;
+        while (i < text.size()) {
+            const char c = text[i];
+
+            if (stringQuote != 0) {
+                if (c == '\\' && i + 1 < text.size()) {
+                    i += 2;
+                    continue;
+                }
+                if (c == stringQuote) {
+                    stringQuote = 0;
+                }
+                ++i;
+                continue;
+            }
+            if (c == '"' || c == '\'') {
+                stringQuote = c;
+                ++i;
+                continue;
+            }
+
+            // Comments: #..., //... and /* ... */, as in ExprTk's lexer.
+            if (c == '#') {
+                while (i < text.size() && text[i] != '\n') ++i;
+                continue;
+            }
+            if (c == '/' && i + 1 < text.size()) {
+                if (text[i + 1] == '/') {
+                    i += 2;
+                    while (i < text.size() && text[i] != '\n') ++i;
+                    continue;
+                }
+                if (text[i + 1] == '*') {
+                    i += 2;
+                    while (i + 1 < text.size()
+                        && !(text[i] == '*' && text[i + 1] == '/')) {
+                        ++i;
+                    }
+                    i = (i + 1 < text.size()) ? i + 2 : text.size();
+                    continue;
+                }
+            }
+
+            // Numeric literals: a digit or '.' starts a run that may carry
+            // letters (1e5, 2.5E3). Consumed whole so the exponent 'e' is
+            // never read as an identifier.
+            if ((c >= '0' && c <= '9') || c == '.') {
+                while (i < text.size() && (isIdentChar(text[i]) || text[i] == '.')) ++i;
+                continue;
+            }
+
+            if (!isIdentStart(c)) {
+                ++i;
+                continue;
+            }
+
+            name.clear();
+            while (i < text.size() && isIdentChar(text[i])) {
+                name.push_back(asciiToLower(text[i]));
+                ++i;
+            }
+
+            if (nextIsLocal) {
+                locals.push_back(name);
+                nextIsLocal = false;
+                continue;
+            }
+            if (name == "var") {
+                nextIsLocal = true;
+                continue;
+            }
+
+            if (inTable(PURE_NAMES, name)
+                || std::find(locals.begin(), locals.end(), name) != locals.end()) {
+                continue;
+            }
+
+            const auto var = std::find_if(std::begin(VARIABLES), std::end(VARIABLES),
+                [&name](const VariableEntry& e) { return e.name == name; });
+            if (var != std::end(VARIABLES)) {
+                in.variables |= var->bit;
+                if (var->bit == 0) {
+                    addCapture(in, 0);
+                }
+                in.dependency = std::max(in.dependency, var->dependency);
+                continue;
+            }
+
+            in.dependency = BlockDependency::PerMatch;
+
+            if (name == "skip") {
+                continue;
+            }
+            if (name == "num" || name == "txt") {
+                std::size_t open = i;
+                while (open < text.size()
+                    && std::isspace(static_cast<unsigned char>(text[open]))) {
+                    ++open;
+                }
+                if (open < text.size() && text[open] == '(') {
+                    // Scanning resumes inside the argument list, so a
+                    // nested call such as num(num(1)) is seen as well.
+                    recordCaptureCall(text, open, in);
+                    if (!in.deterministic) {
+                        return in;
+                    }
+                    continue;
+                }
+            }
+
+            // History reader, stateful built-in or an unknown name.
+            // Nothing later in the block can change the outcome.
+            in.deterministic = false;
+            return in;
+        }
+
+        return in;
+    }
+
+    BlockDependency classifyBlock(std::string_view formula)
+    {
+        return analyzeBlockInputs(formula).dependency;
+    }
+
+} // namespace MultiReplaceEngine
@@ -0,0 +1,100 @@
+// This file is part of MultiReplace.
+//
+// MultiReplace is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// BlockDependencyAnalysis.h
+// Compile-time scan of one (?=...) formula body. Classifies the block
+// by the narrowest scope its result can change in:
+//
+//   - Constant: references no engine variable and no impure function
+//     (e.g. num2rom(2024), 'v' + totxt(pi)). Evaluated once per run.
+//   - PerFile:  references only FPATH / FNAME on top of constant
+//     material. Evaluated once per document.
+//   - PerMatch: everything else - match variables (CNT, LINE, HIT, ...),
+//     capture and history readers (num, txt, numprev, ...), functions
+//     with state or side effects (rnd, seq, skip, now, loadlib, ...)
+//     and any identifier the scanner cannot place, which covers
+//     functions loaded from an .elib library at run time.
+//
+// The same scan also records which inputs a PerMatch block reads and
+// whether it reads nothing else (BlockInputs). A block that only
+// combines captures, match variables and pure functions is a function
+// of those inputs, which is what lets the engine memoise its output.
+//
+// The scan is deliberately conservative: a wrong "PerMatch" only costs
+// the evaluation it would have saved, a wrong "Constant" would freeze a
+// value that should change. Identifiers declared inside the block with
+// `var` are treated as local and do not widen the classification.
+//
+// Like MatchHistoryAnalysis, the module has no engine dependency. It
+// expects the formula text without its "~ spec" suffix, so the engine
+// hands over FormatSpec::splitFormulaSpec(...).formula.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace MultiReplaceEngine {
+
+    // Ordered from narrowest to widest; the block takes the widest
+    // dependency of any identifier it references.
+    enum class BlockDependency : std::uint8_t {
+        Constant,
+        PerFile,
+        PerMatch
+    };
+
+    // Engine variables a block reads, as bits of BlockInputs::variables.
+    // HIT is not listed: it is derived from the full match and recorded
+    // as capture 0 instead.
+    enum BlockVariable : std::uint32_t {
+        VarCNT   = 1u << 0,
+        VarLCNT  = 1u << 1,
+        VarLINE  = 1u << 2,
+        VarLPOS  = 1u << 3,
+        VarAPOS  = 1u << 4,
+        VarCOL   = 1u << 5,
+        VarFPATH = 1u << 6,
+        VarFNAME = 1u << 7
+    };
+
+    struct BlockInputs {
+        BlockDependency dependency = BlockDependency::Constant;
+
+        // True while the block's result is fully determined by the
+        // inputs below. Cleared by history readers (num/txt arity 2/3,
+        // numout, numprev, ...), stateful built-ins (seq, rnd, now, ...),
+        // CSV column readers (they read the document, not the match) and
+        // unknown names. skip() keeps it set: whether a match is skipped
+        // is part of the result, not a side effect.
+        bool deterministic = true;
+
+        // BlockVariable bits.
+        std::uint32_t variables = 0;
+
+        // Capture indexes read through num(n) / txt(n) with a literal
+        // n, ascending and unique. 0 is the full match (also HIT).
+        std::vector<std::size_t> captures;
+
+        // Set when num / txt is called with a computed index; every
+        // capture then counts as an input.
+        bool allCaptures = false;
+    };
+
+    // Scan one formula body for its dependency scope and inputs. When
+    // `deterministic` ends up false the remaining fields are incomplete
+    // (the scan stops at the first name that rules memoisation out).
+    BlockInputs analyzeBlockInputs(std::string_view formula);
+
+    // Classify one formula body. Never fails: unbalanced quotes or
+    // comments simply end the scan, and ExprTk reports the syntax error
+    // on its own when the block is compiled.
+    BlockDependency classifyBlock(std::string_view formula);
+
+} // namespace MultiReplaceEngine
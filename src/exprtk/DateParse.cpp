@@ -9,6 +9,7 @@
 
 #include <cctype>
 #include <cstring>
+#include <limits>
 
 namespace MultiReplace {
 
@@ -26,6 +27,10 @@ namespace MultiReplace {
                 || c == '\v' || c == '\f' || c == '\r';
         }
 
+        inline char toUpperAscii(char c) noexcept {
+            return (c >= 'a' && c <= 'z') ? static_cast<char>(c - 32) : c;
+        }
+
         // Read up to `maxDigits` ASCII digits starting at input[i].
         // Stops early when a non-digit is hit or maxDigits is reached.
         // Returns false if no digit was read; otherwise writes the
@@ -54,219 +59,373 @@ namespace MultiReplace {
             }
         }
 
-        // Try to consume a single literal `expected` from input at i.
-        // Whitespace is *not* special-cased here - that's done at the
-        // format-loop level so a single space in the format can absorb
-        // any run of whitespace in the input.
-        inline bool consumeLiteral(std::string_view input, std::size_t& i,
-                                   char expected) noexcept
+        // Case-insensitive ASCII compare for the AM/PM token at input[i].
+        // Returns 0 for AM, 1 for PM, -1 for anything else.
+        int readAmPm(std::string_view input, std::size_t i) noexcept
         {
-            if (i >= input.size() || input[i] != expected) return false;
-            ++i;
-            return true;
+            if (i + 1 >= input.size()) return -1;
+            const char c0 = toUpperAscii(input[i]);
+            const char c1 = toUpperAscii(input[i + 1]);
+            if (c1 != 'M') return -1;
+            if (c0 == 'A') return 0;
+            if (c0 == 'P') return 1;
+            return -1;
         }
 
-        // Case-insensitive ASCII compare for AM/PM tokens. Returns true
-        // if input[i..] starts with the 2-char tag and advances i past
-        // it; false otherwise. Only ASCII letters are compared, so the
-        // caller's tag must be 2 ASCII chars.
-        bool consumeCaseInsensitive2(std::string_view input, std::size_t& i,
-                                     char a, char b) noexcept
+        // Days from 1970-01-01 to the given proleptic Gregorian date.
+        // Closed-form civil-to-days conversion (era/day-of-era split),
+        // replacing the per-year loop the UTC path used to run.
+        long long daysFromCivil(long long y, unsigned m, unsigned d) noexcept
         {
-            if (i + 1 >= input.size()) return false;
-            const char c0 = input[i];
-            const char c1 = input[i + 1];
-            const auto toUpper = [](char c) {
-                return (c >= 'a' && c <= 'z') ? static_cast<char>(c - 32) : c;
-            };
-            if (toUpper(c0) != a || toUpper(c1) != b) return false;
-            i += 2;
-            return true;
+            y -= (m <= 2) ? 1 : 0;
+            const long long era = (y >= 0 ? y : y - 399) / 400;
+            const unsigned yoe = static_cast<unsigned>(y - era * 400);
+            const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+            const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+            return era * 146097 + static_cast<long long>(doe) - 719468;
+        }
+
+    }  // namespace
+
+    // ---------------------------------------------------------------------
+    // DateFormat - compile
+    // ---------------------------------------------------------------------
+
+    DateFormat::DateFormat(std::string_view format)
+    {
+        _valid = compileInto(format);
+        if (!_valid) {
+            _ops.clear();
+            return;
+        }
+
+        // Lay out the fixed-offset program. Each field is assumed to be
+        // full width and each format space to match exactly one input
+        // whitespace char. Offsets are stored as bytes, so formats whose
+        // layout exceeds 255 bytes simply skip the fast path.
+        std::size_t offset = 0;
+        for (Op& op : _ops) {
+            if (offset > 0xFF) {
+                return;
+            }
+            op.offset = static_cast<std::uint8_t>(offset);
+            switch (op.kind) {
+            case OpKind::Literal: offset += 1; break;
+            case OpKind::Space:   offset += 1; break;
+            case OpKind::Field:   offset += op.maxDigits; break;
+            case OpKind::AmPm:    offset += 2; break;
+            }
         }
+        _fixedLength = offset;
+        _fixedWidth = !_ops.empty();
+    }
 
-        // Result of a single specifier dispatch. Lets handleSpecifier
-        // signal "I rewrote the format" (for %F / %T) without using
-        // exceptions or out-params for flow control.
-        struct SpecResult {
-            bool ok;          // false = parse failure, abort
-            bool didRewrite;  // %F/%T expanded into a sub-format
+    bool DateFormat::compileInto(std::string_view format)
+    {
+        auto addField = [this](Field f, int digits) {
+            Op op;
+            op.kind = OpKind::Field;
+            op.field = f;
+            op.maxDigits = static_cast<std::uint8_t>(digits);
+            _ops.push_back(op);
         };
 
-        // Forward declaration for the recursive-format case.
-        bool parseImpl(std::string_view input, std::size_t& i,
-                       std::string_view format, std::size_t& f,
-                       std::tm& tm);
-
-        // Handle one %-specifier at format[f] (f points to the char
-        // after '%'). Updates tm, advances input cursor i. Format
-        // cursor f is left pointing AT the specifier letter; the
-        // outer loop bumps past it.
-        SpecResult handleSpecifier(std::string_view input, std::size_t& i,
-                                   std::string_view format, std::size_t& f,
-                                   std::tm& tm) noexcept
-        {
-            // f currently points at the specifier letter itself.
-            const char spec = format[f];
-            int v = 0;
-
-            switch (spec) {
-            case '%':
-                if (!consumeLiteral(input, i, '%')) return { false, false };
-                return { true, false };
-
-            case 'Y':
-                if (!readInt(input, i, 4, v)) return { false, false };
-                if (v < 1 || v > 9999) return { false, false };
-                tm.tm_year = v - 1900;
-                return { true, false };
-
-            case 'y':
-                if (!readInt(input, i, 2, v)) return { false, false };
-                // POSIX rule: 00..68 -> 2000..2068, 69..99 -> 1969..1999.
-                tm.tm_year = (v < 69) ? (v + 2000 - 1900) : (v + 1900 - 1900);
-                return { true, false };
-
-            case 'm':
-                if (!readInt(input, i, 2, v)) return { false, false };
-                if (v < 1 || v > 12) return { false, false };
-                tm.tm_mon = v - 1;
-                return { true, false };
-
-            case 'd':
-                if (!readInt(input, i, 2, v)) return { false, false };
-                if (v < 1 || v > 31) return { false, false };
-                tm.tm_mday = v;
-                return { true, false };
-
-            case 'H':
-                if (!readInt(input, i, 2, v)) return { false, false };
-                if (v < 0 || v > 23) return { false, false };
-                tm.tm_hour = v;
-                return { true, false };
-
-            case 'I':
-                if (!readInt(input, i, 2, v)) return { false, false };
-                if (v < 1 || v > 12) return { false, false };
-                // Store the 12-hour value. %p will normalise it to 24h
-                // when it runs; if %p never appears, 12 means 12 and
-                // 1..11 mean 1..11 - which is what callers asking for
-                // an %I-only parse would expect.
-                tm.tm_hour = (v == 12) ? 0 : v;
-                return { true, false };
-
-            case 'M':
-                if (!readInt(input, i, 2, v)) return { false, false };
-                if (v < 0 || v > 59) return { false, false };
-                tm.tm_min = v;
-                return { true, false };
-
-            case 'S':
-                if (!readInt(input, i, 2, v)) return { false, false };
-                if (v < 0 || v > 60) return { false, false };  // leap sec
-                tm.tm_sec = v;
-                return { true, false };
-
-            case 'p':
-                // Expects exactly "AM" or "PM" (any case). If %I already
-                // ran, tm_hour holds 0..11 - add 12 for PM. If %H ran
-                // instead, %p has no effect (24h is already correct).
-                if (consumeCaseInsensitive2(input, i, 'A', 'M')) {
-                    // AM: nothing to do. 12 AM was already normalised
-                    // to 0 by the %I handler.
-                    return { true, false };
+        for (std::size_t f = 0; f < format.size(); ++f) {
+            const char fc = format[f];
+
+            if (fc == '%') {
+                if (f + 1 >= format.size()) {
+                    // Trailing '%' with no specifier letter - malformed.
+                    return false;
                 }
-                if (consumeCaseInsensitive2(input, i, 'P', 'M')) {
-                    if (tm.tm_hour < 12) tm.tm_hour += 12;
-                    return { true, false };
+                ++f;
+                switch (format[f]) {
+                case '%': {
+                    Op op;
+                    op.literal = '%';
+                    _ops.push_back(op);
+                    break;
                 }
-                return { false, false };
-
-            case 'F': {
-                // %F expands to "%Y-%m-%d". Recurse on the sub-format
-                // so all range-checks and digit-count limits stay in
-                // one code path.
-                constexpr std::string_view sub("%Y-%m-%d");
-                std::size_t subF = 0;
-                if (!parseImpl(input, i, sub, subF, tm)) {
-                    return { false, false };
+                case 'Y': addField(Field::Year4, 4); break;
+                case 'y': addField(Field::Year2, 2); break;
+                case 'm': addField(Field::Month, 2); break;
+                case 'd': addField(Field::Day, 2); break;
+                case 'H': addField(Field::Hour24, 2); break;
+                case 'I': addField(Field::Hour12, 2); break;
+                case 'M': addField(Field::Minute, 2); break;
+                case 'S': addField(Field::Second, 2); break;
+                case 'p': {
+                    Op op;
+                    op.kind = OpKind::AmPm;
+                    _ops.push_back(op);
+                    break;
                 }
-                return { true, true };
-            }
-
-            case 'T': {
-                constexpr std::string_view sub("%H:%M:%S");
-                std::size_t subF = 0;
-                if (!parseImpl(input, i, sub, subF, tm)) {
-                    return { false, false };
+                case 'F':
+                    // %F expands to "%Y-%m-%d". Expanding at compile time
+                    // keeps all range checks and digit limits in one place.
+                    if (!compileInto("%Y-%m-%d")) return false;
+                    break;
+                case 'T':
+                    if (!compileInto("%H:%M:%S")) return false;
+                    break;
+                default:
+                    // Unknown specifier -> fail rather than silently skip.
+                    // Keeps user mistakes visible.
+                    return false;
                 }
-                return { true, true };
+                continue;
             }
 
-            default:
-                // Unknown specifier -> fail rather than silently skip.
-                // Keeps user mistakes visible.
-                return { false, false };
+            Op op;
+            if (isAsciiSpace(fc)) {
+                // Whitespace in format -> zero-or-more whitespace in
+                // input. POSIX strptime behaviour: a single space absorbs
+                // runs of any whitespace.
+                op.kind = OpKind::Space;
             }
+            else {
+                op.literal = fc;
+            }
+            _ops.push_back(op);
         }
+        return true;
+    }
 
-        // Main parse loop. Walks format and input in lockstep; tracks
-        // both indices by reference so the recursive %F / %T cases
-        // share state.
-        bool parseImpl(std::string_view input, std::size_t& i,
-                       std::string_view format, std::size_t& f,
-                       std::tm& tm)
+    // ---------------------------------------------------------------------
+    // DateFormat - apply
+    // ---------------------------------------------------------------------
+
+    namespace {
+
+        // %p: if %I already ran, tm_hour holds 0..11 - add 12 for PM. If
+        // %H ran instead, %p has no effect (24h is already correct). 12 AM
+        // was already normalised to 0 by the %I handler.
+        inline void applyAmPm(int pm, std::tm& tm) noexcept
         {
-            while (f < format.size()) {
-                const char fc = format[f];
-
-                if (fc == '%') {
-                    if (f + 1 >= format.size()) {
-                        // Trailing '%' with no specifier letter - malformed.
-                        return false;
-                    }
-                    ++f;  // step onto specifier letter
-                    const SpecResult r = handleSpecifier(input, i, format, f, tm);
-                    if (!r.ok) return false;
-                    ++f;  // step past specifier letter (or past the
-                          // %F/%T letter; the sub-format inside ran
-                          // independently, no extra advance needed).
-                    continue;
-                }
+            if (pm == 1 && tm.tm_hour < 12) tm.tm_hour += 12;
+        }
+
+    }  // namespace
+
+    bool DateFormat::storeField(Field field, int v, std::tm& tm) noexcept
+    {
+        switch (field) {
+        case Field::Year4:
+            if (v < 1 || v > 9999) return false;
+            tm.tm_year = v - 1900;
+            return true;
+        case Field::Year2:
+            // POSIX rule: 00..68 -> 2000..2068, 69..99 -> 1969..1999.
+            tm.tm_year = (v < 69) ? (v + 2000 - 1900) : (v + 1900 - 1900);
+            return true;
+        case Field::Month:
+            if (v < 1 || v > 12) return false;
+            tm.tm_mon = v - 1;
+            return true;
+        case Field::Day:
+            if (v < 1 || v > 31) return false;
+            tm.tm_mday = v;
+            return true;
+        case Field::Hour24:
+            if (v < 0 || v > 23) return false;
+            tm.tm_hour = v;
+            return true;
+        case Field::Hour12:
+            if (v < 1 || v > 12) return false;
+            // Store the 12-hour value. %p will normalise it to 24h
+            // when it runs; if %p never appears, 12 means 12 and
+            // 1..11 mean 1..11 - which is what callers asking for
+            // an %I-only parse would expect.
+            tm.tm_hour = (v == 12) ? 0 : v;
+            return true;
+        case Field::Minute:
+            if (v < 0 || v > 59) return false;
+            tm.tm_min = v;
+            return true;
+        case Field::Second:
+            if (v < 0 || v > 60) return false;  // leap sec
+            tm.tm_sec = v;
+            return true;
+        }
+        return false;
+    }
 
-                if (isAsciiSpace(fc)) {
-                    // Whitespace in format -> zero-or-more whitespace
-                    // in input. POSIX strptime behaviour: a single
-                    // space absorbs runs of any whitespace.
-                    skipSpaces(input, i);
-                    ++f;
-                    continue;
+    bool DateFormat::parse(std::string_view input, std::tm& tm) const
+    {
+        if (!_valid) {
+            return false;
+        }
+        if (_fixedWidth && input.size() >= _fixedLength
+            && parseFixed(input, tm)) {
+            return true;
+        }
+        // POSIX strptime allows trailing input. We do the same: the
+        // caller may have appended a timezone, comments, etc. The
+        // contract is "format was satisfied", not "input was emptied".
+        return parseGeneric(input, tm);
+    }
+
+    bool DateFormat::parseFixed(std::string_view input, std::tm& tm) const
+    {
+        // Single pass over the precomputed offsets. Only when every token
+        // sits exactly where the fixed layout expects it does the
+        // interpreter consume the very same bytes, so a pass here is
+        // indistinguishable from a generic parse. Any mismatch returns
+        // false and the caller re-runs the input through parseGeneric(),
+        // which rewrites every field it touches - partial writes made
+        // here before bailing out are therefore harmless.
+        const char* p = input.data();
+        for (const Op& op : _ops) {
+            const char* at = p + op.offset;
+            switch (op.kind) {
+            case OpKind::Literal:
+                if (*at != op.literal) return false;
+                break;
+            case OpKind::Space:
+                // Exactly one whitespace char, not followed by another
+                // one the interpreter would also have swallowed.
+                if (!isAsciiSpace(*at)) return false;
+                if (op.offset + 1u < input.size() && isAsciiSpace(at[1])) return false;
+                break;
+            case OpKind::Field: {
+                int v = 0;
+                for (int k = 0; k < op.maxDigits; ++k) {
+                    if (!isAsciiDigit(at[k])) return false;
+                    v = v * 10 + (at[k] - '0');
                 }
+                if (!storeField(op.field, v, tm)) return false;
+                break;
+            }
+            case OpKind::AmPm: {
+                const int pm = readAmPm(input, op.offset);
+                if (pm < 0) return false;
+                applyAmPm(pm, tm);
+                break;
+            }
+            }
+        }
+        return true;
+    }
 
+    bool DateFormat::parseGeneric(std::string_view input, std::tm& tm) const
+    {
+        std::size_t i = 0;
+        for (const Op& op : _ops) {
+            switch (op.kind) {
+            case OpKind::Literal:
                 // Literal character. Must match exactly.
-                if (i >= input.size() || input[i] != fc) {
-                    return false;
-                }
+                if (i >= input.size() || input[i] != op.literal) return false;
                 ++i;
-                ++f;
+                break;
+
+            case OpKind::Space:
+                skipSpaces(input, i);
+                break;
+
+            case OpKind::Field: {
+                int v = 0;
+                if (!readInt(input, i, op.maxDigits, v)) return false;
+                if (!storeField(op.field, v, tm)) return false;
+                break;
+            }
+
+            case OpKind::AmPm: {
+                // Expects exactly "AM" or "PM" (any case).
+                const int pm = readAmPm(input, i);
+                if (pm < 0) return false;
+                applyAmPm(pm, tm);
+                i += 2;
+                break;
+            }
             }
-            return true;
         }
+        return true;
+    }
 
-    }  // namespace
+    // ---------------------------------------------------------------------
+    // DateFormatCache
+    // ---------------------------------------------------------------------
+
+    const DateFormat& DateFormatCache::get(std::string_view format)
+    {
+        if (_last && format == _lastFormat) {
+            return *_last;
+        }
+
+        auto it = _formats.find(std::string(format));
+        if (it == _formats.end()) {
+            if (_formats.size() >= kMaxEntries) {
+                _formats.clear();
+            }
+            it = _formats.emplace(std::string(format), DateFormat(format)).first;
+        }
+        // Node-based map: the element address survives later inserts,
+        // only clear() invalidates it (and resets _last alongside).
+        _lastFormat.assign(format.data(), format.size());
+        _last = &it->second;
+        return *_last;
+    }
+
+    void DateFormatCache::clear()
+    {
+        _formats.clear();
+        _lastFormat.clear();
+        _last = nullptr;
+    }
+
+    // ---------------------------------------------------------------------
+    // Free functions
+    // ---------------------------------------------------------------------
 
     bool parseDateTime(std::string_view input,
                        std::string_view format,
                        std::tm& tm)
     {
-        std::size_t i = 0;
-        std::size_t f = 0;
-        if (!parseImpl(input, i, format, f, tm)) {
-            return false;
+        return DateFormat(format).parse(input, tm);
+    }
+
+    double parseTimestamp(std::string_view input,
+                          std::string_view format,
+                          DateFormatCache& cache)
+    {
+        constexpr double nanResult = std::numeric_limits<double>::quiet_NaN();
+
+        // Optional "utc:" keyword in the format means "treat result as
+        // UTC"; bare format is local. Mirrors d:utc: on the output side.
+        bool utc = false;
+        if (format.substr(0, 4) == "utc:") {
+            utc = true;
+            format.remove_prefix(4);
         }
-        // POSIX strptime allows trailing input. We do the same: the
-        // caller may have appended a timezone, comments, etc. The
-        // contract is "format was satisfied", not "input was emptied".
-        return true;
+
+        // tm starts zeroed so unset fields contribute 0/Jan/1/midnight -
+        // sensible defaults.
+        std::tm tm{};
+        tm.tm_isdst = -1;  // let mktime figure out DST for local time
+        if (!cache.get(format).parse(input, tm)) {
+            return nanResult;
+        }
+
+        if (utc) {
+            // Closed-form day count from 1970-01-01 plus h/m/s; C++17 has
+            // no portable timegm. tm_mday 0 (no %d in the format) rolls
+            // back one day, same as the former month-by-month sum did.
+            const long long year = tm.tm_year + 1900;
+            if (year < 1970) return nanResult;
+            const long long days = daysFromCivil(year,
+                static_cast<unsigned>(tm.tm_mon + 1), 1) + (tm.tm_mday - 1);
+            const long long total = days * 86400
+                + tm.tm_hour * 3600
+                + tm.tm_min * 60
+                + tm.tm_sec;
+            return static_cast<double>(total);
+        }
+
+        const std::time_t t = std::mktime(&tm);
+        if (t == static_cast<std::time_t>(-1)) {
+            return nanResult;
+        }
+        return static_cast<double>(t);
     }
 
 }  // namespace MultiReplace
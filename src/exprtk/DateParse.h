@@ -7,7 +7,8 @@
 //
 // DateParse.h
 // Parser for date/time strings against a strftime-style format. Used
-// by the ExprTk todate() function as the inverse of D[fmt] output.
+// by the ExprTk and Lua todate() functions as the inverse of D[fmt]
+// output.
 //
 // Supported specifiers:
 //   %Y  4-digit year         %F  shortcut for %Y-%m-%d
@@ -24,14 +25,106 @@
 //
 // Two-digit years follow the POSIX rule: 00..68 -> 2000..2068,
 // 69..99 -> 1969..1999.
+//
+// A format is compiled once into a DateFormat (a flat token program
+// with %F / %T already expanded) and can then be applied to any number
+// of inputs without re-reading the format text. Compilation also lays
+// the tokens out at fixed byte offsets, assuming full-width numeric
+// fields and one whitespace char per format space. Machine-written
+// timestamps such as "%Y-%m-%d %H:%M:%S" fit that layout and are
+// decoded directly at those offsets; anything else (short fields, runs
+// of whitespace) falls back to the cursor-driven token interpreter.
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <ctime>
+#include <string>
 #include <string_view>
+#include <unordered_map>
+#include <vector>
 
 namespace MultiReplace {
 
+    // Compiled form of a strftime-style parse format. Cheap to copy,
+    // immutable after construction, safe to share between threads.
+    class DateFormat {
+    public:
+        // Empty format: valid, matches any input without touching tm.
+        DateFormat() = default;
+
+        // Compile `format`. A trailing '%' or an unknown specifier
+        // yields an invalid format whose parse() always fails - the same
+        // outcome the interpreter gives when it reaches the bad token.
+        explicit DateFormat(std::string_view format);
+
+        bool valid() const noexcept { return _valid; }
+
+        // True when the fixed-offset fast path is available for this
+        // format. Exposed for tests and benchmarks only.
+        bool isFixedWidth() const noexcept { return _fixedWidth; }
+
+        // Same contract as parseDateTime() below.
+        bool parse(std::string_view input, std::tm& tm) const;
+
+    private:
+        enum class OpKind : std::uint8_t {
+            Literal,    // one literal byte must match
+            Space,      // zero or more whitespace
+            Field,      // numeric field (year, month, ...)
+            AmPm        // AM / PM token
+        };
+
+        // Numeric field targets. Kept separate from the format letter so
+        // %F / %T expansion and the fast path share one dispatch.
+        enum class Field : std::uint8_t {
+            Year4, Year2, Month, Day, Hour24, Hour12, Minute, Second
+        };
+
+        struct Op {
+            OpKind        kind = OpKind::Literal;
+            Field         field = Field::Year4;
+            char          literal = 0;
+            std::uint8_t  maxDigits = 0;
+            std::uint8_t  offset = 0;   // fast path: byte offset in input
+        };
+
+        bool compileInto(std::string_view format);
+
+        // Range-check a decoded field and store it into tm. Shared by
+        // both apply paths so they enforce the exact same limits.
+        static bool storeField(Field field, int v, std::tm& tm) noexcept;
+
+        bool parseGeneric(std::string_view input, std::tm& tm) const;
+        bool parseFixed(std::string_view input, std::tm& tm) const;
+
+        std::vector<Op> _ops;
+        std::size_t     _fixedLength = 0;
+        bool            _valid = true;
+        bool            _fixedWidth = false;
+    };
+
+    // Small per-caller cache of compiled formats, keyed by format text.
+    // todate() is almost always called with a literal format, so the
+    // steady state is one string compare against the last-used entry.
+    // Not thread-safe; each engine owns its own cache.
+    class DateFormatCache {
+    public:
+        const DateFormat& get(std::string_view format);
+        void clear();
+
+    private:
+        // Bound on distinct formats kept alive. A template that builds
+        // formats dynamically can't grow the cache without limit; on
+        // overflow the map is simply flushed.
+        static constexpr std::size_t kMaxEntries = 32;
+
+        std::unordered_map<std::string, DateFormat> _formats;
+        std::string       _lastFormat;
+        const DateFormat* _last = nullptr;
+    };
+
     // Parses `input` against `format`. Writes the consumed fields into
     // `tm`; fields not mentioned in `format` are left untouched, so the
     // caller should zero-init the struct first if a fully-populated
@@ -41,8 +134,20 @@ namespace MultiReplace {
     // every field landed inside its valid range. Returns false on any
     // mismatch or out-of-range value; tm contents are undefined after
     // a failed parse.
+    //
+    // Compiles the format on every call; hot paths should hold a
+    // DateFormat or DateFormatCache instead.
     bool parseDateTime(std::string_view input,
         std::string_view format,
         std::tm& tm);
 
-}  // namespace MultiReplace
\ No newline at end of file
+    // Shared todate() implementation for both formula engines. Parses
+    // `input` against `format` and returns seconds since the Unix
+    // epoch. A leading "utc:" in `format` treats the fields as UTC;
+    // otherwise they are local time (resolved through mktime). Returns
+    // NaN on parse failure, out-of-range fields, or a pre-1970 UTC date.
+    double parseTimestamp(std::string_view input,
+        std::string_view format,
+        DateFormatCache& cache);
+
+}  // namespace MultiReplace
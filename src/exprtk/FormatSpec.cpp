@@ -8,6 +8,7 @@
 #include "FormatSpec.h"
 
 #include "../Encoding.h"
+#include <algorithm>
 #include <array>
 #include <charconv>
 #include <clocale>
@@ -17,6 +18,8 @@
 #include <cwchar>
 #include <locale.h>
 #include <string>
+#include <string_view>
+#include <system_error>
 #if !defined(_WIN32)
 #include <locale>     // newlocale / wcsftime_l live here on glibc
 #endif
@@ -328,49 +331,109 @@ namespace FormatSpec {
         }
 
         // ---- Numeric renderer -----------------------------------------
-
-        // Build a printf-style format string from the parsed Spec, then
-        // run snprintf. We use printf rather than std::format because
-        // std::format does not support the 'b' (binary) and trims the
-        // .min-max precision form differently. printf gives us a single
-        // backend that covers f/e/g/x/o uniformly; binary is handled
-        // manually below.
         //
-        // Locale: snprintf("%f", ...) honors the C locale, not the user
-        // locale, so we get dot-decimal regardless of system settings.
-        std::wstring formatNumericBody(const Spec& spec, double value);
-        std::size_t countCodepoints(const std::string& s);
-        std::wstring applyFrame(const Spec& spec, const std::string& body,
+        // Every renderer appends UTF-8 straight into the caller's buffer;
+        // nothing on the value path goes through wchar_t. Floating-point
+        // text comes from std::to_chars, which is locale-independent by
+        // definition (always dot decimal, never thousands separators) and
+        // produces the same digits as printf("%.*f/e/g") for an explicit
+        // precision. Flags that printf used to apply (+, 0, width) are
+        // laid out by appendSigned() below with identical results.
+
+        bool formatNumericBody(const Spec& spec, double value, std::string& out);
+        void applyFrame(const Spec& spec, std::string& out, std::size_t bodyStart,
             std::size_t bodyCodepoints, TextAlign effAlign);
+        std::size_t countCodepoints(std::string_view s);
 
-        std::wstring formatPrintf(const Spec& spec, double value) {
+        bool formatPrintf(const Spec& spec, double value, std::string& out) {
             // With an explicit frame alignment, the number is rendered WITHOUT
-            // internal width (no printf space-padding), then the universal
-            // frame stage pads/aligns it. Zero-pad cannot reach here together
-            // with explicit align (parser rejects that mix), so there is no
-            // conflict between internal zero-fill and external padding.
+            // internal width (no space-padding), then the universal frame
+            // stage pads/aligns it in place. Zero-pad cannot reach here
+            // together with explicit align (parser rejects that mix), so
+            // there is no conflict between internal zero-fill and external
+            // padding.
             if (spec.textAlign != TextAlign::Default) {
                 Spec bare = spec;
-                bare.width = -1;              // suppress printf/internal width
+                bare.width = -1;              // suppress internal width
                 bare.textAlign = TextAlign::Default;
-                std::wstring body = formatNumericBody(bare, value);
-                if (body.empty()) return L"";  // non-representable (e.g. inf)
-                // The numeric body is ASCII (digits, . - + type letters), so
-                // each wchar maps to one byte; cast explicitly to avoid the
-                // implicit wchar_t->char narrowing warning.
-                std::string narrow;
-                narrow.reserve(body.size());
-                for (wchar_t wc : body) narrow.push_back(static_cast<char>(wc & 0xFF));
-                return applyFrame(spec, narrow, countCodepoints(narrow), spec.textAlign);
+                const std::size_t bodyStart = out.size();
+                if (!formatNumericBody(bare, value, out)) return false;
+                // The numeric body is ASCII, so bytes == codepoints.
+                applyFrame(spec, out, bodyStart, out.size() - bodyStart, spec.textAlign);
+                return true;
+            }
+            return formatNumericBody(spec, value, out);
+        }
+
+        // printf-compatible layout of a rendered number: optional sign,
+        // then either leading spaces (before the sign) or zeros (after the
+        // sign) up to `width`. `digits` may carry a leading '-' from
+        // to_chars; that sign is moved in front of any zero padding.
+        void appendSigned(std::string& out, std::string_view digits,
+            bool forceSign, bool zeroPad, int width) {
+            const bool negative = !digits.empty() && digits[0] == '-';
+            if (negative) digits.remove_prefix(1);
+            const char sign = negative ? '-' : (forceSign ? '+' : '\0');
+
+            const std::size_t len = digits.size() + (sign ? 1 : 0);
+            const std::size_t pad = (width > 0 && static_cast<std::size_t>(width) > len)
+                ? static_cast<std::size_t>(width) - len : 0;
+
+            if (!zeroPad) out.append(pad, ' ');
+            if (sign)     out.push_back(sign);
+            if (zeroPad)  out.append(pad, '0');
+            out.append(digits);
+        }
+
+        // Strip trailing fraction zeros of the .min-max form in place on
+        // out[bodyStart..]: the value was rendered with pmax decimals, and
+        // zeros are removed down to pmin (never further), plus a trailing
+        // dot when no decimals remain.
+        void trimFraction(std::string& out, std::size_t bodyStart, int precisionMin) {
+            const std::string_view body(out.data() + bodyStart, out.size() - bodyStart);
+            // Find the decimal point. Look for '.' before any 'e'/'E'.
+            const std::size_t e = body.find_first_of("eE");
+            const std::size_t end = (e == std::string_view::npos) ? body.size() : e;
+            const std::size_t dot = body.rfind('.', end == 0 ? 0 : end - 1);
+            if (dot == std::string_view::npos || dot >= end) return;
+
+            const std::size_t maxStrip = end - (dot + 1) - static_cast<std::size_t>(precisionMin);
+            std::size_t stripped = 0;
+            while (stripped < maxStrip && body[end - 1 - stripped] == '0') {
+                ++stripped;
+            }
+            // If we'd be left with a bare '.', strip that too.
+            if (stripped > 0 && body[end - 1 - stripped] == '.'
+                && static_cast<int>(end - dot - 1 - stripped) == 0) {
+                ++stripped;
             }
-            return formatNumericBody(spec, value);
+            out.erase(bodyStart + end - stripped, stripped);
+        }
+
+        // Float to text with a fixed precision. 512 bytes covers every
+        // realistic spec; a huge value combined with a huge precision
+        // (".400f" on 1e300) retries on the heap instead of truncating.
+        template <typename Emit>
+        bool withFloatChars(double value, std::chars_format fmt, int precision, Emit&& emit) {
+            std::array<char, 512> buf;
+            auto res = std::to_chars(buf.data(), buf.data() + buf.size(), value, fmt, precision);
+            if (res.ec == std::errc()) {
+                emit(std::string_view(buf.data(), static_cast<std::size_t>(res.ptr - buf.data())));
+                return true;
+            }
+            std::string big(static_cast<std::size_t>(precision) + 400, '\0');
+            res = std::to_chars(big.data(), big.data() + big.size(), value, fmt, precision);
+            if (res.ec != std::errc()) return false;
+            emit(std::string_view(big.data(), static_cast<std::size_t>(res.ptr - big.data())));
+            return true;
         }
 
         // Bare numeric renderer: sign, digits, precision, internal zero-pad
         // and (when no frame align) the original right-aligned width padding.
-        // Output is byte-identical to the pre-frame behavior for every spec
-        // that has no explicit <>^.
-        std::wstring formatNumericBody(const Spec& spec, double value) {
+        // Output is byte-identical to the former printf-based renderer for
+        // every spec. Returns false (nothing appended) for a value the
+        // type cannot represent.
+        bool formatNumericBody(const Spec& spec, double value, std::string& out) {
             // Default type WITH a precision behaves like 'g' (significant
             // digits), matching Python/Rust where the no-type float format is
             // "same as g". Without a precision the default stays a shortest
@@ -378,136 +441,82 @@ namespace FormatSpec {
             if (spec.numericType == NumericType::Default && spec.precisionMin >= 0) {
                 Spec g = spec;
                 g.numericType = NumericType::General;
-                return formatNumericBody(g, value);
+                return formatNumericBody(g, value, out);
             }
 
-            std::string fmt = "%";
-            if (spec.forceSign) fmt += "+";
-            if (spec.zeroPad)   fmt += "0";
-            if (spec.width >= 0) fmt += std::to_string(spec.width);
-
-            // Precision: .N or .max (we apply min separately below for
-            // trailing-zero trimming).
+            // Precision: .N or .max (min is applied separately below for
+            // trailing-zero trimming). printf's default is 6.
             const int pmax = (spec.precisionMax >= 0) ? spec.precisionMax : spec.precisionMin;
-            if (pmax >= 0) {
-                fmt += "." + std::to_string(pmax);
-            }
+            const int precision = (pmax >= 0) ? pmax : 6;
 
             switch (spec.numericType) {
-            case NumericType::Fixed:      fmt += "f"; break;
-            case NumericType::Scientific: fmt += "e"; break;
-            case NumericType::General:    fmt += "g"; break;
-            case NumericType::Integer:    fmt += "lld"; break;
-            case NumericType::Hex:        fmt = "%";
-                if (spec.zeroPad) fmt += "0";
-                if (spec.width >= 0) fmt += std::to_string(spec.width);
-                fmt += "llx";
-                break;
-            case NumericType::Octal:      fmt = "%";
-                if (spec.zeroPad) fmt += "0";
-                if (spec.width >= 0) fmt += std::to_string(spec.width);
-                fmt += "llo";
-                break;
-            case NumericType::Binary:
-                // Handled separately below.
-                break;
-            case NumericType::Default:
-                // No type letter: shortest round-trip via to_chars,
-                // then pad/sign manually if requested.
-            {
-                std::array<char, 64> buf{};
+            case NumericType::Default: {
+                // No type letter: shortest round-trip, then sign/pad.
+                std::array<char, 64> buf;
                 auto res = std::to_chars(buf.data(), buf.data() + buf.size(), value);
-                std::string body(buf.data(), res.ptr);
-                if (spec.forceSign && !body.empty() && body[0] != '-' && body[0] != '+') {
-                    body.insert(body.begin(), '+');
-                }
-                if (spec.width > 0 && static_cast<int>(body.size()) < spec.width) {
-                    const char pad = spec.zeroPad ? '0' : ' ';
-                    const int need = spec.width - static_cast<int>(body.size());
-                    if (spec.zeroPad && !body.empty() && (body[0] == '-' || body[0] == '+')) {
-                        body.insert(1, need, pad);
-                    }
-                    else {
-                        body.insert(0, need, pad);
-                    }
-                }
-                return std::wstring(body.begin(), body.end());
-            }
+                appendSigned(out, std::string_view(buf.data(),
+                    static_cast<std::size_t>(res.ptr - buf.data())),
+                    spec.forceSign, spec.zeroPad, spec.width);
+                return true;
             }
 
-            // Binary path. Integer cast (negative values get two's
-            // complement of the 64-bit representation).
-            if (spec.numericType == NumericType::Binary) {
-                if (!fitsInt64(value)) return L"";
-                long long iv = static_cast<long long>(value);
-                unsigned long long u = static_cast<unsigned long long>(iv);
-                std::string body;
-                if (u == 0) body = "0";
-                else {
-                    while (u != 0) { body.insert(body.begin(), '0' + (u & 1)); u >>= 1; }
+            case NumericType::Fixed:
+            case NumericType::Scientific:
+            case NumericType::General: {
+                const std::chars_format fmt =
+                    spec.numericType == NumericType::Fixed ? std::chars_format::fixed
+                    : spec.numericType == NumericType::Scientific ? std::chars_format::scientific
+                    : std::chars_format::general;
+                const std::size_t bodyStart = out.size();
+                const bool ok = withFloatChars(value, fmt, precision, [&](std::string_view digits) {
+                    appendSigned(out, digits, spec.forceSign, spec.zeroPad, spec.width);
+                    });
+                if (!ok) return false;
+                if (spec.precisionMax >= 0 && spec.precisionMin >= 0) {
+                    trimFraction(out, bodyStart, spec.precisionMin);
                 }
-                if (spec.width > 0 && static_cast<int>(body.size()) < spec.width) {
-                    const char pad = spec.zeroPad ? '0' : ' ';
-                    body.insert(0, spec.width - body.size(), pad);
-                }
-                return std::wstring(body.begin(), body.end());
-            }
-
-            // printf path for f/e/g/x/o/d.
-            std::array<char, 128> buf{};
-            int n;
-            if (spec.numericType == NumericType::Hex
-                || spec.numericType == NumericType::Octal) {
-                if (!fitsInt64(value)) return L"";
-                long long iv = static_cast<long long>(value);
-                n = std::snprintf(buf.data(), buf.size(), fmt.c_str(),
-                    static_cast<unsigned long long>(iv));
-            }
-            else if (spec.numericType == NumericType::Integer) {
-                if (!fitsInt64(value)) return L"";
-                n = std::snprintf(buf.data(), buf.size(), fmt.c_str(),
-                    static_cast<long long>(value));
+                return true;
             }
-            else {
-                n = std::snprintf(buf.data(), buf.size(), fmt.c_str(), value);
-            }
-            if (n < 0) return L"";
-            std::string body(buf.data(), buf.data() + (std::min<size_t>(n, buf.size() - 1)));
-
-            // Apply min-side trailing-zero trim for the .min-max form.
-            // printf gave us pmax decimals; we strip trailing zeros down
-            // to pmin (but never further), and a trailing dot too.
-            if (spec.precisionMax >= 0 && spec.precisionMin >= 0
-                && (spec.numericType == NumericType::Fixed
-                    || spec.numericType == NumericType::Scientific
-                    || spec.numericType == NumericType::General)) {
-                // Find the decimal point. Look for '.' before any 'e'/'E'.
-                size_t e = body.find_first_of("eE");
-                size_t end = (e == std::string::npos) ? body.size() : e;
-                size_t dot = body.rfind('.', end == 0 ? 0 : end - 1);
-                if (dot != std::string::npos && dot < end) {
-                    size_t maxStrip = end - (dot + 1) - static_cast<size_t>(spec.precisionMin);
-                    size_t stripped = 0;
-                    while (stripped < maxStrip && body[end - 1 - stripped] == '0') {
-                        ++stripped;
-                    }
-                    // If we'd be left with a bare '.', strip that too.
-                    if (stripped > 0 && body[end - 1 - stripped] == '.'
-                        && static_cast<int>(end - dot - 1 - stripped) == 0) {
-                        ++stripped;
-                    }
-                    body.erase(end - stripped, stripped);
-                }
+
+            case NumericType::Integer: {
+                // Signed base-10, truncated toward zero.
+                if (!fitsInt64(value)) return false;
+                std::array<char, 24> buf;
+                auto res = std::to_chars(buf.data(), buf.data() + buf.size(),
+                    static_cast<long long>(value));
+                appendSigned(out, std::string_view(buf.data(),
+                    static_cast<std::size_t>(res.ptr - buf.data())),
+                    spec.forceSign, spec.zeroPad, spec.width);
+                return true;
             }
 
-            return std::wstring(body.begin(), body.end());
+            case NumericType::Hex:
+            case NumericType::Octal:
+            case NumericType::Binary: {
+                // Integer cast; negative values print the two's complement
+                // of the 64-bit representation. No sign flag (the parser
+                // rejects '+' on these types).
+                if (!fitsInt64(value)) return false;
+                const int base = spec.numericType == NumericType::Hex ? 16
+                    : spec.numericType == NumericType::Octal ? 8 : 2;
+                std::array<char, 65> buf;
+                auto res = std::to_chars(buf.data(), buf.data() + buf.size(),
+                    static_cast<unsigned long long>(static_cast<long long>(value)), base);
+                appendSigned(out, std::string_view(buf.data(),
+                    static_cast<std::size_t>(res.ptr - buf.data())),
+                    false, spec.zeroPad, spec.width);
+                return true;
+            }
+            }
+            return false;
         }
 
         // ---- Duration renderer ----------------------------------------
 
         // Split a value in spec.durationUnit into days/hours/minutes/
-        // seconds, then format by spec.durationMode.
-        std::wstring formatDuration(const Spec& spec, double value) {
+        // seconds, then format by spec.durationMode. Integer-only output,
+        // so snprintf is locale-safe here.
+        bool formatDuration(const Spec& spec, double value, std::string& out) {
             // Convert to seconds (the common base).
             double seconds = value;
             switch (spec.durationUnit) {
@@ -520,7 +529,7 @@ namespace FormatSpec {
             const bool negative = seconds < 0.0;
             if (negative) seconds = -seconds;
 
-            if (!fitsInt64(seconds)) return L"";
+            if (!fitsInt64(seconds)) return false;
             long long totalSec = static_cast<long long>(seconds);
             long long days = totalSec / 86400;
             long long rem = totalSec % 86400;
@@ -530,40 +539,42 @@ namespace FormatSpec {
             long long secs = rem % 60;
 
             char buf[64] = {};
+            int n = 0;
             switch (spec.durationMode) {
             case DurationMode::Ms:
                 // M:SS - minutes can grow large; no day/hour folding.
-                std::snprintf(buf, sizeof(buf), "%lld:%02lld",
+                n = std::snprintf(buf, sizeof(buf), "%lld:%02lld",
                     totalSec / 60, totalSec % 60);
                 break;
             case DurationMode::Hms:
                 // H:MM:SS - hours can grow large.
-                std::snprintf(buf, sizeof(buf), "%lld:%02lld:%02lld",
+                n = std::snprintf(buf, sizeof(buf), "%lld:%02lld:%02lld",
                     totalSec / 3600, (totalSec % 3600) / 60, totalSec % 60);
                 break;
             case DurationMode::Hm:
                 // H:MM - hours can grow large; seconds dropped (rounded
                 // down by the integer cast above, no extra rounding here).
-                std::snprintf(buf, sizeof(buf), "%lld:%02lld",
+                n = std::snprintf(buf, sizeof(buf), "%lld:%02lld",
                     totalSec / 3600, (totalSec % 3600) / 60);
                 break;
             case DurationMode::Dh:
-                std::snprintf(buf, sizeof(buf), "%lld %02lld",
+                n = std::snprintf(buf, sizeof(buf), "%lld %02lld",
                     days, hours);
                 break;
             case DurationMode::Dhm:
-                std::snprintf(buf, sizeof(buf), "%lld %02lld:%02lld",
+                n = std::snprintf(buf, sizeof(buf), "%lld %02lld:%02lld",
                     days, hours, mins);
                 break;
             case DurationMode::Dhms:
-                std::snprintf(buf, sizeof(buf), "%lld %02lld:%02lld:%02lld",
+                n = std::snprintf(buf, sizeof(buf), "%lld %02lld:%02lld:%02lld",
                     days, hours, mins, secs);
                 break;
             }
+            if (n <= 0) return false;
 
-            std::string body = buf;
-            if (negative) body.insert(body.begin(), '-');
-            return std::wstring(body.begin(), body.end());
+            if (negative) out.push_back('-');
+            out.append(buf, std::min<std::size_t>(static_cast<std::size_t>(n), sizeof(buf) - 1));
+            return true;
         }
 
         // ---- Text renderer --------------------------------------------
@@ -578,7 +589,7 @@ namespace FormatSpec {
         // is a codepoint start. That's all the decoder we need for
         // counting and slicing.
         // Count UTF-8 codepoints (lead bytes) in a byte string.
-        std::size_t countCodepoints(const std::string& s) {
+        std::size_t countCodepoints(std::string_view s) {
             std::size_t n = 0;
             for (unsigned char b : s) {
                 if ((b & 0xC0) != 0x80) ++n;
@@ -586,51 +597,59 @@ namespace FormatSpec {
             return n;
         }
 
-        // Universal frame stage: pad a finished UTF-8 body to spec.width
-        // codepoints using spec.textFill, positioned by effAlign. Type-blind
-        // - the body is already rendered. effAlign must be resolved (never
-        // Default) by the caller, which knows the kind's natural default.
-        std::wstring applyFrame(const Spec& spec, const std::string& body,
+        // Universal frame stage: pad the finished UTF-8 body that sits at
+        // out[bodyStart..] to spec.width codepoints using spec.textFill,
+        // positioned by effAlign. Type-blind - the body is already
+        // rendered. effAlign must be resolved (never Default) by the
+        // caller, which knows the kind's natural default.
+        void applyFrame(const Spec& spec, std::string& out, std::size_t bodyStart,
             std::size_t bodyCodepoints, TextAlign effAlign) {
-            std::string out;
             const int width = spec.width;
-            if (width > 0 && bodyCodepoints < static_cast<std::size_t>(width)) {
-                const std::size_t padCount =
-                    static_cast<std::size_t>(width) - bodyCodepoints;
-
-                std::size_t padLeft = 0;
-                std::size_t padRight = 0;
-                switch (effAlign) {
-                case TextAlign::Default:
-                case TextAlign::Left:   padRight = padCount; break;
-                case TextAlign::Right:  padLeft = padCount; break;
-                case TextAlign::Center:
-                    padLeft = padCount / 2;
-                    padRight = padCount - padLeft;
-                    break;
-                }
+            if (width <= 0 || bodyCodepoints >= static_cast<std::size_t>(width)) {
+                return;
+            }
+            const std::size_t padCount =
+                static_cast<std::size_t>(width) - bodyCodepoints;
+
+            std::size_t padLeft = 0;
+            std::size_t padRight = 0;
+            switch (effAlign) {
+            case TextAlign::Default:
+            case TextAlign::Left:   padRight = padCount; break;
+            case TextAlign::Right:  padLeft = padCount; break;
+            case TextAlign::Center:
+                padLeft = padCount / 2;
+                padRight = padCount - padLeft;
+                break;
+            }
 
-                out.reserve(body.size() + padCount * spec.textFill.size());
-                for (std::size_t k = 0; k < padLeft; ++k)  out.append(spec.textFill);
-                out.append(body);
-                for (std::size_t k = 0; k < padRight; ++k) out.append(spec.textFill);
+            const std::string& fill = spec.textFill;
+            if (padLeft > 0) {
+                if (fill.size() == 1) {
+                    out.insert(bodyStart, padLeft, fill[0]);
+                }
+                else {
+                    std::string left;
+                    left.reserve(padLeft * fill.size());
+                    for (std::size_t k = 0; k < padLeft; ++k) left.append(fill);
+                    out.insert(bodyStart, left);
+                }
+            }
+            if (fill.size() == 1) {
+                out.append(padRight, fill[0]);
             }
             else {
-                out = body;
+                for (std::size_t k = 0; k < padRight; ++k) out.append(fill);
             }
-            return std::wstring(out.begin(), out.end());
         }
 
-        std::wstring formatString(const Spec& spec, const std::string& text) {
+        void formatString(const Spec& spec, std::string_view text, std::string& out) {
             auto isLeadByte = [](unsigned char b) {
                 return (b & 0xC0) != 0x80;
                 };
 
             // Count codepoints in the input.
-            std::size_t codepointCount = 0;
-            for (unsigned char b : text) {
-                if (isLeadByte(b)) ++codepointCount;
-            }
+            std::size_t codepointCount = countCodepoints(text);
 
             // Truncate to textMaxLength codepoints, slicing at a lead-byte
             // boundary. byteCutoff sits at the start of the (maxLen+1)-th
@@ -650,12 +669,13 @@ namespace FormatSpec {
                 }
                 codepointCount = static_cast<std::size_t>(spec.textMaxLength);
             }
-            const std::string body(text.data(), byteCutoff);
 
             // Frame stage. Text's natural default align is Left.
             const TextAlign eff =
                 (spec.textAlign == TextAlign::Default) ? TextAlign::Left : spec.textAlign;
-            return applyFrame(spec, body, codepointCount, eff);
+            const std::size_t bodyStart = out.size();
+            out.append(text.data(), byteCutoff);
+            applyFrame(spec, out, bodyStart, codepointCount, eff);
         }
 
         // Form: d:<strftime fmt> or d:utc:<strftime fmt>
@@ -684,6 +704,29 @@ namespace FormatSpec {
             // any narrow/codepage round-trip.
             out.dateFormat = body;
 
+            // Most date specs are purely numeric (%Y-%m-%d %H:%M:%S). Those
+            // render the same in every locale, so keep an ASCII copy that
+            // formatDate() can hand to plain strftime and append straight
+            // to the UTF-8 output. Any name-producing or locale-composed
+            // specifier (%a %b %c %p %x %Z ...) or non-ASCII literal keeps
+            // the wide, locale-aware path.
+            bool numericOnly = true;
+            for (std::size_t k = 0; k < body.size() && numericOnly; ++k) {
+                const wchar_t c = body[k];
+                if (c >= 0x80) {
+                    numericOnly = false;
+                }
+                else if (c == L'%') {
+                    if (++k >= body.size()
+                        || !std::wcschr(L"YyCmdejHIMSFTDRuwgGVUWznt%", body[k])) {
+                        numericOnly = false;
+                    }
+                }
+            }
+            if (numericOnly) {
+                out.dateFormatAscii.assign(body.begin(), body.end());
+            }
+
             out.valid = true;
             return out;
         }
@@ -692,19 +735,20 @@ namespace FormatSpec {
         // Treats `value` as a Unix timestamp (seconds since 1970-01-01
         // UTC). Negative timestamps and out-of-range conversions are
         // refused; strftime is asked for either gm-time or local-time
-        // depending on spec.dateUtc.
-        std::wstring formatDate(const Spec& spec, double value) {
+        // depending on spec.dateUtc. Appends UTF-8 to out; returns false
+        // (nothing appended) when the value or pattern can't be rendered.
+        bool formatDate(const Spec& spec, double value, std::string& out) {
             if (!(value >= 0.0)) {
                 // Negative or NaN. (NaN is already filtered upstream,
                 // but we guard defensively here too.)
-                return L"";
+                return false;
             }
             // Drop subseconds; strftime only consumes integer seconds.
             // Cap to a sane range so we don't hit time_t overflow on
             // 32-bit ABIs.
             constexpr double kMaxSeconds = 253402300800.0;  // 9999-12-31
             if (value > kMaxSeconds) {
-                return L"";
+                return false;
             }
             std::time_t t = static_cast<std::time_t>(value);
 
@@ -714,17 +758,29 @@ namespace FormatSpec {
             const int rc = spec.dateUtc ? gmtime_s(&tm, &t)
                 : localtime_s(&tm, &t);
             if (rc != 0) {
-                return L"";
+                return false;
             }
 #else
             // POSIX: gmtime_r / localtime_r return a pointer (NULL on err).
             std::tm* res = spec.dateUtc ? gmtime_r(&t, &tm)
                 : localtime_r(&t, &tm);
             if (res == nullptr) {
-                return L"";
+                return false;
             }
 #endif
 
+            // Numeric-only pattern (see parseDate): every specifier yields
+            // ASCII digits/signs in any locale, so narrow strftime writes
+            // the final bytes directly - no locale object, no wide buffer.
+            if (!spec.dateFormatAscii.empty()) {
+                char buf[256];
+                const std::size_t n = std::strftime(buf, sizeof(buf),
+                    spec.dateFormatAscii.c_str(), &tm);
+                if (n == 0) return false;
+                out.append(buf, n);
+                return true;
+            }
+
             // wcsftime renders straight to wchar_t, so locale month/day
             // names (%B/%A) and literal non-ASCII text in the pattern come
             // out as proper wide chars - no UTF-8/codepage guess needed.
@@ -759,10 +815,14 @@ namespace FormatSpec {
                 // Either the pattern was empty (caught at parse time)
                 // or the output exceeded the buffer; surface as empty
                 // rather than truncating silently.
-                return L"";
+                return false;
             }
 
-            return std::wstring(buf, n);
+            // Locale names may carry non-ASCII characters; this is the
+            // one remaining wide->UTF-8 conversion, and only for patterns
+            // that actually need the locale.
+            out.append(Encoding::wstringToUtf8(std::wstring(buf, n)));
+            return true;
         }
 
     }  // unnamed namespace
@@ -845,35 +905,35 @@ namespace FormatSpec {
         return parseNumeric(s);
     }
 
-    std::wstring apply(const Spec& spec, double value) {
-        if (!spec.valid) return L"";
+    bool applyTo(std::string& out, const Spec& spec, double value) {
+        if (!spec.valid) return false;
 
         // Every numeric kind needs a finite value; a non-finite one is
         // unrepresentable, so emit "" rather than letting "inf"/"nan" or
         // an overflowed integer cast leak out. Callers may also pre-filter,
         // but guarding here keeps the formatter self-contained.
-        if (spec.kind != Kind::Text && !std::isfinite(value)) return L"";
+        if (spec.kind != Kind::Text && !std::isfinite(value)) return false;
 
         switch (spec.kind) {
         case Kind::Date:
         case Kind::Duration: {
-            std::wstring body = (spec.kind == Kind::Date)
-                ? formatDate(spec, value) : formatDuration(spec, value);
-            if (body.empty()) return body;
-            // Frame stage. Date/duration default align is Left.
+            const std::size_t bodyStart = out.size();
+            const bool ok = (spec.kind == Kind::Date)
+                ? formatDate(spec, value, out) : formatDuration(spec, value, out);
+            if (!ok) return false;
+            // Frame stage. Date/duration default align is Left. Date
+            // output may carry multi-byte characters (locale %B/%A names),
+            // so the width is counted in codepoints, not bytes.
             const TextAlign eff =
                 (spec.textAlign == TextAlign::Default) ? TextAlign::Left : spec.textAlign;
-            // applyFrame works in UTF-8 and counts codepoints, so convert
-            // the wide body properly: date output may carry multi-byte
-            // characters (locale %B/%A names, literal non-ASCII text) that
-            // a per-wchar byte cast would mangle.
-            const std::string narrow = Encoding::wstringToUtf8(body);
-            return applyFrame(spec, narrow, countCodepoints(narrow), eff);
+            applyFrame(spec, out, bodyStart,
+                countCodepoints(std::string_view(out).substr(bodyStart)), eff);
+            return true;
         }
-        case Kind::Numeric:  return formatPrintf(spec, value);
-        case Kind::Text:     return L"";  // type mismatch; caller routes via string overload
+        case Kind::Numeric:  return formatPrintf(spec, value, out);
+        case Kind::Text:     return false;  // type mismatch; caller routes via string overload
         }
-        return L"";
+        return false;
     }
 
     bool isPureFrame(const Spec& spec) {
@@ -883,11 +943,12 @@ namespace FormatSpec {
             && spec.precisionMax < 0;
     }
 
-    std::wstring apply(const Spec& spec, const std::string& text) {
-        if (!spec.valid) return L"";
+    bool applyTo(std::string& out, const Spec& spec, std::string_view text) {
+        if (!spec.valid) return false;
 
         if (spec.kind == Kind::Text) {
-            return formatString(spec, text);
+            formatString(spec, text, out);
+            return true;
         }
 
         // Marker-free path: a bare spec (parsed as Numeric because number is
@@ -900,10 +961,27 @@ namespace FormatSpec {
             Spec asText = spec;
             asText.kind = Kind::Text;
             asText.textMaxLength = spec.precisionMin;  // .N -> truncation
-            return formatString(asText, text);
+            formatString(asText, text, out);
+            return true;
         }
 
-        return std::wstring(text.begin(), text.end());
+        out.append(text);
+        return true;
+    }
+
+    // The wide overloads keep their historic contract: UTF-8 bytes packed
+    // one per wchar_t. They exist for callers that still hold wide text;
+    // hot paths use applyTo() and never build the wide copy.
+    std::wstring apply(const Spec& spec, double value) {
+        std::string out;
+        applyTo(out, spec, value);
+        return std::wstring(out.begin(), out.end());
+    }
+
+    std::wstring apply(const Spec& spec, const std::string& text) {
+        std::string out;
+        applyTo(out, spec, text);
+        return std::wstring(out.begin(), out.end());
     }
 
     // ---- Formula / spec splitter --------------------------------------
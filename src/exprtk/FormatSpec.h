@@ -67,6 +67,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 
 namespace FormatSpec {
 
@@ -138,6 +139,12 @@ namespace FormatSpec {
         bool dateUtc = false;
         std::wstring dateFormat;
 
+        // ASCII copy of dateFormat, set only when the pattern uses purely
+        // numeric specifiers (%Y %m %d %H ...) and no non-ASCII literals.
+        // Such patterns are locale-independent and render through plain
+        // strftime straight into the UTF-8 output. Empty otherwise.
+        std::string dateFormatAscii;
+
         // Universal frame subfields (apply to every kind in the final pad
         // stage). width above is the minimum codepoint length. textAlign
         // defaults to Default so the renderer picks per kind (number=right,
@@ -174,6 +181,13 @@ namespace FormatSpec {
     // a leading '-' on the whole output.
     std::wstring apply(const Spec& spec, double value);
 
+    // UTF-8 native form of the above: appends the rendered value to `out`
+    // without any wide-string intermediate. Returns false and leaves out
+    // untouched when nothing is rendered (invalid spec, non-finite value,
+    // Text kind, or a value the type cannot represent) - exactly the cases
+    // where the wide overload returns an empty string.
+    bool applyTo(std::string& out, const Spec& spec, double value);
+
     // True if spec is a PURE frame: parsed as Numeric (the default kind) but
     // carrying only fill/align/width/.precision - no numeric-only traits
     // (sign, zero-pad, a type letter, or a range precision). Such a spec is
@@ -191,6 +205,10 @@ namespace FormatSpec {
     // codepoints; truncation never splits a multi-byte sequence.
     std::wstring apply(const Spec& spec, const std::string& text);
 
+    // UTF-8 native form of the string overload; appends to `out`.
+    // Returns false only for an invalid spec.
+    bool applyTo(std::string& out, const Spec& spec, std::string_view text);
+
     // ---- Formula / spec splitter --------------------------------------
     //
     // Splits the body of an (?= ... ) block into the formula part and
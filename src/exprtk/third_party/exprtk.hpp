@@ -36,6 +36,7 @@
 
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cctype>
 #include <cmath>
@@ -20967,7 +20968,20 @@ namespace exprtk
                 mutability_ = mutability;
             }
 
-            std::size_t ref_count;
+            // ----------------------------------------------------------------
+            // Atomic reference count (extension, daddel80 patch)
+            //
+            // Upstream counts symbol_table copies with a plain std::size_t.
+            // MultiReplace keeps one process-wide table of stateless
+            // built-ins that every ExprTkEngine registers on its
+            // expressions, and engines leased from an EnginePool compile
+            // and destroy expressions on different threads. Each register,
+            // expression copy and parser compile copies the table handle,
+            // so the count must be atomic for the shared table to survive
+            // concurrent use. Lookups into the table are read-only and
+            // need no further synchronisation.
+            // ----------------------------------------------------------------
+            std::atomic<std::size_t> ref_count;
             st_data* data_;
             symtab_mutability_type mutability_;
         };
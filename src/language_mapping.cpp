@@ -71,6 +71,7 @@ const LangKV kEnglishPairs[] = {
 { L"filetype_all_files", L"All Files (*.*)" },
 { L"filetype_mrl", L"MultiReplace List (*.mrl)" },
 { L"filetype_csv_excel", L"CSV (Excel) (*.csv)" },
+{ L"filetype_jsonl", L"JSON Lines (*.jsonl)" },
 
 // Legacy .csv list migration
 { L"legacy_csv_title", L"MultiReplace - List Format Changed" },
@@ -223,6 +224,12 @@ const LangKV kEnglishPairs[] = {
 { L"status_line_and_column_position", L" (Line: $REPLACE_STRING1, Column: $REPLACE_STRING2)" },
 { L"status_unable_to_open_file", L"Failed to open the file: $REPLACE_STRING" },
 { L"status_tab_not_found", L"Tab not found: $REPLACE_STRING" },
+{ L"status_export_progress", L"Exporting results: [$REPLACE_STRING%]" },
+{ L"status_export_done", L"$REPLACE_STRING hits exported." },
+{ L"status_export_failed", L"Could not write file: $REPLACE_STRING" },
+{ L"status_refine_done", L"$REPLACE_STRING hits kept." },
+{ L"status_refine_invalid_regex", L"Invalid regular expression: $REPLACE_STRING" },
+{ L"status_refine_regex_failed", L"Regular expression failed: $REPLACE_STRING" },
 { L"status_no_data_for_duplicates", L"No data rows to check for duplicates." },
 { L"status_no_duplicates_found", L"No duplicates found." },
 { L"status_duplicates_deleted", L"Deleted $REPLACE_STRING duplicate rows." },
@@ -254,6 +261,7 @@ const LangKV kEnglishPairs[] = {
 { L"msgbox_btn_skip_all_errors", L"Skip all errors" },
 { L"msgbox_btn_stop", L"Stop" },
 { L"status_recoverable_errors_skipped_summary", L"$REPLACE_STRING match(es) skipped." },
+{ L"status_formula_memo_summary", L"Formula cache: $REPLACE_STRING1 of $REPLACE_STRING2 results reused." },
 { L"msgbox_title_recoverable_errors_skipped_notice", L"Matches Skipped" },
 { L"msgbox_recoverable_errors_skipped_notice", L"$REPLACE_STRING match(es) were skipped because their replacement could not be evaluated.\n\nThe original text was left unchanged for those matches." },
 { L"msgbox_confirm_delete_single", L"Are you sure you want to delete this line?" },
@@ -322,6 +330,9 @@ const LangKV kEnglishPairs[] = {
 { L"rdmenu_select_all",          L"Select all\tCtrl+A" },
 { L"rdmenu_clear_all",           L"Clear all" },
 { L"rdmenu_open_paths",          L"Open selected pathname(s)" },
+{ L"rdmenu_export",              L"Export results..." },
+{ L"rdmenu_refine",              L"Refine results..." },
+{ L"rdmenu_pin_search",          L"Pin search" },
 { L"rdmenu_wrap",                L"Word wrap long lines" },
 { L"rdmenu_purge",               L"Purge for every search" },
 
@@ -330,6 +341,16 @@ const LangKV kEnglishPairs[] = {
 { L"dock_crit_header",L"Search \"$REPLACE_STRING1\" ($REPLACE_STRING2 hits)" },
 { L"dock_hits_suffix", L"($REPLACE_STRING hits)" },
 { L"dock_line", L"Line" },
+{ L"dock_more_hits", L"… $REPLACE_STRING more hits" },
+{ L"dock_export_title", L"Export search results" },
+{ L"dock_refine_title", L"Refine search results" },
+{ L"dock_refine_header", L"Refine \"$REPLACE_STRING1\" ($REPLACE_STRING2 hits in $REPLACE_STRING3 file(s))" },
+{ L"dock_refine_path", L"Path filter:" },
+{ L"dock_refine_text", L"Line contains:" },
+{ L"dock_refine_regex", L"Regular expression" },
+{ L"dock_refine_matchcase", L"Match case" },
+{ L"dock_refine_entry", L"List entry:" },
+{ L"dock_history_info", L"$REPLACE_STRING1 searches, $REPLACE_STRING2 hits, $REPLACE_STRING3 MB" },
 
 // Configuration Dialog
 { L"config_btn_close", L"Close" },
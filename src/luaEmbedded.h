@@ -157,6 +157,19 @@ init = vars  -- 'init' alias for compatibility
 ------------------------------------------------------------------
 hashTables = {}
 
+-- Number keys as the native store holds them: tostring() of the number,
+-- and a float with an integral value also under the integer (2.0 -> '2'),
+-- which is the text a number is looked up by.
+local function lkpSetKey(tbl, k, value)
+  if type(k) == 'number' then
+    if math.type(k) == 'float' and math.tointeger(k) ~= nil then
+      tbl[tostring(math.tointeger(k))] = value
+    end
+    k = tostring(k)
+  end
+  tbl[k] = value
+end
+
 function lkp(key, hpath, inner)
   local res = { result = '', skip = false }
 
@@ -164,7 +177,7 @@ function lkp(key, hpath, inner)
     error('lkp: key passed to file is nil in ' .. tostring(hpath))
   end
   if type(key) == 'number' then
-    key = tostring(key)
+    key = tostring(math.tointeger(key) or key)
   end
 
   if hpath == nil or hpath == '' then
@@ -174,8 +187,14 @@ function lkp(key, hpath, inner)
     inner = false
   end
 
-  -- Lazy-load + cache the file's lookup table on first use.
+  -- Lazy-load + cache the file's lookup table on first use. The native
+  -- store serves literal tables from a shared mapping; anything it
+  -- cannot parse is evaluated here as before.
   local tbl = hashTables[hpath]
+  if tbl == nil and lookupStoreOpen ~= nil then
+    tbl = lookupStoreOpen(hpath)
+    hashTables[hpath] = tbl
+  end
   if tbl == nil then
     local success, dataEntries = safeLoadFileSandbox(hpath)
     if not success then
@@ -194,15 +213,10 @@ function lkp(key, hpath, inner)
         local kt = type(keys)
         if kt == 'table' then
           for _, k in ipairs(keys) do
-            if type(k) == 'number' then
-              k = tostring(k)
-            end
-            tbl[k] = value
+            lkpSetKey(tbl, k, value)
           end
-        elseif kt == 'string' then
-          tbl[keys] = value
-        elseif kt == 'number' then
-          tbl[tostring(keys)] = value
+        elseif kt == 'string' or kt == 'number' then
+          lkpSetKey(tbl, keys, value)
         end
       end
     end
@@ -0,0 +1,102 @@
+// Headless tests for the engine-output transcoder (Utf8Transcoder):
+// valid UTF-8 passes into a UTF-8 document unchanged, invalid bytes come
+// out as U+FFFD whatever the target codepage, and ANSI targets convert.
+//
+// MinGW / g++:
+//   g++ -std=c++17 -O2 -Wall -Wextra -I.. encoding_qa.cpp ../Encoding.cpp
+//       -o encoding_qa
+//   ./encoding_qa
+//
+// Pass -v for a verbose pass-by-pass listing.
+
+#include "../Encoding.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace {
+
+int passed = 0;
+int failed = 0;
+bool verbose = false;  // toggled via -v command line flag
+
+const std::string kReplacement = "\xEF\xBF\xBD";  // U+FFFD in UTF-8
+
+std::string hex(const std::string& s)
+{
+    std::string out;
+    char buf[4];
+    for (unsigned char c : s) {
+        std::snprintf(buf, sizeof(buf), "%02X ", c);
+        out += buf;
+    }
+    return out;
+}
+
+void expectBytes(const char* name, const std::string& got, const std::string& want)
+{
+    if (got == want) {
+        ++passed;
+        if (verbose) std::printf("[PASS] %s\n", name);
+        return;
+    }
+    ++failed;
+    std::printf("[FAIL] %s\n  got:  %s\n  want: %s\n", name, hex(got).c_str(), hex(want).c_str());
+}
+
+std::string toUtf8Doc(Encoding::Utf8Transcoder& tc, const std::string& in)
+{
+    std::string out;
+    tc.toCodepage(in, CP_UTF8, out);
+    return out;
+}
+
+void testUtf8Document()
+{
+    Encoding::Utf8Transcoder tc;
+
+    expectBytes("utf8: ascii copied", toUtf8Doc(tc, "abc"), "abc");
+    expectBytes("utf8: multi-byte copied", toUtf8Doc(tc, "Gr\xC3\xB6\xC3\x9F" "e \xE6\x97\xA5 \xF0\x9F\x98\x80"),
+        "Gr\xC3\xB6\xC3\x9F" "e \xE6\x97\xA5 \xF0\x9F\x98\x80");
+    expectBytes("utf8: empty", toUtf8Doc(tc, ""), "");
+
+    // Invalid input must not reach the document as raw bytes
+    expectBytes("utf8: lone continuation", toUtf8Doc(tc, "a\x80" "b"), "a" + kReplacement + "b");
+    expectBytes("utf8: latin-1 byte", toUtf8Doc(tc, "caf\xE9"), "caf" + kReplacement);
+    expectBytes("utf8: invalid lead", toUtf8Doc(tc, "x\xFFy"), "x" + kReplacement + "y");
+
+    std::string out;
+    tc.toCodepage("caf\xE9", 4, CP_UTF8, out);
+    expectBytes("utf8: result is valid", Encoding::isValidUtf8(out.data(), out.size()) ? "1" : "0", "1");
+
+    // The scratch buffer is reused; a valid call after an invalid one is
+    // still a plain copy.
+    expectBytes("utf8: valid after invalid", toUtf8Doc(tc, "\xC3\xA4"), "\xC3\xA4");
+}
+
+void testAnsiDocument()
+{
+    Encoding::Utf8Transcoder tc;
+    std::string out;
+
+    tc.toCodepage("caf\xC3\xA9", 1252, out);
+    expectBytes("1252: e-acute", out, "caf\xE9");
+
+    tc.toCodepage("abc", 1252, out);
+    expectBytes("1252: ascii", out, "abc");
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; ++i)
+        if (std::strcmp(argv[i], "-v") == 0) verbose = true;
+
+    testUtf8Document();
+    testAnsiDocument();
+
+    std::printf("\n%d passed, %d failed\n", passed, failed);
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,569 @@
+// Headless tests for IFormulaEngine::clone() and EnginePool. Runs the
+// same set of files through both engines serially, with one pooled
+// worker and with several, and checks that every file comes out the
+// same. Run from the src/tests dir.
+//
+// Each simulated file is one run: beginRun(), the init rows, then the
+// file's matches, as Replace in Files does per document. The templates
+// use the stateful features whose per-file behaviour EnginePool.h
+// defines: seq(), match history, a seeded RNG, loadlib() and Lua
+// globals.
+//
+// The Lua sources are compiled as C, the engines as C++. The host-side
+// pieces the engines link against in the plugin are stubbed at the
+// bottom of this file, as in lua_engine_qa.cpp.
+//
+// The creation section builds 100 ExprTk engines and prints how long
+// construction, initialize() and beginRun() take. The stateless
+// built-ins live in one process-wide symbol table, so those engines and
+// the ones created concurrently on worker threads all share it.
+//
+// MinGW / g++:
+//   gcc -O2 -c ../lua/*.c          (all except lua.c and luac.c)
+//   g++ -std=c++20 -O2 -Wall -Wextra -I.. -I../lua engine_pool_qa.cpp
+//       ../engine/EnginePool.cpp ../engine/LuaEngine.cpp
+//       ../engine/ExprTkEngine.cpp ../engine/FormulaMemo.cpp
+//       ../engine/LookupStore.cpp ../exprtk/*.cpp ../Encoding.cpp
+//       *.o -o engine_pool_qa
+//   ./engine_pool_qa
+//
+// Pass -v for a verbose pass-by-pass listing.
+
+#include "../engine/EnginePool.h"
+#include "../engine/ExprTkEngine.h"
+#include "../engine/LuaEngine.h"
+#include "../StringUtils.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace MultiReplaceEngine;
+
+namespace {
+
+int passed = 0;
+int failed = 0;
+bool verbose = false;  // toggled via -v command line flag
+
+constexpr int kFileCount = 24;
+
+// Console host shared by all workers. Every callback is either const or
+// atomic, so concurrent engines may call it.
+class QaHost final : public ILuaEngineHost {
+public:
+    std::atomic<int> errors{ 0 };
+
+    std::string escapeForRegex(const std::string& input) override { return input; }
+    int  showDebugWindow(const std::string&) override { return 0; }
+    void refreshUiListView() override {}
+    void showErrorMessage(ErrorCategory, const std::string&,
+        const std::string& details) override {
+        ++errors;
+        if (verbose) std::printf("  host error: %s\n", details.c_str());
+    }
+    RecoverableErrorChoice showRecoverableErrorDialog(const std::string&,
+        const std::string&) override {
+        return RecoverableErrorChoice::SkipOne;
+    }
+    bool isFormulaErrorDialogEnabled() const override { return true; }
+    bool isLuaSafeModeEnabled() const override { return false; }
+    bool isDebugModeEnabled() const override { return false; }
+    FormulaLimits formulaLimits() const override { return FormulaLimits{}; }
+    LuaGcSettings luaGcSettings() const override { return LuaGcSettings{}; }
+    bool readCurrentRowColumnByIndex(int, std::string&) const override { return false; }
+    bool readCurrentRowColumnByName(const std::string&, std::string&) const override { return false; }
+};
+
+// The rows applied to every file: init rows first, then the template
+// run once per match.
+struct Workload {
+    std::vector<std::string> initRows;
+    std::string              replaceTemplate;
+};
+
+FormulaVars makeVars(int file, int cnt)
+{
+    FormulaVars v;
+    v.CNT = cnt;
+    v.LCNT = 1;
+    v.LINE = cnt;
+    v.APOS = cnt * 8;
+    v.MATCH = "n" + std::to_string(cnt * (file + 1));
+    v.FPATH = "C:\\docs\\file" + std::to_string(file) + ".txt";
+    v.FNAME = "file" + std::to_string(file) + ".txt";
+    v.captures = { std::to_string(cnt * (file + 1)) };
+    return v;
+}
+
+// File sizes vary so workers finish out of order.
+int matchCount(int file)
+{
+    return 40 + (file * 37) % 90;
+}
+
+// One file as Replace in Files runs it: a fresh run, the init rows,
+// every match. Returns the outputs joined, plus the run summary.
+std::string runFile(IFormulaEngine& engine, const Workload& work, int file)
+{
+    engine.beginRun();
+    for (const std::string& row : work.initRows) {
+        engine.execute(row, makeVars(file, 1), true, 65001);
+    }
+
+    std::string out;
+    const int count = matchCount(file);
+    for (int cnt = 1; cnt <= count; ++cnt) {
+        const FormulaResult r =
+            engine.execute(work.replaceTemplate, makeVars(file, cnt), true, 65001);
+        if (!r.success) {
+            out += "<error:" + r.errorMessage + ">";
+        }
+        else if (r.skip) {
+            out += "<skip>";
+        }
+        else {
+            out += r.output;
+        }
+        out += '\n';
+    }
+    const std::wstring summary = engine.endRunSummary();
+    out += std::string(summary.begin(), summary.end());
+    return out;
+}
+
+// Run every file through a pool of `workers` clones, each worker
+// picking the next file index as it becomes free.
+std::vector<std::string> runPooled(const IFormulaEngine& prototype,
+    const Workload& work, std::size_t workers, std::size_t& created)
+{
+    EnginePool pool(prototype, workers);
+    std::vector<std::string> results(kFileCount);
+    std::atomic<int> next{ 0 };
+
+    auto worker = [&] {
+        for (int file = next++; file < kFileCount; file = next++) {
+            EnginePool::Lease lease = pool.acquire();
+            if (!lease) {
+                results[file] = "<no engine>";
+                continue;
+            }
+            results[file] = runFile(*lease.get(), work, file);
+        }
+        };
+
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < workers; ++i) {
+        threads.emplace_back(worker);
+    }
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    created = pool.created();
+    return results;
+}
+
+void checkTrue(const char* name, bool ok, const std::string& detail = {})
+{
+    if (ok) {
+        ++passed;
+        if (verbose) std::printf("[PASS] %s\n", name);
+        return;
+    }
+    ++failed;
+    std::printf("[FAIL] %s %s\n", name, detail.c_str());
+}
+
+void checkSameFiles(const char* name, const std::vector<std::string>& expect,
+    const std::vector<std::string>& got)
+{
+    for (int file = 0; file < kFileCount; ++file) {
+        if (expect[file] != got[file]) {
+            ++failed;
+            std::printf("[FAIL] %s: file %d differs\n  expected: %.120s\n  got:      %.120s\n",
+                name, file, expect[file].c_str(), got[file].c_str());
+            return;
+        }
+    }
+    ++passed;
+    if (verbose) std::printf("[PASS] %s\n", name);
+}
+
+// Serial reference, the pool with one worker and with several must all
+// agree, and the pool must not build more engines than workers.
+void runEquivalence(const char* label, IFormulaEngine& prototype,
+    const Workload& work)
+{
+    std::vector<std::string> serial(kFileCount);
+    for (int file = 0; file < kFileCount; ++file) {
+        serial[file] = runFile(prototype, work, file);
+    }
+
+    // The prototype ends on the last file's run: template compiled,
+    // libraries loaded. The clones start from there.
+    std::size_t created = 0;
+    const std::vector<std::string> one = runPooled(prototype, work, 1, created);
+    const std::string prefix = label;
+    checkSameFiles((prefix + "_serial_vs_1_worker").c_str(), serial, one);
+    checkTrue((prefix + "_1_worker_clones").c_str(), created == 1,
+        "created=" + std::to_string(created));
+
+    for (std::size_t workers : { 2u, 4u, 8u }) {
+        const std::vector<std::string> many = runPooled(prototype, work, workers, created);
+        const std::string name = prefix + "_1_vs_" + std::to_string(workers) + "_workers";
+        checkSameFiles(name.c_str(), one, many);
+        checkTrue((name + "_clones").c_str(), created >= 1 && created <= workers,
+            "created=" + std::to_string(created));
+    }
+
+    // Guard against a workload that makes every file look the same.
+    checkTrue((prefix + "_files_distinct").c_str(), serial[0] != serial[1]);
+}
+
+std::string writeTempLibrary()
+{
+    const auto path = std::filesystem::temp_directory_path() / "engine_pool_qa.elib";
+    std::ofstream(path, std::ios::binary)
+        << "function wrap(s: S) : S\n"
+        << "    return '[' + s + ']';\n"
+        << "end\n";
+    return path.generic_string();
+}
+
+void runExprTkTests(QaHost& host)
+{
+    const std::string libPath = writeTempLibrary();
+
+    Workload work;
+    work.initRows = {
+        "(?=rndseed(42))",
+        "(?=loadlib('" + libPath + "'))",
+    };
+    work.replaceTemplate =
+        "(?=seq(10, 2)) (?=num(1) + numprev()) (?=rnd(1000)) (?=wrap(txt(1)))";
+
+    ExprTkEngine prototype(&host);
+    if (!prototype.initialize()) {
+        checkTrue("exprtk_initialize", false);
+        return;
+    }
+    runEquivalence("exprtk", prototype, work);
+
+    // A clone taken mid-run carries the compiled template and the loaded
+    // library, but starts its own history: it answers like the
+    // prototype did on the run's first match.
+    prototype.beginRun();
+    for (const std::string& row : work.initRows) {
+        prototype.execute(row, makeVars(0, 1), true, 65001);
+    }
+    const std::string historyTemplate = "(?=wrap(txt(1))) (?=num(1) + numprev())";
+    const FormulaResult first = prototype.execute(historyTemplate, makeVars(0, 1), true, 65001);
+    prototype.execute(historyTemplate, makeVars(0, 2), true, 65001);
+
+    FormulaEnginePtr copy = prototype.clone();
+    checkTrue("exprtk_clone_created", copy != nullptr);
+    if (copy) {
+        const FormulaResult r = copy->execute(historyTemplate, makeVars(0, 1), true, 65001);
+        checkTrue("exprtk_clone_library_and_fresh_history",
+            r.success && r.output == first.output && first.output == "[1] 1",
+            "got '" + r.output + "' expected '" + first.output + "'");
+    }
+
+    std::filesystem::remove(libPath);
+}
+
+void runLuaTests(QaHost& host)
+{
+    Workload work;
+    work.initRows = {
+        "math.randomseed(42)",
+        "function wrap(s) return '[' .. s .. ']' end",
+    };
+    work.replaceTemplate =
+        "acc = (acc or 0) + tonumber(CAP1)\n"
+        "set(CNT .. ' ' .. acc .. ' ' .. math.random(1000) .. ' ' .. wrap(FNAME))";
+
+    LuaEngine prototype(&host);
+    if (!prototype.initialize()) {
+        checkTrue("lua_initialize", false);
+        return;
+    }
+    runEquivalence("lua", prototype, work);
+
+    // Globals are run state: a clone has the template but not acc.
+    prototype.beginRun();
+    prototype.execute("acc = 100 set('x')", makeVars(0, 1), true, 65001);
+    prototype.compile("set(tostring(acc))");
+    FormulaEnginePtr copy = prototype.clone();
+    checkTrue("lua_clone_created", copy != nullptr);
+    if (copy) {
+        const FormulaResult r = copy->execute("set(tostring(acc))", makeVars(0, 1), true, 65001);
+        checkTrue("lua_clone_fresh_globals", r.success && r.output == "nil",
+            "got '" + r.output + "'");
+    }
+}
+
+// rndkey(n): a match's draws depend on the key, file, rule and CNT
+// only, so evaluation order and the other matches do not matter.
+void runRndKeyTests(QaHost& host)
+{
+    Workload work;
+    work.initRows = { "(?=rndkey(7))" };
+    work.replaceTemplate =
+        "(?=rnd()) (?=rnd(6)) (?=rnd(-5, 5)) (?=rndnorm(100, 15))";
+
+    ExprTkEngine prototype(&host);
+    if (!prototype.initialize()) {
+        checkTrue("rndkey_initialize", false);
+        return;
+    }
+    runEquivalence("rndkey", prototype, work);
+
+    const auto draw = [&](int file, int cnt, int rule) {
+        FormulaVars v = makeVars(file, cnt);
+        v.ruleIndex = rule;
+        return prototype.execute(work.replaceTemplate, v, true, 65001).output;
+        };
+    const auto startRun = [&] {
+        prototype.beginRun();
+        prototype.execute(work.initRows[0], makeVars(0, 1), true, 65001);
+        };
+
+    constexpr int kMatches = 200;
+    std::vector<std::string> forward(kMatches + 1);
+    startRun();
+    for (int cnt = 1; cnt <= kMatches; ++cnt) {
+        forward[cnt] = draw(0, cnt, 0);
+    }
+
+    // Reverse order, every other match left out.
+    startRun();
+    bool sameReversed = true;
+    for (int cnt = kMatches; cnt >= 1; cnt -= 2) {
+        sameReversed = sameReversed && draw(0, cnt, 0) == forward[cnt];
+    }
+    checkTrue("rndkey_order_independent", sameReversed);
+
+    // A later run with the same key repeats the numbers; another rule,
+    // file or key does not.
+    startRun();
+    checkTrue("rndkey_repeats_across_runs", draw(0, 17, 0) == forward[17]);
+    checkTrue("rndkey_rule_changes_draws", draw(0, 17, 1) != forward[17]);
+    checkTrue("rndkey_file_changes_draws", draw(1, 17, 0) != forward[17]);
+    prototype.execute("(?=rndkey(8))", makeVars(0, 1), true, 65001);
+    checkTrue("rndkey_key_changes_draws", draw(0, 17, 0) != forward[17]);
+
+    // Values stay inside the documented ranges.
+    startRun();
+    bool inRange = true;
+    for (int cnt = 1; cnt <= kMatches; ++cnt) {
+        FormulaVars v = makeVars(0, cnt);
+        const double u = std::stod(
+            prototype.execute("(?=rnd())", v, true, 65001).output);
+        const double d = std::stod(
+            prototype.execute("(?=rnd(6))", v, true, 65001).output);
+        const double r = std::stod(
+            prototype.execute("(?=rnd(10, -10))", v, true, 65001).output);
+        inRange = inRange && u >= 0.0 && u < 1.0 && d >= 1.0 && d <= 6.0
+            && r >= -10.0 && r <= 10.0 && r == static_cast<long long>(r);
+    }
+    checkTrue("rndkey_ranges", inRange);
+
+    // rndseed() goes back to the stream generator, and a new run starts
+    // without counter mode.
+    prototype.execute("(?=rndseed(7))", makeVars(0, 1), true, 65001);
+    const std::string streamFirst = draw(0, 1, 0);
+    prototype.beginRun();
+    prototype.execute("(?=rndseed(7))", makeVars(0, 1), true, 65001);
+    checkTrue("rndseed_leaves_counter_mode",
+        draw(0, 1, 0) == streamFirst && streamFirst != forward[1]);
+}
+
+// 100 engines created, initialised and run side by side. Every engine
+// sees the shared built-ins (len, trim, pi) next to its own state (txt,
+// cnt, totxt), and keeps doing so while the others are destroyed.
+void runCreationTests(QaHost& host)
+{
+    constexpr int kEngines = 100;
+    const std::string tmpl = "(?=len(trim(txt(1)))) (?=cnt) (?=totxt(pi, '.3'))";
+    const auto expected = [](int cnt) {
+        const std::string cap = std::to_string(cnt * 3);
+        return std::to_string(cap.size()) + " " + std::to_string(cnt) + " 3.14";
+        };
+
+    using Clock = std::chrono::steady_clock;
+    const auto ms = [](Clock::duration d) {
+        return std::chrono::duration<double, std::milli>(d).count();
+        };
+
+    std::vector<std::unique_ptr<ExprTkEngine>> engines;
+    engines.reserve(kEngines);
+    const Clock::time_point t0 = Clock::now();
+    for (int i = 0; i < kEngines; ++i) {
+        engines.push_back(std::make_unique<ExprTkEngine>(&host));
+    }
+    const Clock::time_point t1 = Clock::now();
+    bool initialised = true;
+    for (auto& engine : engines) {
+        initialised = engine->initialize() && initialised;
+    }
+    const Clock::time_point t2 = Clock::now();
+    for (auto& engine : engines) {
+        engine->beginRun();
+    }
+    const Clock::time_point t3 = Clock::now();
+    std::printf("create %d engines: construct %.2f ms, initialize %.2f ms, beginRun %.2f ms\n",
+        kEngines, ms(t1 - t0), ms(t2 - t1), ms(t3 - t2));
+    checkTrue("create_100_initialize", initialised);
+
+    bool allAnswer = true;
+    for (int i = 0; i < kEngines; ++i) {
+        FormulaVars v = makeVars(2, i + 1);
+        allAnswer = allAnswer
+            && engines[i]->execute(tmpl, v, true, 65001).output == expected(i + 1);
+    }
+    checkTrue("create_100_shared_builtins", allAnswer);
+
+    // Dropping engines must leave the shared table intact for the rest.
+    engines.erase(engines.begin(), engines.begin() + kEngines / 2);
+    bool survivorsAnswer = true;
+    for (auto& engine : engines) {
+        engine->beginRun();
+        survivorsAnswer = survivorsAnswer
+            && engine->execute(tmpl, makeVars(2, 7), true, 65001).output == expected(7);
+    }
+    checkTrue("create_shared_table_survives_teardown", survivorsAnswer);
+
+    // Threads creating, compiling and destroying engines at once all
+    // copy handles to the shared table.
+    std::atomic<int> mismatches{ 0 };
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&, t] {
+            for (int round = 0; round < 20; ++round) {
+                ExprTkEngine engine(&host);
+                if (!engine.initialize()) {
+                    ++mismatches;
+                    continue;
+                }
+                engine.beginRun();
+                const int cnt = t * 100 + round + 1;
+                if (engine.execute(tmpl, makeVars(2, cnt), true, 65001).output != expected(cnt)) {
+                    ++mismatches;
+                }
+            }
+            });
+    }
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    checkTrue("create_concurrent_engines", mismatches == 0,
+        "mismatches=" + std::to_string(mismatches.load()));
+}
+
+// A pool never builds more than capacity clones; a worker asking for
+// one more waits until a lease comes back.
+void runCapacityTests(QaHost& host)
+{
+    ExprTkEngine prototype(&host);
+    prototype.initialize();
+    EnginePool pool(prototype, 2);
+
+    EnginePool::Lease a = pool.acquire();
+    EnginePool::Lease b = pool.acquire();
+    checkTrue("pool_two_leases", a && b && a.get() != b.get());
+
+    std::atomic<bool> got{ false };
+    IFormulaEngine* third = nullptr;
+    std::thread waiter([&] {
+        EnginePool::Lease c = pool.acquire();
+        third = c.get();
+        got = true;
+        });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    checkTrue("pool_blocks_at_capacity", !got);
+
+    IFormulaEngine* returned = a.get();
+    a = EnginePool::Lease();
+    waiter.join();
+    checkTrue("pool_reuses_returned_engine", got && third == returned);
+    checkTrue("pool_created_bounded", pool.created() == 2,
+        "created=" + std::to_string(pool.created()));
+
+    EnginePool zero(prototype, 0);
+    checkTrue("pool_zero_capacity_is_one", zero.capacity() == 1);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-v") == 0) verbose = true;
+    }
+
+    QaHost host;
+    runExprTkTests(host);
+    runLuaTests(host);
+    runRndKeyTests(host);
+    runCapacityTests(host);
+    runCreationTests(host);
+    checkTrue("no_host_errors", host.errors == 0,
+        "errors=" + std::to_string(host.errors.load()));
+
+    std::printf("\n%d passed, %d failed\n", passed, failed);
+    return failed == 0 ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------
+// Link stubs for host-side pieces
+// ---------------------------------------------------------------------
+
+namespace MultiReplaceEngine {
+
+    ILuaEngineHost::RecoverableErrorChoice IFormulaEngine::handleRecoverableSkip(
+        ILuaEngineHost*, const std::wstring&, const std::wstring&, const std::string&)
+    {
+        ++_errorSkipCount;
+        return ILuaEngineHost::RecoverableErrorChoice::SkipOne;
+    }
+
+    std::wstring IFormulaEngine::localiseCount(const std::wstring& key, std::size_t count)
+    {
+        return key + L" " + std::to_wstring(count);
+    }
+
+    std::wstring IFormulaEngine::localiseCounts(const std::wstring& key,
+        std::size_t first, std::size_t second)
+    {
+        return key + L" " + std::to_wstring(first) + L"/" + std::to_wstring(second);
+    }
+
+} // namespace MultiReplaceEngine
+
+// LuaEngine declares the loader at block scope inside its namespace,
+// which standard C++ places in MultiReplaceEngine; the panel defines it
+// at global scope. Provide both so either lookup links.
+static int qaLoadFileUnavailable(lua_State* L)
+{
+    lua_pushboolean(L, 0);
+    lua_pushstring(L, "file loading is not available in engine_pool_qa");
+    return 2;
+}
+
+int luaSafeLoadFileSandbox_impl(lua_State* L) { return qaLoadFileUnavailable(L); }
+
+namespace MultiReplaceEngine {
+    int luaSafeLoadFileSandbox_impl(lua_State* L) { return qaLoadFileUnavailable(L); }
+}
+
+namespace StringUtils {
+    std::string escapeControlChars(const std::string& input) { return input; }
+}
@@ -0,0 +1,229 @@
+// Headless tests for the ExprTk string built-ins (split, slice, trim,
+// replace, reptxt, len, find) run through ExprTkEngine: each case is a
+// replace template compiled and executed on a match, as a Replace All
+// does. The built-ins read their arguments as views into ExprTk's
+// buffers; the chain cases check that nesting them gives the same text
+// as composing the steps by hand.
+//
+// The host-side pieces the engine links against in the plugin are
+// stubbed at the bottom of this file, as in engine_pool_qa.cpp.
+//
+// MinGW / g++:
+//   g++ -std=c++20 -O2 -Wall -Wextra -I.. exprtk_strings_qa.cpp
+//       ../engine/ExprTkEngine.cpp ../engine/FormulaMemo.cpp
+//       ../engine/LookupStore.cpp ../exprtk/*.cpp ../Encoding.cpp
+//       -o exprtk_strings_qa
+//   ./exprtk_strings_qa
+//
+// Pass -v for a verbose pass-by-pass listing, -b to additionally time
+// reptxt(trim(replace(slice(split(...))))) per match and count the heap
+// allocations a match makes (operator new is replaced below).
+
+#include "../engine/ExprTkEngine.h"
+#include "../StringUtils.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace MultiReplaceEngine;
+
+namespace {
+
+int passed = 0;
+int failed = 0;
+bool verbose = false;  // toggled via -v command line flag
+bool bench = false;    // toggled via -b command line flag
+
+std::size_t allocations = 0;
+
+class QaHost final : public ILuaEngineHost {
+public:
+    int errors = 0;
+
+    std::string escapeForRegex(const std::string& input) override { return input; }
+    int  showDebugWindow(const std::string&) override { return 0; }
+    void refreshUiListView() override {}
+    void showErrorMessage(ErrorCategory, const std::string&,
+        const std::string& details) override {
+        ++errors;
+        if (verbose) std::printf("  host error: %s\n", details.c_str());
+    }
+    RecoverableErrorChoice showRecoverableErrorDialog(const std::string&,
+        const std::string&) override {
+        return RecoverableErrorChoice::SkipOne;
+    }
+    bool isFormulaErrorDialogEnabled() const override { return true; }
+    bool isLuaSafeModeEnabled() const override { return false; }
+    bool isDebugModeEnabled() const override { return false; }
+    FormulaLimits formulaLimits() const override { return FormulaLimits{}; }
+    LuaGcSettings luaGcSettings() const override { return LuaGcSettings{}; }
+    bool readCurrentRowColumnByIndex(int, std::string&) const override { return false; }
+    bool readCurrentRowColumnByName(const std::string&, std::string&) const override { return false; }
+};
+
+void checkTrue(const char* name, bool ok, const std::string& detail = {})
+{
+    if (ok) {
+        ++passed;
+        if (verbose) std::printf("[PASS] %s\n", name);
+        return;
+    }
+    ++failed;
+    std::printf("[FAIL] %s %s\n", name, detail.c_str());
+}
+
+// A regex match whose capture 1 is `text`
+FormulaVars makeVars(const std::string& text, int cnt = 1)
+{
+    FormulaVars v;
+    v.CNT = cnt;
+    v.LCNT = 1;
+    v.LINE = cnt;
+    v.MATCH = text;
+    v.FPATH = "C:\\docs\\rows.csv";
+    v.FNAME = "rows.csv";
+    v.captures = { text };
+    return v;
+}
+
+void checkOutput(ExprTkEngine& engine, const char* name, const std::string& tmpl,
+    const std::string& capture, const std::string& expected)
+{
+    const FormulaResult r = engine.execute(tmpl, makeVars(capture), true, 65001);
+    const std::string got = r.success ? r.output : "<error:" + r.errorMessage + ">";
+    checkTrue(name, got == expected, "got '" + got + "', want '" + expected + "'");
+}
+
+void runBuiltinTests(ExprTkEngine& engine)
+{
+    checkOutput(engine, "split_field", "(?=split(txt(1), ',', 2))", "a,bb,c", "bb");
+    checkOutput(engine, "split_multichar_sep", "(?=split(txt(1), '::', 3))", "a::b::c", "c");
+    checkOutput(engine, "split_out_of_range", "[(?=split(txt(1), ',', 4))]", "a,b,c", "[]");
+    checkOutput(engine, "split_empty_field", "[(?=split(txt(1), ',', 2))]", "a,,c", "[]");
+    checkOutput(engine, "slice_codepoints", "(?=slice(txt(1), 2, 3))", "x\xC3\xA4\xC3\xB6\xC3\xBCy", "\xC3\xA4\xC3\xB6\xC3\xBC");
+    checkOutput(engine, "slice_clamped", "(?=slice(txt(1), 3, 40))", "abcd", "cd");
+    checkOutput(engine, "trim_both", "[(?=trim(txt(1)))]", " \t ab c \r\n", "[ab c]");
+    checkOutput(engine, "ltrim", "[(?=ltrim(txt(1)))]", "  ab  ", "[ab  ]");
+    checkOutput(engine, "rtrim", "[(?=rtrim(txt(1)))]", "  ab  ", "[  ab]");
+    checkOutput(engine, "replace_all", "(?=replace(txt(1), '_', '::'))", "a_b_c", "a::b::c");
+    checkOutput(engine, "replace_empty_from", "(?=replace(txt(1), '', 'x'))", "abc", "abc");
+    checkOutput(engine, "reptxt", "(?=reptxt(txt(1), 3))", "ab", "ababab");
+    checkOutput(engine, "len_find", "(?=len(txt(1))) (?=find(txt(1), 'c'))", "abcabc", "6 3");
+
+    // Nested calls read the inner call's result buffer as their argument
+    const std::string chain =
+        "(?=reptxt(trim(replace(slice(split(txt(1), ',', 2), 1, 40), '_', '::')), 2))";
+    checkOutput(engine, "chain_nested", chain, "row1,  customer_record_7919  ,tail",
+        "customer::record::7919customer::record::7919");
+
+    // The call-site buffers are reused from match to match: a short
+    // result after a long one must not keep the long one's tail
+    checkOutput(engine, "chain_long_then_short", chain, "x, a_b ,y", "a::ba::b");
+    checkOutput(engine, "chain_empty_field", "[" + chain + "]", "x,   ,y", "[]");
+}
+
+// Per-match time and allocations of a five built-in chain over rows
+// whose second field is past the small-string buffer. The template
+// reads CNT, so the result memo stays off and every match evaluates
+// the chain.
+void runBenchmark(ExprTkEngine& engine)
+{
+    constexpr int kWarmup = 1000;
+    constexpr int kMatches = 200000;
+    const std::string chain =
+        "(?=cnt): (?=reptxt(trim(replace(slice(split(txt(1), ',', 2), 1, 40), '_', '::')), 2))";
+
+    std::vector<FormulaVars> matches;
+    for (int i = 0; i < 64; ++i) {
+        matches.push_back(makeVars("row" + std::to_string(i) + ",  customer_record_"
+            + std::to_string(i * 7919) + "_active_status  ,tail", i + 1));
+    }
+
+    for (int i = 0; i < kWarmup; ++i) {
+        matches[i % matches.size()].CNT = i + 1;
+        engine.execute(chain, matches[i % matches.size()], true, 65001);
+    }
+
+    std::size_t bytes = 0;
+    const std::size_t before = allocations;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kMatches; ++i) {
+        FormulaVars& vars = matches[i % matches.size()];
+        vars.CNT = kWarmup + i + 1;
+        bytes += engine.execute(chain, vars, true, 65001).output.size();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const std::size_t made = allocations - before;
+
+    std::printf("\nstring chain, %d matches through execute():\n", kMatches);
+    std::printf("  %.0f ns/match, %.2f allocations/match (%zu output bytes)\n",
+        seconds * 1e9 / kMatches, static_cast<double>(made) / kMatches, bytes);
+}
+
+} // namespace
+
+void* operator new(std::size_t size)
+{
+    ++allocations;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-v") == 0) verbose = true;
+        else if (std::strcmp(argv[i], "-b") == 0) bench = true;
+    }
+
+    QaHost host;
+    ExprTkEngine engine(&host);
+    checkTrue("initialize", engine.initialize());
+    engine.beginRun();
+
+    runBuiltinTests(engine);
+    checkTrue("no_host_errors", host.errors == 0, "errors=" + std::to_string(host.errors));
+
+    if (bench) runBenchmark(engine);
+
+    std::printf("\n%d passed, %d failed\n", passed, failed);
+    return failed == 0 ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------
+// Link stubs for host-side pieces
+// ---------------------------------------------------------------------
+
+namespace MultiReplaceEngine {
+
+    ILuaEngineHost::RecoverableErrorChoice IFormulaEngine::handleRecoverableSkip(
+        ILuaEngineHost*, const std::wstring&, const std::wstring&, const std::string&)
+    {
+        ++_errorSkipCount;
+        return ILuaEngineHost::RecoverableErrorChoice::SkipOne;
+    }
+
+    std::wstring IFormulaEngine::localiseCount(const std::wstring& key, std::size_t count)
+    {
+        return key + L" " + std::to_wstring(count);
+    }
+
+    std::wstring IFormulaEngine::localiseCounts(const std::wstring& key,
+        std::size_t first, std::size_t second)
+    {
+        return key + L" " + std::to_wstring(first) + L"/" + std::to_wstring(second);
+    }
+
+} // namespace MultiReplaceEngine
+
+namespace StringUtils {
+    std::string escapeControlChars(const std::string& input) { return input; }
+}
@@ -9,20 +9,25 @@
 //   g++ -std=c++17 -Wall -Wextra -I.. format_spec_qa.cpp ../exprtk/FormatSpec.cpp -o format_spec_qa
 //   ./format_spec_qa
 //
-// Pass -v for a verbose pass-by-pass listing.
+// Pass -v for a verbose pass-by-pass listing, -b to additionally run a
+// formatting throughput benchmark (wide apply() vs UTF-8 applyTo()).
 
 #include "../exprtk/FormatSpec.h"
 
+#include <chrono>
 #include <cstdio>
+#include <cmath>
 #include <cstdlib>
 #include <iostream>
 #include <string>
+#include <vector>
 
 namespace {
 
 int passed = 0;
 int failed = 0;
 bool verbose = false;  // toggled via -v command line flag
+bool bench = false;    // toggled via -b command line flag
 
 void check(const std::wstring& specText, double value,
            const std::wstring& expected, const char* label)
@@ -132,12 +137,95 @@ void checkSplit(const std::string& body,
     ++passed;
 }
 
+// Cross-check: the UTF-8 applyTo() must append exactly the bytes the
+// wide apply() packs one per wchar_t, and must append to (not replace)
+// whatever the buffer already holds.
+void checkUtf8(const std::wstring& specText, double value, const char* label)
+{
+    auto spec = FormatSpec::parse(specText);
+    const std::wstring wide = FormatSpec::apply(spec, value);
+    std::string expected = "prefix:";
+    for (wchar_t wc : wide) expected.push_back(static_cast<char>(wc));
+
+    std::string got = "prefix:";
+    FormatSpec::applyTo(got, spec, value);
+    if (got != expected) {
+        std::wcout << L"FAIL [" << label << L"] applyTo differs from apply for spec=\""
+                   << specText << L"\"\n";
+        ++failed;
+        return;
+    }
+    if (verbose) {
+        std::wprintf(L"PASS  %-14ls  %-14g  -> applyTo == apply     (%hs)\n",
+                     specText.c_str(), value, label);
+    }
+    ++passed;
+}
+
+// ---- Throughput benchmark ---------------------------------------------
+
+template <typename Fn>
+double timeLoop(std::size_t iterations, Fn&& fn)
+{
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < iterations; ++i) {
+        fn(i);
+    }
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+void runBenchmark()
+{
+    constexpr std::size_t kIterations = 1'000'000;
+
+    // Values spread over several magnitudes so the loop can't collapse
+    // to a constant. Specs cover the common numeric/duration/date shapes.
+    const std::vector<double> values = {
+        3.14159, -2718.28, 0.000123, 1234567.0, 42.0, 1700000000.0, 86399.0, 7.5
+    };
+    const std::vector<std::wstring> specs = {
+        L".2f", L"08.3f", L">12.2f", L".2-5f", L"+.4e", L"08x", L"d", L"ts:hms",
+        L"d:utc:%Y-%m-%d %H:%M:%S"
+    };
+
+    // wprintf throughout: stdout is wide-oriented in this harness.
+    std::wprintf(L"\n---- Benchmark (%zu formats per spec) ----\n", kIterations);
+    std::wprintf(L"  %-26ls %12ls %12ls %8ls\n", L"spec", L"wide ms", L"utf8 ms", L"speedup");
+
+    std::size_t sink = 0;
+    for (const auto& specText : specs) {
+        const auto spec = FormatSpec::parse(specText);
+
+        // Former engine path: wide apply() result, narrowed byte by byte.
+        std::string out;
+        const double wideSecs = timeLoop(kIterations, [&](std::size_t i) {
+            out.clear();
+            const std::wstring w = FormatSpec::apply(spec, values[i & 7]);
+            for (wchar_t wc : w) out.push_back(static_cast<char>(wc));
+            sink += out.size();
+        });
+
+        // Current engine path: append into a reused UTF-8 buffer.
+        const double utf8Secs = timeLoop(kIterations, [&](std::size_t i) {
+            out.clear();
+            FormatSpec::applyTo(out, spec, values[i & 7]);
+            sink += out.size();
+        });
+
+        std::wprintf(L"  %-26ls %12.1f %12.1f %7.2fx\n", specText.c_str(),
+                     wideSecs * 1000.0, utf8Secs * 1000.0, wideSecs / utf8Secs);
+    }
+    std::wprintf(L"  (checksum %zu)\n", sink);
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
     for (int i = 1; i < argc; ++i) {
         std::string a(argv[i]);
         if (a == "-v" || a == "--verbose") verbose = true;
+        if (a == "-b" || a == "--bench") bench = true;
     }
 
     if (verbose) {
@@ -434,6 +522,37 @@ int main(int argc, char** argv) {
         else { std::wcout << L"FAIL [colon pattern no marker]\n"; ++failed; }
     }
 
+    // ---- UTF-8 output path agrees with the wide overload ----
+    checkUtf8(L"08.3f",       -3.14159,     "utf8 zero-pad negative");
+    checkUtf8(L"^12.2-5f",    2.5,          "utf8 center + min-max trim");
+    checkUtf8(L"+.3e",        12345.678,    "utf8 scientific with sign");
+    checkUtf8(L"*>20b",       1234.0,       "utf8 binary with fill");
+    checkUtf8(L".30f",        1e20,         "utf8 long fixed output");
+    checkUtf8(L"<14 ts:dhms", 93784.0,      "utf8 duration framed");
+    checkUtf8(L">24 d:utc:%Y-%m-%dT%H:%M:%S", 1700000000.0, "utf8 date numeric-only");
+    checkUtf8(L"<20 d:utc:%A %d %B", 1700000000.0, "utf8 date with names");
+    checkUtf8(L"x",           std::nan(""), "utf8 NaN appends nothing");
+    {
+        // Multi-byte fill: padding is counted in codepoints, not bytes.
+        auto spec = FormatSpec::parse(L"\u00e4>6.1f");
+        std::string out;
+        FormatSpec::applyTo(out, spec, 2.0);
+        if (out == "\xc3\xa4\xc3\xa4\xc3\xa4" "2.0") ++passed;
+        else { std::wcout << L"FAIL [utf8 multi-byte fill]\n"; ++failed; }
+    }
+    {
+        // Text overload appends into an existing buffer.
+        auto spec = FormatSpec::parse(L"*^9");
+        std::string out = "[";
+        FormatSpec::applyTo(out, spec, std::string_view("\xc3\xa4" "bc"));
+        if (out == "[***\xc3\xa4" "bc***") ++passed;
+        else { std::wcout << L"FAIL [utf8 text overload appends]\n"; ++failed; }
+    }
+
+    if (bench) {
+        runBenchmark();
+    }
+
     // ---- Result summary ----
     std::wcout << L"\n========================================\n";
     std::wcout << L"PASSED: " << passed << L"\n";
@@ -0,0 +1,312 @@
+// Headless tests for LookupStore: the .lkp literal parser, the compiled
+// image, and open() with its cache file and process-wide sharing. Run
+// from the src/tests dir; scratch files go to the system temp dir.
+//
+// MinGW / g++:
+//   g++ -std=c++20 -O2 -Wall -Wextra -I.. lookup_store_qa.cpp
+//       ../engine/LookupStore.cpp ../Encoding.cpp -o lookup_store_qa
+//   ./lookup_store_qa
+//
+// Pass -v for a verbose pass-by-pass listing, -b to additionally time
+// compiling, re-opening and probing a table with two million keys.
+
+#include "../engine/LookupStore.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+using namespace MultiReplaceEngine;
+
+namespace {
+
+int passed = 0;
+int failed = 0;
+bool verbose = false;  // toggled via -v command line flag
+bool bench = false;    // toggled via -b command line flag
+
+namespace fs = std::filesystem;
+
+void expect(const char* name, bool ok, const std::string& detail = {})
+{
+    if (ok) {
+        ++passed;
+        if (verbose) std::printf("[PASS] %s\n", name);
+        return;
+    }
+    ++failed;
+    std::printf("[FAIL] %s%s%s\n", name, detail.empty() ? "" : "\n  ", detail.c_str());
+}
+
+// Open `text` through a scratch file of its own, so no two tables
+// share a path (and a possibly equal mtime).
+std::shared_ptr<const LookupTable> compile(const std::string& text, std::string& error)
+{
+    static int serial = 0;
+    const fs::path src = fs::temp_directory_path() / "mr_lookup_qa"
+        / ("compile" + std::to_string(++serial) + ".lkp");
+    {
+        std::ofstream out(src, std::ios::binary | std::ios::trunc);
+        out << text;
+    }
+    LookupStore::OpenResult r = LookupStore::open(src.string());
+    error = r.error;
+    return r.table;
+}
+
+void checkValue(const char* name, const LookupTable* table, const std::string& key,
+    const std::string& expectText, LookupTable::ValueType expectType = LookupTable::ValueType::String)
+{
+    LookupTable::Value v;
+    const bool found = table && table->find(key, v);
+    const bool ok = found && v.text == expectText && v.type == expectType;
+    expect(name, ok, "key \"" + key + "\": expected \"" + expectText + "\", got "
+        + (found ? "\"" + std::string(v.text) + "\"" : std::string("nothing")));
+}
+
+void checkMissing(const char* name, const LookupTable* table, const std::string& key)
+{
+    LookupTable::Value v;
+    expect(name, table && !table->find(key, v), "key \"" + key + "\" should be missing");
+}
+
+void checkUnsupported(const char* name, const std::string& text)
+{
+    std::string image;
+    std::string error;
+    const bool ok = !LookupStore::compileImage(text, "qa", 0, 0, image, error) && !error.empty();
+    expect(name, ok, "expected a parse failure for: " + text);
+}
+
+void writeFile(const fs::path& path, const std::string& text)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << text;
+}
+
+void runTests()
+{
+    const fs::path dir = fs::temp_directory_path() / "mr_lookup_qa";
+    fs::remove_all(dir);
+    fs::create_directories(dir / "cache");
+    LookupStore::setCacheDirectory(dir / "cache");
+
+    std::string error;
+
+    // Row shapes: single key, key list, numeric key, nil value dropped.
+    auto basic = compile(
+        "return {\n"
+        "  { 'a', '1' },\n"
+        "  { { \"b\", \"c\" }, \"2\" },\n"
+        "  { 3, 4.5 },\n"
+        "  { 'n', nil },\n"
+        "}\n", error);
+    expect("basic_compiles", basic != nullptr, error);
+    checkValue("basic_single_key", basic.get(), "a", "1");
+    checkValue("basic_key_list_first", basic.get(), "b", "2");
+    checkValue("basic_key_list_second", basic.get(), "c", "2");
+    checkValue("basic_number_key_and_value", basic.get(), "3", "4.5", LookupTable::ValueType::Number);
+    checkMissing("basic_nil_value_dropped", basic.get(), "n");
+    checkMissing("basic_absent_key", basic.get(), "zz");
+    expect("basic_size", basic && basic->size() == 4);
+
+    // Numbers are keyed by their tostring() text.
+    auto numbers = compile(
+        "return { {10, 'int'}, {1e3, 'exp'}, {0x10, 'hex'}, {-5, 'neg'},\n"
+        "  {2.0, 'float'}, {0.1, 'frac'}, {9223372036854775808, 'big'},\n"
+        "  {'k', 7} }", error);
+    expect("numbers_compile", numbers != nullptr, error);
+    checkValue("number_integer", numbers.get(), "10", "int");
+    checkValue("number_exponent_is_float", numbers.get(), "1000.0", "exp");
+    checkValue("number_hex", numbers.get(), "16", "hex");
+    checkValue("number_negative", numbers.get(), "-5", "neg");
+    checkValue("number_float_keeps_point", numbers.get(), "2.0", "float");
+    checkValue("number_fraction", numbers.get(), "0.1", "frac");
+    checkValue("number_overflow_to_float", numbers.get(), "9.2233720368548e+18", "big");
+    checkValue("number_value_type", numbers.get(), "k", "7", LookupTable::ValueType::Number);
+
+    // A float key with an integral value is also keyed by the integer,
+    // the text numberKey() gives a numeric lookup of 2 or 2.0.
+    checkValue("number_float_integer_alias", numbers.get(), "2", "float");
+    checkValue("number_exponent_integer_alias", numbers.get(), "1000", "exp");
+    checkMissing("number_fraction_no_alias", numbers.get(), "0");
+    checkValue("number_key_integral_float", numbers.get(), LookupStore::numberKey(2.0), "float");
+    checkValue("number_key_integer", numbers.get(), LookupStore::numberKey(10), "int");
+    checkValue("number_key_fraction", numbers.get(), LookupStore::numberKey(0.1), "frac");
+    checkValue("number_key_beyond_int64", numbers.get(), LookupStore::numberKey(9223372036854775808.0), "big");
+    expect("number_key_rounds_like_tostring", LookupStore::numberKey(0.1 + 0.2) == "0.3",
+        LookupStore::numberKey(0.1 + 0.2));
+    expect("number_key_negative_zero", LookupStore::numberKey(-0.0) == "0");
+
+    // 2 and 2.0 are one key, as in a Lua table: the last row wins.
+    auto merged = compile("return { {2, 'int'}, {2.0, 'float'}, {3.0, 'float'}, {3, 'int'} }", error);
+    expect("merged_compiles", merged != nullptr, error);
+    checkValue("merged_float_after_integer", merged.get(), "2", "float");
+    checkValue("merged_integer_after_float", merged.get(), "3", "int");
+    checkValue("merged_float_text_kept", merged.get(), "3.0", "float");
+
+    // String forms and escapes.
+    auto strings = compile(
+        "return {\n"
+        "  { 'tab', 'a\\tb' },\n"
+        "  { 'hex', '\\x41\\65\\u{20AC}' },\n"
+        "  { 'long', [[line]] },\n"
+        "  { 'level', [==[x]]y]==] },\n"
+        "  { 'z', 'a\\z   b' },\n"
+        "  { 'quote', \"it's \\\"q\\\"\" },\n"
+        "}", error);
+    expect("strings_compile", strings != nullptr, error);
+    checkValue("string_tab_escape", strings.get(), "tab", "a\tb");
+    checkValue("string_hex_dec_unicode", strings.get(), "hex", "AA\xE2\x82\xAC");
+    checkValue("string_long_bracket", strings.get(), "long", "line");
+    checkValue("string_long_bracket_level", strings.get(), "level", "x]]y");
+    checkValue("string_z_escape", strings.get(), "z", "ab");
+    checkValue("string_quotes", strings.get(), "quote", "it's \"q\"");
+
+    // Comments, semicolons, a BOM and a trailing table separator.
+    auto commented = compile(
+        "\xEF\xBB\xBF-- country codes\n"
+        "return { --[[ block\n comment ]] { 'de', 'Germany' }; -- trailing\n"
+        "  { 'fr', 'France' }; };\n", error);
+    expect("comments_compile", commented != nullptr, error);
+    checkValue("comments_first_row", commented.get(), "de", "Germany");
+    checkValue("comments_second_row", commented.get(), "fr", "France");
+
+    // A repeated key keeps the later value, as the Lua fill loop did.
+    auto dup = compile("return { {'k', 'first'}, {{'j', 'k'}, 'second'} }", error);
+    checkValue("duplicate_later_wins", dup.get(), "k", "second");
+    checkValue("duplicate_shared_value", dup.get(), "j", "second");
+
+    // Anything computed is left to Lua.
+    checkUnsupported("unsupported_variable", "return { {'a', x} }");
+    checkUnsupported("unsupported_concat", "return { {'a', 'b' .. 'c'} }");
+    checkUnsupported("unsupported_boolean", "return { {'a', true} }");
+    checkUnsupported("unsupported_local", "local t = {} return t");
+    checkUnsupported("unsupported_trailing_code", "return { {'a', 'b'} } print(1)");
+    checkUnsupported("unsupported_hex_float", "return { {0x1p4, 'b'} }");
+    checkUnsupported("unsupported_unfinished", "return { {'a', 'b'}");
+
+    // open(): missing and non-literal files.
+    {
+        LookupStore::OpenResult r = LookupStore::open((dir / "missing.lkp").string());
+        expect("open_missing_file", r.status == LookupStore::Status::CannotRead && !r.table);
+
+        writeFile(dir / "computed.lkp", "local t = {} for i = 1, 3 do t[i] = {i, i} end return t");
+        r = LookupStore::open((dir / "computed.lkp").string());
+        expect("open_computed_file", r.status == LookupStore::Status::Unsupported && !r.table);
+    }
+
+    // open(): compiled once, shared, mapped from the cache directory.
+    const fs::path data = dir / "data.lkp";
+    writeFile(data, "return { {'a', 'one'} }");
+    {
+        LookupStore::OpenResult first = LookupStore::open(data.string());
+        LookupStore::OpenResult second = LookupStore::open(data.string());
+        expect("open_ok", first.status == LookupStore::Status::Ok && first.table, first.error);
+        expect("open_shared", first.table && first.table == second.table);
+        expect("open_mapped", first.table && first.table->isMapped());
+
+        std::size_t images = 0;
+        for (const auto& e : fs::directory_iterator(dir / "cache")) {
+            if (e.path().extension() == ".mrlkp") ++images;
+        }
+        expect("open_writes_one_image", images >= 1);
+
+        // An edited source is compiled again; the old handle stays valid.
+        writeFile(data, "return { {'a', 'two'}, {'b', 'three'} }");
+        LookupStore::OpenResult edited = LookupStore::open(data.string());
+        expect("edit_new_table", edited.table && edited.table != first.table);
+        checkValue("edit_new_value", edited.table.get(), "a", "two");
+        checkValue("edit_old_handle_intact", first.table.get(), "a", "one");
+    }
+
+    // With every handle gone the image is mapped again from disk.
+    {
+        LookupStore::OpenResult reopened = LookupStore::open(data.string());
+        checkValue("reopen_from_image", reopened.table.get(), "b", "three");
+    }
+
+    // A damaged image is rebuilt rather than trusted.
+    for (const auto& e : fs::directory_iterator(dir / "cache")) {
+        if (e.path().extension() == ".mrlkp") fs::resize_file(e.path(), 40);
+    }
+    {
+        LookupStore::OpenResult rebuilt = LookupStore::open(data.string());
+        checkValue("rebuild_damaged_image", rebuilt.table.get(), "a", "two");
+    }
+
+    // An unwritable cache directory keeps the image in memory.
+    writeFile(dir / "blocker", "not a directory");
+    LookupStore::setCacheDirectory(dir / "blocker" / "cache");
+    {
+        writeFile(dir / "memory.lkp", "return { {'m', 'mem'} }");
+        LookupStore::OpenResult mem = LookupStore::open((dir / "memory.lkp").string());
+        checkValue("memory_fallback_value", mem.table.get(), "m", "mem");
+        expect("memory_fallback_not_mapped", mem.table && !mem.table->isMapped());
+    }
+    LookupStore::setCacheDirectory(dir / "cache");
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void runBench()
+{
+    constexpr int kRows = 2000000;
+    const fs::path dir = fs::temp_directory_path() / "mr_lookup_qa";
+    const fs::path big = dir / "big.lkp";
+
+    std::string text = "return {\n";
+    text.reserve(static_cast<std::size_t>(kRows) * 32);
+    for (int i = 0; i < kRows; ++i) {
+        text += "  { 'key" + std::to_string(i) + "', 'value" + std::to_string(i) + "' },\n";
+    }
+    text += "}\n";
+    writeFile(big, text);
+    std::printf("\n%d rows, %.1f MB source\n", kRows, static_cast<double>(text.size()) / 1e6);
+
+    auto start = std::chrono::steady_clock::now();
+    LookupStore::OpenResult cold = LookupStore::open(big.string());
+    std::printf("  compile + write + map : %8.1f ms\n", secondsSince(start) * 1e3);
+    cold.table.reset();
+
+    start = std::chrono::steady_clock::now();
+    LookupStore::OpenResult warm = LookupStore::open(big.string());
+    std::printf("  map existing image    : %8.1f ms\n", secondsSince(start) * 1e3);
+
+    start = std::chrono::steady_clock::now();
+    LookupStore::OpenResult shared = LookupStore::open(big.string());
+    std::printf("  open while shared     : %8.3f ms\n", secondsSince(start) * 1e3);
+
+    std::size_t hits = 0;
+    LookupTable::Value v;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kRows; ++i) {
+        hits += warm.table->find("key" + std::to_string((i * 7919LL) % kRows), v) ? 1 : 0;
+    }
+    const double elapsed = secondsSince(start);
+    std::printf("  random lookups        : %8.0f k/s (%zu hits)\n", kRows / elapsed / 1e3, hits);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-v") == 0) verbose = true;
+        if (std::strcmp(argv[i], "-b") == 0) bench = true;
+    }
+
+    runTests();
+    if (bench) {
+        runBench();
+    }
+
+    std::printf("\n%d passed, %d failed\n", passed, failed);
+    return failed == 0 ? 0 : 1;
+}
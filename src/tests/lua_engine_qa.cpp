@@ -0,0 +1,629 @@
+// Headless tests for LuaEngine. Drives the engine through the same
+// IFormulaEngine surface the replace pipeline uses, with a console host
+// instead of the panel. Run from the src/tests dir.
+//
+// The Lua sources are compiled as C, the engine as C++. The host-side
+// pieces the engine links against in the plugin (recoverable-error
+// dialog plumbing, the sandboxed file loader, StringUtils) are stubbed
+// at the bottom of this file; lkp() tables go through the real
+// LookupStore, which needs Encoding.cpp.
+//
+// MinGW / g++:
+//   gcc -O2 -c ../lua/*.c          (all except lua.c and luac.c)
+//   g++ -std=c++20 -O2 -Wall -Wextra -I.. -I../lua lua_engine_qa.cpp
+//       ../engine/LuaEngine.cpp ../engine/LookupStore.cpp
+//       ../exprtk/DateParse.cpp ../Encoding.cpp *.o -o lua_engine_qa
+//   ./lua_engine_qa
+//
+// Pass -v for a verbose pass-by-pass listing, -b to additionally run a
+// throughput benchmark (matches per second for typical replace scripts).
+
+#include "../engine/LuaEngine.h"
+#include "../StringUtils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace MultiReplaceEngine;
+
+namespace {
+
+int passed = 0;
+int failed = 0;
+bool verbose = false;  // toggled via -v command line flag
+bool bench = false;    // toggled via -b command line flag
+
+// Console host: no dialogs, errors are counted and kept for diagnostics.
+class QaHost final : public ILuaEngineHost {
+public:
+    int           errors = 0;
+    std::string   lastError;
+    FormulaLimits limits;
+    LuaGcSettings gc;
+
+    std::string escapeForRegex(const std::string& input) override { return input; }
+    int  showDebugWindow(const std::string&) override { return 0; }
+    void refreshUiListView() override {}
+    void showErrorMessage(ErrorCategory, const std::string&,
+        const std::string& details) override {
+        ++errors;
+        lastError = details;
+    }
+    RecoverableErrorChoice showRecoverableErrorDialog(const std::string&,
+        const std::string&) override {
+        return RecoverableErrorChoice::SkipOne;
+    }
+    bool isFormulaErrorDialogEnabled() const override { return true; }
+    bool isLuaSafeModeEnabled() const override { return false; }
+    bool isDebugModeEnabled() const override { return false; }
+    FormulaLimits formulaLimits() const override { return limits; }
+    LuaGcSettings luaGcSettings() const override { return gc; }
+    bool readCurrentRowColumnByIndex(int, std::string&) const override { return false; }
+    bool readCurrentRowColumnByName(const std::string&, std::string&) const override { return false; }
+};
+
+FormulaVars makeVars(int cnt, const std::string& match,
+    std::vector<std::string> captures = {})
+{
+    FormulaVars v;
+    v.CNT = cnt;
+    v.LCNT = cnt;
+    v.LINE = 1 + cnt / 10;
+    v.LPOS = cnt % 10;
+    v.APOS = cnt * 7;
+    v.MATCH = match;
+    v.FPATH = "C:\\docs\\file.txt";
+    v.FNAME = "file.txt";
+    v.captures = std::move(captures);
+    return v;
+}
+
+void check(const char* name, const FormulaResult& r,
+    const std::string& expectOutput, bool expectSkip = false)
+{
+    const bool ok = r.success && r.output == expectOutput && r.skip == expectSkip;
+    if (ok) {
+        ++passed;
+        if (verbose) std::printf("[PASS] %s\n", name);
+        return;
+    }
+    ++failed;
+    std::printf("[FAIL] %s\n  expected \"%s\" skip=%d, got \"%s\" skip=%d success=%d (%s)\n",
+        name, expectOutput.c_str(), expectSkip ? 1 : 0,
+        r.output.c_str(), r.skip ? 1 : 0, r.success ? 1 : 0,
+        r.errorMessage.c_str());
+}
+
+void checkSummary(const char* name, const std::wstring& summary,
+    const std::wstring& expect)
+{
+    if (summary == expect) {
+        ++passed;
+        if (verbose) std::printf("[PASS] %s\n", name);
+        return;
+    }
+    ++failed;
+    std::printf("[FAIL] %s\n  expected \"%ls\", got \"%ls\"\n",
+        name, expect.c_str(), summary.c_str());
+}
+
+void runTests()
+{
+    QaHost host;
+    LuaEngine engine(&host);
+    if (!engine.initialize()) {
+        ++failed;
+        std::printf("[FAIL] initialize\n");
+        return;
+    }
+    engine.beginRun();
+
+    // Variables, both spellings.
+    check("vars_upper",
+        engine.execute("set(CAP1 .. '-' .. CNT .. '-' .. MATCH)", makeVars(3, "a1", { "a", "1" }), true, 65001),
+        "a-3-a1");
+    check("vars_lower",
+        engine.execute("set(cap2 .. cnt .. lcnt .. line .. lpos .. apos)", makeVars(12, "x", { "a", "b" }), true, 65001),
+        "b12122284");
+    check("vars_file",
+        engine.execute("set(FNAME .. '|' .. fname .. '|' .. FPATH)", makeVars(1, "x"), false, 65001),
+        "file.txt|file.txt|C:\\docs\\file.txt");
+    check("vars_regex_flag",
+        engine.execute("set(tostring(REGEX) .. tostring(regex))", makeVars(1, "x"), false, 65001),
+        "falsefalse");
+
+    // cond / skip.
+    check("cond_true",
+        engine.execute("cond(CNT > 1, 'big')", makeVars(2, "x"), false, 65001),
+        "big");
+    check("cond_skip",
+        engine.execute("cond(CNT > 1, 'big')", makeVars(1, "x"), false, 65001),
+        "", true);
+
+    // Script globals persist across matches and are visible to later
+    // scripts in the same run, as are functions defined by init rows.
+    engine.execute("total = (total or 0) + CNT; set('')", makeVars(2, "x"), false, 65001);
+    check("global_persists",
+        engine.execute("total = (total or 0) + CNT; set(total)", makeVars(5, "x"), false, 65001),
+        "7");
+    engine.execute("function twice() return cnt * 2 end; vars({prefix = 'ID_'})", makeVars(1, "x"), false, 65001);
+    check("init_function_reads_vars",
+        engine.execute("set(prefix .. twice())", makeVars(21, "x"), false, 65001),
+        "ID_42");
+
+    // Helpers and _G lookups see the match variables too.
+    check("g_table_lookup",
+        engine.execute("set(_G.CNT .. _G.cnt .. _G['CAP1'])", makeVars(4, "x", { "q" }), true, 65001),
+        "44q");
+
+    // Lowercase names the script only builds at run time are resolved
+    // through the _G fallback, as is code compiled by load().
+    check("dynamic_lowercase_lookup",
+        engine.execute("set(_G['l' .. 'pos'] .. load('return ca' .. 'p1')())", makeVars(6, "x", { "z" }), true, 65001),
+        "6z");
+
+    // A capture that existed in the previous match must not leak.
+    engine.execute("set(CAP1)", makeVars(1, "x", { "a", "b", "c" }), true, 65001);
+    check("stale_capture_cleared",
+        engine.execute("set(tostring(CAP3) .. tostring(cap3))", makeVars(2, "x", { "a" }), true, 65001),
+        "nilnil");
+
+    // Writing to a variable name only affects the current match.
+    check("assign_var_local_to_match",
+        engine.execute("CNT = 99; set(CNT)", makeVars(1, "x"), false, 65001),
+        "99");
+    check("assign_var_reset_next_match",
+        engine.execute("set(CNT)", makeVars(2, "x"), false, 65001),
+        "2");
+
+    // DEBUG set by the script is read back without side effects here.
+    check("debug_flag_global",
+        engine.execute("DEBUG = false; set('ok')", makeVars(1, "x"), false, 65001),
+        "ok");
+
+    // Return protocol: the chunk's first return value is the result.
+    check("return_string",
+        engine.execute("return CAP1 .. '_' .. cap2", makeVars(1, "x", { "a", "b" }), true, 65001),
+        "a_b");
+    check("return_number",
+        engine.execute("return CNT * 2", makeVars(8, "x"), false, 65001),
+        "16");
+    check("return_nil_skips",
+        engine.execute("if CNT > 1 then return 'n' end return nil", makeVars(1, "x"), false, 65001),
+        "", true);
+    check("return_false_skips",
+        engine.execute("return CNT > 1 and 'n'", makeVars(1, "x"), false, 65001),
+        "", true);
+    engine.execute("function tagged(s) return { result = '<' .. s .. '>', skip = false } end", makeVars(1, "x"), false, 65001);
+    check("return_result_table",
+        engine.execute("return tagged(MATCH)", makeVars(1, "m"), false, 65001),
+        "<m>");
+
+    check("return_nothing_skips",
+        engine.execute("if LCNT == 1 then return 'first' end", makeVars(2, "x"), false, 65001),
+        "", true);
+
+    // Legacy protocol: a script naming a helper reads resultTable, even
+    // when it also returns something. A script that returns nothing
+    // picks up resultTable if a helper it called wrote it.
+    check("legacy_ignores_return",
+        engine.execute("set('a'); return 'b'", makeVars(1, "x"), false, 65001),
+        "a");
+    engine.execute("function wrap(s) set('[' .. s .. ']') end wrap('')", makeVars(1, "x"), false, 65001);
+    check("no_return_reads_result_table",
+        engine.execute("wrap(MATCH)", makeVars(1, "w"), false, 65001),
+        "[w]");
+
+    // Helper names inside strings and comments do not make a script
+    // legacy, and resultTable never carries over from an earlier match
+    // (the one above wrote "[w]").
+    check("return_name_in_string",
+        engine.execute("return CAP1 .. ' set'", makeVars(1, "x", { "a" }), true, 65001),
+        "a set");
+    check("return_name_in_comment",
+        engine.execute("return MATCH -- no set() needed", makeVars(1, "m"), false, 65001),
+        "m");
+    check("return_name_in_long_brackets",
+        engine.execute("--[==[ init() ]==]\nreturn [[vars ]] .. MATCH", makeVars(1, "m"), false, 65001),
+        "vars m");
+    check("legacy_no_stale_result_table",
+        engine.execute("vars({ qaUnused = 1 })", makeVars(1, "x"), false, 65001),
+        "", true);
+
+    // Anything but string, number, table, nil or false is an error.
+    const int errorsBefore = host.errors;
+    const FormulaResult bad = engine.execute("return print", makeVars(1, "x"), false, 65001);
+    if (!bad.success && host.errors == errorsBefore + 1) {
+        ++passed;
+        host.errors = errorsBefore;
+        if (verbose) std::printf("[PASS] return_function_rejected\n");
+    }
+    else {
+        ++failed;
+        std::printf("[FAIL] return_function_rejected\n");
+    }
+
+    // Helper errors keep their chunk name and line (the helpers are
+    // loaded from precompiled bytecode with debug info).
+    {
+        const int before = host.errors;
+        const FormulaResult r = engine.execute("cond(nil, 'x')", makeVars(1, "x"), false, 65001);
+        const bool ok = !r.success && host.errors == before + 1
+            && r.errorMessage.rfind("[string \"", 0) == 0
+            && r.errorMessage.find(":7: cond: condition cannot be nil") != std::string::npos;
+        host.errors = before;
+        if (ok) {
+            ++passed;
+            if (verbose) std::printf("[PASS] helper_error_position\n");
+        }
+        else {
+            ++failed;
+            std::printf("[FAIL] helper_error_position\n  got \"%s\"\n", r.errorMessage.c_str());
+        }
+    }
+
+    // lkp() serves a literal table from the shared store, numbers
+    // included; a missing key comes back unchanged or as nil (inner).
+    {
+        const std::filesystem::path lkpFile =
+            std::filesystem::temp_directory_path() / "mr_lua_qa_codes.lkp";
+        std::ofstream(lkpFile, std::ios::binary)
+            << "return { { {'de', 'at'}, 'German' }, { 7, 49 }, { 2.0, 'two' } }\n";
+        const std::string quoted = "'" + lkpFile.generic_string() + "'";
+        check("lkp_store_string",
+            engine.execute("lkp(CAP1, " + quoted + ")", makeVars(1, "x", { "at" }), true, 65001),
+            "German");
+        check("lkp_store_number",
+            engine.execute("set(lkp(7, " + quoted + ").result + 1)", makeVars(1, "x"), false, 65001),
+            "50");
+        check("lkp_store_integer_finds_float_key",
+            engine.execute("lkp(2, " + quoted + ")", makeVars(1, "x"), false, 65001),
+            "two");
+        check("lkp_store_float_finds_integer_key",
+            engine.execute("set(lkp(7.0, " + quoted + ").result + 1)", makeVars(1, "x"), false, 65001),
+            "50");
+        check("lkp_store_missing",
+            engine.execute("lkp(MATCH, " + quoted + ")", makeVars(1, "fr"), false, 65001),
+            "fr");
+        check("lkp_store_inner_missing",
+            engine.execute("set(tostring(lkp('fr', " + quoted + ", true).result))", makeVars(1, "x"), false, 65001),
+            "nil");
+    }
+
+    // A new run starts from a clean state.
+    engine.beginRun();
+    check("run_resets_globals",
+        engine.execute("set(tostring(total))", makeVars(1, "x"), false, 65001),
+        "nil");
+
+    if (host.errors != 0) {
+        ++failed;
+        std::printf("[FAIL] unexpected engine errors: %d (last: %s)\n",
+            host.errors, host.lastError.c_str());
+    }
+}
+
+// Instruction and run-time budgets: a runaway script is skipped without
+// a dialog, the run continues and endRunSummary() reports the count.
+void runBudgetTests()
+{
+    QaHost host;
+    LuaEngine engine(&host);
+    if (!engine.initialize()) {
+        ++failed;
+        std::printf("[FAIL] initialize\n");
+        return;
+    }
+
+    host.limits.luaInstructionsPerMatch = 100000;
+    engine.beginRun();
+    check("budget_loop_skipped",
+        engine.execute("while true do end", makeVars(1, "x"), false, 65001),
+        "", true);
+    check("budget_pcall_cannot_swallow",
+        engine.execute("while true do pcall(function() while true do end end) end",
+            makeVars(2, "x"), false, 65001),
+        "", true);
+    check("budget_next_match_runs",
+        engine.execute("return CNT", makeVars(3, "x"), false, 65001),
+        "3");
+    check("budget_within_limit",
+        engine.execute("local s = 0 for i = 1, 1000 do s = s + i end return s",
+            makeVars(4, "x"), false, 65001),
+        "500500");
+    checkSummary("budget_step_summary", engine.endRunSummary(), L"status_formula_step_limit_summary 2");
+
+    // Once the run has spent its time, later matches are not evaluated.
+    host.limits = FormulaLimits{};
+    host.limits.secondsPerRun = 1;
+    engine.beginRun();
+    check("time_limit_loop_skipped",
+        engine.execute("while true do end", makeVars(1, "x"), false, 65001),
+        "", true);
+    check("time_limit_later_match_skipped",
+        engine.execute("return CNT", makeVars(2, "x"), false, 65001),
+        "", true);
+    checkSummary("time_limit_summary", engine.endRunSummary(), L"status_formula_time_limit_summary 2");
+
+    // No limits: the next run is unrestricted again.
+    host.limits = FormulaLimits{};
+    engine.beginRun();
+    check("budget_cleared_by_begin_run",
+        engine.execute("return CNT", makeVars(5, "x"), false, 65001),
+        "5");
+    checkSummary("budget_summary_reset", engine.endRunSummary(), L"");
+
+    if (host.errors != 0) {
+        ++failed;
+        std::printf("[FAIL] budget tests raised dialogs: %d (last: %s)\n",
+            host.errors, host.lastError.c_str());
+    }
+}
+
+// Collector modes: same output in every mode, and the allocator's
+// figures cover the run.
+void runGcTests()
+{
+    const std::string script = "return string.rep(CAP1, 3) .. '_' .. MATCH";
+    const LuaGcSettings::Mode modes[] = {
+        LuaGcSettings::Mode::Incremental, LuaGcSettings::Mode::Generational };
+    for (const LuaGcSettings::Mode mode : modes) {
+        const bool gen = mode == LuaGcSettings::Mode::Generational;
+        QaHost host;
+        host.gc.mode = mode;
+        host.gc.reportStats = true;
+        LuaEngine engine(&host);
+        engine.initialize();
+        engine.beginRun();
+
+        std::string last;
+        bool allOk = true;
+        for (int i = 1; i <= 50000; ++i) {
+            const FormulaResult r = engine.execute(script,
+                makeVars(i, "m" + std::to_string(i), { std::to_string(i % 97) }),
+                true, 65001);
+            allOk = allOk && r.success && !r.skip;
+            last = r.output;
+        }
+        check(gen ? "gc_generational_output" : "gc_incremental_output",
+            FormulaResult{ last, false, allOk, {}, false }, "454545_m50000");
+
+        const LuaEngine::MemoryStats& stats = engine.memoryStats();
+        const bool counted = stats.allocatedBytes > 50000u * 8 && stats.gcCycles > 0
+            && stats.peakBytes >= stats.currentBytes && stats.allocations > 50000;
+        counted ? ++passed : ++failed;
+        if (!counted || verbose) {
+            std::printf("[%s] %s_stats (%llu bytes, %llu blocks, %llu cycles)\n",
+                counted ? "PASS" : "FAIL", gen ? "gc_generational" : "gc_incremental",
+                static_cast<unsigned long long>(stats.allocatedBytes),
+                static_cast<unsigned long long>(stats.allocations),
+                static_cast<unsigned long long>(stats.gcCycles));
+        }
+
+        const std::wstring summary = engine.endRunSummary();
+        checkSummary(gen ? "gc_generational_summary" : "gc_incremental_summary",
+            summary.substr(0, summary.find(L' ')), L"status_lua_memory_summary");
+
+        // A new run starts counting afresh.
+        engine.beginRun();
+        if (engine.memoryStats().allocatedBytes != 0 || engine.memoryStats().gcCycles != 0) {
+            ++failed;
+            std::printf("[FAIL] gc_stats_reset_by_begin_run\n");
+        }
+    }
+}
+
+void benchScript(const char* label, const std::string& script, bool regex,
+    std::size_t captureCount)
+{
+    QaHost host;
+    LuaEngine engine(&host);
+    engine.initialize();
+    engine.beginRun();
+
+    std::vector<std::string> caps;
+    for (std::size_t i = 0; i < captureCount; ++i) {
+        caps.push_back("cap" + std::to_string(i));
+    }
+    FormulaVars vars = makeVars(0, "match text", caps);
+
+    // Best of a few rounds, to keep scheduler noise out of the figure.
+    constexpr int N = 300000;
+    constexpr int ROUNDS = 5;
+    std::size_t sink = 0;
+    double best = 0.0;
+    for (int round = 0; round < ROUNDS; ++round) {
+        const auto t0 = std::chrono::steady_clock::now();
+        for (int i = 1; i <= N; ++i) {
+            vars.CNT = i;
+            vars.APOS = i * 11;
+            const FormulaResult r = engine.execute(script, vars, regex, 65001);
+            sink += r.output.size();
+        }
+        const double secs = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - t0).count();
+        best = std::max(best, N / secs);
+    }
+    std::printf("  %-28s %9.0f matches/s  (%zu)\n", label, best, sink);
+}
+
+// Engine start-up: construct + initialize + destroy, and beginRun() on
+// a live engine (which rebuilds the Lua state). Best of a few rounds.
+void benchStartup()
+{
+    constexpr int N = 2000;
+    constexpr int ROUNDS = 5;
+    QaHost host;
+
+    double bestCreate = 1e9;
+    for (int round = 0; round < ROUNDS; ++round) {
+        const auto t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < N; ++i) {
+            LuaEngine engine(&host);
+            engine.initialize();
+        }
+        const double secs = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - t0).count();
+        bestCreate = std::min(bestCreate, secs / N);
+    }
+
+    LuaEngine engine(&host);
+    engine.initialize();
+    double bestRun = 1e9;
+    for (int round = 0; round < ROUNDS; ++round) {
+        const auto t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < N; ++i) {
+            engine.beginRun();
+        }
+        const double secs = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - t0).count();
+        bestRun = std::min(bestRun, secs / N);
+    }
+
+    std::printf("\nStart-up (microseconds per call):\n");
+    std::printf("  %-28s %9.1f us\n", "create + initialize", bestCreate * 1e6);
+    std::printf("  %-28s %9.1f us\n", "beginRun", bestRun * 1e6);
+}
+
+// Collector modes on a million-match run with per-match string churn
+// and a long-lived table (the kind of heap a vars() cache builds up).
+// The worst single match is where a full collection shows as a stall.
+void benchGc(const char* label, LuaGcSettings gc)
+{
+    QaHost host;
+    host.gc = gc;
+    LuaEngine engine(&host);
+    engine.initialize();
+    engine.beginRun();
+
+    constexpr int N = 1000000;
+    const std::string init = "seen = {} for i = 1, 200000 do seen[i] = 'k' .. i end";
+    engine.execute(init, makeVars(0, ""), false, 65001);
+    const std::string script =
+        "local k = CAP1 .. ':' .. MATCH; seen[CNT % 200000 + 1] = k; return k .. '_' .. LINE";
+
+    std::vector<std::string> caps{ "capture" };
+    FormulaVars vars = makeVars(0, "match text", caps);
+    std::size_t sink = 0;
+    std::vector<double> latencies;
+    latencies.reserve(N);
+    const auto t0 = std::chrono::steady_clock::now();
+    for (int i = 1; i <= N; ++i) {
+        vars.CNT = i;
+        vars.captures[0] = std::to_string(i);
+        const auto m0 = std::chrono::steady_clock::now();
+        const FormulaResult r = engine.execute(script, vars, true, 65001);
+        latencies.push_back(std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - m0).count());
+        sink += r.output.size();
+    }
+    const double secs = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - t0).count();
+
+    std::sort(latencies.begin(), latencies.end());
+    const LuaEngine::MemoryStats& stats = engine.memoryStats();
+    std::printf("  %-24s %7.0f ms  p99.9 %6.1f us  max %8.1f us  %6.0f MB alloc  peak %5.1f MB  %6llu cycles  (%zu)\n",
+        label, secs * 1e3, latencies[N - N / 1000], latencies.back(),
+        stats.allocatedBytes / 1048576.0, stats.peakBytes / 1048576.0,
+        static_cast<unsigned long long>(stats.gcCycles), sink);
+}
+
+void runBench()
+{
+    std::printf("\nBenchmark (matches per second):\n");
+    benchScript("set(CNT)", "set(CNT)", false, 0);
+    benchScript("return CNT", "return CNT", false, 0);
+    benchScript("set(CAP1..CAP2) regex", "set(CAP1 .. '_' .. CAP2)", true, 2);
+    benchScript("return CAP1..CAP2, regex", "return CAP1 .. '_' .. CAP2", true, 2);
+    benchScript("cond(cnt % 2 == 0, ...)", "cond(cnt % 2 == 0, MATCH, 'odd')", false, 0);
+    benchScript("6 captures, lowercase", "set(cap1 .. cap6 .. lpos)", true, 6);
+
+    std::printf("\nCollector modes (1M matches):\n");
+    LuaGcSettings gc;
+    gc.mode = LuaGcSettings::Mode::Incremental;
+    benchGc("incremental 200/100", gc);
+    gc.pause = 150;
+    gc.stepMul = 400;
+    benchGc("incremental 150/400", gc);
+    gc = LuaGcSettings{};
+    gc.mode = LuaGcSettings::Mode::Generational;
+    benchGc("generational", gc);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-v") == 0) verbose = true;
+        if (std::strcmp(argv[i], "-b") == 0) bench = true;
+    }
+
+    runTests();
+    runBudgetTests();
+    runGcTests();
+    std::printf("\nLuaEngine QA: %d passed, %d failed\n", passed, failed);
+
+    if (bench) {
+        runBench();
+        benchStartup();
+    }
+    return failed == 0 ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------
+// Host-side stubs
+// ---------------------------------------------------------------------
+//
+// In the plugin these come from Iformulaengine.cpp (dialog plumbing and
+// localisation), MultiReplacePanel.cpp (sandboxed loader) and
+// StringUtils.cpp (Win32-backed). None of them is reached by the tests
+// above except the loader, which reports failure.
+
+namespace MultiReplaceEngine {
+
+    ILuaEngineHost::RecoverableErrorChoice IFormulaEngine::handleRecoverableSkip(
+        ILuaEngineHost*, const std::wstring&, const std::wstring&, const std::string&)
+    {
+        ++_errorSkipCount;
+        return ILuaEngineHost::RecoverableErrorChoice::SkipOne;
+    }
+
+    std::wstring IFormulaEngine::localiseCount(const std::wstring& key, std::size_t count)
+    {
+        return key + L" " + std::to_wstring(count);
+    }
+
+    std::wstring IFormulaEngine::localiseCounts(const std::wstring& key,
+        std::size_t first, std::size_t second)
+    {
+        return key + L" " + std::to_wstring(first) + L"/" + std::to_wstring(second);
+    }
+
+} // namespace MultiReplaceEngine
+
+// LuaEngine declares the loader at block scope inside its namespace,
+// which standard C++ places in MultiReplaceEngine; the panel defines it
+// at global scope. Provide both so either lookup links.
+static int qaLoadFileUnavailable(lua_State* L)
+{
+    lua_pushboolean(L, 0);
+    lua_pushstring(L, "file loading is not available in lua_engine_qa");
+    return 2;
+}
+
+int luaSafeLoadFileSandbox_impl(lua_State* L) { return qaLoadFileUnavailable(L); }
+
+namespace MultiReplaceEngine {
+    int luaSafeLoadFileSandbox_impl(lua_State* L) { return qaLoadFileUnavailable(L); }
+}
+
+namespace StringUtils {
+    std::string escapeControlChars(const std::string& input) { return input; }
+}
@@ -0,0 +1,203 @@
+// Headless tests for the result export serializer (CSV and JSON Lines):
+// quoting and escaping, the record layout, flushing in bounded memory,
+// and with -b the throughput of a large export to a temp file.
+//
+// MinGW / g++:
+//   g++ -std=c++17 -O2 -Wall -Wextra -I.. result_export_qa.cpp
+//       ../ResultExport.cpp -o result_export_qa
+//   ./result_export_qa
+//
+// Pass -v for a verbose pass-by-pass listing, -b to additionally time
+// five million records per format.
+
+#include "../ResultExport.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace {
+
+int passed = 0;
+int failed = 0;
+bool verbose = false;  // toggled via -v command line flag
+bool bench = false;    // toggled via -b command line flag
+
+void expect(const char* name, bool ok, const std::string& detail = {})
+{
+    if (ok) {
+        ++passed;
+        if (verbose) std::printf("[PASS] %s\n", name);
+        return;
+    }
+    ++failed;
+    std::printf("[FAIL] %s%s%s\n", name, detail.empty() ? "" : "\n  ", detail.c_str());
+}
+
+void expectEq(const char* name, const std::string& got, const std::string& want)
+{
+    expect(name, got == want, "got:  " + got + "\n  want: " + want);
+}
+
+ResultExportWriter::Record sampleRecord()
+{
+    ResultExportWriter::Record r;
+    r.file = "C:\\logs\\app.log";
+    r.line = 42;
+    r.column = 7;
+    r.length = 5;
+    r.matchText = "error";
+    r.lineText = "fatal error here";
+    r.rule = 3;
+    return r;
+}
+
+std::string exportOne(ResultExportWriter::Format format, const ResultExportWriter::Record& r, bool header)
+{
+    std::ostringstream out;
+    {
+        ResultExportWriter w(out, format);
+        if (header) w.writeHeader();
+        w.write(r);
+    }
+    return out.str();
+}
+
+void runTests()
+{
+    using Format = ResultExportWriter::Format;
+
+    // CSV
+    expectEq("csv_plain", exportOne(Format::Csv, sampleRecord(), true),
+        "file,line,column,length,match,line_text,rule\r\n"
+        "C:\\logs\\app.log,42,7,5,error,fatal error here,3\r\n");
+
+    {
+        auto r = sampleRecord();
+        r.lineText = "say \"hi\", then\r\nleave";
+        r.matchText = "a,b";
+        expectEq("csv_quoting", exportOne(Format::Csv, r, false),
+            "C:\\logs\\app.log,42,7,5,\"a,b\",\"say \"\"hi\"\", then\r\nleave\",3\r\n");
+    }
+    {
+        auto r = sampleRecord();
+        r.column = 0;
+        r.rule = -1;
+        r.matchText = {};
+        expectEq("csv_unknowns_empty", exportOne(Format::Csv, r, false),
+            "C:\\logs\\app.log,42,,5,,fatal error here,\r\n");
+    }
+
+    // JSONL
+    expectEq("jsonl_plain", exportOne(Format::Jsonl, sampleRecord(), true),
+        "{\"file\":\"C:\\\\logs\\\\app.log\",\"line\":42,\"column\":7,\"length\":5,"
+        "\"match\":\"error\",\"line_text\":\"fatal error here\",\"rule\":3}\n");
+
+    {
+        auto r = sampleRecord();
+        r.lineText = std::string_view("q\"\t\x01\xC3\xA4", 6);
+        r.column = 0;
+        r.rule = -1;
+        r.length = 1LL << 40;
+        expectEq("jsonl_escaping", exportOne(Format::Jsonl, r, false),
+            "{\"file\":\"C:\\\\logs\\\\app.log\",\"line\":42,\"column\":null,\"length\":1099511627776,"
+            "\"match\":\"error\",\"line_text\":\"q\\\"\\t\\u0001\xC3\xA4\",\"rule\":null}\n");
+    }
+
+    // Bounded buffer: the stream receives data long before the end
+    {
+        std::ostringstream out;
+        ResultExportWriter w(out, Format::Jsonl);
+        const auto r = sampleRecord();
+        std::size_t maxPending = 0;
+        for (int i = 0; i < 20000; ++i) {
+            w.write(r);
+            const std::size_t pending = static_cast<std::size_t>(w.bytesWritten()) - out.str().size();
+            if (pending > maxPending) maxPending = pending;
+        }
+        w.flush();
+        expect("buffer_bounded", maxPending < ResultExportWriter::kFlushBytes + 1024,
+            std::to_string(maxPending) + " bytes pending");
+        expect("count_and_size", w.recordCount() == 20000 && w.bytesWritten() == out.str().size());
+    }
+
+    // A failed stream is reported by flush
+    {
+        std::ofstream bad;  // never opened
+        ResultExportWriter w(bad, Format::Csv);
+        w.write(sampleRecord());
+        expect("flush_reports_failure", !w.flush());
+    }
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void runBench()
+{
+    constexpr int kRecords = 5000000;
+
+    std::error_code ec;
+    const std::filesystem::path dir = std::filesystem::temp_directory_path(ec) / "MultiReplace-qa";
+    std::filesystem::create_directories(dir, ec);
+
+    const std::string line = "2024-05-01 12:00:00 [worker-7] request 1234 failed: timeout after 30s, retrying";
+    std::printf("\n%d records, line text of %zu bytes\n", kRecords, line.size());
+
+    for (const auto format : { ResultExportWriter::Format::Csv, ResultExportWriter::Format::Jsonl }) {
+        const bool csv = format == ResultExportWriter::Format::Csv;
+        const std::filesystem::path path = dir / (csv ? "bench.csv" : "bench.jsonl");
+
+        const auto start = std::chrono::steady_clock::now();
+        std::uint64_t bytes = 0;
+        {
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            ResultExportWriter w(out, format);
+            w.writeHeader();
+            ResultExportWriter::Record r;
+            r.file = "/var/log/service/worker-7.log";
+            r.lineText = line;
+            r.matchText = std::string_view(line).substr(45, 6);
+            r.length = 6;
+            r.column = 46;
+            for (int i = 0; i < kRecords; ++i) {
+                r.line = i + 1;
+                r.rule = i % 8;
+                w.write(r);
+            }
+            w.flush();
+            bytes = w.bytesWritten();
+        }
+        const double secs = secondsSince(start);
+        std::printf("  %-5s : %7.1f ms, %7.1f MB, %7.1f MB/s, %6.2f M records/s\n",
+            csv ? "csv" : "jsonl", secs * 1e3, bytes / 1048576.0,
+            bytes / 1048576.0 / secs, kRecords / secs / 1e6);
+        expect("bench_file_size", std::filesystem::file_size(path, ec) == bytes);
+    }
+
+    std::filesystem::remove_all(dir, ec);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-v") == 0) verbose = true;
+        if (std::strcmp(argv[i], "-b") == 0) bench = true;
+    }
+
+    runTests();
+    if (bench) {
+        runBench();
+    }
+
+    std::printf("\n%d passed, %d failed\n", passed, failed);
+    return failed == 0 ? 0 : 1;
+}
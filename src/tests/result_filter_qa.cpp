@@ -0,0 +1,234 @@
+// Headless tests for the result refine criteria: the wildcard path
+// filter, literal and regex line tests, and the parallel batch match
+// against a single-threaded run; with -b the batch throughput.
+//
+// MSVC (x64 Native Tools Command Prompt for VS 2022):
+//   cl /std:c++17 /EHsc /I.. result_filter_qa.cpp ..\ResultFilter.cpp /Fe:result_filter_qa.exe
+//   result_filter_qa.exe
+//
+// MinGW / g++:
+//   g++ -std=c++17 -O2 -Wall -Wextra -pthread -I.. result_filter_qa.cpp
+//       ../ResultFilter.cpp -o result_filter_qa
+//   ./result_filter_qa
+//
+// Pass -v for a verbose pass-by-pass listing, -b to additionally match a
+// million lines per filter kind on one thread and on all cores.
+
+#include "../ResultFilter.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+int passed = 0;
+int failed = 0;
+bool verbose = false;  // toggled via -v command line flag
+bool bench = false;    // toggled via -b command line flag
+
+void expect(const char* name, bool ok, const std::string& detail = {})
+{
+    if (ok) {
+        ++passed;
+        if (verbose) std::printf("[PASS] %s\n", name);
+        return;
+    }
+    ++failed;
+    std::printf("[FAIL] %s%s%s\n", name, detail.empty() ? "" : "\n  ", detail.c_str());
+}
+
+ResultFilter textFilter(const std::wstring& text, bool regex, bool matchCase)
+{
+    ResultFilter::Criteria c;
+    c.text = text;
+    c.regex = regex;
+    c.matchCase = matchCase;
+    return ResultFilter(c);
+}
+
+bool lineMatches(const ResultFilter& f, std::string_view line)
+{
+    std::wstring scratch;
+    return f.textMatches(line, scratch);
+}
+
+// Log-like lines; every 7th has an error code, every 11th mentions a user
+std::vector<std::string> makeLines(std::size_t n)
+{
+    std::vector<std::string> lines;
+    lines.reserve(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        std::string s = "2024-05-01 12:00:" + std::to_string(i % 60) + " [worker-" + std::to_string(i % 8) + "] ";
+        s += (i % 7 == 0) ? "ERROR " + std::to_string(400 + i % 100) : "request served";
+        if (i % 11 == 0) s += " for user M\xC3\xBCller";
+        lines.push_back(std::move(s));
+    }
+    return lines;
+}
+
+void runTests()
+{
+    // Wildcards
+    expect("wild_star", ResultFilter::wildcardMatch("*.cpp", "main.cpp") && !ResultFilter::wildcardMatch("*.cpp", "main.h"));
+    expect("wild_question", ResultFilter::wildcardMatch("log?.txt", "log1.txt") && !ResultFilter::wildcardMatch("log?.txt", "log.txt"));
+    expect("wild_backtrack", ResultFilter::wildcardMatch("*a*b", "xaxxab") && !ResultFilter::wildcardMatch("*a*b", "xaxxa"));
+    expect("wild_case_and_slash", ResultFilter::wildcardMatch("C:/SRC/*", "c:\\src\\util\\a.h"));
+    expect("wild_empty", ResultFilter::wildcardMatch("*", "") && !ResultFilter::wildcardMatch("?", ""));
+
+    // Path filter lists
+    {
+        ResultFilter::Criteria c;
+        c.pathFilter = " *.cpp ; *.h ; !*Test* ";
+        const ResultFilter f(c);
+        expect("path_include", f.pathMatches("C:\\src\\main.cpp") && f.pathMatches("C:\\src\\main.h"));
+        expect("path_not_included", !f.pathMatches("C:\\src\\notes.txt"));
+        expect("path_exclude", !f.pathMatches("C:\\src\\MainTest.cpp"));
+        expect("path_name_only", !f.pathMatches("C:\\cpp\\readme"));
+    }
+    {
+        ResultFilter::Criteria c;
+        c.pathFilter = "C:\\src\\engine\\*";
+        const ResultFilter f(c);
+        expect("path_folder", f.pathMatches("C:\\src\\engine\\lua\\x.cpp") && !f.pathMatches("C:\\src\\ui\\x.cpp"));
+    }
+    {
+        ResultFilter::Criteria c;
+        c.pathFilter = "!*.bak";
+        const ResultFilter f(c);
+        expect("path_only_exclusions", f.pathMatches("a.txt") && !f.pathMatches("a.bak"));
+        expect("path_empty_passes", ResultFilter(ResultFilter::Criteria{}).pathMatches("x") && !ResultFilter(ResultFilter::Criteria{}).hasPathFilter());
+    }
+
+    // Line text
+    {
+        const ResultFilter f = textFilter(L"Error", false, true);
+        expect("literal_case", lineMatches(f, "an Error here") && !lineMatches(f, "an error here"));
+        const ResultFilter g = textFilter(L"Error", false, false);
+        expect("literal_nocase", lineMatches(g, "an ERROR here") && !lineMatches(g, "all fine"));
+        const ResultFilter u = textFilter(L"M\u00FCller", false, true);
+        expect("literal_utf8", lineMatches(u, "user M\xC3\xBCller") && !lineMatches(u, "user Muller"));
+        const ResultFilter w = textFilter(L"m\u00FCller", false, false);
+        expect("literal_nocase_utf8", lineMatches(w, "user M\xC3\xBCller"));
+    }
+    {
+        const ResultFilter f = textFilter(L"err(or)?\\s+4\\d\\d", true, false);
+        expect("regex_valid", f.valid() && f.hasTextFilter());
+        expect("regex_match", lineMatches(f, "ERROR  404 x") && lineMatches(f, "err 418") && !lineMatches(f, "error 500"));
+        const ResultFilter g = textFilter(L"^\\[", true, true);
+        expect("regex_anchor", lineMatches(g, "[x] y") && !lineMatches(g, "y [x]"));
+        const ResultFilter bad = textFilter(L"(unclosed", true, false);
+        expect("regex_invalid", !bad.valid() && !bad.error().empty());
+    }
+
+    // Batches: every thread count gives the single-threaded answer
+    {
+        const std::vector<std::string> owned = makeLines(50000);
+        const std::vector<std::string_view> lines(owned.begin(), owned.end());
+        const ResultFilter f = textFilter(L"error\\s+4[0-4]", true, false);
+
+        std::vector<std::uint8_t> serial, parallel;
+        std::string error;
+        expect("batch_no_error", f.matchLines(lines, serial, error, 1) && error.empty());
+        bool same = true;
+        for (unsigned t : { 2u, 3u, 8u, 0u }) {
+            f.matchLines(lines, parallel, error, t);
+            same = same && parallel == serial;
+        }
+        std::size_t hits = 0;
+        for (std::size_t i = 0; i < owned.size(); ++i) hits += serial[i];
+        std::size_t want = 0;
+        for (std::size_t i = 0; i < owned.size(); i += 7) want += (400 + i % 100) < 450;
+        expect("batch_threads_agree", same);
+        expect("batch_count", hits == want, std::to_string(hits) + " vs " + std::to_string(want));
+
+        std::vector<std::uint8_t> all;
+        ResultFilter(ResultFilter::Criteria{}).matchLines(lines, all, error);
+        expect("batch_no_text_filter", all.size() == lines.size() && all.front() == 1 && all.back() == 1);
+    }
+
+    // A regex that gives up while matching (MSVC throws error_complexity
+    // or error_stack on heavy backtracking) fails the batch instead of
+    // taking the process down from a worker thread. libstdc++ never
+    // throws here, it backtracks for good, so the case needs MSVC.
+#if defined(_MSC_VER)
+    {
+        std::vector<std::string> owned(8192, "just a line");
+        for (std::size_t i = 0; i < owned.size(); i += 512)
+            owned[i].assign(2048, 'a');
+        std::vector<std::string_view> lines(owned.begin(), owned.end());
+        const ResultFilter f = textFilter(L"(a|aa)*c", true, false);
+
+        for (unsigned t : { 1u, 4u }) {
+            std::vector<std::uint8_t> out;
+            std::string error;
+            const bool ok = f.matchLines(lines, out, error, t);
+            std::size_t hits = 0;
+            for (const std::uint8_t v : out) hits += v;
+            expect(t == 1 ? "regex_throws_serial" : "regex_throws_parallel",
+                !ok && !error.empty() && hits == 0, error);
+        }
+    }
+#else
+    if (verbose) std::printf("[SKIP] regex_throws (needs MSVC's std::regex)\n");
+#endif
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void runBench()
+{
+    constexpr std::size_t kLines = 1000000;
+    const std::vector<std::string> owned = makeLines(kLines);
+    const std::vector<std::string_view> lines(owned.begin(), owned.end());
+    const unsigned cores = (std::max)(std::thread::hardware_concurrency(), 1u);
+    std::printf("\n%zu lines, %u cores\n", kLines, cores);
+
+    struct Case { const char* name; std::wstring text; bool regex; bool matchCase; };
+    const Case cases[] = {
+        { "literal", L"ERROR 4", false, true },
+        { "nocase",  L"m\u00FCller", false, false },
+        { "regex",   L"error\\s+4[0-4]\\d", true, false },
+    };
+    for (const Case& c : cases) {
+        const ResultFilter f = textFilter(c.text, c.regex, c.matchCase);
+        std::vector<std::uint8_t> one, all;
+
+        auto start = std::chrono::steady_clock::now();
+        std::string error;
+        f.matchLines(lines, one, error, 1);
+        const double single = secondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        f.matchLines(lines, all, error, 0);
+        const double parallel = secondsSince(start);
+
+        std::printf("  %-7s : %8.1f ms on one thread, %8.1f ms on %u (x%.1f)\n",
+            c.name, single * 1e3, parallel * 1e3, cores, single / parallel);
+        expect("bench_same_result", one == all);
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-v") == 0) verbose = true;
+        if (std::strcmp(argv[i], "-b") == 0) bench = true;
+    }
+
+    runTests();
+    if (bench) {
+        runBench();
+    }
+
+    std::printf("\n%d passed, %d failed\n", passed, failed);
+    return failed == 0 ? 0 : 1;
+}
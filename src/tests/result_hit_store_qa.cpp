@@ -0,0 +1,606 @@
+// Headless tests for ResultHitStore: interning, row/match runs, the bulk
+// edits the result dock performs (append, block prepend, shift, erase,
+// FlowTab position adjustment), edit tracking through the position index
+// and the memory it reports.
+//
+// MinGW / g++:
+//   g++ -std=c++17 -O2 -Wall -Wextra -I.. result_hit_store_qa.cpp
+//       ../ResultHitStore.cpp ../ResultSpill.cpp -o result_hit_store_qa
+//   ./result_hit_store_qa
+//
+// Pass -v for a verbose pass-by-pass listing, -b to additionally store
+// two million hits and report bytes per hit next to the former
+// one-struct-per-row layout, then stack them as 200 separate searches
+// and time edit tracking against a full position scan.
+
+#include "../ResultHitStore.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace {
+
+int passed = 0;
+int failed = 0;
+bool verbose = false;  // toggled via -v command line flag
+bool bench = false;    // toggled via -b command line flag
+
+// Live heap bytes, tracked by the operator new/delete below.
+std::size_t g_liveBytes = 0;
+
+void expect(const char* name, bool ok, const std::string& detail = {})
+{
+    if (ok) {
+        ++passed;
+        if (verbose) std::printf("[PASS] %s\n", name);
+        return;
+    }
+    ++failed;
+    std::printf("[FAIL] %s%s%s\n", name, detail.empty() ? "" : "\n  ", detail.c_str());
+}
+
+// Two rows in one file: row 0 holds matches at 10 and 20 (second one
+// pattern B), row 1 holds a match at 100.
+ResultHitStore makeSample(const std::string& path, int displayBase)
+{
+    ResultHitStore s;
+    const std::uint32_t f = s.internFile(path);
+    const std::uint32_t a = s.internPattern(L"alpha", 4);
+    const std::uint32_t b = s.internPattern(L"beta", 0);
+    s.beginRow(f, 0, displayBase, 9, 1);
+    s.addMatch(10, 5, a, 0, 0, 12, 5);
+    s.addMatch(20, 4, b, 1, 40, 22, 4);
+    s.beginRow(f, 3, displayBase + 40, 9, 1);
+    s.addMatch(100, 5, a, 0, 0, 12, 5);
+    return s;
+}
+
+void runTests()
+{
+    // Interning
+    {
+        ResultHitStore s;
+        const auto f1 = s.internFile("C:\\a.txt");
+        const auto f2 = s.internFile("C:\\b.txt");
+        expect("intern_file_distinct", f1 != f2);
+        expect("intern_file_stable", s.internFile("C:\\a.txt") == f1);
+        expect("intern_file_count", s.fileCount() == 2);
+
+        const auto p1 = s.internPattern(L"x", 0);
+        expect("intern_pattern_stable", s.internPattern(L"x", 0) == p1);
+        expect("intern_pattern_flags_differ", s.internPattern(L"x", 2) != p1);
+    }
+
+    // Rows and match runs
+    {
+        const ResultHitStore s = makeSample("C:\\a.txt", 0);
+        expect("rows_count", s.rowCount() == 2 && s.matchCount() == 3);
+        expect("row0_run", s.matchBegin(0) == 0 && s.matchEnd(0) == 2);
+        expect("row1_run", s.matchBegin(1) == 2 && s.matchEnd(1) == 3);
+        expect("row_fields", s.rowDocLine(1) == 3 && s.rowDisplayStart(1) == 40
+            && s.rowNumberStart(0) == 9 && s.rowNumberLen(0) == 1);
+        expect("row_path", s.rowFilePath(1) == "C:\\a.txt");
+        expect("match_fields", s.matchPos(1) == 20 && s.matchLength(1) == 4
+            && s.matchFindText(1) == L"beta" && s.matchSearchFlags(0) == 4
+            && s.matchColor(1) == 1 && s.matchDisplayStart(1) == 22 && s.matchDisplayLen(1) == 4);
+        expect("match_list_index", s.matchListIndex(0) == 0 && s.matchListIndex(1) == 40);
+    }
+
+    // 64-bit positions survive
+    {
+        ResultHitStore s;
+        s.beginRow(s.internFile("big"), 0, 0, 0, 1);
+        const ResultHitStore::Pos far = (ResultHitStore::Pos{ 1 } << 33) + 7;
+        s.addMatch(far, 3, s.internPattern(L"p", 0), -1, -1, 0, 0);
+        expect("pos_64bit", s.matchPos(0) == far);
+        expect("no_color", s.matchColor(0) == -1 && s.matchListIndex(0) == -1);
+    }
+
+    // Append remaps ids and offsets
+    {
+        ResultHitStore s = makeSample("C:\\a.txt", 0);
+        ResultHitStore other;
+        const auto fb = other.internFile("C:\\b.txt");
+        other.internFile("C:\\unused.txt");
+        const auto pb = other.internPattern(L"beta", 0);
+        other.beginRow(fb, 7, 0, 9, 1);
+        other.addMatch(70, 4, pb, 2, 2, 12, 4);
+
+        s.append(other, 100);
+        expect("append_rows", s.rowCount() == 3 && s.matchCount() == 4);
+        expect("append_run", s.matchBegin(2) == 3 && s.matchEnd(2) == 4);
+        expect("append_display", s.rowDisplayStart(2) == 100);
+        expect("append_file_remap", s.rowFilePath(2) == "C:\\b.txt");
+        expect("append_pattern_shared", s.matchPatternId(3) == s.matchPatternId(1));
+        expect("append_list_index", s.matchListIndex(3) == 2 && s.matchListIndex(1) == 40);
+    }
+
+    // Prepending a block puts its rows first; older rows keep their runs
+    // and move back by the block length
+    {
+        ResultHitStore s = makeSample("C:\\a.txt", 0);
+        const ResultHitStore block = makeSample("C:\\b.txt", 0);
+        s.prependBlock(block, 60);
+        expect("prepend_rows", s.rowCount() == 4 && s.matchCount() == 6 && s.blockCount() == 2);
+        expect("prepend_new_first", s.rowFilePath(0) == "C:\\b.txt" && s.rowDisplayStart(0) == 0
+            && s.rowDisplayStart(1) == 40);
+        expect("prepend_new_run", s.matchBegin(0) == 3 && s.matchEnd(0) == 5
+            && s.matchBegin(1) == 5 && s.matchEnd(1) == 6);
+        expect("prepend_old_run", s.matchBegin(2) == 0 && s.matchEnd(2) == 2
+            && s.matchBegin(3) == 2 && s.matchEnd(3) == 3);
+        expect("prepend_old_display", s.rowDisplayStart(2) == 60 && s.rowDisplayStart(3) == 100);
+        expect("prepend_list_index", s.matchListIndex(s.matchBegin(0) + 1) == 40
+            && s.matchListIndex(s.matchBegin(2) + 1) == 40);
+        expect("prepend_old_match", s.matchPos(s.matchBegin(3)) == 100 && s.rowFilePath(3) == "C:\\a.txt");
+    }
+
+    // Block table: three searches stacked, then edits inside the middle one
+    {
+        ResultHitStore s;
+        s.prependBlock(makeSample("C:\\a.txt", 10), 80);    // a: 10, 50
+        s.prependBlock(makeSample("C:\\b.txt", 10), 70);    // b: 10, 50; a: 80, 120
+        s.prependBlock(makeSample("C:\\c.txt", 10), 60);    // c: 10, 50; b: 70, 110; a: 140, 180
+        expect("blocks_count", s.blockCount() == 3 && s.rowCount() == 6);
+        expect("blocks_display", s.rowDisplayStart(0) == 10 && s.rowDisplayStart(1) == 50
+            && s.rowDisplayStart(2) == 70 && s.rowDisplayStart(3) == 110
+            && s.rowDisplayStart(4) == 140 && s.rowDisplayStart(5) == 180);
+        expect("blocks_paths", s.rowFilePath(0) == "C:\\c.txt" && s.rowFilePath(2) == "C:\\b.txt"
+            && s.rowFilePath(5) == "C:\\a.txt");
+        expect("blocks_lower_bound", s.lowerBoundDisplay(0) == 0 && s.lowerBoundDisplay(60) == 2
+            && s.lowerBoundDisplay(70) == 2 && s.lowerBoundDisplay(111) == 4
+            && s.lowerBoundDisplay(181) == 6);
+        expect("blocks_row_at", s.rowAtDisplayStart(110) == 3 && s.rowAtDisplayStart(111) == SIZE_MAX
+            && s.rowAtDisplayStart(180) == 5);
+
+        // Text grows inside b: b's later row and all of a follow, c stays
+        s.shiftDisplay(5, 100);
+        expect("blocks_shift_mid", s.rowDisplayStart(1) == 50 && s.rowDisplayStart(2) == 70
+            && s.rowDisplayStart(3) == 115 && s.rowDisplayStart(4) == 145 && s.rowDisplayStart(5) == 185);
+
+        // Erase across the b/a boundary: b's second row and a's first row go
+        s.eraseDisplayRange(100, 150);
+        expect("blocks_erase_cross", s.rowCount() == 4 && s.blockCount() == 3
+            && s.rowDisplayStart(2) == 70 && s.rowDisplayStart(3) == 135
+            && s.rowFilePath(3) == "C:\\a.txt");
+
+        // Erasing all of b folds its table entry away
+        s.eraseDisplayRange(60, 100);
+        expect("blocks_erase_drop", s.blockCount() == 2 && s.rowCount() == 3
+            && s.rowDisplayStart(1) == 50 && s.rowDisplayStart(2) == 95);
+    }
+
+    // A newest block without rows (a lone search header) merges into the next
+    {
+        ResultHitStore s;
+        s.prependBlock(makeSample("C:\\a.txt", 10), 80);
+        s.prependBlock(ResultHitStore{}, 30);
+        expect("empty_block_kept", s.blockCount() == 2 && s.rowDisplayStart(0) == 40);
+        s.prependBlock(makeSample("C:\\b.txt", 10), 60);
+        expect("empty_block_merged", s.blockCount() == 2 && s.rowDisplayStart(1) == 50
+            && s.rowDisplayStart(2) == 100 && s.lowerBoundDisplay(70) == 2);
+    }
+
+    // Shift from a position
+    {
+        ResultHitStore s = makeSample("C:\\a.txt", 0);
+        s.shiftDisplay(5, 10);
+        expect("shift_from", s.rowDisplayStart(0) == 0 && s.rowDisplayStart(1) == 45);
+    }
+
+    // Erase a display range keeps order and runs
+    {
+        ResultHitStore s = makeSample("C:\\a.txt", 0);
+        s.append(makeSample("C:\\b.txt", 0), 80);  // rows at 0, 40, 80, 120
+        s.eraseDisplayRange(40, 80);
+        expect("erase_rows", s.rowCount() == 3 && s.matchCount() == 5);
+        expect("erase_shift", s.rowDisplayStart(0) == 0 && s.rowDisplayStart(1) == 40
+            && s.rowDisplayStart(2) == 80);
+        expect("erase_runs", s.matchBegin(1) == 2 && s.matchEnd(1) == 4
+            && s.matchBegin(2) == 4 && s.matchEnd(2) == 5);
+        expect("erase_match_moved", s.matchPos(2) == 10 && s.rowFilePath(1) == "C:\\b.txt");
+        expect("erase_list_moved", s.matchListIndex(3) == 40);
+    }
+
+    // FlowTab-style adjustment touches only one file, every match
+    {
+        ResultHitStore s = makeSample("C:\\a.txt", 0);
+        s.append(makeSample("C:\\b.txt", 0), 80);
+        const std::uint32_t fa = s.internFile("C:\\a.txt");
+        s.adjustPositions(fa, [](ResultHitStore::Pos p) { return p + 3; });
+        expect("adjust_file", s.matchPos(0) == 13 && s.matchPos(1) == 23 && s.matchPos(2) == 103);
+        expect("adjust_other_file", s.matchPos(3) == 10 && s.matchPos(5) == 100);
+    }
+
+    // Edit tracking: inserts move later matches, removals collapse the
+    // matches inside them, other files stay put
+    {
+        ResultHitStore s = makeSample("C:\\a.txt", 0);
+        s.append(makeSample("C:\\b.txt", 0), 80);
+        const std::uint32_t fa = s.internFile("C:\\a.txt");
+        s.shiftPositions(fa, 20, 5);
+        expect("shift_insert", s.matchPos(0) == 10 && s.matchPos(1) == 25 && s.matchPos(2) == 105);
+        s.shiftPositions(fa, 5, -10);
+        expect("shift_remove", s.matchPos(0) == 5 && s.matchPos(1) == 15 && s.matchPos(2) == 95);
+        expect("shift_other_file", s.matchPos(3) == 10 && s.matchPos(4) == 20 && s.matchPos(5) == 100);
+
+        // Bulk edits fold the tracked positions into the store
+        s.prependBlock(makeSample("C:\\a.txt", 0), 80);
+        expect("shift_survives_prepend", s.matchPos(0) == 5 && s.matchPos(1) == 15 && s.matchPos(2) == 95
+            && s.matchPos(6) == 10 && s.matchPos(8) == 100);
+        s.shiftPositions(fa, 0, 1);
+        expect("shift_after_prepend", s.matchPos(0) == 6 && s.matchPos(6) == 11 && s.matchPos(3) == 10);
+    }
+
+    // Replace All: each replacement is reported as one shift (see
+    // ResultDock::trackReplacement); undo then arrives as a removal and an
+    // insert per replacement, last replacement first. Matches outside the
+    // replaced text end up where they started.
+    {
+        ResultHitStore s;
+        const std::uint32_t f = s.internFile("C:\\a.txt");
+        const std::uint32_t p = s.internPattern(L"abc", 0);
+        const std::int64_t starts[] = { 10, 20, 40, 70 };
+        for (int k = 0; k < 4; ++k) {
+            s.beginRow(f, k, k * 20, 9, 1);
+            s.addMatch(starts[k], 3, p, 0, 0, 12, 3);
+        }
+        auto replaceAt = [&](std::int64_t pos, std::int64_t removed, std::int64_t inserted) {
+            s.shiftPositions(f, pos + (std::min)(removed, inserted), inserted - removed);
+        };
+        replaceAt(20, 3, 7);    // grows: later matches move by 4
+        replaceAt(74, 3, 1);    // shrinks, at its shifted position
+        expect("replace_all_shift", s.matchPos(0) == 10 && s.matchPos(1) == 20
+            && s.matchPos(2) == 44 && s.matchPos(3) == 74);
+
+        s.shiftPositions(f, 74, -1);
+        s.shiftPositions(f, 74, 3);
+        s.shiftPositions(f, 20, -7);
+        s.shiftPositions(f, 20, 3);
+        expect("replace_all_undo", s.matchPos(0) == 10 && s.matchPos(2) == 40);
+    }
+
+    // Edit tracking against a brute-force model: three stacked searches
+    // over two files, random inserts and removals
+    {
+        ResultHitStore s;
+        std::vector<std::int64_t> model;
+        std::vector<int> fileOf;
+        std::uint32_t seed = 12345;
+        auto rnd = [&seed](std::uint32_t n) { seed = seed * 1103515245u + 12345u; return (seed >> 8) % n; };
+
+        for (int block = 0; block < 3; ++block) {
+            ResultHitStore b;
+            const std::uint32_t f0 = b.internFile("C:\\x.txt");
+            const std::uint32_t f1 = b.internFile("C:\\y.txt");
+            const std::uint32_t p = b.internPattern(L"p", 0);
+            for (int r = 0; r < 300; ++r) {
+                b.beginRow(r % 2 ? f1 : f0, r, r * 20, 9, 1);
+                b.addMatch(r * 37 + block, 3, p, 0, 0, 12, 3);
+                if (r % 5 == 0) b.addMatch(r * 37 + block + 9, 3, p, 0, 0, 22, 3);
+            }
+            s.prependBlock(b, 300 * 20);
+        }
+        for (std::size_t m = 0; m < s.matchCount(); ++m) model.push_back(s.matchPos(m));
+        for (std::size_t r = 0; r < s.rowCount(); ++r)
+            for (std::size_t m = s.matchBegin(r); m < s.matchEnd(r); ++m) {
+                if (fileOf.size() <= m) fileOf.resize(m + 1);
+                fileOf[m] = s.rowFilePath(r) == "C:\\x.txt" ? 0 : 1;
+            }
+
+        bool ok = true;
+        const std::uint32_t ids[2] = { s.internFile("C:\\x.txt"), s.internFile("C:\\y.txt") };
+        for (int k = 0; k < 2000 && ok; ++k) {
+            const int f = static_cast<int>(rnd(2));
+            const std::int64_t pos = rnd(12000);
+            const std::int64_t delta = rnd(2) ? std::int64_t(rnd(40)) + 1 : -std::int64_t(rnd(40)) - 1;
+            s.shiftPositions(ids[f], pos, delta);
+            for (std::size_t m = 0; m < model.size(); ++m) {
+                if (fileOf[m] != f) continue;
+                if (delta > 0 && model[m] >= pos) model[m] += delta;
+                else if (delta < 0 && model[m] >= pos - delta) model[m] += delta;
+                else if (delta < 0 && model[m] >= pos) model[m] = pos;
+            }
+            if (k % 97 == 0 || k == 1999)
+                for (std::size_t m = 0; m < model.size(); ++m)
+                    if (s.matchPos(m) != model[m]) ok = false;
+        }
+        expect("shift_model", ok);
+
+        // Erasing dock lines folds the index; the rest keep their positions
+        auto displayOrder = [&s](std::size_t fromRow) {
+            std::vector<std::int64_t> v;
+            for (std::size_t r = fromRow; r < s.rowCount(); ++r)
+                for (std::size_t m = s.matchBegin(r); m < s.matchEnd(r); ++m) v.push_back(s.matchPos(m));
+            return v;
+        };
+        const std::size_t rowsBefore = s.rowCount();
+        const std::vector<std::int64_t> before = displayOrder(0);
+        s.eraseDisplayRange(0, 20);
+        const std::vector<std::int64_t> after = displayOrder(0);
+        ok = s.rowCount() == rowsBefore - 1 && after.size() < before.size()
+            && std::equal(after.begin(), after.end(), before.end() - after.size());
+        expect("shift_model_after_erase", ok);
+    }
+
+    // Pending rows: deferred behind a placeholder, then placed chunk-wise
+    {
+        ResultHitStore s = makeSample("C:\\a.txt", 0);
+        s.append(makeSample("C:\\b.txt", 0), 80);   // rows at 0, 40, 80, 120
+        s.deferRow(2, 80);
+        s.deferRow(3, 80);
+        expect("pending_flag", !s.rowPending(1) && s.rowPending(2) && s.rowPending(3));
+        expect("pending_lower_bound", s.lowerBoundDisplay(80) == 2 && s.lowerBoundDisplay(41) == 2
+            && s.lowerBoundDisplay(0) == 0 && s.lowerBoundDisplay(81) == 4);
+
+        // Rendering a chunk in front of the placeholder shifts only what follows it
+        s.shiftDisplay(30, 81);
+        expect("pending_shift_keeps_anchor", s.rowDisplayStart(2) == 80 && s.rowDisplayStart(3) == 80);
+        s.placeRow(2, 80);
+        s.deferRow(3, 110);
+        expect("pending_place", !s.rowPending(2) && s.rowDisplayStart(2) == 80
+            && s.rowPending(3) && s.rowDisplayStart(3) == 110);
+
+        // The flag travels with the row through prepend and erase
+        s.prependBlock(makeSample("C:\\c.txt", 0), 80);
+        expect("pending_prepend", s.rowPending(5) && !s.rowPending(0) && !s.rowPending(4));
+        s.eraseDisplayRange(0, 40);
+        expect("pending_erase", s.rowCount() == 5 && s.rowPending(4) && s.rowDisplayStart(4) == 150);
+    }
+
+    // Unformatted rows: raw spans until the dock formats the row
+    {
+        ResultHitStore s;
+        const std::uint32_t f = s.internFile("C:\\a.txt");
+        const std::uint32_t p = s.internPattern(L"x", 0);
+        s.beginRow(f, 0, 0, 11, 1);
+        s.addMatch(5, 1, p, 0, -1, 19, 1);
+        s.beginRow(f, 1, 40, 11, 1, true);
+        s.addMatch(50, 2, p, 0, -1, 7, 2);
+        s.deferRow(1, 40);
+        expect("unformatted_flag", !s.rowUnformatted(0) && s.rowUnformatted(1)
+            && s.matchDisplayStart(1) == 7 && s.matchDisplayLen(1) == 2);
+
+        // The flag is independent of pending and survives placing and prepending
+        s.placeRow(1, 40);
+        s.prependBlock(makeSample("C:\\c.txt", 0), 80);
+        const std::size_t r = s.rowCount() - 1;
+        expect("unformatted_travels", !s.rowPending(r) && s.rowUnformatted(r) && !s.rowUnformatted(0));
+
+        s.setMatchDisplay(s.matchBegin(r), 26, 2);
+        s.markRowFormatted(r);
+        expect("unformatted_formatted", !s.rowUnformatted(r)
+            && s.matchDisplayStart(s.matchBegin(r)) == 26 && s.matchDisplayLen(s.matchBegin(r)) == 2);
+    }
+
+    // hasRowsForFile and clear
+    {
+        ResultHitStore s = makeSample("C:\\a.txt", 0);
+        const std::uint32_t fx = s.internFile("C:\\x.txt");
+        expect("has_rows_yes", s.hasRowsForFile(0));
+        expect("has_rows_no", !s.hasRowsForFile(fx));
+        s.eraseDisplayRange(0, 100);
+        expect("has_rows_after_erase", !s.hasRowsForFile(0) && s.empty());
+        s.clear();
+        expect("clear", s.rowCount() == 0 && s.fileCount() == 0 && s.memoryBytes() == 0);
+    }
+
+    // History eviction: a search goes from the separator above its header
+    // to the next kept search (or the end of the dock)
+    {
+        ResultHitStore s = makeSample("C:\\a.txt", 10);       // oldest, pinned
+        s.prependBlock(makeSample("C:\\b.txt", 10), 100);
+        s.prependBlock(makeSample("C:\\c.txt", 10), 100);     // newest
+        s.eraseDisplayRange(98, 198);
+        expect("evict_middle", s.rowCount() == 4 && s.matchCount() == 6 && s.blockCount() == 2
+            && s.rowFilePath(1) == "C:\\c.txt" && s.rowFilePath(2) == "C:\\a.txt"
+            && s.rowDisplayStart(2) == 110 && s.rowDisplayStart(3) == 150 && s.matchPos(5) == 100);
+        s.eraseDisplayRange(98, 300);
+        expect("evict_oldest", s.rowCount() == 2 && s.matchCount() == 3 && s.blockCount() == 1
+            && s.rowFilePath(0) == "C:\\c.txt" && s.rowDisplayStart(1) == 50 && s.lowerBoundDisplay(99) == 2);
+    }
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The per-row struct the dock kept before the store, filled the way
+// formatHitsLines filled it for a row with one match.
+struct LegacyHit
+{
+    std::string  fullPathUtf8;
+    std::int64_t pos{};
+    std::int64_t length{};
+    int          docLine{ -1 };
+    int          searchFlags{ 0 };
+    std::wstring findTextW;
+    std::vector<std::wstring> allFindTexts;
+    std::vector<std::int64_t> allPositions;
+    std::vector<std::int64_t> allLengths;
+    std::vector<int>          allSearchFlags;
+    int displayLineStart{ -1 };
+    int numberStart{ 0 };
+    int numberLen{ 0 };
+    std::vector<int> matchStarts;
+    std::vector<int> matchLens;
+    std::vector<int> matchColors;
+    int colorIndex{ -1 };
+};
+
+void runBench()
+{
+    constexpr int kFiles = 200;
+    constexpr int kHitsPerFile = 10000;
+    constexpr std::size_t kHits = static_cast<std::size_t>(kFiles) * kHitsPerFile;
+    const std::wstring pattern = L"searchTerm";
+
+    std::vector<std::string> paths;
+    for (int f = 0; f < kFiles; ++f)
+        paths.push_back("C:\\Projects\\SomeProduct\\src\\module" + std::to_string(f) + "\\Implementation.cpp");
+
+    std::printf("\n%zu hits in %d files, one per row\n", kHits, kFiles);
+
+    // Store
+    std::size_t before = g_liveBytes;
+    auto start = std::chrono::steady_clock::now();
+    {
+        ResultHitStore s;
+        int display = 0;
+        for (int f = 0; f < kFiles; ++f) {
+            const std::uint32_t fid = s.internFile(paths[f]);
+            const std::uint32_t pid = s.internPattern(pattern, 6);
+            for (int i = 0; i < kHitsPerFile; ++i) {
+                s.beginRow(fid, i, display, 9, 5);
+                s.addMatch(static_cast<ResultHitStore::Pos>(i) * 80 + 12, 10, pid, 0, -1, 20, 10);
+                display += 90;
+            }
+        }
+        const double elapsed = secondsSince(start);
+        const std::size_t heap = g_liveBytes - before;
+        std::printf("  store   : %6.1f bytes/hit heap, %6.1f reported, %7.1f ms to build\n",
+            static_cast<double>(heap) / kHits, static_cast<double>(s.memoryBytes()) / kHits, elapsed * 1e3);
+        expect("bench_store_rows", s.rowCount() == kHits);
+    }
+
+    // Former layout
+    before = g_liveBytes;
+    start = std::chrono::steady_clock::now();
+    {
+        std::vector<LegacyHit> v;
+        v.reserve(kHits);
+        int display = 0;
+        for (int f = 0; f < kFiles; ++f) {
+            for (int i = 0; i < kHitsPerFile; ++i) {
+                LegacyHit h;
+                h.fullPathUtf8 = paths[f];
+                h.pos = static_cast<std::int64_t>(i) * 80 + 12;
+                h.length = 10;
+                h.docLine = i;
+                h.searchFlags = 6;
+                h.findTextW = pattern;
+                h.allFindTexts.push_back(pattern);
+                h.allPositions.push_back(h.pos);
+                h.allLengths.push_back(h.length);
+                h.allSearchFlags.push_back(h.searchFlags);
+                h.displayLineStart = display;
+                h.numberStart = 9;
+                h.numberLen = 5;
+                h.matchStarts.push_back(20);
+                h.matchLens.push_back(10);
+                h.matchColors.push_back(0);
+                h.colorIndex = 0;
+                v.push_back(std::move(h));
+                display += 90;
+            }
+        }
+        const double elapsed = secondsSince(start);
+        const std::size_t heap = g_liveBytes - before;
+        std::printf("  legacy  : %6.1f bytes/hit heap, %7.1f ms to build\n",
+            static_cast<double>(heap) / kHits, elapsed * 1e3);
+    }
+
+    // The same hits as one search per file stacked on top of each other:
+    // every prepend used to shift all rows already in the dock.
+    {
+        ResultHitStore s;
+        start = std::chrono::steady_clock::now();
+        for (int f = 0; f < kFiles; ++f) {
+            ResultHitStore block;
+            const std::uint32_t fid = block.internFile(paths[f]);
+            const std::uint32_t pid = block.internPattern(pattern, 6);
+            for (int i = 0; i < kHitsPerFile; ++i) {
+                block.beginRow(fid, i, i * 90, 9, 5);
+                block.addMatch(static_cast<ResultHitStore::Pos>(i) * 80 + 12, 10, pid, 0, -1, 20, 10);
+            }
+            s.prependBlock(block, kHitsPerFile * 90);
+        }
+        const double stacked = secondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        std::size_t found = 0;
+        for (std::size_t r = 0; r < kHits; r += 97)
+            found += s.rowAtDisplayStart(static_cast<int>(r) * 90) == r;
+        const double lookups = secondsSince(start);
+        std::printf("  stacked : %d blocks in %7.1f ms, %zu line lookups in %6.2f ms\n",
+            kFiles, stacked * 1e3, found, lookups * 1e3);
+        expect("bench_stacked_lookup", found == (kHits + 96) / 97);
+    }
+
+    // Typing in a file with a million hits: every keystroke shifts the
+    // matches behind the caret. A full scan per edit against the index.
+    {
+        constexpr int kEdits = 10000;
+        constexpr int kScans = 100;
+        ResultHitStore s;
+        const std::uint32_t fid = s.internFile(paths[0]);
+        const std::uint32_t pid = s.internPattern(pattern, 6);
+        for (int i = 0; i < 1000000; ++i) {
+            s.beginRow(fid, i, i * 90, 9, 5);
+            s.addMatch(static_cast<ResultHitStore::Pos>(i) * 80 + 12, 10, pid, 0, -1, 20, 10);
+        }
+
+        start = std::chrono::steady_clock::now();
+        for (int k = 0; k < kScans; ++k) {
+            const ResultHitStore::Pos at = static_cast<ResultHitStore::Pos>(k) * 797;
+            s.adjustPositions(fid, [at](ResultHitStore::Pos p) { return p >= at ? p + 1 : p; });
+        }
+        const double scans = secondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        for (int k = 0; k < kEdits; ++k)
+            s.shiftPositions(fid, static_cast<ResultHitStore::Pos>(k) * 7919 % 80000000, k % 3 ? 1 : -1);
+        const double edits = secondsSince(start);
+        std::printf("  edits   : %8.2f us/edit scanning, %6.2f us/edit indexed (1M hits)\n",
+            scans * 1e6 / kScans, edits * 1e6 / kEdits);
+        expect("bench_edit_order", s.matchPos(0) <= s.matchPos(1) && s.matchPos(999998) <= s.matchPos(999999));
+    }
+}
+
+} // namespace
+
+// Heap accounting for the benchmark: a small header in front of every
+// block records its size.
+void* operator new(std::size_t size)
+{
+    void* p = std::malloc(size + 16);
+    if (!p) throw std::bad_alloc();
+    *static_cast<std::size_t*>(p) = size;
+    g_liveBytes += size;
+    return static_cast<char*>(p) + 16;
+}
+
+void operator delete(void* p) noexcept
+{
+    if (!p) return;
+    char* base = static_cast<char*>(p) - 16;
+    g_liveBytes -= *reinterpret_cast<std::size_t*>(base);
+    std::free(base);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    operator delete(p);
+}
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-v") == 0) verbose = true;
+        if (std::strcmp(argv[i], "-b") == 0) bench = true;
+    }
+
+    runTests();
+    if (bench) {
+        runBench();
+    }
+
+    std::printf("\n%d passed, %d failed\n", passed, failed);
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,320 @@
+// Headless tests for the result dock's disk spill: the spill file, paged
+// columns, and a ResultHitStore that searches a synthetic corpus under a
+// small memory ceiling and is then navigated and edited like the dock
+// does, checked against an identical store kept in memory.
+//
+// MinGW / g++:
+//   g++ -std=c++17 -O2 -Wall -Wextra -I.. result_spill_qa.cpp
+//       ../ResultHitStore.cpp ../ResultSpill.cpp -o result_spill_qa
+//   ./result_spill_qa
+//
+// Pass -v for a verbose pass-by-pass listing, -b to additionally time a
+// ten million hit search under a 64 MB ceiling.
+
+#include "../ResultHitStore.h"
+#include "../ResultSpill.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+int passed = 0;
+int failed = 0;
+bool verbose = false;  // toggled via -v command line flag
+bool bench = false;    // toggled via -b command line flag
+
+void expect(const char* name, bool ok, const std::string& detail = {})
+{
+    if (ok) {
+        ++passed;
+        if (verbose) std::printf("[PASS] %s\n", name);
+        return;
+    }
+    ++failed;
+    std::printf("[FAIL] %s%s%s\n", name, detail.empty() ? "" : "\n  ", detail.c_str());
+}
+
+// Synthetic file: every line carries a number; "needle" sits on every
+// third line, twice on every ninth.
+std::string makeCorpusFile(int fileNo, int lines)
+{
+    std::string text;
+    for (int l = 0; l < lines; ++l) {
+        text += "file " + std::to_string(fileNo) + " line " + std::to_string(l);
+        if (l % 3 == 0) text += " needle";
+        if (l % 9 == 0) text += " and another needle";
+        text += " tail\r\n";
+    }
+    return text;
+}
+
+// Search one file the way the dock formats it: one row per hit line
+// ("    Line N: <text>"), one match per hit, positions in the shown text.
+ResultHitStore searchFile(const std::string& path, const std::string& text, int& blockLen)
+{
+    static const std::string needle = "needle";
+    static const std::wstring needleW = L"needle";
+    ResultHitStore s;
+    const std::uint32_t f = s.internFile(path);
+    const std::uint32_t p = s.internPattern(needleW, 0);
+
+    int display = static_cast<int>(path.size()) + 2;   // file header line
+    int line = 0;
+    for (std::size_t pos = 0; pos < text.size(); ++line) {
+        std::size_t eol = text.find('\n', pos);
+        if (eol == std::string::npos) eol = text.size();
+        const std::string_view body(text.data() + pos, eol - pos);
+        const std::string prefix = "    Line " + std::to_string(line + 1) + ": ";
+
+        bool row = false;
+        for (std::size_t h = body.find(needle); h != std::string_view::npos; h = body.find(needle, h + 1)) {
+            if (!row) {
+                s.beginRow(f, line, display, 9, static_cast<int>(std::to_string(line + 1).size()));
+                row = true;
+            }
+            s.addMatch(static_cast<ResultHitStore::Pos>(pos + h), 6, p, 0, line % 50,
+                static_cast<int>(prefix.size() + h), 6);
+        }
+        if (row) display += static_cast<int>(prefix.size() + body.size()) + 1;
+        pos = eol + 1;
+    }
+    blockLen = display;
+    return s;
+}
+
+std::string compareStores(const ResultHitStore& a, const ResultHitStore& b)
+{
+    if (a.rowCount() != b.rowCount() || a.matchCount() != b.matchCount())
+        return "counts differ";
+    for (std::size_t r = 0; r < a.rowCount(); ++r) {
+        if (a.rowDisplayStart(r) != b.rowDisplayStart(r) || a.rowDocLine(r) != b.rowDocLine(r)
+            || a.rowFilePath(r) != b.rowFilePath(r) || a.rowPending(r) != b.rowPending(r)
+            || a.matchBegin(r) != b.matchBegin(r) || a.matchEnd(r) != b.matchEnd(r))
+            return "row " + std::to_string(r) + " differs";
+        for (std::size_t m = a.matchBegin(r); m < a.matchEnd(r); ++m)
+            if (a.matchPos(m) != b.matchPos(m) || a.matchLength(m) != b.matchLength(m)
+                || a.matchDisplayStart(m) != b.matchDisplayStart(m) || a.matchListIndex(m) != b.matchListIndex(m))
+                return "match " + std::to_string(m) + " differs";
+    }
+    return {};
+}
+
+void runTests()
+{
+    // Spill file: records round-trip, released slots are reused
+    {
+        ResultSpillFile f;
+        const std::string a(1000, 'a');
+        const std::string b(3000, 'b');
+        const std::uint64_t oa = f.write(a.data(), a.size());
+        const std::uint64_t ob = f.write(b.data(), b.size());
+        std::string back(3000, ' ');
+        expect("file_write", oa != ResultSpillFile::kNoOffset && ob != ResultSpillFile::kNoOffset);
+        expect("file_read", f.read(ob, back.data(), 3000) && back == b);
+        expect("file_in_use", f.bytesInUse() == 4000);
+
+        f.release(oa, a.size());
+        const std::string c(1000, 'c');
+        const std::uint64_t oc = f.write(c.data(), c.size());
+        back.resize(1000);
+        expect("file_slot_reused", oc == oa && f.read(oc, back.data(), 1000) && back == c);
+        f.close();
+        expect("file_closed", f.bytesInUse() == 0 && !f.read(oc, back.data(), 1000));
+    }
+
+    // Paged column: a two-page budget over forty pages keeps values and
+    // writes back what changed while evicted
+    {
+        SpillPager pager;
+        pager.pagesPerColumn = 2;
+        PagedColumn<std::int64_t> col;
+        col.attach(&pager);
+        const std::size_t n = 40 * PagedColumn<std::int64_t>::kPageSize + 123;
+        for (std::size_t i = 0; i < n; ++i) col.push_back(static_cast<std::int64_t>(i) * 3);
+        expect("column_spilled", pager.file.bytesInUse() > 0
+            && col.residentBytes() < 4 * PagedColumn<std::int64_t>::kPageSize * sizeof(std::int64_t));
+
+        bool ok = true;
+        std::mt19937 rng(7);
+        for (int k = 0; k < 5000; ++k) {
+            const std::size_t i = rng() % n;
+            if (col[i] != static_cast<std::int64_t>(i) * 3) ok = false;
+        }
+        expect("column_random_reads", ok);
+
+        for (std::size_t i = 0; i < n; i += 1000) col.set(i, -1);
+        ok = true;
+        for (std::size_t i = 0; i < n; ++i)
+            if (col[i] != ((i % 1000) ? static_cast<std::int64_t>(i) * 3 : -1)) ok = false;
+        expect("column_writes_survive_eviction", ok);
+
+        col.resize(5);
+        col.attach(nullptr);
+        expect("column_detach", col.size() == 5 && col[4] == 12 && pager.file.bytesInUse() == 0);
+    }
+
+    // Short read: the spill file is replaced by a shorter one under an
+    // evicted page, which then reads as zeros, stays evicted and is
+    // retried (and counted) on every access
+    {
+        SpillPager pager;
+        pager.pagesPerColumn = 2;
+        PagedColumn<std::int64_t> col;
+        col.attach(&pager);
+        const std::size_t n = 6 * PagedColumn<std::int64_t>::kPageSize;
+        for (std::size_t i = 0; i < n; ++i) col.push_back(static_cast<std::int64_t>(i) + 1);
+        const std::size_t resident = col.residentBytes();
+
+        pager.file.close();
+        const std::string stub(100, 's');
+        pager.file.write(stub.data(), stub.size());
+
+        expect("short_read_zeros", col[5] == 0 && pager.readFailures == 1);
+        col.set(5, 42);
+        expect("short_read_stays_evicted", col[5] == 0 && pager.readFailures == 3
+            && col.residentBytes() == resident);
+        expect("short_read_resident_pages_intact", col[n - 1] == static_cast<std::int64_t>(n));
+
+        col.attach(nullptr);
+        expect("short_read_detach", col.size() == n && col[5] == 0 && col[n - 1] == static_cast<std::int64_t>(n)
+            && pager.readFailures >= 4);
+    }
+
+    // Search a synthetic corpus into a dock store under a small ceiling
+    {
+        constexpr int kFiles = 12;
+        constexpr int kLines = 60000;
+        constexpr std::size_t kLimit = 4u << 20;
+
+        ResultHitStore dock;
+        ResultHitStore reference;
+        dock.setMemoryLimit(kLimit);
+
+        std::vector<std::string> corpus;
+        for (int f = 0; f < kFiles; ++f) {
+            corpus.push_back(makeCorpusFile(f, kLines));
+            const std::string path = "C:\\corpus\\file" + std::to_string(f) + ".txt";
+            int blockLen = 0;
+            const ResultHitStore found = searchFile(path, corpus.back(), blockLen);
+            dock.prependBlock(found, blockLen);
+            reference.prependBlock(found, blockLen);
+        }
+
+        expect("corpus_hits", dock.matchCount() == static_cast<std::size_t>(kFiles) * ((kLines + 2) / 3 + (kLines + 8) / 9));
+        expect("corpus_spilled", dock.spilledBytes() > 0);
+        expect("corpus_under_ceiling", dock.memoryBytes() < kLimit + kLimit / 4,
+            std::to_string(dock.memoryBytes()) + " bytes resident");
+        expect("corpus_same_as_memory", compareStores(dock, reference).empty(), compareStores(dock, reference));
+
+        // Navigation: jump to random rows by their line start, then step
+        // through one block in order like gotoAdjacentHit
+        bool ok = true;
+        std::mt19937 rng(11);
+        for (int k = 0; k < 20000 && ok; ++k) {
+            const std::size_t r = rng() % dock.rowCount();
+            const int start = dock.rowDisplayStart(r);
+            if (dock.rowAtDisplayStart(start) != r || dock.lowerBoundDisplay(start + 1) != r + 1) ok = false;
+
+            // The hit points at a needle of its file
+            const std::size_t m = dock.matchBegin(r);
+            const std::string& path = dock.rowFilePath(r);
+            const int fileNo = std::stoi(path.substr(path.find("file") + 4));
+            if (corpus[fileNo].compare(static_cast<std::size_t>(dock.matchPos(m)), 6, "needle") != 0) ok = false;
+        }
+        expect("navigate_random", ok);
+
+        const std::size_t first = dock.lowerBoundDisplay(dock.rowDisplayStart(dock.rowCount() / 2));
+        ok = true;
+        for (std::size_t r = first + 1; r < dock.rowCount() && ok; ++r)
+            if (dock.rowDisplayStart(r) <= dock.rowDisplayStart(r - 1)) ok = false;
+        expect("navigate_in_order", ok);
+
+        // Edits the dock performs: a chunk rendered inside a block, a
+        // deleted range, FlowTab position changes in one file
+        const int mid = dock.rowDisplayStart(dock.rowCount() / 3);
+        dock.shiftDisplay(777, mid + 1);
+        reference.shiftDisplay(777, mid + 1);
+        const int e0 = dock.rowDisplayStart(dock.rowCount() / 2);
+        const int e1 = dock.rowDisplayStart(dock.rowCount() / 2 + 5000);
+        dock.eraseDisplayRange(e0, e1);
+        reference.eraseDisplayRange(e0, e1);
+        const std::uint32_t f3 = dock.internFile("C:\\corpus\\file3.txt");
+        const std::uint32_t r3 = reference.internFile("C:\\corpus\\file3.txt");
+        dock.adjustPositions(f3, [](ResultHitStore::Pos p) { return p + 2; });
+        reference.adjustPositions(r3, [](ResultHitStore::Pos p) { return p + 2; });
+        expect("edits_same_as_memory", compareStores(dock, reference).empty(), compareStores(dock, reference));
+        expect("edits_under_ceiling", dock.memoryBytes() < kLimit + kLimit / 4);
+
+        dock.clear();
+        expect("clear_keeps_limit", dock.empty() && dock.spilledBytes() == 0 && dock.memoryLimit() == kLimit);
+    }
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void runBench()
+{
+    constexpr std::size_t kHits = 10000000;
+    constexpr std::size_t kLimit = 64u << 20;
+
+    ResultHitStore s;
+    s.setMemoryLimit(kLimit);
+    const std::uint32_t f = s.internFile("C:\\big.log");
+    const std::uint32_t p = s.internPattern(L"needle", 0);
+
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < kHits; ++i) {
+        s.beginRow(f, static_cast<int>(i), static_cast<int>(i) * 100, 9, 8);
+        s.addMatch(static_cast<ResultHitStore::Pos>(i) * 120 + 7, 6, p, 0, -1, 20, 6);
+    }
+    const double build = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    std::mt19937 rng(3);
+    std::size_t found = 0;
+    for (int k = 0; k < 20000; ++k) {
+        const std::size_t r = rng() % kHits;
+        found += s.rowAtDisplayStart(static_cast<int>(r) * 100) == r;
+    }
+    const double lookups = secondsSince(start);
+
+    std::printf("\n%zu hits under a %zu MB ceiling\n", kHits, kLimit >> 20);
+    std::printf("  build   : %7.1f ms, %6.1f MB resident, %6.1f MB spilled\n",
+        build * 1e3, s.memoryBytes() / 1048576.0, s.spilledBytes() / 1048576.0);
+    std::printf("  lookups : %zu random rows in %7.1f ms\n", found, lookups * 1e3);
+    expect("bench_lookups", found == 20000);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-v") == 0) verbose = true;
+        if (std::strcmp(argv[i], "-b") == 0) bench = true;
+    }
+
+    // Keep scratch files apart from a running Notepad++
+    std::error_code ec;
+    const std::filesystem::path dir = std::filesystem::temp_directory_path(ec) / "MultiReplace-qa" / "spill";
+    ResultSpillFile::setDirectory(dir);
+
+    runTests();
+    if (bench) {
+        runBench();
+    }
+
+    std::filesystem::remove_all(dir.parent_path(), ec);
+
+    std::printf("\n%d passed, %d failed\n", passed, failed);
+    return failed == 0 ? 0 : 1;
+}
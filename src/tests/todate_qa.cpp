@@ -1,22 +1,31 @@
 // Standalone tests for DateParse.
 // Compile:
-//   g++ -std=c++20 -Wall -Wextra todate_qa.cpp ../fs/DateParse.cpp -o todate_qa
-//   ./todate_qa [-v]
+//   g++ -std=c++20 -O2 -Wall -Wextra todate_qa.cpp ../exprtk/DateParse.cpp -o todate_qa
+//   ./todate_qa [-v] [-b]
+//
+// -b additionally runs a throughput benchmark comparing per-call format
+// interpretation (parseDateTime) against a precompiled DateFormat and
+// the DateFormatCache lookup that todate() uses.
 
 #include "../exprtk/DateParse.h"
 
 #include <cstdio>
+#include <chrono>
+#include <cmath>
 #include <cstring>
 #include <ctime>
 #include <iostream>
+#include <limits>
 #include <string>
 #include <string_view>
+#include <vector>
 
 namespace {
 
 int passed = 0;
 int failed = 0;
 bool verbose = false;
+bool bench = false;
 
 void checkFields(std::string_view input, std::string_view fmt,
                  int year, int mon0based, int mday,
@@ -30,6 +39,18 @@ void checkFields(std::string_view input, std::string_view fmt,
         ++failed;
         return;
     }
+
+    // The compiled form must agree field-for-field with the wrapper,
+    // whichever of its two apply paths the input ends up on.
+    std::tm tmCompiled{};
+    const MultiReplace::DateFormat compiled(fmt);
+    if (!compiled.parse(input, tmCompiled)
+        || std::memcmp(&tm, &tmCompiled, sizeof(std::tm)) != 0)
+    {
+        std::printf("FAIL [%s] compiled DateFormat disagrees with parseDateTime\n", label);
+        ++failed;
+        return;
+    }
     if (tm.tm_year + 1900 != year || tm.tm_mon != mon0based
         || tm.tm_mday != mday || tm.tm_hour != hour
         || tm.tm_min != min || tm.tm_sec != sec)
@@ -55,7 +76,9 @@ void checkFail(std::string_view input, std::string_view fmt, const char* label)
 {
     std::tm tm{};
     const bool ok = MultiReplace::parseDateTime(input, fmt, tm);
-    if (ok) {
+    std::tm tmCompiled{};
+    const bool okCompiled = MultiReplace::DateFormat(fmt).parse(input, tmCompiled);
+    if (ok || okCompiled) {
         std::printf("FAIL [%s] expected parse failure for \"%.*s\" but it succeeded\n",
                     label, (int)input.size(), input.data());
         ++failed;
@@ -69,6 +92,107 @@ void checkFail(std::string_view input, std::string_view fmt, const char* label)
     ++passed;
 }
 
+void checkFixedWidth(std::string_view fmt, bool expected, const char* label)
+{
+    const MultiReplace::DateFormat compiled(fmt);
+    if (compiled.isFixedWidth() != expected) {
+        std::printf("FAIL [%s] isFixedWidth() = %d, expected %d\n",
+                    label, compiled.isFixedWidth() ? 1 : 0, expected ? 1 : 0);
+        ++failed;
+        return;
+    }
+    if (verbose) {
+        std::printf("PASS  fmt=\"%-18.*s\" fixed-width=%d  (%s)\n",
+                    (int)fmt.size(), fmt.data(), expected ? 1 : 0, label);
+    }
+    ++passed;
+}
+
+// UTC timestamps are timezone-independent, so they can be compared
+// exactly. NaN expectations are checked with std::isnan.
+void checkTimestamp(MultiReplace::DateFormatCache& cache,
+                    std::string_view input, std::string_view fmt,
+                    double expected, const char* label)
+{
+    const double got = MultiReplace::parseTimestamp(input, fmt, cache);
+    const bool ok = std::isnan(expected) ? std::isnan(got) : got == expected;
+    if (!ok) {
+        std::printf("FAIL [%s] expected %.0f got %.0f\n", label, expected, got);
+        ++failed;
+        return;
+    }
+    if (verbose) {
+        std::printf("PASS  \"%-26.*s\" fmt=\"%-22.*s\" -> %.0f  (%s)\n",
+                    (int)input.size(), input.data(),
+                    (int)fmt.size(), fmt.data(), got, label);
+    }
+    ++passed;
+}
+
+// ---------------------------------------------------------------------
+// Throughput benchmark
+// ---------------------------------------------------------------------
+
+template <typename Fn>
+double timeLoop(std::size_t iterations, Fn&& fn)
+{
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < iterations; ++i) {
+        fn(i);
+    }
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+void runBenchmark()
+{
+    constexpr std::size_t kIterations = 2'000'000;
+
+    // A rotating set of log-style inputs so the loop can't be folded
+    // into a constant. All share one format, the common real-world case.
+    const std::vector<std::string> inputs = {
+        "2023-11-14 22:13:20", "2024-02-29 00:00:00",
+        "1999-12-31 23:59:59", "2010-06-15 12:30:45",
+    };
+    const std::vector<std::string> looseInputs = {
+        "2023-11-14  22:13:20", "2024-2-29 0:0:0",
+        "1999-12-31\t23:59:59", "2010-6-15 12:30:45",
+    };
+    const std::string_view fmt = "%Y-%m-%d %H:%M:%S";
+    const std::string_view utcFmt = "utc:%Y-%m-%d %H:%M:%S";
+
+    long long sink = 0;
+    auto report = [&](const char* name, double secs) {
+        std::printf("  %-34s %8.1f ms  %7.1f Mparse/s\n", name, secs * 1000.0,
+                    (double)kIterations / secs / 1e6);
+    };
+
+    std::printf("\n---- Benchmark (%zu parses each) ----\n", kIterations);
+
+    report("parseDateTime (per-call format)", timeLoop(kIterations, [&](std::size_t i) {
+        std::tm tm{};
+        if (MultiReplace::parseDateTime(inputs[i & 3], fmt, tm)) sink += tm.tm_sec;
+    }));
+
+    const MultiReplace::DateFormat compiled(fmt);
+    report("DateFormat::parse (fixed path)", timeLoop(kIterations, [&](std::size_t i) {
+        std::tm tm{};
+        if (compiled.parse(inputs[i & 3], tm)) sink += tm.tm_sec;
+    }));
+
+    report("DateFormat::parse (generic path)", timeLoop(kIterations, [&](std::size_t i) {
+        std::tm tm{};
+        if (compiled.parse(looseInputs[i & 3], tm)) sink += tm.tm_sec;
+    }));
+
+    MultiReplace::DateFormatCache cache;
+    report("parseTimestamp utc: (cached)", timeLoop(kIterations, [&](std::size_t i) {
+        sink += (long long)MultiReplace::parseTimestamp(inputs[i & 3], utcFmt, cache);
+    }));
+
+    std::printf("  (checksum %lld)\n", sink);
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
@@ -78,6 +202,11 @@ int main(int argc, char** argv) {
         {
             verbose = true;
         }
+        else if (std::strcmp(argv[i], "-b") == 0
+            || std::strcmp(argv[i], "--bench") == 0)
+        {
+            bench = true;
+        }
     }
 
     // ---- ISO date ----
@@ -152,6 +281,62 @@ int main(int argc, char** argv) {
     checkFail("2023%", "%Y%",               "trailing percent in format");
     checkFail("2023", "%Q",                 "unknown specifier");
 
+    // ---- Short fields fall back to the generic path ----
+    checkFields("2023-1-5", "%Y-%m-%d",         2023, 0, 5, 0, 0, 0, "single-digit month/day");
+    checkFields("2023-11-14 2:3:4", "%Y-%m-%d %H:%M:%S",
+                2023, 10, 14, 2, 3, 4, "single-digit time fields");
+    checkFields("5.1.2023", "%d.%m.%Y",         2023, 0, 5, 0, 0, 0, "short DE date");
+
+    // ---- Compiled layout ----
+    checkFixedWidth("%Y-%m-%d %H:%M:%S", true,  "ISO datetime is fixed-width");
+    checkFixedWidth("%F %T", true,              "shortcuts are fixed-width");
+    checkFixedWidth("%d.%m.%Y", true,           "DE date is fixed-width");
+    checkFixedWidth("%I:%M:%S %p", true,        "AM/PM is fixed-width");
+    checkFixedWidth("%Y%%%m", true,             "escaped percent is fixed-width");
+    checkFixedWidth("%Y%", false,               "invalid format");
+
+    // ---- parseTimestamp (UTC, timezone-independent) ----
+    {
+        const double nan = std::numeric_limits<double>::quiet_NaN();
+        MultiReplace::DateFormatCache cache;
+        checkTimestamp(cache, "2023-11-14 22:13:20", "utc:%Y-%m-%d %H:%M:%S",
+                       1700000000.0, "utc datetime");
+        checkTimestamp(cache, "1970-01-01", "utc:%Y-%m-%d", 0.0, "utc epoch");
+        checkTimestamp(cache, "2024-02-29", "utc:%F", 1709164800.0, "utc leap day");
+        checkTimestamp(cache, "2000-03-01 00:00:00", "utc:%F %T",
+                       951868800.0, "utc century leap year");
+        checkTimestamp(cache, "11/14/2023 10:13:20 PM", "utc:%m/%d/%Y %I:%M:%S %p",
+                       1700000000.0, "utc 12-hour clock");
+        checkTimestamp(cache, "2023-11-14 22:13:20", "utc:%Y-%m-%d %H:%M:%S",
+                       1700000000.0, "cache hit returns same value");
+        checkTimestamp(cache, "1969-12-31", "utc:%Y-%m-%d", nan, "utc pre-epoch -> NaN");
+        checkTimestamp(cache, "2023-13-01", "utc:%Y-%m-%d", nan, "utc bad month -> NaN");
+        checkTimestamp(cache, "2023", "utc:%Q", nan, "utc bad format -> NaN");
+
+        // More distinct formats than the cache holds: entries are
+        // flushed, results must stay correct.
+        int overflowBad = 0;
+        for (int i = 0; i < 40; ++i) {
+            const std::string fmt = "utc:%Y-%m-%d" + std::string(i, 'x');
+            const std::string in = "1970-01-02" + std::string(i, 'x');
+            if (MultiReplace::parseTimestamp(in, fmt, cache) != 86400.0) {
+                ++overflowBad;
+            }
+        }
+        if (overflowBad != 0) {
+            std::printf("FAIL [cache overflow] %d of 40 formats gave a wrong result\n",
+                        overflowBad);
+            ++failed;
+        }
+        else {
+            ++passed;
+        }
+    }
+
+    if (bench) {
+        runBenchmark();
+    }
+
     // ---- Result ----
     std::printf("\n========================================\n");
     std::printf("PASSED: %d\n", passed);